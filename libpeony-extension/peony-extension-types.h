@@ -77,6 +77,17 @@ GType peony_operation_result_get_type (void);
  * @include: libpeony-extension/peony-extension-types.h
  *
  * Methods that each extension implements.
+ *
+ * The first time Peony sees a library, and again whenever the library
+ * file changes, it is opened at startup and the types returned by
+ * peony_module_list_types() are recorded together with the classes
+ * they derive from and the interfaces they implement. After that the
+ * library is only opened, and peony_module_initialize() and
+ * peony_module_list_types() only called, once Peony first asks for
+ * one of those interfaces or classes, for example the first time a
+ * context menu asks for #PeonyMenuProvider. Extensions should not
+ * rely on being initialized at startup. Libraries providing Python
+ * extensions are always opened at startup.
  */
 
 void peony_module_initialize  (GTypeModule  *module);
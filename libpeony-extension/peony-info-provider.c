@@ -37,6 +37,11 @@
  * files. When peony_info_provider_update_file_info() is called by the application,
  * extensions will know that it's time to add extra information to the provided
  * #PeonyFileInfo.
+ *
+ * Providers that implement update_file_info_batch() are handed many files
+ * at once and may report them done in chunks. Providers that return
+ * %PEONY_INFO_PROVIDER_THREAD_SAFE from get_flags() are called from a
+ * worker thread instead of the main loop.
  */
 
 static void
@@ -101,6 +106,74 @@ peony_info_provider_cancel_update (PeonyInfoProvider    *provider,
             handle);
 }
 
+/**
+ * peony_info_provider_can_update_batch:
+ * @provider: a #PeonyInfoProvider
+ *
+ * Returns: %TRUE if @provider implements update_file_info_batch().
+ */
+gboolean
+peony_info_provider_can_update_batch (PeonyInfoProvider *provider)
+{
+    g_return_val_if_fail (PEONY_IS_INFO_PROVIDER (provider), FALSE);
+
+    return PEONY_INFO_PROVIDER_GET_IFACE (provider)->update_file_info_batch != NULL;
+}
+
+/**
+ * peony_info_provider_update_file_info_batch:
+ * @provider: a #PeonyInfoProvider
+ * @files: (element-type PeonyFileInfo): the files to update
+ * @update_complete: closure to invoke with
+ *   peony_info_provider_batch_complete_invoke() as files are done
+ * @handle: (out): location for an operation handle, usable with
+ *   peony_info_provider_cancel_update()
+ *
+ * Batched variant of peony_info_provider_update_file_info(). When it
+ * returns %PEONY_OPERATION_IN_PROGRESS, @update_complete is invoked one
+ * or more times with the files finished so far, until every file of
+ * @files has been reported.
+ *
+ * Returns: %PEONY_OPERATION_COMPLETE if all files were updated right
+ * away, otherwise a #PeonyOperationResult.
+ */
+PeonyOperationResult
+peony_info_provider_update_file_info_batch (PeonyInfoProvider     *provider,
+                                           GList                *files,
+                                           GClosure             *update_complete,
+                                           PeonyOperationHandle **handle)
+{
+    g_return_val_if_fail (PEONY_IS_INFO_PROVIDER (provider),
+                          PEONY_OPERATION_FAILED);
+    g_return_val_if_fail (PEONY_INFO_PROVIDER_GET_IFACE (provider)->update_file_info_batch != NULL,
+                          PEONY_OPERATION_FAILED);
+    g_return_val_if_fail (update_complete != NULL,
+                          PEONY_OPERATION_FAILED);
+    g_return_val_if_fail (handle != NULL, PEONY_OPERATION_FAILED);
+
+    return PEONY_INFO_PROVIDER_GET_IFACE (provider)->update_file_info_batch
+           (provider, files, update_complete, handle);
+}
+
+/**
+ * peony_info_provider_get_flags:
+ * @provider: a #PeonyInfoProvider
+ *
+ * Returns: the #PeonyInfoProviderFlags of @provider.
+ */
+PeonyInfoProviderFlags
+peony_info_provider_get_flags (PeonyInfoProvider *provider)
+{
+    g_return_val_if_fail (PEONY_IS_INFO_PROVIDER (provider),
+                          PEONY_INFO_PROVIDER_FLAGS_NONE);
+
+    if (PEONY_INFO_PROVIDER_GET_IFACE (provider)->get_flags == NULL) {
+        return PEONY_INFO_PROVIDER_FLAGS_NONE;
+    }
+
+    return PEONY_INFO_PROVIDER_GET_IFACE (provider)->get_flags (provider);
+}
+
 void
 peony_info_provider_update_complete_invoke (GClosure            *update_complete,
                                            PeonyInfoProvider    *provider,
@@ -128,3 +201,44 @@ peony_info_provider_update_complete_invoke (GClosure            *update_complete
     g_value_unset (&args[2]);
 }
 
+/**
+ * peony_info_provider_batch_complete_invoke:
+ * @update_complete: the closure passed to
+ *   peony_info_provider_update_file_info_batch()
+ * @provider: a #PeonyInfoProvider
+ * @handle: the handle of the batch
+ * @files: (element-type PeonyFileInfo): the files finished since the last call
+ * @result: the #PeonyOperationResult for @files
+ *
+ * Reports files of a batch as done. May be called from any thread.
+ */
+void
+peony_info_provider_batch_complete_invoke (GClosure            *update_complete,
+                                          PeonyInfoProvider    *provider,
+                                          PeonyOperationHandle *handle,
+                                          GList               *files,
+                                          PeonyOperationResult  result)
+{
+    GValue args[4] = { { 0, } };
+    GValue return_val = { 0, };
+
+    g_return_if_fail (update_complete != NULL);
+    g_return_if_fail (PEONY_IS_INFO_PROVIDER (provider));
+
+    g_value_init (&args[0], PEONY_TYPE_INFO_PROVIDER);
+    g_value_init (&args[1], G_TYPE_POINTER);
+    g_value_init (&args[2], G_TYPE_POINTER);
+    g_value_init (&args[3], PEONY_TYPE_OPERATION_RESULT);
+
+    g_value_set_object (&args[0], provider);
+    g_value_set_pointer (&args[1], handle);
+    g_value_set_pointer (&args[2], files);
+    g_value_set_enum (&args[3], result);
+
+    g_closure_invoke (update_complete, &return_val, 4, args, NULL);
+
+    g_value_unset (&args[0]);
+    g_value_unset (&args[1]);
+    g_value_unset (&args[2]);
+    g_value_unset (&args[3]);
+}
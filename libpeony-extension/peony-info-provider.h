@@ -49,6 +49,22 @@ typedef void (*PeonyInfoProviderUpdateComplete) (PeonyInfoProvider    *provider,
                                                 PeonyOperationResult  result,
                                                 gpointer             user_data);
 
+/**
+ * PeonyInfoProviderFlags:
+ * @PEONY_INFO_PROVIDER_FLAGS_NONE: No flags.
+ * @PEONY_INFO_PROVIDER_THREAD_SAFE: update_file_info() may be called on a
+ *   worker thread. It should finish synchronously there. The
+ *   #PeonyFileInfo it gets is a copy taken on the main thread: string
+ *   attributes and the parent info read as %NULL, and emblems and
+ *   attributes added to it reach the file once the call is done.
+ *
+ * Flags describing how a #PeonyInfoProvider can be called.
+ */
+typedef enum {
+    PEONY_INFO_PROVIDER_FLAGS_NONE = 0,
+    PEONY_INFO_PROVIDER_THREAD_SAFE = 1 << 0
+} PeonyInfoProviderFlags;
+
 /**
  * PeonyInfoProviderIface:
  * @g_iface: The parent interface.
@@ -56,6 +72,9 @@ typedef void (*PeonyInfoProviderUpdateComplete) (PeonyInfoProvider    *provider,
  *   See peony_info_provider_update_file_info() for details.
  * @cancel_update: Cancels a previous call to peony_info_provider_update_file_info().
  *   See peony_info_provider_cancel_update() for details.
+ * @update_file_info_batch: Optional. Returns a #PeonyOperationResult.
+ *   See peony_info_provider_update_file_info_batch() for details.
+ * @get_flags: Optional. Returns the #PeonyInfoProviderFlags of the provider.
  *
  * Interface for extensions to provide additional information about files.
  */
@@ -69,6 +88,12 @@ struct _PeonyInfoProviderIface {
                                              PeonyOperationHandle **handle);
     void                (*cancel_update)    (PeonyInfoProvider     *provider,
                                              PeonyOperationHandle  *handle);
+
+    PeonyOperationResult (*update_file_info_batch) (PeonyInfoProvider     *provider,
+                                                   GList                *files,
+                                                   GClosure             *update_complete,
+                                                   PeonyOperationHandle **handle);
+    PeonyInfoProviderFlags (*get_flags)           (PeonyInfoProvider     *provider);
 };
 
 /* Interface Functions */
@@ -79,6 +104,12 @@ PeonyOperationResult peony_info_provider_update_file_info       (PeonyInfoProvid
                                                                PeonyOperationHandle **handle);
 void                peony_info_provider_cancel_update          (PeonyInfoProvider     *provider,
                                                                PeonyOperationHandle  *handle);
+gboolean            peony_info_provider_can_update_batch       (PeonyInfoProvider     *provider);
+PeonyOperationResult peony_info_provider_update_file_info_batch (PeonyInfoProvider     *provider,
+                                                               GList                *files,
+                                                               GClosure             *update_complete,
+                                                               PeonyOperationHandle **handle);
+PeonyInfoProviderFlags peony_info_provider_get_flags           (PeonyInfoProvider     *provider);
 
 
 
@@ -87,6 +118,11 @@ void                peony_info_provider_update_complete_invoke (GClosure
                                                                PeonyInfoProvider     *provider,
                                                                PeonyOperationHandle  *handle,
                                                                PeonyOperationResult   result);
+void                peony_info_provider_batch_complete_invoke  (GClosure             *update_complete,
+                                                               PeonyInfoProvider     *provider,
+                                                               PeonyOperationHandle  *handle,
+                                                               GList                *files,
+                                                               PeonyOperationResult   result);
 
 G_END_DECLS
 
@@ -106,11 +106,23 @@ peony_clipboard_info_new (GList *files,
                          gboolean cut)
 {
     PeonyClipboardInfo *info;
+    GList *l;
 
     info = g_slice_new0 (PeonyClipboardInfo);
     info->files = peony_file_list_copy (files);
     info->cut = cut;
 
+    /* Views look up every file they show here, so a list won't do.
+     * Icon containers keep a reference to the set after the info is
+     * gone, so it holds its own references to the files.
+     */
+    info->file_set = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                            (GDestroyNotify) peony_file_unref, NULL);
+    for (l = info->files; l != NULL; l = l->next)
+    {
+        g_hash_table_add (info->file_set, peony_file_ref (l->data));
+    }
+
     return info;
 }
 
@@ -133,11 +145,19 @@ peony_clipboard_info_copy (PeonyClipboardInfo *info)
 static void
 peony_clipboard_info_free (PeonyClipboardInfo *info)
 {
+    g_hash_table_unref (info->file_set);
     peony_file_list_free (info->files);
 
     g_slice_free (PeonyClipboardInfo, info);
 }
 
+gboolean
+peony_clipboard_info_has_file (PeonyClipboardInfo *info,
+                               gpointer file)
+{
+    return info != NULL && g_hash_table_contains (info->file_set, file);
+}
+
 static void
 peony_clipboard_monitor_init (PeonyClipboardMonitor *monitor)
 {
@@ -232,7 +252,6 @@ convert_file_list_to_string (PeonyClipboardInfo *info,
     GString *uris;
     char *uri, *tmp;
     GFile *f;
-    guint i;
     GList *l;
 
     if (format_for_text)
@@ -244,7 +263,7 @@ convert_file_list_to_string (PeonyClipboardInfo *info,
         uris = g_string_new (info->cut ? "cut" : "copy");
     }
 
-    for (i = 0, l = info->files; l != NULL; l = l->next, i++)
+    for (l = info->files; l != NULL; l = l->next)
     {
         uri = peony_file_get_uri (l->data);
 
@@ -265,7 +284,7 @@ convert_file_list_to_string (PeonyClipboardInfo *info,
             }
 
             /* skip newline for last element */
-            if (i + 1 < g_list_length (info->files))
+            if (l->next != NULL)
             {
                 g_string_append_c (uris, '\n');
             }
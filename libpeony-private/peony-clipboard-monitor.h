@@ -62,6 +62,7 @@ struct PeonyClipboardInfo
 {
     GList *files;
     gboolean cut;
+    GHashTable *file_set; /* the same files, for lookups, holding refs */
 };
 
 GType   peony_clipboard_monitor_get_type (void);
@@ -70,6 +71,8 @@ PeonyClipboardMonitor *   peony_clipboard_monitor_get (void);
 void peony_clipboard_monitor_set_clipboard_info (PeonyClipboardMonitor *monitor,
         PeonyClipboardInfo *info);
 PeonyClipboardInfo * peony_clipboard_monitor_get_clipboard_info (PeonyClipboardMonitor *monitor);
+gboolean peony_clipboard_info_has_file (PeonyClipboardInfo *info,
+                                        gpointer file);
 void peony_clipboard_monitor_emit_changed (void);
 
 void peony_clear_clipboard_callback (GtkClipboard *clipboard,
@@ -29,6 +29,8 @@
 
 #include <config.h>
 #include "peony-clipboard.h"
+#include "peony-clipboard-monitor.h"
+#include "peony-file.h"
 #include "peony-file-utilities.h"
 
 #include <glib/gi18n.h>
@@ -646,38 +648,100 @@ peony_clipboard_get (GtkWidget *widget)
                                           GDK_SELECTION_CLIPBOARD);
 }
 
+static GHashTable *
+build_uri_set (const GList *uris)
+{
+    GHashTable *set;
+    const GList *l;
+
+    set = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    for (l = uris; l != NULL; l = l->next)
+    {
+        g_hash_table_add (set, g_strdup (l->data));
+    }
+
+    return set;
+}
+
+typedef struct {
+    GHashTable *item_uris;
+    GdkAtom copied_files_atom;
+} ClearIfCollidingData;
+
+static void
+clear_if_colliding_received (GtkClipboard *clipboard,
+                             GtkSelectionData *selection_data,
+                             gpointer user_data)
+{
+    ClearIfCollidingData *data;
+    GList *clipboard_item_uris, *l;
+
+    data = user_data;
+
+    clipboard_item_uris = peony_clipboard_get_uri_list_from_selection_data (selection_data, NULL,
+                          data->copied_files_atom);
+
+    for (l = clipboard_item_uris; l != NULL; l = l->next)
+    {
+        if (g_hash_table_contains (data->item_uris, l->data))
+        {
+            gtk_clipboard_clear (clipboard);
+            break;
+        }
+    }
+
+    g_list_free_full (clipboard_item_uris, g_free);
+    g_hash_table_destroy (data->item_uris);
+    g_slice_free (ClearIfCollidingData, data);
+}
+
+/* Clears the clipboard if it holds any of @item_uris. When the files on
+ * it were put there by us they are checked right away, otherwise the
+ * contents are requested without blocking and checked when they arrive.
+ */
 void
 peony_clipboard_clear_if_colliding_uris (GtkWidget *widget,
                                         const GList *item_uris,
                                         GdkAtom copied_files_atom)
 {
-    GtkSelectionData *data;
-    GList *clipboard_item_uris, *l;
+    PeonyClipboardInfo *info;
+    PeonyFile *file;
+    ClearIfCollidingData *data;
+    const GList *l;
     gboolean collision;
 
-    collision = FALSE;
-    data = gtk_clipboard_wait_for_contents (peony_clipboard_get (widget),
-                                            copied_files_atom);
-    if (data == NULL) {
+    if (item_uris == NULL)
+    {
         return;
     }
 
-    clipboard_item_uris = peony_clipboard_get_uri_list_from_selection_data (data, NULL,
-                          copied_files_atom);
+    info = peony_clipboard_monitor_get_clipboard_info (peony_clipboard_monitor_get ());
+    if (info != NULL)
+    {
+        collision = FALSE;
+        for (l = item_uris; l != NULL && !collision; l = l->next)
+        {
+            file = peony_file_get_existing_by_uri (l->data);
+            if (file != NULL)
+            {
+                collision = peony_clipboard_info_has_file (info, file);
+                peony_file_unref (file);
+            }
+        }
 
-    for (l = (GList *) item_uris; l; l = l->next) {
-        if (g_list_find_custom ((GList *) item_uris, l->data,
-                                (GCompareFunc) g_strcmp0)) {
-            collision = TRUE;
-            break;
+        if (collision)
+        {
+            gtk_clipboard_clear (peony_clipboard_get (widget));
         }
+        return;
     }
 
-    if (collision) {
-        gtk_clipboard_clear (peony_clipboard_get (widget));
-    }
+    data = g_slice_new (ClearIfCollidingData);
+    data->item_uris = build_uri_set (item_uris);
+    data->copied_files_atom = copied_files_atom;
 
-    if (clipboard_item_uris) {
-        g_list_free_full (clipboard_item_uris, g_free);
-    }
+    gtk_clipboard_request_contents (peony_clipboard_get (widget),
+                                    copied_files_atom,
+                                    clear_if_colliding_received,
+                                    data);
 }
@@ -27,9 +27,11 @@
 #include "peony-directory-notify.h"
 #include "peony-directory-private.h"
 #include "peony-file-attributes.h"
+#include "peony-file-info-snapshot.h"
 #include "peony-file-private.h"
 #include "peony-file-utilities.h"
 #include "peony-signaller.h"
+#include "peony-trace.h"
 #include "peony-global-preferences.h"
 #include "peony-link.h"
 #include "peony-marshal.h"
@@ -59,6 +61,22 @@
 /* Keep async. jobs down to this number for all directories. */
 #define MAX_ASYNC_JOBS 10
 
+/* File info, link info and item count requests kept in flight per
+ * directory. The window grows by one for every step of measured round
+ * trip time, so a backend that spends its requests waiting on the
+ * network gets more of them at once. Remote directories start out as
+ * if they had already been measured slow.
+ */
+#define MAX_REQUEST_WINDOW 8
+#define REQUEST_WINDOW_LATENCY_STEP (2 * G_TIME_SPAN_MILLISECOND)
+#define REMOTE_INITIAL_LATENCY (6 * REQUEST_WINDOW_LATENCY_STEP)
+
+/* Files handed to a batched or thread safe info provider at once, and
+ * how many of them a worker thread finishes before reporting back.
+ */
+#define EXTENSION_INFO_BATCH_SIZE 100
+#define EXTENSION_INFO_CHUNK_SIZE 20
+
 struct TopLeftTextReadState
 {
     PeonyDirectory *directory;
@@ -72,6 +90,7 @@ struct LinkInfoReadState
     PeonyDirectory *directory;
     GCancellable *cancellable;
     PeonyFile *file;
+    gint64 start_time;
 };
 
 struct ThumbnailState
@@ -105,6 +124,7 @@ struct DirectoryLoadState
     GHashTable *load_mime_list_hash;
     PeonyFile *load_directory_file;
     int load_file_count;
+    gint64 trace_begin;
 };
 
 struct MimeListState
@@ -119,7 +139,9 @@ struct MimeListState
 struct GetInfoState
 {
     PeonyDirectory *directory;
+    PeonyFile *file;
     GCancellable *cancellable;
+    gint64 start_time;
 };
 
 struct NewFilesState
@@ -136,6 +158,7 @@ struct DirectoryCountState
     GCancellable *cancellable;
     GFileEnumerator *enumerator;
     int file_count;
+    gint64 start_time;
 };
 
 struct DeepCountState
@@ -184,6 +207,28 @@ typedef struct
     PeonyOperationResult result;
 } InfoProviderResponse;
 
+/* One call to a batched info provider, or one worker thread run of a
+ * thread safe one. Referenced by the directory while running and by
+ * every pending completion.
+ */
+struct ExtensionInfoBatch
+{
+    volatile gint ref_count;
+    PeonyDirectory *directory; /* NULL once finished or cancelled */
+    PeonyInfoProvider *provider;
+    PeonyOperationHandle *handle;
+    GList *files; /* PeonyFiles not reported done yet */
+    GList *snapshots; /* PeonyFileInfoSnapshots for the worker thread */
+    GCancellable *cancellable; /* worker thread only */
+};
+
+typedef struct
+{
+    ExtensionInfoBatch *batch;
+    GList *files;
+    GList *snapshots; /* to apply before the files are done */
+} ExtensionInfoChunk;
+
 typedef gboolean (* RequestCheck) (Request);
 typedef gboolean (* FileCheck) (PeonyFile *);
 
@@ -382,6 +427,7 @@ async_job_start (PeonyDirectory *directory,
 {
 #ifdef DEBUG_ASYNC_JOBS
     char *key;
+    gpointer table_key, value;
 #endif
 
 #ifdef DEBUG_START_STOP
@@ -404,6 +450,7 @@ async_job_start (PeonyDirectory *directory,
                              directory,
                              directory);
 
+        PEONY_TRACE_COUNTER ("async jobs deferred", 1);
         return FALSE;
     }
 
@@ -418,17 +465,26 @@ async_job_start (PeonyDirectory *directory,
         }
         uri = peony_directory_get_uri (directory);
         key = g_strconcat (uri, ": ", job, NULL);
-        if (g_hash_table_lookup (async_jobs, key) != NULL)
+        /* Windowed requests run several jobs of a kind at once */
+        if (g_hash_table_lookup_extended (async_jobs, key, &table_key, &value))
         {
-            g_warning ("same job twice: %s in %s",
-                       job, uri);
+            g_hash_table_insert (async_jobs, table_key,
+                                 GINT_TO_POINTER (GPOINTER_TO_INT (value) + 1));
+            g_free (key);
+        }
+        else
+        {
+            g_hash_table_insert (async_jobs, key, GINT_TO_POINTER (1));
         }
         g_free (uri);
-        g_hash_table_insert (async_jobs, key, directory);
     }
 #endif
 
     async_job_count += 1;
+
+    /* Job names are static strings, so they work as counter names */
+    PEONY_TRACE_COUNTER ("async jobs", 1);
+    PEONY_TRACE_COUNTER (job, 1);
     return TRUE;
 }
 
@@ -459,6 +515,11 @@ async_job_end (PeonyDirectory *directory,
             g_warning ("ending job we didn't start: %s in %s",
                        job, uri);
         }
+        else if (GPOINTER_TO_INT (value) > 1)
+        {
+            g_hash_table_insert (async_jobs, table_key,
+                                 GINT_TO_POINTER (GPOINTER_TO_INT (value) - 1));
+        }
         else
         {
             g_hash_table_remove (async_jobs, key);
@@ -470,6 +531,9 @@ async_job_end (PeonyDirectory *directory,
 #endif
 
     async_job_count -= 1;
+
+    PEONY_TRACE_COUNTER ("async jobs", -1);
+    PEONY_TRACE_COUNTER (job, -1);
 }
 
 /* Helper to get one value from a hash table. */
@@ -528,12 +592,59 @@ async_job_wake_up (void)
     already_waking_up = FALSE;
 }
 
+static int
+get_request_window (PeonyDirectory *directory)
+{
+    gint64 latency;
+
+    if (directory->details->request_latency_known)
+    {
+        latency = directory->details->request_latency;
+    }
+    else if (peony_directory_is_local (directory))
+    {
+        latency = 0;
+    }
+    else
+    {
+        latency = REMOTE_INITIAL_LATENCY;
+    }
+
+    return CLAMP (1 + latency / REQUEST_WINDOW_LATENCY_STEP,
+                  1, MAX_REQUEST_WINDOW);
+}
+
+/* Keep a running average of how long a request takes to come back. */
+static void
+record_request_latency (PeonyDirectory *directory,
+                        gint64 start_time)
+{
+    gint64 latency;
+
+    latency = g_get_monotonic_time () - start_time;
+
+    if (!directory->details->request_latency_known)
+    {
+        directory->details->request_latency = latency;
+        directory->details->request_latency_known = TRUE;
+    }
+    else
+    {
+        directory->details->request_latency =
+            (7 * directory->details->request_latency + latency) / 8;
+    }
+}
+
 static void
 directory_count_cancel (PeonyDirectory *directory)
 {
-    if (directory->details->count_in_progress != NULL)
+    GList *node;
+    DirectoryCountState *state;
+
+    for (node = directory->details->count_in_progress; node != NULL; node = node->next)
     {
-        g_cancellable_cancel (directory->details->count_in_progress->cancellable);
+        state = node->data;
+        g_cancellable_cancel (state->cancellable);
     }
 }
 
@@ -578,15 +689,26 @@ top_left_cancel (PeonyDirectory *directory)
     }
 }
 
+static void
+link_info_cancel_state (PeonyDirectory *directory,
+                        LinkInfoReadState *state)
+{
+    g_cancellable_cancel (state->cancellable);
+    state->directory = NULL;
+    state->file = NULL;
+    directory->details->link_info_in_progress =
+        g_list_remove (directory->details->link_info_in_progress, state);
+
+    async_job_end (directory, "link info");
+}
+
 static void
 link_info_cancel (PeonyDirectory *directory)
 {
-    if (directory->details->link_info_read_state != NULL)
+    while (directory->details->link_info_in_progress != NULL)
     {
-        g_cancellable_cancel (directory->details->link_info_read_state->cancellable);
-        directory->details->link_info_read_state->directory = NULL;
-        directory->details->link_info_read_state = NULL;
-        async_job_end (directory, "link info");
+        link_info_cancel_state (directory,
+                                directory->details->link_info_in_progress->data);
     }
 }
 
@@ -614,17 +736,26 @@ mount_cancel (PeonyDirectory *directory)
     }
 }
 
+static void
+file_info_cancel_state (PeonyDirectory *directory,
+                        GetInfoState *state)
+{
+    g_cancellable_cancel (state->cancellable);
+    state->directory = NULL;
+    state->file = NULL;
+    directory->details->get_info_in_progress =
+        g_list_remove (directory->details->get_info_in_progress, state);
+
+    async_job_end (directory, "file info");
+}
+
 static void
 file_info_cancel (PeonyDirectory *directory)
 {
-    if (directory->details->get_info_in_progress != NULL)
+    while (directory->details->get_info_in_progress != NULL)
     {
-        g_cancellable_cancel (directory->details->get_info_in_progress->cancellable);
-        directory->details->get_info_in_progress->directory = NULL;
-        directory->details->get_info_in_progress = NULL;
-        directory->details->get_info_file = NULL;
-
-        async_job_end (directory, "file info");
+        file_info_cancel_state (directory,
+                                directory->details->get_info_in_progress->data);
     }
 }
 
@@ -1194,6 +1325,12 @@ directory_load_done (PeonyDirectory *directory,
     directory->details->directory_loaded = TRUE;
     directory->details->directory_loaded_sent_notification = FALSE;
 
+    if (directory->details->directory_load_in_progress != NULL)
+    {
+        PEONY_TRACE_END (PEONY_TRACE_CATEGORY_DIRECTORY, "load",
+                         directory->details->directory_load_in_progress->trace_begin);
+    }
+
     if (error != NULL)
     {
         /* The load did not complete successfully. This means
@@ -1717,11 +1854,15 @@ peony_async_destroying_file (PeonyFile *file)
     /* Check if it's a file that's currently being worked on.
      * If so, make that NULL so it gets canceled right away.
      */
-    if (directory->details->count_in_progress != NULL &&
-            directory->details->count_in_progress->count_file == file)
+    for (node = directory->details->count_in_progress; node != NULL; node = node->next)
     {
-        directory->details->count_in_progress->count_file = NULL;
-        changed = TRUE;
+        DirectoryCountState *count_state = node->data;
+
+        if (count_state->count_file == file)
+        {
+            count_state->count_file = NULL;
+            changed = TRUE;
+        }
     }
     if (directory->details->deep_count_file == file)
     {
@@ -1734,10 +1875,15 @@ peony_async_destroying_file (PeonyFile *file)
         directory->details->mime_list_in_progress->mime_list_file = NULL;
         changed = TRUE;
     }
-    if (directory->details->get_info_file == file)
+    for (node = directory->details->get_info_in_progress; node != NULL; node = node->next)
     {
-        directory->details->get_info_file = NULL;
-        changed = TRUE;
+        GetInfoState *info_state = node->data;
+
+        if (info_state->file == file)
+        {
+            info_state->file = NULL;
+            changed = TRUE;
+        }
     }
     if (directory->details->top_left_read_state != NULL
             && directory->details->top_left_read_state->file == file)
@@ -1745,11 +1891,15 @@ peony_async_destroying_file (PeonyFile *file)
         directory->details->top_left_read_state->file = NULL;
         changed = TRUE;
     }
-    if (directory->details->link_info_read_state != NULL &&
-            directory->details->link_info_read_state->file == file)
+    for (node = directory->details->link_info_in_progress; node != NULL; node = node->next)
     {
-        directory->details->link_info_read_state->file = NULL;
-        changed = TRUE;
+        LinkInfoReadState *link_info_state = node->data;
+
+        if (link_info_state->file == file)
+        {
+            link_info_state->file = NULL;
+            changed = TRUE;
+        }
     }
     if (directory->details->extension_info_file == file)
     {
@@ -2416,6 +2566,7 @@ start_monitoring_file_list (PeonyDirectory *directory)
     state->cancellable = g_cancellable_new ();
     state->load_mime_list_hash = istr_set_new ();
     state->load_file_count = 0;
+    state->trace_begin = PEONY_TRACE_BEGIN ();
 
     g_assert (directory->details->location != NULL);
     state->load_directory_file =
@@ -2642,11 +2793,14 @@ is_needy (PeonyFile *file,
 static void
 directory_count_stop (PeonyDirectory *directory)
 {
+    GList *node;
+    DirectoryCountState *state;
     PeonyFile *file;
 
-    if (directory->details->count_in_progress != NULL)
+    for (node = directory->details->count_in_progress; node != NULL; node = node->next)
     {
-        file = directory->details->count_in_progress->count_file;
+        state = node->data;
+        file = state->count_file;
         if (file != NULL)
         {
             g_assert (PEONY_IS_FILE (file));
@@ -2655,13 +2809,31 @@ directory_count_stop (PeonyDirectory *directory)
                           should_get_directory_count_now,
                           REQUEST_DIRECTORY_COUNT))
             {
-                return;
+                continue;
             }
         }
 
         /* The count is not wanted, so stop it. */
-        directory_count_cancel (directory);
+        g_cancellable_cancel (state->cancellable);
+    }
+}
+
+static DirectoryCountState *
+find_directory_count_state (PeonyDirectory *directory,
+                            PeonyFile *file)
+{
+    GList *node;
+    DirectoryCountState *state;
+
+    for (node = directory->details->count_in_progress; node != NULL; node = node->next)
+    {
+        state = node->data;
+        if (state->count_file == file)
+        {
+            return state;
+        }
     }
+    return NULL;
 }
 
 static guint
@@ -2685,10 +2857,13 @@ count_non_skipped_files (GList *list)
 
 static void
 count_children_done (PeonyDirectory *directory,
-                     PeonyFile *count_file,
+                     DirectoryCountState *state,
                      gboolean succeeded,
                      int count)
 {
+    PeonyFile *count_file;
+
+    count_file = state->count_file;
     g_assert (PEONY_IS_FILE (count_file));
 
     count_file->details->directory_count_is_up_to_date = TRUE;
@@ -2706,7 +2881,8 @@ count_children_done (PeonyDirectory *directory,
         count_file->details->got_directory_count = TRUE;
         count_file->details->directory_count = count;
     }
-    directory->details->count_in_progress = NULL;
+    directory->details->count_in_progress =
+        g_list_remove (directory->details->count_in_progress, state);
 
     /* Send file-changed even if count failed, so interested parties can
      * distinguish between unknowable and not-yet-known cases.
@@ -2751,7 +2927,8 @@ count_more_files_callback (GObject *source_object,
     if (g_cancellable_is_cancelled (state->cancellable))
     {
         /* Operation was cancelled. Bail out */
-        directory->details->count_in_progress = NULL;
+        directory->details->count_in_progress =
+            g_list_remove (directory->details->count_in_progress, state);
 
         async_job_end (directory, "directory count");
         peony_directory_async_state_changed (directory);
@@ -2761,8 +2938,7 @@ count_more_files_callback (GObject *source_object,
         return;
     }
 
-    g_assert (directory->details->count_in_progress != NULL);
-    g_assert (directory->details->count_in_progress == state);
+    g_assert (g_list_find (directory->details->count_in_progress, state) != NULL);
 
     error = NULL;
     files = g_file_enumerator_next_files_finish (state->enumerator,
@@ -2772,7 +2948,7 @@ count_more_files_callback (GObject *source_object,
 
     if (files == NULL)
     {
-        count_children_done (directory, state->count_file,
+        count_children_done (directory, state,
                              TRUE, state->file_count);
         directory_count_state_free (state);
     }
@@ -2810,7 +2986,8 @@ count_children_callback (GObject *source_object,
     {
         /* Operation was cancelled. Bail out */
         directory = state->directory;
-        directory->details->count_in_progress = NULL;
+        directory->details->count_in_progress =
+            g_list_remove (directory->details->count_in_progress, state);
 
         async_job_end (directory, "directory count");
         peony_directory_async_state_changed (directory);
@@ -2820,6 +2997,8 @@ count_children_callback (GObject *source_object,
         return;
     }
 
+    record_request_latency (state->directory, state->start_time);
+
     error = NULL;
     enumerator = g_file_enumerate_children_finish  (G_FILE (source_object),
                  res, &error);
@@ -2827,7 +3006,7 @@ count_children_callback (GObject *source_object,
     if (enumerator == NULL)
     {
         count_children_done (state->directory,
-                             state->count_file,
+                             state,
                              FALSE, 0);
         g_error_free (error);
         directory_count_state_free (state);
@@ -2853,7 +3032,7 @@ directory_count_start (PeonyDirectory *directory,
     DirectoryCountState *state;
     GFile *location;
 
-    if (directory->details->count_in_progress != NULL)
+    if (find_directory_count_state (directory, file) != NULL)
     {
         *doing_io = TRUE;
         return;
@@ -2877,6 +3056,11 @@ directory_count_start (PeonyDirectory *directory,
         return;
     }
 
+    if (g_list_length (directory->details->count_in_progress) >= get_request_window (directory))
+    {
+        return;
+    }
+
     if (!async_job_start (directory, "directory count"))
     {
         return;
@@ -2887,8 +3071,10 @@ directory_count_start (PeonyDirectory *directory,
     state->count_file = file;
     state->directory = peony_directory_ref (directory);
     state->cancellable = g_cancellable_new ();
+    state->start_time = g_get_monotonic_time ();
 
-    directory->details->count_in_progress = state;
+    directory->details->count_in_progress =
+        g_list_prepend (directory->details->count_in_progress, state);
 
     location = peony_file_get_location (file);
 #ifdef DEBUG_LOAD_DIRECTORY
@@ -3636,21 +3822,21 @@ top_left_read_callback (GObject *source_object,
     file_details = state->file->details;
 
     file_details->top_left_text_is_up_to_date = TRUE;
-    g_free (file_details->top_left_text);
 
     if (g_file_load_partial_contents_finish (G_FILE (source_object),
             res,
             &file_contents, &file_size,
             NULL, NULL))
     {
-        file_details->top_left_text = peony_extract_top_left_text (file_contents, state->large, file_size);
+        peony_file_take_top_left_text (state->file,
+                                       peony_extract_top_left_text (file_contents, state->large, file_size));
         file_details->got_top_left_text = TRUE;
         file_details->got_large_top_left_text = state->large;
         g_free (file_contents);
     }
     else
     {
-        file_details->top_left_text = NULL;
+        peony_file_take_top_left_text (state->file, NULL);
         file_details->got_top_left_text = FALSE;
         file_details->got_large_top_left_text = FALSE;
     }
@@ -3738,8 +3924,7 @@ top_left_start (PeonyDirectory *directory,
 
     if (!peony_file_contains_text (file))
     {
-        g_free (file->details->top_left_text);
-        file->details->top_left_text = NULL;
+        peony_file_take_top_left_text (file, NULL);
         file->details->got_top_left_text = FALSE;
         file->details->got_large_top_left_text = FALSE;
         file->details->top_left_text_is_up_to_date = TRUE;
@@ -3800,11 +3985,12 @@ query_info_callback (GObject *source_object,
 
     directory = peony_directory_ref (state->directory);
 
-    get_info_file = directory->details->get_info_file;
+    get_info_file = state->file;
     g_assert (PEONY_IS_FILE (get_info_file));
 
-    directory->details->get_info_file = NULL;
-    directory->details->get_info_in_progress = NULL;
+    directory->details->get_info_in_progress =
+        g_list_remove (directory->details->get_info_in_progress, state);
+    record_request_latency (directory, state->start_time);
 
     /* ref here because we might be removing the last ref when we
      * mark the file gone below, but we need to keep a ref at
@@ -3847,24 +4033,46 @@ query_info_callback (GObject *source_object,
 static void
 file_info_stop (PeonyDirectory *directory)
 {
+    GList *node, *next;
+    GetInfoState *state;
     PeonyFile *file;
 
-    if (directory->details->get_info_in_progress != NULL)
+    for (node = directory->details->get_info_in_progress; node != NULL; node = next)
     {
-        file = directory->details->get_info_file;
+        next = node->next;
+        state = node->data;
+        file = state->file;
         if (file != NULL)
         {
             g_assert (PEONY_IS_FILE (file));
             g_assert (file->details->directory == directory);
             if (is_needy (file, lacks_info, REQUEST_FILE_INFO))
             {
-                return;
+                continue;
             }
         }
 
         /* The info is not wanted, so stop it. */
-        file_info_cancel (directory);
+        file_info_cancel_state (directory, state);
+    }
+}
+
+static GetInfoState *
+find_file_info_state (PeonyDirectory *directory,
+                      PeonyFile *file)
+{
+    GList *node;
+    GetInfoState *state;
+
+    for (node = directory->details->get_info_in_progress; node != NULL; node = node->next)
+    {
+        state = node->data;
+        if (state->file == file)
+        {
+            return state;
+        }
     }
+    return NULL;
 }
 
 static void
@@ -3877,7 +4085,7 @@ file_info_start (PeonyDirectory *directory,
 
     file_info_stop (directory);
 
-    if (directory->details->get_info_in_progress != NULL)
+    if (find_file_info_state (directory, file) != NULL)
     {
         *doing_io = TRUE;
         return;
@@ -3889,12 +4097,16 @@ file_info_start (PeonyDirectory *directory,
     }
     *doing_io = TRUE;
 
+    if (g_list_length (directory->details->get_info_in_progress) >= get_request_window (directory))
+    {
+        return;
+    }
+
     if (!async_job_start (directory, "file info"))
     {
         return;
     }
 
-    directory->details->get_info_file = file;
     file->details->get_info_failed = FALSE;
     if (file->details->get_info_error)
     {
@@ -3904,9 +4116,12 @@ file_info_start (PeonyDirectory *directory,
 
     state = g_new (GetInfoState, 1);
     state->directory = directory;
+    state->file = file;
     state->cancellable = g_cancellable_new ();
+    state->start_time = g_get_monotonic_time ();
 
-    directory->details->get_info_in_progress = state;
+    directory->details->get_info_in_progress =
+        g_list_prepend (directory->details->get_info_in_progress, state);
 
     location = peony_file_get_location (file);
     g_file_query_info_async (location,
@@ -3971,8 +4186,6 @@ link_info_done (PeonyDirectory *directory,
     }
 
     file->details->got_link_info = TRUE;
-    g_free (file->details->custom_icon);
-    file->details->custom_icon = NULL;
     if (uri)
     {
         g_free (file->details->activation_uri);
@@ -3980,10 +4193,7 @@ link_info_done (PeonyDirectory *directory,
         file->details->got_custom_activation_uri = TRUE;
         file->details->activation_uri = g_strdup (uri);
     }
-    if (is_trusted)
-    {
-        file->details->custom_icon = g_strdup (icon);
-    }
+    peony_file_set_custom_icon_internal (file, is_trusted ? icon : NULL);
     file->details->is_launcher = is_launcher;
     file->details->is_foreign_link = is_foreign;
     file->details->is_trusted_link = is_trusted;
@@ -4004,12 +4214,15 @@ should_read_link_info_sync (PeonyFile *file)
 static void
 link_info_stop (PeonyDirectory *directory)
 {
+    GList *node, *next;
+    LinkInfoReadState *state;
     PeonyFile *file;
 
-    if (directory->details->link_info_read_state != NULL)
+    for (node = directory->details->link_info_in_progress; node != NULL; node = next)
     {
-        file = directory->details->link_info_read_state->file;
-
+        next = node->next;
+        state = node->data;
+        file = state->file;
         if (file != NULL)
         {
             g_assert (PEONY_IS_FILE (file));
@@ -4018,13 +4231,31 @@ link_info_stop (PeonyDirectory *directory)
                           lacks_link_info,
                           REQUEST_LINK_INFO))
             {
-                return;
+                continue;
             }
         }
 
         /* The link info is not wanted, so stop it. */
-        link_info_cancel (directory);
+        link_info_cancel_state (directory, state);
+    }
+}
+
+static LinkInfoReadState *
+find_link_info_state (PeonyDirectory *directory,
+                      PeonyFile *file)
+{
+    GList *node;
+    LinkInfoReadState *state;
+
+    for (node = directory->details->link_info_in_progress; node != NULL; node = node->next)
+    {
+        state = node->data;
+        if (state->file == file)
+        {
+            return state;
+        }
     }
+    return NULL;
 }
 
 static void
@@ -4105,10 +4336,19 @@ link_info_peony_link_read_callback (GObject *source_object,
                                           &file_contents, &file_size,
                                           NULL, NULL);
 
-    state->directory->details->link_info_read_state = NULL;
-    async_job_end (state->directory, "link info");
+    directory->details->link_info_in_progress =
+        g_list_remove (directory->details->link_info_in_progress, state);
+    record_request_latency (directory, state->start_time);
+    async_job_end (directory, "link info");
 
-    link_info_got_data (state->directory, state->file, result, file_size, file_contents);
+    if (state->file != NULL)
+    {
+        link_info_got_data (directory, state->file, result, file_size, file_contents);
+    }
+    else
+    {
+        peony_directory_async_state_changed (directory);
+    }
 
     if (result)
     {
@@ -4132,7 +4372,7 @@ link_info_start (PeonyDirectory *directory,
     gboolean result;
     LinkInfoReadState *state;
 
-    if (directory->details->link_info_read_state != NULL)
+    if (find_link_info_state (directory, file) != NULL)
     {
         *doing_io = TRUE;
         return;
@@ -4163,7 +4403,8 @@ link_info_start (PeonyDirectory *directory,
     }
     else
     {
-        if (!async_job_start (directory, "link info"))
+        if (g_list_length (directory->details->link_info_in_progress) >= get_request_window (directory) ||
+                !async_job_start (directory, "link info"))
         {
             g_object_unref (location);
             return;
@@ -4173,8 +4414,10 @@ link_info_start (PeonyDirectory *directory,
         state->directory = directory;
         state->file = file;
         state->cancellable = g_cancellable_new ();
+        state->start_time = g_get_monotonic_time ();
 
-        directory->details->link_info_read_state = state;
+        directory->details->link_info_in_progress =
+            g_list_prepend (directory->details->link_info_in_progress, state);
 
         g_file_load_contents_async (location,
                                     state->cancellable,
@@ -4195,11 +4438,7 @@ thumbnail_done (PeonyDirectory *directory,
 
     file->details->thumbnail_is_up_to_date = TRUE;
     file->details->thumbnail_tried_original  = tried_original;
-    if (file->details->thumbnail)
-    {
-        g_object_unref (file->details->thumbnail);
-        file->details->thumbnail = NULL;
-    }
+    peony_file_set_thumbnail (file, NULL, 0);
     if (pixbuf)
     {
         if (tried_original)
@@ -4218,8 +4457,7 @@ thumbnail_done (PeonyDirectory *directory,
         if (thumb_mtime == 0 ||
                 thumb_mtime == file->details->mtime)
         {
-            file->details->thumbnail = g_object_ref (pixbuf);
-            file->details->thumbnail_mtime = thumb_mtime;
+            peony_file_set_thumbnail (file, pixbuf, thumb_mtime);
         }
         else
         {
@@ -4830,9 +5068,91 @@ filesystem_info_start (PeonyDirectory *directory,
     g_object_unref (location);
 }
 
+static ExtensionInfoBatch *
+extension_info_batch_ref (ExtensionInfoBatch *batch)
+{
+    g_atomic_int_inc (&batch->ref_count);
+    return batch;
+}
+
+static void
+extension_info_batch_unref (ExtensionInfoBatch *batch)
+{
+    if (!g_atomic_int_dec_and_test (&batch->ref_count))
+    {
+        return;
+    }
+
+    g_assert (batch->directory == NULL);
+
+    g_object_unref (batch->provider);
+    peony_file_list_free (batch->files);
+    g_list_free_full (batch->snapshots, g_object_unref);
+    if (batch->cancellable != NULL)
+    {
+        g_object_unref (batch->cancellable);
+    }
+    g_free (batch);
+}
+
+static gboolean
+extension_info_batch_unref_idle_callback (gpointer user_data)
+{
+    extension_info_batch_unref (user_data);
+
+    return FALSE;
+}
+
+/* The last reference drops PeonyFiles, which must happen on the
+ * main thread.
+ */
+static void
+extension_info_batch_unref_on_main_thread (ExtensionInfoBatch *batch)
+{
+    g_idle_add (extension_info_batch_unref_idle_callback, batch);
+}
+
+static void
+extension_info_batch_finish (ExtensionInfoBatch *batch)
+{
+    PeonyDirectory *directory;
+
+    directory = batch->directory;
+    directory->details->extension_info_batch = NULL;
+    batch->directory = NULL;
+
+    async_job_end (directory, "extension info");
+    extension_info_batch_unref (batch);
+}
+
+static void
+extension_info_batch_cancel (PeonyDirectory *directory)
+{
+    ExtensionInfoBatch *batch;
+
+    batch = directory->details->extension_info_batch;
+    if (batch == NULL)
+    {
+        return;
+    }
+
+    if (batch->cancellable != NULL)
+    {
+        g_cancellable_cancel (batch->cancellable);
+    }
+    else if (batch->handle != NULL)
+    {
+        peony_info_provider_cancel_update (batch->provider, batch->handle);
+    }
+
+    extension_info_batch_finish (batch);
+}
+
 static void
 extension_info_cancel (PeonyDirectory *directory)
 {
+    extension_info_batch_cancel (directory);
+
     if (directory->details->extension_info_in_progress != NULL)
     {
         if (directory->details->extension_info_idle)
@@ -4858,6 +5178,24 @@ extension_info_cancel (PeonyDirectory *directory)
 static void
 extension_info_stop (PeonyDirectory *directory)
 {
+    ExtensionInfoBatch *batch;
+    GList *node;
+
+    batch = directory->details->extension_info_batch;
+    if (batch != NULL)
+    {
+        for (node = batch->files; node != NULL; node = node->next)
+        {
+            if (is_needy (node->data, lacks_extension_info, REQUEST_EXTENSION_INFO))
+            {
+                return;
+            }
+        }
+
+        /* None of the files is wanted any more, so stop it. */
+        extension_info_batch_cancel (directory);
+    }
+
     if (directory->details->extension_info_in_progress != NULL)
     {
         PeonyFile *file;
@@ -4949,6 +5287,266 @@ info_provider_callback (PeonyInfoProvider *provider,
                          g_free);
 }
 
+/* Takes files that a batch reports as done off the batch, and ends the
+ * batch once all of its files are done.
+ */
+static void
+extension_info_batch_files_done (ExtensionInfoBatch *batch,
+                                 GList *files)
+{
+    PeonyDirectory *directory;
+    PeonyFile *file;
+    GList *node, *link;
+
+    directory = batch->directory;
+    if (directory == NULL)
+    {
+        /* Cancelled or already done */
+        return;
+    }
+
+    for (node = files; node != NULL; node = node->next)
+    {
+        file = PEONY_FILE (node->data);
+        link = g_list_find (batch->files, file);
+        if (link == NULL)
+        {
+            continue;
+        }
+        batch->files = g_list_delete_link (batch->files, link);
+
+        /* The providers may have been reset since the batch started */
+        if (g_list_find (file->details->pending_info_providers, batch->provider) != NULL)
+        {
+            file->details->pending_info_providers =
+                g_list_remove (file->details->pending_info_providers,
+                               batch->provider);
+            g_object_unref (batch->provider);
+
+            if (file->details->pending_info_providers == NULL)
+            {
+                peony_file_info_providers_done (file);
+            }
+        }
+        peony_file_unref (file);
+    }
+
+    if (batch->files == NULL)
+    {
+        peony_directory_ref (directory);
+        extension_info_batch_finish (batch);
+        peony_directory_async_state_changed (directory);
+        peony_directory_unref (directory);
+    }
+}
+
+static gboolean
+extension_info_chunk_idle_callback (gpointer user_data)
+{
+    ExtensionInfoChunk *chunk;
+    PeonyFileInfoSnapshot *snapshot;
+    GList *node;
+
+    chunk = user_data;
+    for (node = chunk->snapshots; node != NULL; node = node->next)
+    {
+        snapshot = node->data;
+        if (chunk->batch->directory != NULL)
+        {
+            peony_file_info_snapshot_apply (snapshot);
+        }
+        chunk->files = g_list_prepend (chunk->files,
+                                       peony_file_ref (peony_file_info_snapshot_get_file (snapshot)));
+    }
+    extension_info_batch_files_done (chunk->batch, chunk->files);
+
+    return FALSE;
+}
+
+static void
+extension_info_chunk_free (ExtensionInfoChunk *chunk)
+{
+    peony_file_list_free (chunk->files);
+    g_list_free_full (chunk->snapshots, g_object_unref);
+    extension_info_batch_unref (chunk->batch);
+    g_free (chunk);
+}
+
+/* Called by the provider or the worker thread, the chunk owns the
+ * lists and is freed on the main thread.
+ */
+static void
+extension_info_report_chunk (ExtensionInfoBatch *batch,
+                             GList *files,
+                             GList *snapshots)
+{
+    ExtensionInfoChunk *chunk;
+
+    chunk = g_new0 (ExtensionInfoChunk, 1);
+    chunk->batch = extension_info_batch_ref (batch);
+    chunk->files = files;
+    chunk->snapshots = snapshots;
+
+    g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+                     extension_info_chunk_idle_callback, chunk,
+                     (GDestroyNotify) extension_info_chunk_free);
+}
+
+static void
+info_provider_batch_callback (PeonyInfoProvider *provider,
+                              PeonyOperationHandle *handle,
+                              GList *files,
+                              PeonyOperationResult result,
+                              gpointer user_data)
+{
+    extension_info_report_chunk (user_data, peony_file_list_copy (files), NULL);
+}
+
+static void
+info_provider_thread_callback (PeonyInfoProvider *provider,
+                               PeonyOperationHandle *handle,
+                               PeonyOperationResult result,
+                               gpointer user_data)
+{
+    /* The worker thread doesn't wait for providers that finish late,
+     * whatever they add after their chunk was applied is lost.
+     */
+}
+
+static gboolean
+extension_info_thread_job (GIOSchedulerJob *io_job,
+                           GCancellable *cancellable,
+                           gpointer user_data)
+{
+    ExtensionInfoBatch *batch;
+    PeonyOperationHandle *handle;
+    GClosure *update_complete;
+    GList *node, *done;
+    int count;
+
+    batch = user_data;
+
+    update_complete = g_cclosure_new (G_CALLBACK (info_provider_thread_callback),
+                                      NULL, NULL);
+    g_closure_set_marshal (update_complete,
+                           peony_marshal_VOID__POINTER_ENUM);
+    g_closure_ref (update_complete);
+    g_closure_sink (update_complete);
+
+    done = NULL;
+    count = 0;
+    for (node = batch->snapshots;
+            node != NULL && !g_cancellable_is_cancelled (cancellable);
+            node = node->next)
+    {
+        handle = NULL;
+        peony_info_provider_update_file_info (batch->provider,
+                                              PEONY_FILE_INFO (node->data),
+                                              update_complete,
+                                              &handle);
+
+        done = g_list_prepend (done, g_object_ref (node->data));
+        if (++count % EXTENSION_INFO_CHUNK_SIZE == 0)
+        {
+            extension_info_report_chunk (batch, NULL, done);
+            done = NULL;
+        }
+    }
+
+    if (done != NULL)
+    {
+        extension_info_report_chunk (batch, NULL, done);
+    }
+
+    g_closure_unref (update_complete);
+
+    return FALSE;
+}
+
+/* Hands the file, and the files queued after it that are waiting for
+ * the same provider, to a batched or thread safe info provider.
+ */
+static void
+extension_info_batch_start (PeonyDirectory *directory,
+                            PeonyFile *first_file,
+                            PeonyInfoProvider *provider)
+{
+    ExtensionInfoBatch *batch;
+    PeonyOperationResult result;
+    PeonyOperationHandle *handle;
+    GClosure *update_complete;
+    PeonyFile *file;
+    GList *files, *node;
+    int count;
+
+    batch = g_new0 (ExtensionInfoBatch, 1);
+    batch->ref_count = 1;
+    batch->directory = directory;
+    batch->provider = g_object_ref (provider);
+
+    count = 0;
+    for (file = first_file;
+            file != NULL && count < EXTENSION_INFO_BATCH_SIZE;
+            file = peony_file_queue_next (directory->details->extension_queue, file))
+    {
+        if (file->details->pending_info_providers != NULL &&
+                file->details->pending_info_providers->data == provider &&
+                is_needy (file, lacks_extension_info, REQUEST_EXTENSION_INFO))
+        {
+            batch->files = g_list_prepend (batch->files, peony_file_ref (file));
+            count++;
+        }
+    }
+    batch->files = g_list_reverse (batch->files);
+
+    directory->details->extension_info_batch = batch;
+
+    if (peony_info_provider_get_flags (provider) & PEONY_INFO_PROVIDER_THREAD_SAFE)
+    {
+        batch->cancellable = g_cancellable_new ();
+        for (node = batch->files; node != NULL; node = node->next)
+        {
+            batch->snapshots = g_list_prepend (batch->snapshots,
+                                               peony_file_info_snapshot_new (node->data));
+        }
+        batch->snapshots = g_list_reverse (batch->snapshots);
+        g_io_scheduler_push_job (extension_info_thread_job,
+                                 extension_info_batch_ref (batch),
+                                 (GDestroyNotify) extension_info_batch_unref_on_main_thread,
+                                 G_PRIORITY_DEFAULT,
+                                 batch->cancellable);
+        return;
+    }
+
+    update_complete = g_cclosure_new (G_CALLBACK (info_provider_batch_callback),
+                                      extension_info_batch_ref (batch),
+                                      (GClosureNotify) extension_info_batch_unref);
+    g_closure_set_marshal (update_complete,
+                           peony_marshal_VOID__POINTER_POINTER_ENUM);
+
+    files = g_list_copy (batch->files);
+    handle = NULL;
+    result = peony_info_provider_update_file_info_batch (provider,
+             files,
+             update_complete,
+             &handle);
+    g_list_free (files);
+
+    g_closure_unref (update_complete);
+
+    if (result == PEONY_OPERATION_COMPLETE ||
+            result == PEONY_OPERATION_FAILED)
+    {
+        files = g_list_copy (batch->files);
+        extension_info_batch_files_done (batch, files);
+        g_list_free (files);
+    }
+    else
+    {
+        batch->handle = handle;
+    }
+}
+
 static void
 extension_info_start (PeonyDirectory *directory,
                       PeonyFile *file,
@@ -4959,7 +5557,8 @@ extension_info_start (PeonyDirectory *directory,
     PeonyOperationHandle *handle;
     GClosure *update_complete;
 
-    if (directory->details->extension_info_in_progress != NULL)
+    if (directory->details->extension_info_in_progress != NULL ||
+            directory->details->extension_info_batch != NULL)
     {
         *doing_io = TRUE;
         return;
@@ -4978,6 +5577,13 @@ extension_info_start (PeonyDirectory *directory,
 
     provider = file->details->pending_info_providers->data;
 
+    if (peony_info_provider_can_update_batch (provider) ||
+            (peony_info_provider_get_flags (provider) & PEONY_INFO_PROVIDER_THREAD_SAFE))
+    {
+        extension_info_batch_start (directory, file, provider);
+        return;
+    }
+
     update_complete = g_cclosure_new (G_CALLBACK (info_provider_callback),
                                       directory,
                                       NULL);
@@ -5009,8 +5615,9 @@ extension_info_start (PeonyDirectory *directory,
 static void
 start_or_stop_io (PeonyDirectory *directory)
 {
-    PeonyFile *file;
-    gboolean doing_io;
+    PeonyFile *file, *next;
+    gboolean doing_io, file_doing_io;
+    int window, waiting_files;
 
     /* Start or stop reading files. */
     file_list_start_or_stop (directory);
@@ -5027,44 +5634,80 @@ start_or_stop_io (PeonyDirectory *directory)
     thumbnail_stop (directory);
     filesystem_info_stop (directory);
 
+    /* Take files that are all done off the queue. Files still waiting
+     * for I/O stay where they are, but we look past up to a window's
+     * worth of them, in queue order, so that several requests can be
+     * in flight at once.
+     */
+    window = get_request_window (directory);
     doing_io = FALSE;
-    /* Take files that are all done off the queue. */
-    while (!peony_file_queue_is_empty (directory->details->high_priority_queue))
+    waiting_files = 0;
+    file = peony_file_queue_head (directory->details->high_priority_queue);
+    while (file != NULL)
     {
-        file = peony_file_queue_head (directory->details->high_priority_queue);
+        next = peony_file_queue_next (directory->details->high_priority_queue, file);
 
         /* Start getting attributes if possible */
-        file_info_start (directory, file, &doing_io);
-        link_info_start (directory, file, &doing_io);
+        file_doing_io = FALSE;
+        file_info_start (directory, file, &file_doing_io);
+        link_info_start (directory, file, &file_doing_io);
 
-        if (doing_io)
+        if (file_doing_io)
         {
-            return;
+            doing_io = TRUE;
+            if (++waiting_files >= window)
+            {
+                return;
+            }
+        }
+        else
+        {
+            move_file_to_low_priority_queue (directory, file);
         }
 
-        move_file_to_low_priority_queue (directory, file);
+        file = next;
+    }
+
+    if (doing_io)
+    {
+        return;
     }
 
     /* High priority queue must be empty */
-    while (!peony_file_queue_is_empty (directory->details->low_priority_queue))
+    file = peony_file_queue_head (directory->details->low_priority_queue);
+    while (file != NULL)
     {
-        file = peony_file_queue_head (directory->details->low_priority_queue);
+        next = peony_file_queue_next (directory->details->low_priority_queue, file);
 
         /* Start getting attributes if possible */
-        mount_start (directory, file, &doing_io);
-        directory_count_start (directory, file, &doing_io);
-        deep_count_start (directory, file, &doing_io);
-        mime_list_start (directory, file, &doing_io);
-        top_left_start (directory, file, &doing_io);
-        thumbnail_start (directory, file, &doing_io);
-        filesystem_info_start (directory, file, &doing_io);
-
-        if (doing_io)
+        file_doing_io = FALSE;
+        mount_start (directory, file, &file_doing_io);
+        directory_count_start (directory, file, &file_doing_io);
+        deep_count_start (directory, file, &file_doing_io);
+        mime_list_start (directory, file, &file_doing_io);
+        top_left_start (directory, file, &file_doing_io);
+        thumbnail_start (directory, file, &file_doing_io);
+        filesystem_info_start (directory, file, &file_doing_io);
+
+        if (file_doing_io)
         {
-            return;
+            doing_io = TRUE;
+            if (++waiting_files >= window)
+            {
+                return;
+            }
+        }
+        else
+        {
+            move_file_to_extension_queue (directory, file);
         }
 
-        move_file_to_extension_queue (directory, file);
+        file = next;
+    }
+
+    if (doing_io)
+    {
+        return;
     }
 
     /* Low priority queue must be empty */
@@ -5152,10 +5795,12 @@ static void
 cancel_directory_count_for_file (PeonyDirectory *directory,
                                  PeonyFile      *file)
 {
-    if (directory->details->count_in_progress != NULL &&
-            directory->details->count_in_progress->count_file == file)
+    DirectoryCountState *state;
+
+    state = find_directory_count_state (directory, file);
+    if (state != NULL)
     {
-        directory_count_cancel (directory);
+        g_cancellable_cancel (state->cancellable);
     }
 }
 
@@ -5195,9 +5840,12 @@ static void
 cancel_file_info_for_file (PeonyDirectory *directory,
                            PeonyFile      *file)
 {
-    if (directory->details->get_info_file == file)
+    GetInfoState *state;
+
+    state = find_file_info_state (directory, file);
+    if (state != NULL)
     {
-        file_info_cancel (directory);
+        file_info_cancel_state (directory, state);
     }
 }
 
@@ -5238,10 +5886,12 @@ static void
 cancel_link_info_for_file (PeonyDirectory *directory,
                            PeonyFile      *file)
 {
-    if (directory->details->link_info_read_state != NULL &&
-            directory->details->link_info_read_state->file == file)
+    LinkInfoReadState *state;
+
+    state = find_link_info_state (directory, file);
+    if (state != NULL)
     {
-        link_info_cancel (directory);
+        link_info_cancel_state (directory, state);
     }
 }
 
@@ -5389,6 +6039,22 @@ peony_directory_remove_file_from_work_queue (PeonyDirectory *directory,
                             file);
 }
 
+/* Files in view should get their attributes before the rest of the
+ * folder. The file only moves within whichever queue it is on, so the
+ * work already done for it is kept.
+ */
+void
+peony_directory_prioritize_file_in_work_queue (PeonyDirectory *directory,
+        PeonyFile *file)
+{
+    peony_file_queue_move_to_head (directory->details->high_priority_queue,
+                                   file);
+    peony_file_queue_move_to_head (directory->details->low_priority_queue,
+                                   file);
+    peony_file_queue_move_to_head (directory->details->extension_queue,
+                                   file);
+}
+
 
 static void
 move_file_to_low_priority_queue (PeonyDirectory *directory,
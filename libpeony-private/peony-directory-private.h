@@ -43,6 +43,7 @@ typedef struct MimeListState MimeListState;
 typedef struct ThumbnailState ThumbnailState;
 typedef struct MountState MountState;
 typedef struct FilesystemInfoState FilesystemInfoState;
+typedef struct ExtensionInfoBatch ExtensionInfoBatch;
 
 typedef enum
 {
@@ -109,20 +110,20 @@ struct PeonyDirectoryDetails
 
     GList *new_files_in_progress; /* list of NewFilesState * */
 
-    DirectoryCountState *count_in_progress;
+    GList *count_in_progress; /* list of DirectoryCountState * */
 
     PeonyFile *deep_count_file;
     DeepCountState *deep_count_in_progress;
 
     MimeListState *mime_list_in_progress;
 
-    PeonyFile *get_info_file;
-    GetInfoState *get_info_in_progress;
+    GList *get_info_in_progress; /* list of GetInfoState * */
 
     PeonyFile *extension_info_file;
     PeonyInfoProvider *extension_info_provider;
     PeonyOperationHandle *extension_info_in_progress;
     guint extension_info_idle;
+    ExtensionInfoBatch *extension_info_batch;
 
     ThumbnailState *thumbnail_state;
 
@@ -132,7 +133,11 @@ struct PeonyDirectoryDetails
 
     TopLeftTextReadState *top_left_read_state;
 
-    LinkInfoReadState *link_info_read_state;
+    GList *link_info_in_progress; /* list of LinkInfoReadState * */
+
+    /* Running average of request round trips, for the request window */
+    gint64 request_latency;
+    gboolean request_latency_known;
 
     GList *file_operations_in_progress; /* list of FileOperation * */
 
@@ -200,6 +205,8 @@ void               peony_directory_emit_change_signals             (PeonyDirecto
         GList                     *changed_files);
 void               emit_change_signals_for_all_files		      (PeonyDirectory	 *directory);
 void               emit_change_signals_for_all_files_in_all_directories (void);
+/* Returns a list of referenced directories, free with peony_directory_list_free */
+GList *            peony_directory_list_all                        (void);
 void               peony_directory_emit_done_loading               (PeonyDirectory         *directory);
 void               peony_directory_emit_load_error                 (PeonyDirectory         *directory,
         GError                    *error);
@@ -236,6 +243,8 @@ void               peony_directory_add_file_to_work_queue          (PeonyDirecto
         PeonyFile *file);
 void               peony_directory_remove_file_from_work_queue     (PeonyDirectory *directory,
         PeonyFile *file);
+void               peony_directory_prioritize_file_in_work_queue   (PeonyDirectory *directory,
+        PeonyFile *file);
 
 /* KDE compatibility hacks */
 
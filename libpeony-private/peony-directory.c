@@ -292,6 +292,22 @@ emit_change_signals_for_all_files_in_all_directories (void)
     g_list_free (dirs);
 }
 
+GList *
+peony_directory_list_all (void)
+{
+    GList *dirs;
+
+    dirs = NULL;
+    if (directories != NULL)
+    {
+        g_hash_table_foreach (directories,
+                              collect_all_directories,
+                              &dirs);
+    }
+
+    return dirs;
+}
+
 static void
 async_state_changed_one (gpointer key, gpointer value, gpointer user_data)
 {
@@ -172,11 +172,13 @@ peony_extensions_get_for_type (GType type)
     GList *l;
     GList *ret = NULL;
 
+    peony_module_load_for_type (type);
+
     for (l = peony_extensions; l != NULL; l = l->next)
     {
         Extension *ext = l->data;
         ext->state = peony_extension_get_state (ext->filename);
-        if (ext->state) // only load enabled extensions
+        if (ext->state && ext->module != NULL) // only load enabled extensions
         {
             if (G_TYPE_CHECK_INSTANCE_TYPE (G_OBJECT (ext->module), type))
             {
@@ -192,6 +194,8 @@ peony_extensions_get_for_type (GType type)
 GList *
 peony_extensions_get_list (void)
 {
+    peony_module_setup ();
+
     return peony_extensions;
 }
 
@@ -201,15 +205,33 @@ peony_extension_register (gchar *filename, GObject *module)
     gboolean ext_state = TRUE; // new extensions are enabled by default.
     gboolean ext_python = FALSE;
     gchar *ext_filename;
+    Extension *ext;
+    GList *l;
 
     ext_filename = g_strndup (filename, strlen(filename) - 3);
+
+    /* Libraries known from the manifest are listed before they are
+     * opened, fill in the entry once they are.
+     */
+    for (l = peony_extensions; l != NULL; l = l->next)
+    {
+        ext = l->data;
+        if (ext->module == NULL && module != NULL &&
+            g_strcmp0 (ext->filename, ext_filename) == 0)
+        {
+            ext->module = module;
+            g_free (ext_filename);
+            return;
+        }
+    }
+
     ext_state = peony_extension_get_state (ext_filename);
 
     if (g_str_has_suffix (filename, ".py")) {
         ext_python = TRUE;
     }
 
-    Extension *ext = extension_new (ext_filename, ext_state, ext_python, module);
+    ext = extension_new (ext_filename, ext_state, ext_python, module);
     peony_extensions = g_list_append (peony_extensions, ext);
 }
 
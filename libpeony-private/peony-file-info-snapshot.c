@@ -0,0 +1,376 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4; tab-width: 8 -*- */
+
+/*
+   peony-file-info-snapshot.c: A copy of what extensions can read about
+   a file, for info providers running on a worker thread.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include <config.h>
+#include "peony-file-info-snapshot.h"
+
+#include <libpeony-extension/peony-file-info.h>
+
+typedef struct
+{
+    char *attribute_name; /* NULL for an emblem */
+    char *value;
+} SnapshotAddition;
+
+struct PeonyFileInfoSnapshotDetails
+{
+    /* Only touched on the main thread */
+    PeonyFile *file;
+
+    /* Set once in _new (), read-only after that */
+    gboolean is_gone;
+    char *name;
+    char *uri;
+    char *parent_uri;
+    char *uri_scheme;
+    char *mime_type;
+    char *activation_uri;
+    gboolean is_directory;
+    gboolean can_write;
+    GFileType file_type;
+    GFile *location;
+    GFile *parent_location;
+    GMount *mount;
+
+    /* What the provider added, protected by lock */
+    GMutex lock;
+    GList *additions; /* of SnapshotAddition, most recent first */
+    gboolean invalidated;
+};
+
+static void peony_file_info_snapshot_iface_init (PeonyFileInfoIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (PeonyFileInfoSnapshot, peony_file_info_snapshot, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (PEONY_TYPE_FILE_INFO,
+                                 peony_file_info_snapshot_iface_init));
+
+static void
+snapshot_addition_free (SnapshotAddition *addition)
+{
+    g_free (addition->attribute_name);
+    g_free (addition->value);
+    g_free (addition);
+}
+
+PeonyFileInfoSnapshot *
+peony_file_info_snapshot_new (PeonyFile *file)
+{
+    PeonyFileInfoSnapshot *snapshot;
+    PeonyFileInfoSnapshotDetails *details;
+    PeonyFileInfo *info;
+
+    g_return_val_if_fail (PEONY_IS_FILE (file), NULL);
+
+    snapshot = g_object_new (PEONY_TYPE_FILE_INFO_SNAPSHOT, NULL);
+    details = snapshot->details;
+    info = PEONY_FILE_INFO (file);
+
+    details->file = peony_file_ref (file);
+    details->is_gone = peony_file_info_is_gone (info);
+    details->name = peony_file_info_get_name (info);
+    details->uri = peony_file_info_get_uri (info);
+    details->parent_uri = peony_file_info_get_parent_uri (info);
+    details->uri_scheme = peony_file_info_get_uri_scheme (info);
+    details->mime_type = peony_file_info_get_mime_type (info);
+    details->activation_uri = peony_file_info_get_activation_uri (info);
+    details->is_directory = peony_file_info_is_directory (info);
+    details->can_write = peony_file_info_can_write (info);
+    details->file_type = peony_file_info_get_file_type (info);
+    details->location = peony_file_info_get_location (info);
+    details->parent_location = peony_file_info_get_parent_location (info);
+    details->mount = peony_file_info_get_mount (info);
+
+    return snapshot;
+}
+
+PeonyFile *
+peony_file_info_snapshot_get_file (PeonyFileInfoSnapshot *snapshot)
+{
+    g_return_val_if_fail (PEONY_IS_FILE_INFO_SNAPSHOT (snapshot), NULL);
+
+    return snapshot->details->file;
+}
+
+void
+peony_file_info_snapshot_apply (PeonyFileInfoSnapshot *snapshot)
+{
+    PeonyFileInfo *info;
+    SnapshotAddition *addition;
+    GList *additions, *node;
+    gboolean invalidated;
+
+    g_return_if_fail (PEONY_IS_FILE_INFO_SNAPSHOT (snapshot));
+
+    g_mutex_lock (&snapshot->details->lock);
+    additions = g_list_reverse (snapshot->details->additions);
+    snapshot->details->additions = NULL;
+    invalidated = snapshot->details->invalidated;
+    snapshot->details->invalidated = FALSE;
+    g_mutex_unlock (&snapshot->details->lock);
+
+    info = PEONY_FILE_INFO (snapshot->details->file);
+    for (node = additions; node != NULL; node = node->next)
+    {
+        addition = node->data;
+        if (addition->attribute_name == NULL)
+        {
+            peony_file_info_add_emblem (info, addition->value);
+        }
+        else
+        {
+            peony_file_info_add_string_attribute (info,
+                                                  addition->attribute_name,
+                                                  addition->value);
+        }
+    }
+    g_list_free_full (additions, (GDestroyNotify) snapshot_addition_free);
+
+    if (invalidated)
+    {
+        peony_file_info_invalidate_extension_info (info);
+    }
+}
+
+static void
+snapshot_add (PeonyFileInfoSnapshot *snapshot,
+              const char *attribute_name,
+              const char *value)
+{
+    SnapshotAddition *addition;
+
+    addition = g_new0 (SnapshotAddition, 1);
+    addition->attribute_name = g_strdup (attribute_name);
+    addition->value = g_strdup (value);
+
+    g_mutex_lock (&snapshot->details->lock);
+    snapshot->details->additions = g_list_prepend (snapshot->details->additions, addition);
+    g_mutex_unlock (&snapshot->details->lock);
+}
+
+static gboolean
+snapshot_is_gone (PeonyFileInfo *info)
+{
+    return PEONY_FILE_INFO_SNAPSHOT (info)->details->is_gone;
+}
+
+static char *
+snapshot_get_name (PeonyFileInfo *info)
+{
+    return g_strdup (PEONY_FILE_INFO_SNAPSHOT (info)->details->name);
+}
+
+static char *
+snapshot_get_uri (PeonyFileInfo *info)
+{
+    return g_strdup (PEONY_FILE_INFO_SNAPSHOT (info)->details->uri);
+}
+
+static char *
+snapshot_get_parent_uri (PeonyFileInfo *info)
+{
+    return g_strdup (PEONY_FILE_INFO_SNAPSHOT (info)->details->parent_uri);
+}
+
+static char *
+snapshot_get_uri_scheme (PeonyFileInfo *info)
+{
+    return g_strdup (PEONY_FILE_INFO_SNAPSHOT (info)->details->uri_scheme);
+}
+
+static char *
+snapshot_get_mime_type (PeonyFileInfo *info)
+{
+    return g_strdup (PEONY_FILE_INFO_SNAPSHOT (info)->details->mime_type);
+}
+
+static gboolean
+snapshot_is_mime_type (PeonyFileInfo *info,
+                       const char *mime_type)
+{
+    const char *own_mime_type;
+
+    own_mime_type = PEONY_FILE_INFO_SNAPSHOT (info)->details->mime_type;
+    if (own_mime_type == NULL)
+    {
+        return FALSE;
+    }
+
+    return g_content_type_is_a (own_mime_type, mime_type);
+}
+
+static gboolean
+snapshot_is_directory (PeonyFileInfo *info)
+{
+    return PEONY_FILE_INFO_SNAPSHOT (info)->details->is_directory;
+}
+
+static void
+snapshot_add_emblem (PeonyFileInfo *info,
+                     const char *emblem_name)
+{
+    snapshot_add (PEONY_FILE_INFO_SNAPSHOT (info), NULL, emblem_name);
+}
+
+static char *
+snapshot_get_string_attribute (PeonyFileInfo *info,
+                               const char *attribute_name)
+{
+    return NULL;
+}
+
+static void
+snapshot_add_string_attribute (PeonyFileInfo *info,
+                               const char *attribute_name,
+                               const char *value)
+{
+    snapshot_add (PEONY_FILE_INFO_SNAPSHOT (info), attribute_name, value);
+}
+
+static void
+snapshot_invalidate_extension_info (PeonyFileInfo *info)
+{
+    PeonyFileInfoSnapshot *snapshot;
+
+    snapshot = PEONY_FILE_INFO_SNAPSHOT (info);
+
+    g_mutex_lock (&snapshot->details->lock);
+    snapshot->details->invalidated = TRUE;
+    g_mutex_unlock (&snapshot->details->lock);
+}
+
+static char *
+snapshot_get_activation_uri (PeonyFileInfo *info)
+{
+    return g_strdup (PEONY_FILE_INFO_SNAPSHOT (info)->details->activation_uri);
+}
+
+static GFileType
+snapshot_get_file_type (PeonyFileInfo *info)
+{
+    return PEONY_FILE_INFO_SNAPSHOT (info)->details->file_type;
+}
+
+static GFile *
+snapshot_get_location (PeonyFileInfo *info)
+{
+    GFile *location;
+
+    location = PEONY_FILE_INFO_SNAPSHOT (info)->details->location;
+
+    return location != NULL ? g_object_ref (location) : NULL;
+}
+
+static GFile *
+snapshot_get_parent_location (PeonyFileInfo *info)
+{
+    GFile *location;
+
+    location = PEONY_FILE_INFO_SNAPSHOT (info)->details->parent_location;
+
+    return location != NULL ? g_object_ref (location) : NULL;
+}
+
+static PeonyFileInfo *
+snapshot_get_parent_info (PeonyFileInfo *info)
+{
+    return NULL;
+}
+
+static GMount *
+snapshot_get_mount (PeonyFileInfo *info)
+{
+    GMount *mount;
+
+    mount = PEONY_FILE_INFO_SNAPSHOT (info)->details->mount;
+
+    return mount != NULL ? g_object_ref (mount) : NULL;
+}
+
+static gboolean
+snapshot_can_write (PeonyFileInfo *info)
+{
+    return PEONY_FILE_INFO_SNAPSHOT (info)->details->can_write;
+}
+
+static void
+peony_file_info_snapshot_finalize (GObject *object)
+{
+    PeonyFileInfoSnapshotDetails *details;
+
+    details = PEONY_FILE_INFO_SNAPSHOT (object)->details;
+
+    peony_file_unref (details->file);
+    g_free (details->name);
+    g_free (details->uri);
+    g_free (details->parent_uri);
+    g_free (details->uri_scheme);
+    g_free (details->mime_type);
+    g_free (details->activation_uri);
+    g_clear_object (&details->location);
+    g_clear_object (&details->parent_location);
+    g_clear_object (&details->mount);
+    g_list_free_full (details->additions, (GDestroyNotify) snapshot_addition_free);
+    g_mutex_clear (&details->lock);
+
+    G_OBJECT_CLASS (peony_file_info_snapshot_parent_class)->finalize (object);
+}
+
+static void
+peony_file_info_snapshot_iface_init (PeonyFileInfoIface *iface)
+{
+    iface->is_gone = snapshot_is_gone;
+    iface->get_name = snapshot_get_name;
+    iface->get_uri = snapshot_get_uri;
+    iface->get_parent_uri = snapshot_get_parent_uri;
+    iface->get_uri_scheme = snapshot_get_uri_scheme;
+    iface->get_mime_type = snapshot_get_mime_type;
+    iface->is_mime_type = snapshot_is_mime_type;
+    iface->is_directory = snapshot_is_directory;
+    iface->add_emblem = snapshot_add_emblem;
+    iface->get_string_attribute = snapshot_get_string_attribute;
+    iface->add_string_attribute = snapshot_add_string_attribute;
+    iface->invalidate_extension_info = snapshot_invalidate_extension_info;
+    iface->get_activation_uri = snapshot_get_activation_uri;
+    iface->get_file_type = snapshot_get_file_type;
+    iface->get_location = snapshot_get_location;
+    iface->get_parent_location = snapshot_get_parent_location;
+    iface->get_parent_info = snapshot_get_parent_info;
+    iface->get_mount = snapshot_get_mount;
+    iface->can_write = snapshot_can_write;
+}
+
+static void
+peony_file_info_snapshot_class_init (PeonyFileInfoSnapshotClass *klass)
+{
+    G_OBJECT_CLASS (klass)->finalize = peony_file_info_snapshot_finalize;
+
+    g_type_class_add_private (klass, sizeof (PeonyFileInfoSnapshotDetails));
+}
+
+static void
+peony_file_info_snapshot_init (PeonyFileInfoSnapshot *snapshot)
+{
+    snapshot->details = G_TYPE_INSTANCE_GET_PRIVATE (snapshot,
+                        PEONY_TYPE_FILE_INFO_SNAPSHOT,
+                        PeonyFileInfoSnapshotDetails);
+    g_mutex_init (&snapshot->details->lock);
+}
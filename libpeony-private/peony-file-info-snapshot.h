@@ -0,0 +1,65 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4; tab-width: 8 -*- */
+
+/*
+   peony-file-info-snapshot.h: A copy of what extensions can read about
+   a file, for info providers running on a worker thread.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef PEONY_FILE_INFO_SNAPSHOT_H
+#define PEONY_FILE_INFO_SNAPSHOT_H
+
+#include <libpeony-private/peony-file.h>
+
+/* PeonyFile may only be used on the main thread. A snapshot is taken
+ * there and answers the PeonyFileInfo getters from its copy on any
+ * thread. Emblems and attributes added to it are kept until they are
+ * applied to the file, again on the main thread.
+ *
+ * A snapshot has no string attributes and no parent info, those
+ * getters return NULL.
+ */
+
+typedef struct PeonyFileInfoSnapshot PeonyFileInfoSnapshot;
+typedef struct PeonyFileInfoSnapshotClass PeonyFileInfoSnapshotClass;
+typedef struct PeonyFileInfoSnapshotDetails PeonyFileInfoSnapshotDetails;
+
+#define PEONY_TYPE_FILE_INFO_SNAPSHOT peony_file_info_snapshot_get_type()
+#define PEONY_FILE_INFO_SNAPSHOT(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), PEONY_TYPE_FILE_INFO_SNAPSHOT, PeonyFileInfoSnapshot))
+#define PEONY_IS_FILE_INFO_SNAPSHOT(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), PEONY_TYPE_FILE_INFO_SNAPSHOT))
+
+struct PeonyFileInfoSnapshot
+{
+    GObject object;
+    PeonyFileInfoSnapshotDetails *details;
+};
+
+struct PeonyFileInfoSnapshotClass
+{
+    GObjectClass parent_class;
+};
+
+GType                  peony_file_info_snapshot_get_type  (void);
+
+/* Main thread only, as is dropping the last reference */
+PeonyFileInfoSnapshot *peony_file_info_snapshot_new       (PeonyFile             *file);
+PeonyFile             *peony_file_info_snapshot_get_file  (PeonyFileInfoSnapshot *snapshot);
+void                   peony_file_info_snapshot_apply     (PeonyFileInfoSnapshot *snapshot);
+
+#endif /* PEONY_FILE_INFO_SNAPSHOT_H */
@@ -30,13 +30,17 @@
 
 #include <config.h>
 #include <string.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <locale.h>
 #include <math.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <dirent.h>
 
 #include "peony-file-operations.h"
 
@@ -45,6 +49,7 @@
 #include "peony-lib-self-check-functions.h"
 
 #include "peony-progress-info.h"
+#include "peony-trace.h"
 
 #include <eel/eel-glib-extensions.h>
 #include <eel/eel-gtk-extensions.h>
@@ -56,6 +61,7 @@
 #include <gdk/gdk.h>
 #include <gtk/gtk.h>
 #include <gio/gio.h>
+#include <gio/gunixmounts.h>
 #include <glib.h>
 #include <libnotify/notify.h>
 #include "peony-file-changes-queue.h"
@@ -88,6 +94,7 @@ typedef struct {
 	gboolean replace_all;
 	gboolean delete_all;
 	PeonyUndoStackActionData* undo_redo_data;
+	gint64 trace_begin;
 } CommonJob;
 
 typedef struct {
@@ -132,6 +139,7 @@ typedef struct {
 typedef struct {
 	CommonJob common;
 	GList *trash_dirs;
+	GList *staged_roots;
 	gboolean should_confirm;
 	PeonyOpCallback done_callback;
 	gpointer done_callback_data;
@@ -154,6 +162,14 @@ typedef struct {
 	guint32 file_mask;
 	guint32 dir_permissions;
 	guint32 dir_mask;
+
+	/* Directories are walked in parallel by the pool */
+	GThreadPool *pool;
+	GMutex lock;
+	GCond done_cond;
+	int pending_dirs; /* protected by lock */
+	volatile gint files_examined;
+	volatile gint files_changed;
 } SetPermissionsJob;
 
 typedef enum {
@@ -183,6 +199,16 @@ typedef struct {
 
 #define MAXIMUM_DISPLAYED_FILE_NAME_LENGTH 50
 
+/* Directories handled at once by a recursive permission change */
+#define SET_PERMISSIONS_MAX_THREADS 8
+#define SET_PERMISSIONS_PROGRESS_INTERVAL (100 * G_TIME_SPAN_MILLISECOND)
+
+/* Subtrees removed at once by the local delete fast path */
+#define DELETE_LOCAL_MAX_THREADS 8
+
+/* Filesystems trashed to at once by the local trash fast path */
+#define TRASH_LOCAL_MAX_THREADS 8
+
 #define IS_IO_ERROR(__error, KIND) (((__error)->domain == G_IO_ERROR && (__error)->code == G_IO_ERROR_ ## KIND))
 
 #define SKIP _("_Skip")
@@ -966,6 +992,7 @@ init_common (gsize job_size,
 	common->time = g_timer_new ();
 	common->inhibit_cookie = -1;
 	common->screen_num = 0;
+	common->trace_begin = PEONY_TRACE_BEGIN ();
 	if (parent_window) {
 		screen = gtk_widget_get_screen (GTK_WIDGET (parent_window));
 		common->screen_num = gdk_screen_get_number (screen);
@@ -998,6 +1025,8 @@ finalize_common (CommonJob *common)
 	// End UNDO-REDO
 	g_object_unref (common->progress);
 	g_object_unref (common->cancellable);
+
+	PEONY_TRACE_END (PEONY_TRACE_CATEGORY_FILE_OPS, "job", common->trace_begin);
 	g_free (common);
 }
 
@@ -1546,6 +1575,265 @@ report_delete_progress (CommonJob *job,
 	}
 }
 
+/* A directory fd shared by the work items for its subdirectories,
+ * which open them with openat() relative to it. Going through the
+ * parent's fd rather than a full path means a directory swapped for a
+ * symlink anywhere up the tree can't lead a walk out of it.
+ */
+typedef struct {
+	int fd;
+	volatile gint ref_count;
+} LocalDirFd;
+
+static LocalDirFd *
+local_dir_fd_new (int fd)
+{
+	LocalDirFd *dir_fd;
+
+	dir_fd = g_slice_new (LocalDirFd);
+	dir_fd->fd = fd;
+	dir_fd->ref_count = 1;
+
+	return dir_fd;
+}
+
+static LocalDirFd *
+local_dir_fd_ref (LocalDirFd *dir_fd)
+{
+	g_atomic_int_inc (&dir_fd->ref_count);
+	return dir_fd;
+}
+
+static void
+local_dir_fd_unref (LocalDirFd *dir_fd)
+{
+	if (dir_fd != NULL && g_atomic_int_dec_and_test (&dir_fd->ref_count)) {
+		close (dir_fd->fd);
+		g_slice_free (LocalDirFd, dir_fd);
+	}
+}
+
+/* Opens a directory for reading without following a symlink, relative
+ * to parent_fd, or as a path when there is none.
+ */
+static int
+local_dir_open (LocalDirFd *parent_fd,
+		const char *name)
+{
+	return openat (parent_fd != NULL ? parent_fd->fd : AT_FDCWD, name,
+		       O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+}
+
+/* Fast path for deleting the contents of local folders: every folder
+ * is read and emptied relative to its fd on a pool thread, and removed
+ * once its last subfolder is gone. Anything that can't be removed is
+ * left in place for the GIO based code below, which reports it.
+ */
+typedef struct DeleteLocalDir DeleteLocalDir;
+
+typedef struct {
+	CommonJob *job;
+	GThreadPool *pool;
+	GMutex lock;
+	GCond done_cond;
+	gboolean done; /* protected by lock */
+	volatile gint num_files;
+} DeleteLocalContext;
+
+struct DeleteLocalDir {
+	DeleteLocalDir *parent;
+	/* The parent's fd and the name in it, NULL and the path for the
+	 * toplevel folder. The path is only used to report the removal. */
+	LocalDirFd *parent_fd;
+	char *name;
+	char *path;
+	int depth;
+	volatile gint pending; /* own scan + subfolders not yet removed */
+	volatile gint failed;
+};
+
+/* Deeper folders first, which also removes them sooner */
+static gint
+delete_local_dir_compare (gconstpointer a,
+			  gconstpointer b,
+			  gpointer user_data)
+{
+	const DeleteLocalDir *dir_a = a;
+	const DeleteLocalDir *dir_b = b;
+
+	return dir_b->depth - dir_a->depth;
+}
+
+static void
+delete_local_dir_release (DeleteLocalContext *context,
+			  DeleteLocalDir *dir)
+{
+	DeleteLocalDir *parent;
+	GFile *file;
+
+	while (dir != NULL && g_atomic_int_dec_and_test (&dir->pending)) {
+		parent = dir->parent;
+
+		if (parent == NULL) {
+			/* The toplevel folder itself is removed by the caller */
+			g_mutex_lock (&context->lock);
+			context->done = TRUE;
+			g_cond_signal (&context->done_cond);
+			g_mutex_unlock (&context->lock);
+		} else if (g_atomic_int_get (&dir->failed) ||
+			   unlinkat (dir->parent_fd->fd, dir->name, AT_REMOVEDIR) != 0) {
+			g_atomic_int_set (&parent->failed, TRUE);
+		} else {
+			file = g_file_new_for_path (dir->path);
+			peony_file_changes_queue_file_removed (file);
+			g_object_unref (file);
+			g_atomic_int_inc (&context->num_files);
+		}
+
+		local_dir_fd_unref (dir->parent_fd);
+		g_free (dir->name);
+		g_free (dir->path);
+		g_slice_free (DeleteLocalDir, dir);
+		dir = parent;
+	}
+}
+
+static void
+delete_local_dir_thread (gpointer data,
+			 gpointer user_data)
+{
+	DeleteLocalContext *context;
+	DeleteLocalDir *dir, *child;
+	struct dirent *dirent;
+	struct stat statbuf;
+	LocalDirFd *shared_fd;
+	gboolean is_dir;
+	DIR *dirp;
+	int dir_fd;
+	char *path;
+	GFile *file;
+
+	context = user_data;
+	dir = data;
+
+	peony_progress_info_get_ready (context->job->progress);
+
+	shared_fd = NULL;
+	dirp = NULL;
+	if (!job_aborted (context->job)) {
+		dir_fd = local_dir_open (dir->parent_fd,
+					 dir->parent_fd != NULL ? dir->name : dir->path);
+		if (dir_fd >= 0) {
+			/* readdir() needs its own fd, subfolders share the other one */
+			shared_fd = local_dir_fd_new (dir_fd);
+			dir_fd = dup (dir_fd);
+			dirp = dir_fd >= 0 ? fdopendir (dir_fd) : NULL;
+			if (dirp == NULL && dir_fd >= 0) {
+				close (dir_fd);
+			}
+		}
+	}
+	if (dirp == NULL) {
+		local_dir_fd_unref (shared_fd);
+		g_atomic_int_set (&dir->failed, TRUE);
+		delete_local_dir_release (context, dir);
+		return;
+	}
+
+	while ((dirent = readdir (dirp)) != NULL) {
+		if (job_aborted (context->job)) {
+			g_atomic_int_set (&dir->failed, TRUE);
+			break;
+		}
+
+		if (strcmp (dirent->d_name, ".") == 0 ||
+		    strcmp (dirent->d_name, "..") == 0) {
+			continue;
+		}
+
+		if (dirent->d_type != DT_UNKNOWN) {
+			is_dir = dirent->d_type == DT_DIR;
+		} else if (fstatat (dir_fd, dirent->d_name, &statbuf, AT_SYMLINK_NOFOLLOW) == 0) {
+			is_dir = S_ISDIR (statbuf.st_mode);
+		} else {
+			g_atomic_int_set (&dir->failed, TRUE);
+			continue;
+		}
+
+		if (is_dir) {
+			child = g_slice_new0 (DeleteLocalDir);
+			child->parent = dir;
+			child->parent_fd = local_dir_fd_ref (shared_fd);
+			child->name = g_strdup (dirent->d_name);
+			child->path = g_build_filename (dir->path, dirent->d_name, NULL);
+			child->depth = dir->depth + 1;
+			child->pending = 1;
+			g_atomic_int_inc (&dir->pending);
+			g_thread_pool_push (context->pool, child, NULL);
+		} else if (unlinkat (dir_fd, dirent->d_name, 0) == 0) {
+			path = g_build_filename (dir->path, dirent->d_name, NULL);
+			file = g_file_new_for_path (path);
+			peony_file_changes_queue_file_removed (file);
+			g_object_unref (file);
+			g_free (path);
+			g_atomic_int_inc (&context->num_files);
+		} else {
+			g_atomic_int_set (&dir->failed, TRUE);
+		}
+	}
+
+	closedir (dirp);
+	local_dir_fd_unref (shared_fd);
+	delete_local_dir_release (context, dir);
+}
+
+static void
+delete_local_dir_contents (CommonJob *job,
+			   const char *path,
+			   SourceInfo *source_info,
+			   TransferInfo *transfer_info)
+{
+	DeleteLocalContext context;
+	DeleteLocalDir *root;
+	int base_num_files;
+	gint64 end_time;
+
+	context.job = job;
+	context.done = FALSE;
+	context.num_files = 0;
+	g_mutex_init (&context.lock);
+	g_cond_init (&context.done_cond);
+	context.pool = g_thread_pool_new (delete_local_dir_thread, &context,
+					  DELETE_LOCAL_MAX_THREADS, FALSE, NULL);
+	g_thread_pool_set_sort_function (context.pool, delete_local_dir_compare, NULL);
+
+	root = g_slice_new0 (DeleteLocalDir);
+	root->path = g_strdup (path);
+	root->pending = 1;
+	g_thread_pool_push (context.pool, root, NULL);
+
+	base_num_files = transfer_info->num_files;
+
+	g_mutex_lock (&context.lock);
+	while (!context.done) {
+		end_time = g_get_monotonic_time () + 100 * G_TIME_SPAN_MILLISECOND;
+		if (!g_cond_wait_until (&context.done_cond, &context.lock, end_time)) {
+			g_mutex_unlock (&context.lock);
+			transfer_info->num_files = base_num_files + g_atomic_int_get (&context.num_files);
+			report_delete_progress (job, source_info, transfer_info);
+			g_mutex_lock (&context.lock);
+		}
+	}
+	g_mutex_unlock (&context.lock);
+
+	g_thread_pool_free (context.pool, FALSE, TRUE);
+	g_mutex_clear (&context.lock);
+	g_cond_clear (&context.done_cond);
+
+	transfer_info->num_files = base_num_files + g_atomic_int_get (&context.num_files);
+	report_delete_progress (job, source_info, transfer_info);
+}
+
 static void delete_file (CommonJob *job, GFile *file,
 			 gboolean *skipped_file,
 			 SourceInfo *source_info,
@@ -1567,9 +1855,26 @@ delete_dir (CommonJob *job, GFile *dir,
 	int response;
 	gboolean skip_error;
 	gboolean local_skipped_file;
+	char *path;
 
 	local_skipped_file = FALSE;
 
+	/* Files the user chose to skip while scanning must survive, so
+	 * only take the fast path if there are none. Subfolders only get
+	 * here when the fast path left something behind, the regular path
+	 * below then deals with what is left and reports the errors.
+	 */
+	if (toplevel &&
+	    g_file_is_native (dir) &&
+	    !job_aborted (job) &&
+	    (job->skip_files == NULL || g_hash_table_size (job->skip_files) == 0)) {
+		path = g_file_get_path (dir);
+		if (path != NULL) {
+			delete_local_dir_contents (job, path, source_info, transfer_info);
+		}
+		g_free (path);
+	}
+
 	skip_error = should_skip_readdir_error (job, dir);
  retry:
 	error = NULL;
@@ -1840,12 +2145,399 @@ report_trash_progress (CommonJob *job,
 }
 
 
+/* Fast path for trashing many local files: the trash directory of each
+ * filesystem is looked up once, and every filesystem's files are moved
+ * there in a tight loop on a thread of its own, following the trash
+ * specification like g_file_trash() does. Whatever this can't trash is
+ * handed back to the g_file_trash() loop, which reports the errors.
+ */
+typedef struct {
+	GFile *file;
+	char *path;
+	guint64 mtime;
+	gboolean trashed;
+} TrashLocalItem;
+
+typedef struct {
+	dev_t dev;
+	char *topdir; /* NULL for the home trash */
+	gboolean system_internal;
+	GList *items;
+} TrashLocalMount;
+
+typedef struct {
+	CommonJob *job;
+	char *delete_time;
+	GMutex lock;
+	GCond done_cond;
+	int running; /* protected by lock */
+	volatile gint num_trashed;
+} TrashLocalContext;
+
+static char *
+find_local_topdir (const char *path, dev_t dev)
+{
+	struct stat statbuf;
+	char *dir, *parent;
+
+	/* Start at path itself, which may be a mount point */
+	dir = g_strdup (path);
+	while (strcmp (dir, "/") != 0) {
+		parent = g_path_get_dirname (dir);
+		if (lstat (parent, &statbuf) != 0 || statbuf.st_dev != dev) {
+			g_free (parent);
+			break;
+		}
+		g_free (dir);
+		dir = parent;
+	}
+
+	return dir;
+}
+
+/* Like g_file_trash(), which refuses to trash on mounts like /tmp or
+ * /dev/shm, where no trash listing would ever find the files.
+ */
+static gboolean
+local_topdir_is_system_internal (const char *topdir)
+{
+	GUnixMountEntry *entry;
+	gboolean internal;
+
+	entry = g_unix_mount_at (topdir, NULL);
+	if (entry == NULL) {
+		return TRUE;
+	}
+
+	internal = g_unix_mount_is_system_internal (entry);
+	g_unix_mount_free (entry);
+
+	return internal;
+}
+
+/* Returns the trash directory to use for the files on mount, creating
+ * it if needed, the same way GIO picks it.
+ */
+static char *
+get_local_trash_dir (TrashLocalMount *mount)
+{
+	struct stat statbuf;
+	char *trash_dir, *admin_dir, *uid, *files, *info;
+
+	if (mount->topdir == NULL) {
+		trash_dir = g_build_filename (g_get_user_data_dir (), "Trash", NULL);
+	} else {
+		uid = g_strdup_printf ("%d", getuid ());
+		trash_dir = NULL;
+
+		/* An admin created, sticky .Trash directory is preferred */
+		admin_dir = g_build_filename (mount->topdir, ".Trash", NULL);
+		if (lstat (admin_dir, &statbuf) == 0 &&
+		    S_ISDIR (statbuf.st_mode) &&
+		    (statbuf.st_mode & S_ISVTX) != 0) {
+			trash_dir = g_build_filename (admin_dir, uid, NULL);
+			if (g_mkdir (trash_dir, 0700) != 0 && errno != EEXIST) {
+				g_free (trash_dir);
+				trash_dir = NULL;
+			}
+		}
+		g_free (admin_dir);
+
+		if (trash_dir == NULL) {
+			trash_dir = g_strconcat (mount->topdir, "/.Trash-", uid, NULL);
+			g_mkdir (trash_dir, 0700);
+		}
+		g_free (uid);
+
+		/* Never follow someone else's directory or link */
+		if (lstat (trash_dir, &statbuf) != 0 ||
+		    !S_ISDIR (statbuf.st_mode) ||
+		    statbuf.st_uid != getuid () ||
+		    statbuf.st_dev != mount->dev) {
+			g_free (trash_dir);
+			return NULL;
+		}
+	}
+
+	files = g_build_filename (trash_dir, "files", NULL);
+	info = g_build_filename (trash_dir, "info", NULL);
+	if (g_mkdir_with_parents (files, 0700) != 0 ||
+	    g_mkdir_with_parents (info, 0700) != 0) {
+		g_free (trash_dir);
+		trash_dir = NULL;
+	}
+	g_free (files);
+	g_free (info);
+
+	return trash_dir;
+}
+
+static gboolean
+trash_local_item (TrashLocalContext *context,
+		  TrashLocalMount *mount,
+		  TrashLocalItem *item,
+		  int files_fd,
+		  int info_fd)
+{
+	char *basename, *trash_name, *info_name, *original_name, *escaped, *data;
+	gboolean res;
+	int fd, i;
+
+	basename = g_path_get_basename (item->path);
+
+	fd = -1;
+	trash_name = NULL;
+	info_name = NULL;
+	for (i = 1; fd < 0; i++) {
+		g_free (trash_name);
+		g_free (info_name);
+		trash_name = i == 1 ? g_strdup (basename) : g_strdup_printf ("%s.%d", basename, i);
+		info_name = g_strconcat (trash_name, ".trashinfo", NULL);
+
+		fd = openat (info_fd, info_name, O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0666);
+		if (fd < 0 && errno != EEXIST) {
+			break;
+		}
+	}
+	g_free (basename);
+
+	res = FALSE;
+	if (fd < 0) {
+		goto out;
+	}
+
+	/* Paths are relative to the top of the filesystem, except in the
+	 * home trash.
+	 */
+	if (mount->topdir == NULL) {
+		original_name = item->path;
+	} else if (strcmp (mount->topdir, "/") == 0) {
+		original_name = item->path + 1;
+	} else {
+		original_name = item->path + strlen (mount->topdir) + 1;
+	}
+	escaped = g_uri_escape_string (original_name, "/", FALSE);
+	data = g_strdup_printf ("[Trash Info]\nPath=%s\nDeletionDate=%s\n",
+				escaped, context->delete_time);
+	g_free (escaped);
+
+	res = write (fd, data, strlen (data)) == (gssize) strlen (data);
+	close (fd);
+	g_free (data);
+
+	if (res) {
+		res = renameat (AT_FDCWD, item->path, files_fd, trash_name) == 0;
+	}
+	if (!res) {
+		unlinkat (info_fd, info_name, 0);
+	}
+
+ out:
+	g_free (trash_name);
+	g_free (info_name);
+
+	return res;
+}
+
+static void
+trash_local_mount_thread (gpointer data,
+			  gpointer user_data)
+{
+	TrashLocalContext *context;
+	TrashLocalMount *mount;
+	TrashLocalItem *item;
+	char *trash_dir, *path;
+	int files_fd, info_fd;
+	GList *l;
+
+	context = user_data;
+	mount = data;
+
+	files_fd = info_fd = -1;
+	trash_dir = get_local_trash_dir (mount);
+	if (trash_dir != NULL) {
+		path = g_build_filename (trash_dir, "files", NULL);
+		files_fd = open (path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		g_free (path);
+		path = g_build_filename (trash_dir, "info", NULL);
+		info_fd = open (path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		g_free (path);
+		g_free (trash_dir);
+	}
+
+	if (files_fd >= 0 && info_fd >= 0) {
+		for (l = mount->items; l != NULL && !job_aborted (context->job); l = l->next) {
+			peony_progress_info_get_ready (context->job->progress);
+			if (job_aborted (context->job)) {
+				break;
+			}
+
+			item = l->data;
+			item->trashed = trash_local_item (context, mount, item, files_fd, info_fd);
+			if (item->trashed) {
+				g_atomic_int_inc (&context->num_trashed);
+			}
+		}
+	}
+
+	if (files_fd >= 0) {
+		close (files_fd);
+	}
+	if (info_fd >= 0) {
+		close (info_fd);
+	}
+
+	g_mutex_lock (&context->lock);
+	context->running--;
+	g_cond_signal (&context->done_cond);
+	g_mutex_unlock (&context->lock);
+}
+
+/* Trashes what it can of files and returns the rest, in order. */
+static GList *
+trash_local_files (CommonJob *job,
+		   GList *files,
+		   int *files_trashed,
+		   int total_files)
+{
+	TrashLocalContext context;
+	TrashLocalMount *mount;
+	TrashLocalItem *item;
+	GHashTable *mounts;
+	GHashTableIter iter;
+	GThreadPool *pool;
+	GDateTime *now;
+	struct stat statbuf;
+	dev_t home_dev;
+	gboolean have_home;
+	GList *items, *remaining, *l;
+	gint64 end_time, dev;
+	int base_trashed;
+
+	have_home = lstat (g_get_home_dir (), &statbuf) == 0;
+	home_dev = statbuf.st_dev;
+
+	mounts = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, NULL);
+	items = NULL;
+
+	for (l = files; l != NULL; l = l->next) {
+		item = g_slice_new0 (TrashLocalItem);
+		item->file = l->data;
+		items = g_list_prepend (items, item);
+
+		item->path = g_file_get_path (item->file);
+		if (item->path == NULL || lstat (item->path, &statbuf) != 0) {
+			continue;
+		}
+		/* The same value peony_undostack_manager_get_file_modification_time()
+		 * records in the slow path: the unfollowed mtime in seconds.
+		 */
+		item->mtime = statbuf.st_mtime;
+
+		dev = statbuf.st_dev;
+		mount = g_hash_table_lookup (mounts, &dev);
+		if (mount == NULL) {
+			mount = g_slice_new0 (TrashLocalMount);
+			mount->dev = statbuf.st_dev;
+			if (!have_home || statbuf.st_dev != home_dev) {
+				mount->topdir = find_local_topdir (item->path, statbuf.st_dev);
+				mount->system_internal = local_topdir_is_system_internal (mount->topdir);
+			}
+			g_hash_table_insert (mounts, g_memdup (&dev, sizeof (dev)), mount);
+		}
+
+		/* Left to g_file_trash(), which reports that it can't */
+		if (mount->system_internal) {
+			continue;
+		}
+
+		/* The top of a filesystem can't go to its own trash */
+		if (mount->topdir != NULL && strcmp (item->path, mount->topdir) == 0) {
+			continue;
+		}
+		mount->items = g_list_prepend (mount->items, item);
+	}
+	items = g_list_reverse (items);
+
+	now = g_date_time_new_now_local ();
+	context.job = job;
+	context.delete_time = g_date_time_format (now, "%Y-%m-%dT%H:%M:%S");
+	context.running = 0;
+	context.num_trashed = 0;
+	g_mutex_init (&context.lock);
+	g_cond_init (&context.done_cond);
+	g_date_time_unref (now);
+
+	pool = g_thread_pool_new (trash_local_mount_thread, &context,
+				  TRASH_LOCAL_MAX_THREADS, FALSE, NULL);
+
+	g_mutex_lock (&context.lock);
+	g_hash_table_iter_init (&iter, mounts);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &mount)) {
+		if (mount->items != NULL) {
+			mount->items = g_list_reverse (mount->items);
+			context.running++;
+			g_thread_pool_push (pool, mount, NULL);
+		}
+	}
+
+	base_trashed = *files_trashed;
+
+	while (context.running > 0) {
+		end_time = g_get_monotonic_time () + 100 * G_TIME_SPAN_MILLISECOND;
+		if (!g_cond_wait_until (&context.done_cond, &context.lock, end_time)) {
+			g_mutex_unlock (&context.lock);
+			*files_trashed = base_trashed + g_atomic_int_get (&context.num_trashed);
+			report_trash_progress (job, *files_trashed, total_files);
+			g_mutex_lock (&context.lock);
+		}
+	}
+	g_mutex_unlock (&context.lock);
+
+	g_thread_pool_free (pool, FALSE, TRUE);
+	g_mutex_clear (&context.lock);
+	g_cond_clear (&context.done_cond);
+	g_free (context.delete_time);
+
+	*files_trashed = base_trashed + g_atomic_int_get (&context.num_trashed);
+	report_trash_progress (job, *files_trashed, total_files);
+
+	remaining = NULL;
+	for (l = items; l != NULL; l = l->next) {
+		item = l->data;
+
+		if (item->trashed) {
+			peony_file_changes_queue_file_removed (item->file);
+
+			// Start UNDO-REDO
+			peony_undostack_manager_data_add_trashed_file (job->undo_redo_data, item->file, item->mtime);
+			// End UNDO-REDO
+		} else {
+			remaining = g_list_prepend (remaining, item->file);
+		}
+
+		g_free (item->path);
+		g_slice_free (TrashLocalItem, item);
+	}
+	g_list_free (items);
+
+	g_hash_table_iter_init (&iter, mounts);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &mount)) {
+		g_list_free (mount->items);
+		g_free (mount->topdir);
+		g_slice_free (TrashLocalMount, mount);
+	}
+	g_hash_table_destroy (mounts);
+
+	return g_list_reverse (remaining);
+}
+
 static void
 trash_files (CommonJob *job, GList *files, int *files_skipped)
 {
 	GList *l;
 	GFile *file;
-	GList *to_delete;
+	GList *to_delete, *remaining;
 	GError *error;
 	int total_files, files_trashed;
 	char *primary, *secondary, *details;
@@ -1862,8 +2554,10 @@ trash_files (CommonJob *job, GList *files, int *files_skipped)
 
 	report_trash_progress (job, files_trashed, total_files);
 
+	remaining = trash_local_files (job, files, &files_trashed, total_files);
+
 	to_delete = NULL;
-	for (l = files;
+	for (l = remaining;
 	     l != NULL && !job_aborted (job);
 	     l = l->next) {
         peony_progress_info_get_ready (job->progress);
@@ -1930,6 +2624,8 @@ trash_files (CommonJob *job, GList *files, int *files_skipped)
 		}
 	}
 
+	g_list_free (remaining);
+
 	if (to_delete) {
 		to_delete = g_list_reverse (to_delete);
 		delete_files (job, to_delete, files_skipped);
@@ -1942,8 +2638,10 @@ delete_job_done (gpointer user_data)
 {
 	DeleteJob *job;
 	GHashTable *debuting_uris;
+	gint64 trace_begin;
 
 	job = user_data;
+	trace_begin = PEONY_TRACE_BEGIN ();
 
     	g_list_free_full (job->files, g_object_unref);
 
@@ -1957,6 +2655,7 @@ delete_job_done (gpointer user_data)
 
 	peony_file_changes_consume_changes (TRUE);
 
+	PEONY_TRACE_END (PEONY_TRACE_CATEGORY_FILE_OPS, "finalize", trace_begin);
 	return FALSE;
 }
 
@@ -1976,6 +2675,7 @@ delete_job (GIOSchedulerJob *io_job,
 	gboolean must_confirm_delete;
 	gboolean must_confirm_trash;
 	int files_skipped;
+	gint64 trace_begin;
 
 	common = (CommonJob *)job;
 	common->io_job = io_job;
@@ -2019,7 +2719,9 @@ delete_job (GIOSchedulerJob *io_job,
 			confirmed = confirm_delete_directly (common, to_delete_files);
 		}
 		if (confirmed) {
+			trace_begin = PEONY_TRACE_BEGIN ();
 			delete_files (common, to_delete_files, &files_skipped);
+			PEONY_TRACE_END (PEONY_TRACE_CATEGORY_FILE_OPS, "delete", trace_begin);
 		} else {
 			job->user_cancel = TRUE;
 		}
@@ -2029,7 +2731,9 @@ delete_job (GIOSchedulerJob *io_job,
 		to_trash_files = g_list_reverse (to_trash_files);
 
 		if (! must_confirm_trash || confirm_trash (common, to_trash_files)) {
+			trace_begin = PEONY_TRACE_BEGIN ();
 			trash_files (common, to_trash_files, &files_skipped);
+			PEONY_TRACE_END (PEONY_TRACE_CATEGORY_FILE_OPS, "trash", trace_begin);
 		} else {
 			job->user_cancel = TRUE;
 		}
@@ -2785,6 +3489,9 @@ scan_sources (GList *files,
 {
 	GList *l;
 	GFile *file;
+	gint64 trace_begin;
+
+	trace_begin = PEONY_TRACE_BEGIN ();
 
 	memset (source_info, 0, sizeof (SourceInfo));
 	source_info->op = kind;
@@ -2801,6 +3508,8 @@ scan_sources (GList *files,
 
 	/* Make sure we report the final count */
 	report_count_progress (job, source_info);
+
+	PEONY_TRACE_END (PEONY_TRACE_CATEGORY_FILE_OPS, "scan", trace_begin);
 }
 
 static void
@@ -4577,8 +5286,11 @@ static gboolean
 copy_job_done (gpointer user_data)
 {
 	CopyMoveJob *job;
+	gint64 trace_begin;
 
 	job = user_data;
+	trace_begin = PEONY_TRACE_BEGIN ();
+
 	if (job->done_callback) {
 		job->done_callback (job->debuting_files, job->done_callback_data);
 	}
@@ -4596,6 +5308,8 @@ copy_job_done (gpointer user_data)
 	finalize_common ((CommonJob *)job);
 
 	peony_file_changes_consume_changes (TRUE);
+
+	PEONY_TRACE_END (PEONY_TRACE_CATEGORY_FILE_OPS, "finalize", trace_begin);
 	return FALSE;
 }
 
@@ -4610,6 +5324,7 @@ copy_job (GIOSchedulerJob *io_job,
 	TransferInfo transfer_info;
 	char *dest_fs_id;
 	GFile *dest;
+	gint64 trace_begin;
 
 	job = user_data;
 	common = &job->common;
@@ -4647,10 +5362,12 @@ copy_job (GIOSchedulerJob *io_job,
 
 	g_timer_start (job->common.time);
 
+	trace_begin = PEONY_TRACE_BEGIN ();
 	memset (&transfer_info, 0, sizeof (transfer_info));
 	copy_files (job,
 		    dest_fs_id,
 		    &source_info, &transfer_info);
+	PEONY_TRACE_END (PEONY_TRACE_CATEGORY_FILE_OPS, "copy", trace_begin);
 
  aborted:
 
@@ -5125,8 +5842,11 @@ static gboolean
 move_job_done (gpointer user_data)
 {
 	CopyMoveJob *job;
+	gint64 trace_begin;
 
 	job = user_data;
+	trace_begin = PEONY_TRACE_BEGIN ();
+
 	if (job->done_callback) {
 		job->done_callback (job->debuting_files, job->done_callback_data);
 	}
@@ -5139,6 +5859,8 @@ move_job_done (gpointer user_data)
 	finalize_common ((CommonJob *)job);
 
 	peony_file_changes_consume_changes (TRUE);
+
+	PEONY_TRACE_END (PEONY_TRACE_CATEGORY_FILE_OPS, "finalize", trace_begin);
 	return FALSE;
 }
 
@@ -5155,6 +5877,7 @@ move_job (GIOSchedulerJob *io_job,
 	char *dest_fs_id;
 	char *dest_fs_type;
 	GList *fallback_files;
+	gint64 trace_begin;
 
 	job = user_data;
 	common = &job->common;
@@ -5176,7 +5899,9 @@ move_job (GIOSchedulerJob *io_job,
 	}
 
 	/* This moves all files that we can do without copy + delete */
+	trace_begin = PEONY_TRACE_BEGIN ();
 	move_files_prepare (job, dest_fs_id, &dest_fs_type, &fallbacks);
+	PEONY_TRACE_END (PEONY_TRACE_CATEGORY_FILE_OPS, "rename", trace_begin);
 	if (job_aborted (common)) {
 		goto aborted;
 	}
@@ -5204,11 +5929,13 @@ move_job (GIOSchedulerJob *io_job,
 		goto aborted;
 	}
 
+	trace_begin = PEONY_TRACE_BEGIN ();
 	memset (&transfer_info, 0, sizeof (transfer_info));
 	move_files (job,
 		    fallbacks,
 		    dest_fs_id, &dest_fs_type,
 		    &source_info, &transfer_info);
+	PEONY_TRACE_END (PEONY_TRACE_CATEGORY_FILE_OPS, "move", trace_begin);
 
  aborted:
     	g_list_free_full (fallbacks, g_free);
@@ -5648,90 +6375,295 @@ set_permissions_job_done (gpointer user_data)
 	return FALSE;
 }
 
+static guint32
+set_permissions_get_new_mode (SetPermissionsJob *job,
+			      gboolean is_dir,
+			      guint32 current)
+{
+	if (is_dir) {
+		return (current & ~job->dir_mask) | job->dir_permissions;
+	} else {
+		return (current & ~job->file_mask) | job->file_permissions;
+	}
+}
+
 static void
-set_permissions_file (SetPermissionsJob *job,
-		      GFile *file,
-		      GFileInfo *info)
+set_permissions_record_change (SetPermissionsJob *job,
+			       GFile *file,
+			       guint32 current)
 {
 	CommonJob *common;
-	GFileInfo *child_info;
-	gboolean free_info;
-	guint32 current;
-	guint32 value;
-	guint32 mask;
-	GFileEnumerator *enumerator;
-	GFile *child;
 
 	common = (CommonJob *)job;
 
-	peony_progress_info_pulse_progress (common->progress);
-
-    peony_progress_info_get_ready (common->progress);
+	g_atomic_int_inc (&job->files_changed);
 
-	free_info = FALSE;
-	if (info == NULL) {
-		free_info = TRUE;
-		info = g_file_query_info (file,
-					  G_FILE_ATTRIBUTE_STANDARD_TYPE","
-					  G_FILE_ATTRIBUTE_UNIX_MODE,
-					  G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-					  common->cancellable,
-					  NULL);
-		/* Ignore errors */
-		if (info == NULL) {
-			return;
-		}
+	if (common->undo_redo_data != NULL) {
+		g_mutex_lock (&job->lock);
+		// Start UNDO-REDO
+		peony_undostack_manager_data_add_file_permissions (common->undo_redo_data, file, current);
+		// End UNDO-REDO
+		g_mutex_unlock (&job->lock);
 	}
+}
 
-	if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
-		value = job->dir_permissions;
-		mask = job->dir_mask;
-	} else {
-		value = job->file_permissions;
-		mask = job->file_mask;
-	}
+/* A directory waiting for the pool. Local subdirectories are opened
+ * relative to their parent's fd, anything else through its GFile.
+ */
+typedef struct {
+	GFile *file;
+	LocalDirFd *parent_fd;
+	char *name;
+	int depth;
+} SetPermissionsDir;
+
+/* Deeper directories first, so that few parent fds are held open by
+ * queued subdirectories at any time.
+ */
+static gint
+set_permissions_dir_compare (gconstpointer a,
+			     gconstpointer b,
+			     gpointer user_data)
+{
+	const SetPermissionsDir *dir_a = a;
+	const SetPermissionsDir *dir_b = b;
+
+	return dir_b->depth - dir_a->depth;
+}
+
+static void
+set_permissions_queue_dir (SetPermissionsJob *job,
+			   GFile *file,
+			   LocalDirFd *parent_fd,
+			   const char *name,
+			   int depth)
+{
+	SetPermissionsDir *dir;
+
+	dir = g_slice_new (SetPermissionsDir);
+	dir->file = g_object_ref (file);
+	dir->parent_fd = parent_fd != NULL ? local_dir_fd_ref (parent_fd) : NULL;
+	dir->name = g_strdup (name);
+	dir->depth = depth;
 
+	g_mutex_lock (&job->lock);
+	job->pending_dirs++;
+	g_mutex_unlock (&job->lock);
+
+	g_thread_pool_push (job->pool, dir, NULL);
+}
+
+/* Sets the mode of a file through GIO, for the top level file and
+ * for locations without a local path. Files already in the wanted
+ * mode are left alone.
+ */
+static void
+set_permissions_file (SetPermissionsJob *job,
+		      GFile *file,
+		      GFileInfo *info,
+		      int depth)
+{
+	CommonJob *common;
+	gboolean is_dir;
+	guint32 current;
+	guint32 value;
+
+	common = (CommonJob *)job;
+
+	peony_progress_info_get_ready (common->progress);
+
+	g_atomic_int_inc (&job->files_examined);
+
+	is_dir = g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY;
 
 	if (!job_aborted (common) &&
 	    g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_UNIX_MODE)) {
 		current = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_MODE);
-		// Start UNDO-REDO
-		peony_undostack_manager_data_add_file_permissions(common->undo_redo_data, file, current);
-		// End UNDO-REDO
-		current = (current & ~mask) | value;
+		value = set_permissions_get_new_mode (job, is_dir, current);
 
-		g_file_set_attribute_uint32 (file, G_FILE_ATTRIBUTE_UNIX_MODE,
-					     current, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-					     common->cancellable, NULL);
+		if ((value & 07777) != (current & 07777) &&
+		    g_file_set_attribute_uint32 (file, G_FILE_ATTRIBUTE_UNIX_MODE,
+						 value, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+						 common->cancellable, NULL)) {
+			set_permissions_record_change (job, file, current);
+		}
 	}
 
-	if (!job_aborted (common) &&
-	    g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
-		enumerator = g_file_enumerate_children (file,
-							G_FILE_ATTRIBUTE_STANDARD_NAME","
-							G_FILE_ATTRIBUTE_STANDARD_TYPE","
-							G_FILE_ATTRIBUTE_UNIX_MODE,
-							G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-							common->cancellable,
-							NULL);
-		if (enumerator) {
-			while (!job_aborted (common) &&
-			       (child_info = g_file_enumerator_next_file (enumerator, common->cancellable, NULL)) != NULL) {
-				child = g_file_get_child (file,
-							  g_file_info_get_name (child_info));
-				set_permissions_file (job, child, child_info);
-				g_object_unref (child);
-				g_object_unref (child_info);
+	if (!job_aborted (common) && is_dir) {
+		set_permissions_queue_dir (job, file, NULL, NULL, depth);
+	}
+}
+
+static void
+set_permissions_remote_dir (SetPermissionsJob *job,
+			    GFile *dir,
+			    int depth)
+{
+	CommonJob *common;
+	GFileEnumerator *enumerator;
+	GFileInfo *child_info;
+	GFile *child;
+
+	common = (CommonJob *)job;
+
+	enumerator = g_file_enumerate_children (dir,
+						G_FILE_ATTRIBUTE_STANDARD_NAME","
+						G_FILE_ATTRIBUTE_STANDARD_TYPE","
+						G_FILE_ATTRIBUTE_UNIX_MODE,
+						G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+						common->cancellable,
+						NULL);
+	if (enumerator == NULL) {
+		return;
+	}
+
+	while (!job_aborted (common) &&
+	       (child_info = g_file_enumerator_next_file (enumerator, common->cancellable, NULL)) != NULL) {
+		child = g_file_get_child (dir,
+					  g_file_info_get_name (child_info));
+		set_permissions_file (job, child, child_info, depth + 1);
+		g_object_unref (child);
+		g_object_unref (child_info);
+	}
+	g_file_enumerator_close (enumerator, common->cancellable, NULL);
+	g_object_unref (enumerator);
+}
+
+/* Local directories are read and changed relative to the directory fd,
+ * which saves a path lookup and a GFileInfo per entry.
+ */
+static void
+set_permissions_local_dir (SetPermissionsJob *job,
+			   GFile *dir,
+			   int dir_fd,
+			   int depth)
+{
+	CommonJob *common;
+	struct dirent *dirent;
+	struct stat statbuf;
+	LocalDirFd *shared_fd;
+	DIR *dirp;
+	GFile *child;
+	gboolean is_dir;
+	guint32 value;
+
+	common = (CommonJob *)job;
+
+	/* readdir() needs its own fd, subdirectories share the other one */
+	shared_fd = local_dir_fd_new (dir_fd);
+	dir_fd = dup (dir_fd);
+	dirp = dir_fd >= 0 ? fdopendir (dir_fd) : NULL;
+	if (dirp == NULL) {
+		if (dir_fd >= 0) {
+			close (dir_fd);
+		}
+		local_dir_fd_unref (shared_fd);
+		return;
+	}
+
+	while (!job_aborted (common) &&
+	       (dirent = readdir (dirp)) != NULL) {
+		if (strcmp (dirent->d_name, ".") == 0 ||
+		    strcmp (dirent->d_name, "..") == 0) {
+			continue;
+		}
+
+		peony_progress_info_get_ready (common->progress);
+
+		if (fstatat (dir_fd, dirent->d_name, &statbuf, AT_SYMLINK_NOFOLLOW) != 0) {
+			continue;
+		}
+
+		g_atomic_int_inc (&job->files_examined);
+
+		/* The mode of a symlink can't be changed */
+		if (S_ISLNK (statbuf.st_mode)) {
+			continue;
+		}
+
+		is_dir = S_ISDIR (statbuf.st_mode);
+		value = set_permissions_get_new_mode (job, is_dir, statbuf.st_mode);
+
+		child = NULL;
+		if ((value & 07777) != (statbuf.st_mode & 07777) &&
+		    fchmodat (dir_fd, dirent->d_name, value & 07777, 0) == 0) {
+			child = g_file_get_child (dir, dirent->d_name);
+			set_permissions_record_change (job, child, statbuf.st_mode);
+		}
+
+		if (is_dir) {
+			if (child == NULL) {
+				child = g_file_get_child (dir, dirent->d_name);
 			}
-			g_file_enumerator_close (enumerator, common->cancellable, NULL);
-			g_object_unref (enumerator);
+			set_permissions_queue_dir (job, child, shared_fd,
+						   dirent->d_name, depth + 1);
+		}
+
+		if (child != NULL) {
+			g_object_unref (child);
 		}
 	}
-	if (free_info) {
-		g_object_unref (info);
+
+	closedir (dirp);
+	local_dir_fd_unref (shared_fd);
+}
+
+static void
+set_permissions_dir_thread (gpointer data,
+			    gpointer user_data)
+{
+	SetPermissionsJob *job;
+	SetPermissionsDir *dir;
+	char *path;
+	int dir_fd;
+
+	job = user_data;
+	dir = data;
+
+	if (!job_aborted ((CommonJob *)job)) {
+		if (dir->parent_fd != NULL) {
+			dir_fd = local_dir_open (dir->parent_fd, dir->name);
+			if (dir_fd >= 0) {
+				set_permissions_local_dir (job, dir->file, dir_fd, dir->depth);
+			}
+		} else if ((path = g_file_get_path (dir->file)) != NULL) {
+			dir_fd = local_dir_open (NULL, path);
+			if (dir_fd >= 0) {
+				set_permissions_local_dir (job, dir->file, dir_fd, dir->depth);
+			}
+			g_free (path);
+		} else {
+			set_permissions_remote_dir (job, dir->file, dir->depth);
+		}
+	}
+
+	local_dir_fd_unref (dir->parent_fd);
+	g_object_unref (dir->file);
+	g_free (dir->name);
+	g_slice_free (SetPermissionsDir, dir);
+
+	g_mutex_lock (&job->lock);
+	if (--job->pending_dirs == 0) {
+		g_cond_signal (&job->done_cond);
 	}
+	g_mutex_unlock (&job->lock);
 }
 
+static void
+report_set_permissions_progress (SetPermissionsJob *job)
+{
+	int examined, changed;
+
+	examined = g_atomic_int_get (&job->files_examined);
+	changed = g_atomic_int_get (&job->files_changed);
+
+	peony_progress_info_take_details (job->common.progress,
+					  f (ngettext ("Changed %'d of %'d file",
+						       "Changed %'d of %'d files",
+						       examined),
+					     changed, examined));
+	peony_progress_info_pulse_progress (job->common.progress);
+}
 
 static gboolean
 set_permissions_job (GIOSchedulerJob *io_job,
@@ -5740,6 +6672,8 @@ set_permissions_job (GIOSchedulerJob *io_job,
 {
 	SetPermissionsJob *job = user_data;
 	CommonJob *common;
+	GFileInfo *info;
+	gint64 end_time;
 
 	common = (CommonJob *)job;
 	common->io_job = io_job;
@@ -5749,7 +6683,41 @@ set_permissions_job (GIOSchedulerJob *io_job,
 
 	peony_progress_info_start (job->common.progress);
 
-	set_permissions_file (job, job->file, NULL);
+	g_mutex_init (&job->lock);
+	g_cond_init (&job->done_cond);
+	job->pool = g_thread_pool_new (set_permissions_dir_thread, job,
+				       SET_PERMISSIONS_MAX_THREADS, FALSE, NULL);
+	g_thread_pool_set_sort_function (job->pool, set_permissions_dir_compare, NULL);
+
+	info = g_file_query_info (job->file,
+				  G_FILE_ATTRIBUTE_STANDARD_TYPE","
+				  G_FILE_ATTRIBUTE_UNIX_MODE,
+				  G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+				  common->cancellable,
+				  NULL);
+	/* Ignore errors */
+	if (info != NULL) {
+		set_permissions_file (job, job->file, info, 0);
+		g_object_unref (info);
+	}
+
+	g_mutex_lock (&job->lock);
+	while (job->pending_dirs > 0) {
+		end_time = g_get_monotonic_time () + SET_PERMISSIONS_PROGRESS_INTERVAL;
+		if (!g_cond_wait_until (&job->done_cond, &job->lock, end_time)) {
+			g_mutex_unlock (&job->lock);
+			report_set_permissions_progress (job);
+			g_mutex_lock (&job->lock);
+		}
+	}
+	g_mutex_unlock (&job->lock);
+
+	g_thread_pool_free (job->pool, FALSE, TRUE);
+	job->pool = NULL;
+	g_mutex_clear (&job->lock);
+	g_cond_clear (&job->done_cond);
+
+	report_set_permissions_progress (job);
 
 	g_io_scheduler_job_send_to_mainloop_async (io_job,
 						   set_permissions_job_done,
@@ -6412,6 +7380,342 @@ delete_trash_file (CommonJob *job,
 	}
 }
 
+/* Emptying a trash directory moves its "files" and "info" folders into
+ * a hidden staging folder next to them, which makes the trash look
+ * empty at once. The staged folders are then deleted by a low priority
+ * background job, which also picks up anything an interrupted run left
+ * behind.
+ */
+#define TRASH_EXPUNGE_PREFIX ".peony-expunge-"
+
+typedef struct {
+	CommonJob common;
+} ReclaimTrashJob;
+
+static gboolean reclaim_trash_running = FALSE;
+static gboolean reclaim_trash_again = FALSE;
+
+/* Only trash directories that are what they claim to be are emptied
+ * by renaming: a real directory, not a symlink, private to the user.
+ */
+static gboolean
+stat_is_local_trash_root (struct stat *st)
+{
+	return S_ISDIR (st->st_mode) &&
+		st->st_uid == getuid () &&
+		(st->st_mode & 0777) == 0700;
+}
+
+/* shared_parent is set for .Trash/$uid, whose .Trash must be a sticky
+ * directory shared by all users, as the trash spec asks.
+ */
+static void
+add_local_trash_root (GList **roots, char *path, gboolean shared_parent)
+{
+	struct stat st;
+	char *parent;
+	gboolean valid;
+
+	valid = g_lstat (path, &st) == 0 && stat_is_local_trash_root (&st);
+	if (valid && shared_parent) {
+		parent = g_path_get_dirname (path);
+		valid = g_lstat (parent, &st) == 0 &&
+			S_ISDIR (st.st_mode) &&
+			(st.st_mode & S_ISVTX) != 0;
+		g_free (parent);
+	}
+
+	if (valid &&
+	    g_list_find_custom (*roots, path, (GCompareFunc) strcmp) == NULL) {
+		*roots = g_list_prepend (*roots, path);
+	} else {
+		g_free (path);
+	}
+}
+
+/* The local trash directories of the current user, as used by GIO:
+ * the home trash plus .Trash/$uid and .Trash-$uid on every mount.
+ */
+static GList *
+get_local_trash_roots (void)
+{
+	GList *roots, *mounts, *l;
+	const char *mount_path;
+	char *uid;
+
+	roots = NULL;
+	add_local_trash_root (&roots, g_build_filename (g_get_user_data_dir (), "Trash", NULL), FALSE);
+
+	uid = g_strdup_printf ("%d", getuid ());
+	mounts = g_unix_mounts_get (NULL);
+	for (l = mounts; l != NULL; l = l->next) {
+		if (g_unix_mount_is_system_internal (l->data)) {
+			continue;
+		}
+		mount_path = g_unix_mount_get_mount_path (l->data);
+
+		add_local_trash_root (&roots, g_build_filename (mount_path, ".Trash", uid, NULL), TRUE);
+		add_local_trash_root (&roots, g_strconcat (mount_path, "/.Trash-", uid, NULL), FALSE);
+	}
+	g_list_free_full (mounts, (GDestroyNotify) g_unix_mount_free);
+	g_free (uid);
+
+	return roots;
+}
+
+/* Opens a trash directory checked by get_local_trash_roots(), checking
+ * again on the fd in case it was replaced since. Returns -1 on failure.
+ */
+static int
+open_local_trash_root (const char *trash_root)
+{
+	struct stat st;
+	int fd;
+
+	fd = local_dir_open (NULL, trash_root);
+	if (fd == -1) {
+		return -1;
+	}
+
+	if (fstat (fd, &st) != 0 || !stat_is_local_trash_root (&st)) {
+		close (fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* Creates an empty staging folder in the trash directory, returning
+ * its name.
+ */
+static char *
+make_trash_staging_dir (int root_fd)
+{
+	static const char chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+	char *name;
+	int tries, i;
+
+	name = g_strdup (TRASH_EXPUNGE_PREFIX "XXXXXX");
+	for (tries = 0; tries < 100; tries++) {
+		for (i = strlen (TRASH_EXPUNGE_PREFIX); name[i] != 0; i++) {
+			name[i] = chars[g_random_int_range (0, sizeof (chars) - 1)];
+		}
+
+		if (mkdirat (root_fd, name, 0700) == 0) {
+			return name;
+		}
+		if (errno != EEXIST) {
+			break;
+		}
+	}
+
+	g_free (name);
+	return NULL;
+}
+
+/* Moves the contents of the trash at trash_root out of sight. All
+ * renames happen relative to the fds of the trash and staging folders,
+ * so a path component swapped for a symlink meanwhile isn't followed.
+ * Returns FALSE if nothing could be moved.
+ */
+static gboolean
+stage_trash_root_for_expunge (const char *trash_root)
+{
+	const char *names[] = { "files", "info" }; /* files first, so no entry outlives its info */
+	char *staging;
+	int root_fd, staging_fd;
+	gboolean staged;
+	int i;
+
+	root_fd = open_local_trash_root (trash_root);
+	if (root_fd == -1) {
+		return FALSE;
+	}
+
+	staging = make_trash_staging_dir (root_fd);
+	if (staging == NULL) {
+		close (root_fd);
+		return FALSE;
+	}
+
+	staging_fd = openat (root_fd, staging,
+			     O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (staging_fd == -1) {
+		unlinkat (root_fd, staging, AT_REMOVEDIR);
+		g_free (staging);
+		close (root_fd);
+		return FALSE;
+	}
+
+	staged = FALSE;
+	for (i = 0; i < G_N_ELEMENTS (names); i++) {
+		if (renameat (root_fd, names[i], staging_fd, names[i]) != 0) {
+			continue;
+		}
+
+		if (mkdirat (root_fd, names[i], 0700) != 0) {
+			/* Without an empty one in its place, put it back
+			 * rather than leave the trash broken.
+			 */
+			renameat (staging_fd, names[i], root_fd, names[i]);
+			continue;
+		}
+
+		staged = TRUE;
+	}
+
+	close (staging_fd);
+	if (!staged) {
+		unlinkat (root_fd, staging, AT_REMOVEDIR);
+	}
+	g_free (staging);
+	close (root_fd);
+
+	return staged;
+}
+
+static gboolean
+stage_local_trash_for_expunge (GFile *trash_dir, GList **staged_roots)
+{
+	GList *roots, *l;
+	char *path, *root;
+	gboolean staged;
+
+	if (g_file_has_uri_scheme (trash_dir, "trash")) {
+		roots = get_local_trash_roots ();
+	} else {
+		/* A trash directory's "files" or "info" folder on a mount */
+		path = g_file_get_path (trash_dir);
+		if (path == NULL) {
+			return FALSE;
+		}
+		roots = g_list_prepend (NULL, g_path_get_dirname (path));
+		g_free (path);
+	}
+
+	staged = FALSE;
+	for (l = roots; l != NULL; l = l->next) {
+		root = l->data;
+		if (g_list_find_custom (*staged_roots, root, (GCompareFunc) strcmp) != NULL) {
+			continue;
+		}
+		if (stage_trash_root_for_expunge (root)) {
+			*staged_roots = g_list_prepend (*staged_roots, g_strdup (root));
+			staged = TRUE;
+		}
+	}
+	g_list_free_full (roots, g_free);
+
+	return staged;
+}
+
+static gboolean
+reclaim_trash_job_done (gpointer user_data)
+{
+	ReclaimTrashJob *job;
+
+	job = user_data;
+	finalize_common ((CommonJob *)job);
+
+	reclaim_trash_running = FALSE;
+	if (reclaim_trash_again) {
+		peony_file_operations_reclaim_trash ();
+	}
+
+	return FALSE;
+}
+
+static gboolean
+reclaim_trash_job (GIOSchedulerJob *io_job,
+		   GCancellable *cancellable,
+		   gpointer user_data)
+{
+	ReclaimTrashJob *job = user_data;
+	CommonJob *common;
+	SourceInfo source_info;
+	TransferInfo transfer_info;
+	GList *roots, *staged, *l;
+	GDir *dir;
+	const char *name;
+	char *path;
+	int root_fd;
+
+	common = (CommonJob *)job;
+	common->io_job = io_job;
+
+	staged = NULL;
+	roots = get_local_trash_roots ();
+	for (l = roots; l != NULL; l = l->next) {
+		root_fd = open_local_trash_root (l->data);
+		if (root_fd == -1) {
+			continue;
+		}
+		close (root_fd);
+
+		dir = g_dir_open (l->data, 0, NULL);
+		if (dir == NULL) {
+			continue;
+		}
+
+		while ((name = g_dir_read_name (dir)) != NULL) {
+			if (g_str_has_prefix (name, TRASH_EXPUNGE_PREFIX)) {
+				path = g_build_filename (l->data, name, NULL);
+				staged = g_list_prepend (staged, g_file_new_for_path (path));
+				g_free (path);
+			}
+		}
+
+		g_dir_close (dir);
+	}
+	g_list_free_full (roots, g_free);
+
+	/* Nobody sees the totals, and counting would walk every staged
+	 * tree a second time.
+	 */
+	memset (&source_info, 0, sizeof (source_info));
+	memset (&transfer_info, 0, sizeof (transfer_info));
+
+	for (l = staged; l != NULL && !job_aborted (common); l = l->next) {
+		path = g_file_get_path (l->data);
+		delete_local_dir_contents (common, path, &source_info, &transfer_info);
+		g_rmdir (path);
+		g_free (path);
+	}
+	g_list_free_full (staged, g_object_unref);
+
+	g_io_scheduler_job_send_to_mainloop_async (io_job,
+						   reclaim_trash_job_done,
+						   job,
+						   NULL);
+
+	return FALSE;
+}
+
+/* Deletes whatever emptying the trash moved aside. The job's progress
+ * info is created ready to run, so the deletes never wait for it, but
+ * it is never started, so it doesn't show up in the progress window.
+ */
+void
+peony_file_operations_reclaim_trash (void)
+{
+	ReclaimTrashJob *job;
+
+	if (reclaim_trash_running) {
+		reclaim_trash_again = TRUE;
+		return;
+	}
+	reclaim_trash_running = TRUE;
+	reclaim_trash_again = FALSE;
+
+	job = op_job_new (ReclaimTrashJob, NULL, TRUE, FALSE);
+
+	g_io_scheduler_push_job (reclaim_trash_job,
+			   job,
+			   NULL,
+			   G_PRIORITY_LOW,
+			   NULL);
+}
+
 static gboolean
 empty_trash_job_done (gpointer user_data)
 {
@@ -6421,6 +7725,11 @@ empty_trash_job_done (gpointer user_data)
 
     	g_list_free_full (job->trash_dirs, g_object_unref);
 
+	if (job->staged_roots != NULL) {
+		g_list_free_full (job->staged_roots, g_free);
+		peony_file_operations_reclaim_trash ();
+	}
+
 	if (job->done_callback) {
 		job->done_callback (job->done_callback_data);
 	}
@@ -6455,6 +7764,17 @@ empty_trash_job (GIOSchedulerJob *io_job,
 		for (l = job->trash_dirs;
 		     l != NULL && !job_aborted (common);
 		     l = l->next) {
+			/* The done callback unmounts the trash's device, so
+			 * everything has to be gone before it runs rather
+			 * than left to the reclaim job.
+			 */
+			if (job->done_callback == NULL) {
+				stage_local_trash_for_expunge (l->data, &job->staged_roots);
+			}
+
+			/* Whatever couldn't be moved aside, like trashes on
+			 * remote or read-only locations, is deleted the slow way.
+			 */
 			delete_trash_file (common, l->data, FALSE, TRUE);
 		}
 	}
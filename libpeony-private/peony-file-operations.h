@@ -55,6 +55,7 @@ void peony_file_operations_copy_move   (const GList               *item_uris,
                                        PeonyCopyCallback       done_callback,
                                        gpointer                   done_callback_data);
 void peony_file_operations_empty_trash (GtkWidget                 *parent_view);
+void peony_file_operations_reclaim_trash (void);
 void peony_file_operations_new_folder  (GtkWidget                 *parent_view,
                                        GdkPoint                  *target_point,
                                        const char                *parent_dir_uri,
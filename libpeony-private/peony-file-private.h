@@ -58,6 +58,32 @@ typedef struct
     char emblem_keywords[1];
 } PeonyFileSortByEmblemCache;
 
+/* State that only a small fraction of files ever carry. It lives in a
+ * separate block that is allocated on first use and released again as
+ * soon as every field is back to NULL, so plain files in big
+ * directories don't pay for it.
+ */
+typedef struct
+{
+    char *top_left_text;
+
+    /* Info you might get from a link (.desktop, .directory or peony link) */
+    char *custom_icon;
+
+    char *trash_orig_path;
+
+    /* Emblems provided by extensions */
+    GList *extension_emblems;
+    GList *pending_extension_emblems;
+
+    /* Attributes provided by extensions */
+    GHashTable *extension_attributes;
+    GHashTable *pending_extension_attributes;
+} PeonyFileRareDetails;
+
+#define PEONY_FILE_PEEK_RARE(file, field) \
+    ((file)->details->rare != NULL ? (file)->details->rare->field : NULL)
+
 struct PeonyFileDetails
 {
     PeonyDirectory *directory;
@@ -91,8 +117,8 @@ struct PeonyFileDetails
 
     eel_ref_str mime_type;
 
-    char *selinux_context;
-    char *description;
+    eel_ref_str selinux_context;
+    eel_ref_str description;
 
     GError *get_info_error;
 
@@ -105,15 +131,15 @@ struct PeonyFileDetails
 
     GIcon *icon;
 
+    /* The decoded thumbnail itself is kept in a process-wide cache,
+     * see peony_file_set_thumbnail().
+     */
     char *thumbnail_path;
-    GdkPixbuf *thumbnail;
     time_t thumbnail_mtime;
 
     GList *mime_list; /* If this is a directory, the list of MIME types in it. */
-    char *top_left_text;
 
     /* Info you might get from a link (.desktop, .directory or peony link) */
-    char *custom_icon;
     char *activation_uri;
 
     /* used during DND, for checking whether source and destination are on
@@ -121,8 +147,6 @@ struct PeonyFileDetails
      */
     eel_ref_str filesystem_id;
 
-    char *trash_orig_path;
-
     /* The following is for file operations in progress. Since
      * there are normally only a few of these, we can move them to
      * a separate hash table or something if required to keep the
@@ -137,13 +161,7 @@ struct PeonyFileDetails
     /* PeonyInfoProviders that need to be run for this file */
     GList *pending_info_providers;
 
-    /* Emblems provided by extensions */
-    GList *extension_emblems;
-    GList *pending_extension_emblems;
-
-    /* Attributes provided by extensions */
-    GHashTable *extension_attributes;
-    GHashTable *pending_extension_attributes;
+    PeonyFileRareDetails *rare;
 
     GHashTable *metadata;
 
@@ -191,6 +209,9 @@ struct PeonyFileDetails
     eel_boolean_bit got_custom_activation_uri     : 1;
 
     eel_boolean_bit thumbnail_is_up_to_date       : 1;
+    /* TRUE once a thumbnail was decoded; it may since have been
+       evicted from the thumbnail cache. */
+    eel_boolean_bit has_thumbnail                 : 1;
     eel_boolean_bit thumbnail_wants_original      : 1;
     eel_boolean_bit thumbnail_tried_original      : 1;
     eel_boolean_bit thumbnailing_failed           : 1;
@@ -267,6 +288,11 @@ void          peony_file_clear_info                     (PeonyFile           *fi
  * new state.  */
 gboolean      peony_file_update_info                    (PeonyFile           *file,
         GFileInfo              *info);
+/* Like peony_file_update_info() for an info with only some standard
+ * attributes, for a file that hasn't got its info yet.
+ */
+gboolean      peony_file_update_partial_info            (PeonyFile           *file,
+        GFileInfo              *info);
 gboolean      peony_file_update_name                    (PeonyFile           *file,
         const char             *name);
 gboolean      peony_file_update_metadata_from_info      (PeonyFile           *file,
@@ -301,9 +327,21 @@ void                   peony_file_invalidate_extension_info_internal (PeonyFile
 void                   peony_file_info_providers_done                (PeonyFile           *file);
 
 
+/* Rarely used state, see PeonyFileRareDetails */
+void          peony_file_take_top_left_text             (PeonyFile           *file,
+        char                   *top_left_text);
+void          peony_file_set_custom_icon_internal       (PeonyFile           *file,
+        const char             *custom_icon);
+
 /* Thumbnailing: */
 void          peony_file_set_is_thumbnailing            (PeonyFile           *file,
         gboolean                is_thumbnailing);
+/* Stores a decoded thumbnail in the shared thumbnail cache, or drops
+ * the file's cached thumbnail when pixbuf is NULL.
+ */
+void          peony_file_set_thumbnail                  (PeonyFile           *file,
+        GdkPixbuf              *pixbuf,
+        time_t                  thumbnail_mtime);
 
 PeonyFileOperation *peony_file_operation_new      (PeonyFile                  *file,
         PeonyFileOperationCallback  callback,
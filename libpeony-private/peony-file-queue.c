@@ -115,6 +115,30 @@ peony_file_queue_remove (PeonyFileQueue *queue,
     peony_file_unref (file);
 }
 
+void
+peony_file_queue_move_to_head (PeonyFileQueue *queue,
+                               PeonyFile *file)
+{
+    GList *link;
+
+    link = g_hash_table_lookup (queue->item_to_link_map, file);
+
+    if (link == NULL || link == queue->head)
+    {
+        return;
+    }
+
+    if (link == queue->tail)
+    {
+        queue->tail = queue->tail->prev;
+    }
+
+    queue->head = g_list_remove_link (queue->head, link);
+    link->next = queue->head;
+    queue->head->prev = link;
+    queue->head = link;
+}
+
 PeonyFile *
 peony_file_queue_head (PeonyFileQueue *queue)
 {
@@ -126,6 +150,21 @@ peony_file_queue_head (PeonyFileQueue *queue)
     return PEONY_FILE (queue->head->data);
 }
 
+PeonyFile *
+peony_file_queue_next (PeonyFileQueue *queue,
+                       PeonyFile *file)
+{
+    GList *link;
+
+    link = g_hash_table_lookup (queue->item_to_link_map, file);
+    if (link == NULL || link->next == NULL)
+    {
+        return NULL;
+    }
+
+    return PEONY_FILE (link->next->data);
+}
+
 gboolean
 peony_file_queue_is_empty (PeonyFileQueue *queue)
 {
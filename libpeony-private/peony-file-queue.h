@@ -44,9 +44,17 @@ PeonyFile *     peony_file_queue_dequeue  (PeonyFileQueue *queue);
 void               peony_file_queue_remove   (PeonyFileQueue *queue,
         PeonyFile      *file);
 
+/* Move a file already in the queue to its head in constant time. */
+void               peony_file_queue_move_to_head (PeonyFileQueue *queue,
+        PeonyFile      *file);
+
 /* Get the file at the head of the queue without removing or unrefing it. */
 PeonyFile *     peony_file_queue_head     (PeonyFileQueue *queue);
 
+/* Get the file after file in the queue, or NULL if it's the last one. */
+PeonyFile *     peony_file_queue_next     (PeonyFileQueue *queue,
+        PeonyFile      *file);
+
 gboolean           peony_file_queue_is_empty (PeonyFileQueue *queue);
 
 #endif /* PEONY_FILE_CHANGES_QUEUE_H */
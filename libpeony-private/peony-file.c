@@ -46,6 +46,7 @@
 #include "peony-search-directory-file.h"
 #include "peony-thumbnails.h"
 #include "peony-ui-utilities.h"
+#include "peony-user-directory.h"
 #include "peony-vfs-file.h"
 #include "peony-saved-search-file.h"
 #include <eel/eel-debug.h>
@@ -80,6 +81,9 @@
 /* Time in seconds to cache getpwuid results */
 #define GETPWUID_CACHE_TIME (5*60)
 
+/* Upper bound for the decoded thumbnails shared by all files */
+#define THUMBNAIL_CACHE_MAX_SIZE (64 * 1024 * 1024)
+
 #define ICON_NAME_THUMBNAIL_LOADING   "image-loading"
 
 #undef PEONY_FILE_DEBUG_REF
@@ -119,6 +123,8 @@ static guint signals[LAST_SIGNAL] = { 0 };
 
 static GHashTable *symbolic_links;
 
+static guint rare_details_count;
+
 static GQuark attribute_name_q,
 	attribute_size_q,
 	attribute_type_q,
@@ -268,6 +274,278 @@ peony_file_clear_display_name (PeonyFile *file)
 	file->details->edit_name = NULL;
 }
 
+static PeonyFileRareDetails *
+get_rare_details (PeonyFile *file)
+{
+	if (file->details->rare == NULL) {
+		file->details->rare = g_slice_new0 (PeonyFileRareDetails);
+		rare_details_count++;
+	}
+	return file->details->rare;
+}
+
+static void
+free_rare_details (PeonyFileRareDetails *rare)
+{
+	if (rare == NULL) {
+		return;
+	}
+
+	g_free (rare->top_left_text);
+	g_free (rare->custom_icon);
+	g_free (rare->trash_orig_path);
+	g_list_free_full (rare->extension_emblems, g_free);
+	g_list_free_full (rare->pending_extension_emblems, g_free);
+	if (rare->extension_attributes) {
+		g_hash_table_destroy (rare->extension_attributes);
+	}
+	if (rare->pending_extension_attributes) {
+		g_hash_table_destroy (rare->pending_extension_attributes);
+	}
+	g_slice_free (PeonyFileRareDetails, rare);
+	rare_details_count--;
+}
+
+/* Give the block back once nothing in it is set any more. */
+static void
+trim_rare_details (PeonyFile *file)
+{
+	PeonyFileRareDetails *rare;
+
+	rare = file->details->rare;
+	if (rare != NULL &&
+	    rare->top_left_text == NULL &&
+	    rare->custom_icon == NULL &&
+	    rare->trash_orig_path == NULL &&
+	    rare->extension_emblems == NULL &&
+	    rare->pending_extension_emblems == NULL &&
+	    rare->extension_attributes == NULL &&
+	    rare->pending_extension_attributes == NULL) {
+		free_rare_details (rare);
+		file->details->rare = NULL;
+	}
+}
+
+static void
+set_trash_orig_path (PeonyFile *file,
+		     const char *trash_orig_path)
+{
+	if (trash_orig_path == NULL && file->details->rare == NULL) {
+		return;
+	}
+
+	g_free (get_rare_details (file)->trash_orig_path);
+	file->details->rare->trash_orig_path = g_strdup (trash_orig_path);
+	trim_rare_details (file);
+}
+
+void
+peony_file_take_top_left_text (PeonyFile *file,
+				  char *top_left_text)
+{
+	if (top_left_text == NULL && file->details->rare == NULL) {
+		return;
+	}
+
+	g_free (get_rare_details (file)->top_left_text);
+	file->details->rare->top_left_text = top_left_text;
+	trim_rare_details (file);
+}
+
+void
+peony_file_set_custom_icon_internal (PeonyFile *file,
+					const char *custom_icon)
+{
+	if (custom_icon == NULL && file->details->rare == NULL) {
+		return;
+	}
+
+	g_free (get_rare_details (file)->custom_icon);
+	file->details->rare->custom_icon = g_strdup (custom_icon);
+	trim_rare_details (file);
+}
+
+/* Decoded thumbnails are by far the biggest thing a file can hold on
+ * to, so rather than each file owning its pixbuf they share a single
+ * LRU cache with a fixed byte budget. Files whose thumbnail got
+ * evicted load it again through the directory's thumbnail job the next
+ * time they are drawn. Thumbnails of files on screen are pinned and
+ * never evicted, the budget only applies to the others.
+ */
+typedef struct {
+	PeonyFile *file;
+	GdkPixbuf *pixbuf;
+	gsize size;
+} ThumbnailCacheEntry;
+
+static GHashTable *thumbnail_cache; /* PeonyFile -> GList link in thumbnail_cache_lru */
+static GQueue thumbnail_cache_lru = G_QUEUE_INIT; /* most recently used first */
+static gsize thumbnail_cache_size;
+static GHashTable *thumbnail_pins; /* PeonyFile -> pin count */
+
+static gboolean
+thumbnail_is_pinned (PeonyFile *file)
+{
+	return thumbnail_pins != NULL &&
+		g_hash_table_lookup (thumbnail_pins, file) != NULL;
+}
+
+void
+peony_file_pin_thumbnail (PeonyFile *file)
+{
+	guint count;
+
+	g_return_if_fail (PEONY_IS_FILE (file));
+
+	if (thumbnail_pins == NULL) {
+		thumbnail_pins = g_hash_table_new (NULL, NULL);
+	}
+
+	count = GPOINTER_TO_UINT (g_hash_table_lookup (thumbnail_pins, file));
+	g_hash_table_insert (thumbnail_pins, file, GUINT_TO_POINTER (count + 1));
+}
+
+void
+peony_file_unpin_thumbnail (PeonyFile *file)
+{
+	guint count;
+
+	g_return_if_fail (PEONY_IS_FILE (file));
+
+	if (thumbnail_pins == NULL) {
+		return;
+	}
+
+	count = GPOINTER_TO_UINT (g_hash_table_lookup (thumbnail_pins, file));
+	if (count > 1) {
+		g_hash_table_insert (thumbnail_pins, file, GUINT_TO_POINTER (count - 1));
+	} else {
+		g_hash_table_remove (thumbnail_pins, file);
+	}
+}
+
+static void
+thumbnail_cache_entry_free (ThumbnailCacheEntry *entry)
+{
+	thumbnail_cache_size -= entry->size;
+	g_object_unref (entry->pixbuf);
+	g_slice_free (ThumbnailCacheEntry, entry);
+}
+
+static void
+thumbnail_cache_remove (PeonyFile *file)
+{
+	GList *link;
+
+	if (thumbnail_cache == NULL) {
+		return;
+	}
+
+	link = g_hash_table_lookup (thumbnail_cache, file);
+	if (link != NULL) {
+		g_hash_table_remove (thumbnail_cache, file);
+		thumbnail_cache_entry_free (link->data);
+		g_queue_delete_link (&thumbnail_cache_lru, link);
+	}
+}
+
+static GdkPixbuf *
+thumbnail_cache_lookup (PeonyFile *file)
+{
+	GList *link;
+	ThumbnailCacheEntry *entry;
+
+	if (thumbnail_cache == NULL) {
+		return NULL;
+	}
+
+	link = g_hash_table_lookup (thumbnail_cache, file);
+	if (link == NULL) {
+		return NULL;
+	}
+
+	g_queue_unlink (&thumbnail_cache_lru, link);
+	g_queue_push_head_link (&thumbnail_cache_lru, link);
+
+	entry = link->data;
+	return g_object_ref (entry->pixbuf);
+}
+
+static void
+thumbnail_cache_insert (PeonyFile *file,
+			GdkPixbuf *pixbuf)
+{
+	ThumbnailCacheEntry *entry, *last;
+	GList *link, *prev;
+
+	if (thumbnail_cache == NULL) {
+		thumbnail_cache = g_hash_table_new (NULL, NULL);
+	}
+
+	thumbnail_cache_remove (file);
+
+	entry = g_slice_new (ThumbnailCacheEntry);
+	entry->file = file;
+	entry->pixbuf = g_object_ref (pixbuf);
+	entry->size = (gsize) gdk_pixbuf_get_rowstride (pixbuf) * gdk_pixbuf_get_height (pixbuf);
+	thumbnail_cache_size += entry->size;
+
+	g_queue_push_head (&thumbnail_cache_lru, entry);
+	g_hash_table_insert (thumbnail_cache, file, thumbnail_cache_lru.head);
+
+	/* Always keep the entry we just added, even if it is huge, and
+	 * those on screen, which would only be loaded again right away.
+	 */
+	for (link = thumbnail_cache_lru.tail;
+	     link != thumbnail_cache_lru.head &&
+	     thumbnail_cache_size > THUMBNAIL_CACHE_MAX_SIZE;
+	     link = prev) {
+		prev = link->prev;
+		last = link->data;
+		if (thumbnail_is_pinned (last->file)) {
+			continue;
+		}
+		g_hash_table_remove (thumbnail_cache, last->file);
+		g_queue_delete_link (&thumbnail_cache_lru, link);
+		thumbnail_cache_entry_free (last);
+	}
+}
+
+/* Has the directory load an evicted thumbnail again, the same way it
+ * was loaded the first time: the original image when that is what was
+ * shown, the thumbnail file otherwise. The "changed" once it is in
+ * redraws the file.
+ */
+static void
+thumbnail_cache_reload (PeonyFile *file)
+{
+	if (!file->details->thumbnail_is_up_to_date ||
+	    file->details->directory == NULL) {
+		/* Already on its way */
+		return;
+	}
+
+	file->details->thumbnail_is_up_to_date = FALSE;
+	peony_directory_add_file_to_work_queue (file->details->directory, file);
+	peony_directory_async_state_changed (file->details->directory);
+}
+
+void
+peony_file_set_thumbnail (PeonyFile *file,
+			     GdkPixbuf *pixbuf,
+			     time_t thumbnail_mtime)
+{
+	if (pixbuf == NULL) {
+		thumbnail_cache_remove (file);
+		file->details->has_thumbnail = FALSE;
+		return;
+	}
+
+	thumbnail_cache_insert (file, pixbuf);
+	file->details->has_thumbnail = TRUE;
+	file->details->thumbnail_mtime = thumbnail_mtime;
+}
+
 static gboolean
 foreach_metadata_free (gpointer  key,
 		       gpointer  value,
@@ -477,9 +755,9 @@ peony_file_clear_info (PeonyFile *file)
 	file->details->symlink_name = NULL;
 	eel_ref_str_unref (file->details->mime_type);
 	file->details->mime_type = NULL;
-	g_free (file->details->selinux_context);
+	eel_ref_str_unref (file->details->selinux_context);
 	file->details->selinux_context = NULL;
-	g_free (file->details->description);
+	eel_ref_str_unref (file->details->description);
 	file->details->description = NULL;
 	eel_ref_str_unref (file->details->owner);
 	file->details->owner = NULL;
@@ -801,15 +1079,14 @@ finalize (GObject *object)
 	eel_ref_str_unref (file->details->owner);
 	eel_ref_str_unref (file->details->owner_real);
 	eel_ref_str_unref (file->details->group);
-	g_free (file->details->selinux_context);
-	g_free (file->details->description);
-	g_free (file->details->top_left_text);
-	g_free (file->details->custom_icon);
+	eel_ref_str_unref (file->details->selinux_context);
+	eel_ref_str_unref (file->details->description);
 	g_free (file->details->activation_uri);
 	g_free (file->details->compare_by_emblem_cache);
 
-	if (file->details->thumbnail) {
-		g_object_unref (file->details->thumbnail);
+	thumbnail_cache_remove (file);
+	if (thumbnail_pins != NULL) {
+		g_hash_table_remove (thumbnail_pins, file);
 	}
 	if (file->details->mount) {
 		g_signal_handlers_disconnect_by_func (file->details->mount, file_mount_unmounted, file);
@@ -819,17 +1096,9 @@ finalize (GObject *object)
 	eel_ref_str_unref (file->details->filesystem_id);
 
 	g_list_free_full (file->details->mime_list, g_free);
-	g_list_free_full (file->details->pending_extension_emblems, g_free);
-	g_list_free_full (file->details->extension_emblems, g_free);
 	g_list_free_full (file->details->pending_info_providers, g_object_unref);
 
-	if (file->details->pending_extension_attributes) {
-		g_hash_table_destroy (file->details->pending_extension_attributes);
-	}
-
-	if (file->details->extension_attributes) {
-		g_hash_table_destroy (file->details->extension_attributes);
-	}
+	free_rare_details (file->details->rare);
 
 	if (file->details->metadata) {
 		metadata_hash_free (file->details->metadata);
@@ -2383,7 +2652,7 @@ update_info_internal (PeonyFile *file,
 	if (file->details->atime != atime ||
 	    file->details->mtime != mtime ||
 	    file->details->ctime != ctime) {
-		if (file->details->thumbnail == NULL) {
+		if (!file->details->has_thumbnail) {
 			file->details->thumbnail_is_up_to_date = FALSE;
 		}
 
@@ -2393,7 +2662,7 @@ update_info_internal (PeonyFile *file,
 	file->details->ctime = ctime;
 	file->details->mtime = mtime;
 
-	if (file->details->thumbnail != NULL &&
+	if (file->details->has_thumbnail &&
 	    file->details->thumbnail_mtime != 0 &&
 	    file->details->thumbnail_mtime != mtime) {
 		file->details->thumbnail_is_up_to_date = FALSE;
@@ -2438,17 +2707,17 @@ update_info_internal (PeonyFile *file,
 	}
 
 	selinux_context = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_SELINUX_CONTEXT);
-	if (eel_strcmp (file->details->selinux_context, selinux_context) != 0) {
+	if (eel_strcmp (eel_ref_str_peek (file->details->selinux_context), selinux_context) != 0) {
 		changed = TRUE;
-		g_free (file->details->selinux_context);
-		file->details->selinux_context = g_strdup (selinux_context);
+		eel_ref_str_unref (file->details->selinux_context);
+		file->details->selinux_context = eel_ref_str_get_unique (selinux_context);
 	}
 
 	description = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_STANDARD_DESCRIPTION);
-	if (eel_strcmp (file->details->description, description) != 0) {
+	if (eel_strcmp (eel_ref_str_peek (file->details->description), description) != 0) {
 		changed = TRUE;
-		g_free (file->details->description);
-		file->details->description = g_strdup (description);
+		eel_ref_str_unref (file->details->description);
+		file->details->description = eel_ref_str_get_unique (description);
 	}
 
 	filesystem_id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM);
@@ -2470,10 +2739,9 @@ update_info_internal (PeonyFile *file,
 	}
 
 	trash_orig_path = g_file_info_get_attribute_byte_string (info, G_FILE_ATTRIBUTE_TRASH_ORIG_PATH);
-	if (eel_strcmp (file->details->trash_orig_path, trash_orig_path) != 0) {
+	if (eel_strcmp (PEONY_FILE_PEEK_RARE (file, trash_orig_path), trash_orig_path) != 0) {
 		changed = TRUE;
-		g_free (file->details->trash_orig_path);
-		file->details->trash_orig_path = g_strdup (trash_orig_path);
+		set_trash_orig_path (file, trash_orig_path);
 	}
 
 	changed |=
@@ -2533,6 +2801,50 @@ peony_file_update_info (PeonyFile *file,
 	return update_info_internal (file, info, FALSE);
 }
 
+/* Takes the name, type and MIME type from info, as far as it has them,
+ * for a file that has no information yet. The file isn't marked up to
+ * date, so everything else is still loaded the usual way.
+ */
+gboolean
+peony_file_update_partial_info (PeonyFile *file,
+				GFileInfo *info)
+{
+	const char *mime_type;
+	GFileType file_type;
+	gboolean changed;
+
+	if (file->details->is_gone || file->details->got_file_info) {
+		return FALSE;
+	}
+
+	changed = FALSE;
+
+	if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME)) {
+		changed |= peony_file_set_display_name (file,
+							g_file_info_get_display_name (info),
+							NULL, FALSE);
+	}
+
+	if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_TYPE)) {
+		file_type = g_file_info_get_file_type (info);
+		if (file->details->type != file_type) {
+			file->details->type = file_type;
+			changed = TRUE;
+		}
+	}
+
+	if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE)) {
+		mime_type = g_file_info_get_content_type (info);
+		if (eel_strcmp (eel_ref_str_peek (file->details->mime_type), mime_type) != 0) {
+			eel_ref_str_unref (file->details->mime_type);
+			file->details->mime_type = eel_ref_str_get_unique (mime_type);
+			changed = TRUE;
+		}
+	}
+
+	return changed;
+}
+
 static gboolean
 update_name_internal (PeonyFile *file,
 		      const char *name,
@@ -3849,7 +4161,7 @@ peony_file_get_name (PeonyFile *file)
 char *
 peony_file_get_description (PeonyFile *file)
 {
-	return g_strdup (file->details->description);
+	return g_strdup (eel_ref_str_peek (file->details->description));
 }
 
 void
@@ -4029,13 +4341,13 @@ get_custom_icon (PeonyFile *file)
 		g_free (custom_icon_uri);
 	}
 
-	if (icon == NULL && file->details->got_link_info && file->details->custom_icon != NULL) {
-		if (g_path_is_absolute (file->details->custom_icon)) {
-			icon_file = g_file_new_for_path (file->details->custom_icon);
+	if (icon == NULL && file->details->got_link_info && PEONY_FILE_PEEK_RARE (file, custom_icon) != NULL) {
+		if (g_path_is_absolute (file->details->rare->custom_icon)) {
+			icon_file = g_file_new_for_path (file->details->rare->custom_icon);
 			icon = g_file_icon_new (icon_file);
 			g_object_unref (icon_file);
 		} else {
-			icon = g_themed_icon_new (file->details->custom_icon);
+			icon = g_themed_icon_new (file->details->rare->custom_icon);
 		}
  	}
 
@@ -4262,11 +4574,14 @@ peony_file_get_icon (PeonyFile *file,
 	GIcon *gicon;
 	GdkPixbuf *raw_pixbuf, *scaled_pixbuf;
 	int modified_size;
+	gboolean reloading_thumbnail;
 
 	if (file == NULL) {
 		return NULL;
 	}
 
+	reloading_thumbnail = FALSE;
+
 	gicon = get_custom_icon (file);
 	if (gicon) {
 		GdkPixbuf *pixbuf;
@@ -4295,12 +4610,20 @@ peony_file_get_icon (PeonyFile *file,
 	}
 	if (flags & PEONY_FILE_ICON_FLAGS_USE_THUMBNAILS &&
 	    peony_file_should_show_thumbnail (file)) {
-		if (file->details->thumbnail) {
+		raw_pixbuf = NULL;
+		if (file->details->has_thumbnail) {
+			raw_pixbuf = thumbnail_cache_lookup (file);
+			if (raw_pixbuf == NULL) {
+				/* Evicted from the shared cache, load it again */
+				thumbnail_cache_reload (file);
+				reloading_thumbnail = TRUE;
+			}
+		}
+
+		if (raw_pixbuf != NULL) {
 			int w, h, s;
 			double scale;
 
-			raw_pixbuf = g_object_ref (file->details->thumbnail);
-
 			w = gdk_pixbuf_get_width (raw_pixbuf);
 			h = gdk_pixbuf_get_height (raw_pixbuf);
 
@@ -4360,7 +4683,7 @@ peony_file_get_icon (PeonyFile *file,
 		}
 	}
 
-	if (file->details->is_thumbnailing &&
+	if ((file->details->is_thumbnailing || reloading_thumbnail) &&
 	    flags & PEONY_FILE_ICON_FLAGS_USE_THUMBNAILS)
 		gicon = g_themed_icon_new (ICON_NAME_THUMBNAIL_LOADING);
 	else
@@ -4412,7 +4735,7 @@ peony_file_get_custom_icon (PeonyFile *file)
 	custom_icon = get_custom_icon_metadata_uri (file);
 
 	if (custom_icon == NULL && file->details->got_link_info) {
-		custom_icon = g_strdup (file->details->custom_icon);
+		custom_icon = g_strdup (PEONY_FILE_PEEK_RARE (file, custom_icon));
  	}
 
 	return custom_icon;
@@ -4678,7 +5001,7 @@ peony_file_get_trash_original_file_parent_as_string (PeonyFile *file)
 	GFile *location;
 	char *filename;
 
-	if (file->details->trash_orig_path != NULL) {
+	if (PEONY_FILE_PEEK_RARE (file, trash_orig_path) != NULL) {
 		orig_file = peony_file_get_trash_original_file (file);
 		parent = peony_file_get_parent (orig_file);
 		location = peony_file_get_location (parent);
@@ -5216,7 +5539,7 @@ peony_file_get_selinux_context (PeonyFile *file)
 		return NULL;
 	}
 
-	raw = file->details->selinux_context;
+	raw = (char *) eel_ref_str_peek (file->details->selinux_context);
 
 #ifdef HAVE_SELINUX
 	if (selinux_raw_to_trans_context (raw, &translated) == 0) {
@@ -5234,53 +5557,6 @@ peony_file_get_selinux_context (PeonyFile *file)
 	return translated;
 }
 
-static char *
-get_real_name (const char *name, const char *gecos)
-{
-	char *locale_string, *part_before_comma, *capitalized_login_name, *real_name;
-
-	if (gecos == NULL) {
-		return NULL;
-	}
-
-	locale_string = eel_str_strip_substring_and_after (gecos, ",");
-	if (!g_utf8_validate (locale_string, -1, NULL)) {
-		part_before_comma = g_locale_to_utf8 (locale_string, -1, NULL, NULL, NULL);
-		g_free (locale_string);
-	} else {
-		part_before_comma = locale_string;
-	}
-
-	if (!g_utf8_validate (name, -1, NULL)) {
-		locale_string = g_locale_to_utf8 (name, -1, NULL, NULL, NULL);
-	} else {
-		locale_string = g_strdup (name);
-	}
-
-	capitalized_login_name = eel_str_capitalize (locale_string);
-	g_free (locale_string);
-
-	if (capitalized_login_name == NULL) {
-		real_name = part_before_comma;
-	} else {
-		real_name = eel_str_replace_substring
-			(part_before_comma, "&", capitalized_login_name);
-		g_free (part_before_comma);
-	}
-
-
-	if (eel_str_is_empty (real_name)
-	    || eel_strcmp (name, real_name) == 0
-	    || eel_strcmp (capitalized_login_name, real_name) == 0) {
-		g_free (real_name);
-		real_name = NULL;
-	}
-
-	g_free (capitalized_login_name);
-
-	return real_name;
-}
-
 static gboolean
 get_group_id_from_group_name (const char *group_name, uid_t *gid)
 {
@@ -5501,28 +5777,15 @@ peony_file_set_owner (PeonyFile *file,
 GList *
 peony_get_user_names (void)
 {
-	GList *list;
-	char *real_name, *name;
-	struct passwd *user;
-
-	list = NULL;
+	PeonyUserDirectory *user_directory;
 
-	setpwent ();
-
-	while ((user = getpwent ()) != NULL) {
-		real_name = get_real_name (user->pw_name, user->pw_gecos);
-		if (real_name != NULL) {
-			name = g_strconcat (user->pw_name, "\n", real_name, NULL);
-		} else {
-			name = g_strdup (user->pw_name);
-		}
-		g_free (real_name);
-		list = g_list_prepend (list, name);
-	}
-
-	endpwent ();
+	/* The user directory is the only one walking the passwd database,
+	 * getpwent() on this thread would race with its worker.
+	 */
+	user_directory = peony_user_directory_get ();
+	peony_user_directory_load_sync (user_directory);
 
-	return eel_g_str_list_alphabetize (list);
+	return peony_user_directory_search_users (user_directory, NULL, G_MAXUINT);
 }
 
 /**
@@ -5609,20 +5872,21 @@ static GList *
 peony_get_group_names_for_user (void)
 {
 	GList *list;
-	struct group *group;
+	const char *group_name;
 	int count, i;
 	gid_t gid_list[NGROUPS_MAX + 1];
-
+	PeonyUserDirectory *user_directory;
 
 	list = NULL;
+	user_directory = peony_user_directory_get ();
 
 	count = getgroups (NGROUPS_MAX + 1, gid_list);
 	for (i = 0; i < count; i++) {
-		group = getgrgid (gid_list[i]);
-		if (group == NULL)
+		group_name = peony_user_directory_get_group_name (user_directory, gid_list[i]);
+		if (group_name == NULL)
 			break;
 
-		list = g_list_prepend (list, g_strdup (group->gr_name));
+		list = g_list_prepend (list, g_strdup (group_name));
 	}
 
 	return eel_g_str_list_alphabetize (list);
@@ -5636,19 +5900,13 @@ peony_get_group_names_for_user (void)
 GList *
 peony_get_all_group_names (void)
 {
-	GList *list;
-	struct group *group;
-
-	list = NULL;
-
-	setgrent ();
-
-	while ((group = getgrent ()) != NULL)
-		list = g_list_prepend (list, g_strdup (group->gr_name));
+	PeonyUserDirectory *user_directory;
 
-	endgrent ();
+	/* Same as for peony_get_user_names() */
+	user_directory = peony_user_directory_get ();
+	peony_user_directory_load_sync (user_directory);
 
-	return eel_g_str_list_alphabetize (list);
+	return peony_user_directory_search_groups (user_directory, NULL, G_MAXUINT);
 }
 
 /**
@@ -5662,8 +5920,10 @@ peony_get_all_group_names (void)
 GList *
 peony_file_get_settable_group_names (PeonyFile *file)
 {
+	PeonyUserDirectory *user_directory;
 	uid_t user_id;
 	GList *result;
+	char *group_name;
 
 	if (!peony_file_can_set_group (file)) {
 		return NULL;
@@ -5673,8 +5933,19 @@ peony_file_get_settable_group_names (PeonyFile *file)
 	user_id = geteuid();
 
 	if (user_id == 0) {
-		/* Root is allowed to set group to anything. */
-		result = peony_get_all_group_names ();
+		/* Root is allowed to set group to anything. Reading all the
+		 * groups may take a while, so until it is done in the
+		 * background only the current group is offered; the user
+		 * directory's "loaded" signal tells when there are more.
+		 */
+		user_directory = peony_user_directory_get ();
+		peony_user_directory_load (user_directory);
+		if (peony_user_directory_is_loaded (user_directory)) {
+			result = peony_user_directory_search_groups (user_directory, NULL, G_MAXUINT);
+		} else {
+			group_name = peony_file_get_group_name (file);
+			result = group_name != NULL ? g_list_prepend (NULL, group_name) : NULL;
+		}
 	} else if (user_id == (uid_t) file->details->uid) {
 		/* Owner is allowed to set group to any that owner is member of. */
 		result = peony_get_group_names_for_user ();
@@ -5857,25 +6128,45 @@ peony_file_get_permissions_as_string (PeonyFile *file)
 static char *
 peony_file_get_owner_as_string (PeonyFile *file, gboolean include_real_name)
 {
+	const char *owner, *owner_real;
+	PeonyUserDirectory *user_directory;
 	char *user_name;
 
+	owner = eel_ref_str_peek (file->details->owner);
+	owner_real = eel_ref_str_peek (file->details->owner_real);
+
+	/* Fill in whatever the file info lacked from the cached user
+	 * database rather than asking NSS for every file.
+	 */
+	if ((owner == NULL || owner_real == NULL) &&
+	    file->details->uid != -1 &&
+	    peony_file_is_local (file)) {
+		user_directory = peony_user_directory_get ();
+		if (owner == NULL) {
+			owner = peony_user_directory_get_user_name (user_directory, file->details->uid);
+		}
+		if (owner_real == NULL && include_real_name) {
+			owner_real = peony_user_directory_get_real_name (user_directory, file->details->uid);
+		}
+	}
+
 	/* Before we have info on a file, the owner is unknown. */
-	if (file->details->owner == NULL &&
-	    file->details->owner_real == NULL) {
+	if (owner == NULL &&
+	    owner_real == NULL) {
 		return NULL;
 	}
 
-	if (file->details->owner_real == NULL) {
-		user_name = g_strdup (eel_ref_str_peek (file->details->owner));
-	} else if (file->details->owner == NULL) {
-		user_name = g_strdup (eel_ref_str_peek (file->details->owner_real));
+	if (owner_real == NULL) {
+		user_name = g_strdup (owner);
+	} else if (owner == NULL) {
+		user_name = g_strdup (owner_real);
 	} else if (include_real_name &&
-		   strcmp (eel_ref_str_peek (file->details->owner), eel_ref_str_peek (file->details->owner_real)) != 0) {
+		   strcmp (owner, owner_real) != 0) {
 		user_name = g_strdup_printf ("%s - %s",
-					     eel_ref_str_peek (file->details->owner),
-					     eel_ref_str_peek (file->details->owner_real));
+					     owner,
+					     owner_real);
 	} else {
-		user_name = g_strdup (eel_ref_str_peek (file->details->owner));
+		user_name = g_strdup (owner);
 	}
 
 	return user_name;
@@ -6236,13 +6527,13 @@ peony_file_get_string_attribute_q (PeonyFile *file, GQuark attribute_q)
 
 	extension_attribute = NULL;
 
-	if (file->details->pending_extension_attributes) {
-		extension_attribute = g_hash_table_lookup (file->details->pending_extension_attributes,
+	if (PEONY_FILE_PEEK_RARE (file, pending_extension_attributes)) {
+		extension_attribute = g_hash_table_lookup (file->details->rare->pending_extension_attributes,
 							   GINT_TO_POINTER (attribute_q));
 	}
 
-	if (extension_attribute == NULL && file->details->extension_attributes) {
-		extension_attribute = g_hash_table_lookup (file->details->extension_attributes,
+	if (extension_attribute == NULL && PEONY_FILE_PEEK_RARE (file, extension_attributes)) {
+		extension_attribute = g_hash_table_lookup (file->details->rare->extension_attributes,
 							   GINT_TO_POINTER (attribute_q));
 	}
 
@@ -6678,8 +6969,8 @@ peony_file_get_keywords (PeonyFile *file)
 	keywords = peony_file_get_metadata_list
 		(file, PEONY_METADATA_KEY_EMBLEMS);
 
-	keywords = g_list_concat (keywords, eel_g_str_list_copy (file->details->extension_emblems));
-	keywords = g_list_concat (keywords, eel_g_str_list_copy (file->details->pending_extension_emblems));
+	keywords = g_list_concat (keywords, eel_g_str_list_copy (PEONY_FILE_PEEK_RARE (file, extension_emblems)));
+	keywords = g_list_concat (keywords, eel_g_str_list_copy (PEONY_FILE_PEEK_RARE (file, pending_extension_emblems)));
 
 	return sort_keyword_list_and_remove_duplicates (keywords);
 }
@@ -7229,7 +7520,7 @@ peony_file_peek_top_left_text (PeonyFile *file,
 	}
 
 	/* Show what we read in. */
-	return file->details->top_left_text;
+	return PEONY_FILE_PEEK_RARE (file, top_left_text);
 }
 
 /**
@@ -7261,8 +7552,8 @@ peony_file_get_trash_original_file (PeonyFile *file)
 
 	original_file = NULL;
 
-	if (file->details->trash_orig_path != NULL) {
-		location = g_file_new_for_path (file->details->trash_orig_path);
+	if (PEONY_FILE_PEEK_RARE (file, trash_orig_path) != NULL) {
+		location = g_file_new_for_path (file->details->rare->trash_orig_path);
 		original_file = peony_file_get (location);
 		g_object_unref (location);
 	}
@@ -7686,6 +7977,25 @@ peony_file_invalidate_all_attributes (PeonyFile *file)
 	peony_file_invalidate_attributes (file, all_attributes);
 }
 
+/**
+ * peony_file_prioritize_attributes
+ *
+ * Move the file ahead of the rest of its folder in the queue of files
+ * waiting for attributes, e.g. because it just scrolled into view.
+ * @file: PeonyFile representing the file in question.
+ **/
+void
+peony_file_prioritize_attributes (PeonyFile *file)
+{
+	g_return_if_fail (PEONY_IS_FILE (file));
+
+	if (file->details->directory == NULL) {
+		return;
+	}
+
+	peony_directory_prioritize_file_in_work_queue (file->details->directory, file);
+}
+
 
 /**
  * peony_file_dump
@@ -7738,6 +8048,153 @@ peony_file_dump (PeonyFile *file)
 	g_free (uri);
 }
 
+typedef struct {
+	guint files;
+	gsize objects;
+	gsize names;
+	gsize info_strings;
+	gsize rare;
+	gsize metadata;
+	gsize mime_lists;
+} FileMemoryUsage;
+
+/* Size of an unshared eel_ref_str, including its reference count */
+static gsize
+ref_str_size (eel_ref_str str)
+{
+	return str != NULL ? sizeof (gint) + strlen (str) + 1 : 0;
+}
+
+static gsize
+string_size (const char *str)
+{
+	return str != NULL ? strlen (str) + 1 : 0;
+}
+
+static void
+add_file_memory_usage (PeonyFile *file,
+		       FileMemoryUsage *usage)
+{
+	PeonyFileDetails *details;
+	GTypeQuery type_query;
+	GHashTableIter iter;
+	gpointer key, value;
+	GList *l;
+
+	details = file->details;
+
+	usage->files++;
+	g_type_query (G_TYPE_FROM_INSTANCE (file), &type_query);
+	usage->objects += type_query.instance_size + sizeof (PeonyFileDetails);
+
+	/* display_name and edit_name usually share the name's storage */
+	usage->names += ref_str_size (details->name);
+	if (details->display_name != details->name) {
+		usage->names += ref_str_size (details->display_name);
+	}
+	if (details->edit_name != details->display_name) {
+		usage->names += ref_str_size (details->edit_name);
+	}
+	usage->names += string_size (details->display_name_collation_key);
+
+	/* Owner, group, MIME type, SELinux context, description and
+	 * filesystem id are interned and therefore not counted here.
+	 */
+	usage->info_strings += string_size (details->symlink_name);
+	usage->info_strings += string_size (details->thumbnail_path);
+	usage->info_strings += string_size (details->activation_uri);
+
+	if (details->rare != NULL) {
+		usage->rare += sizeof (PeonyFileRareDetails);
+		usage->rare += string_size (details->rare->top_left_text);
+		usage->rare += string_size (details->rare->custom_icon);
+		usage->rare += string_size (details->rare->trash_orig_path);
+		usage->rare += sizeof (GList) * (g_list_length (details->rare->extension_emblems) +
+						 g_list_length (details->rare->pending_extension_emblems));
+	}
+
+	if (details->metadata != NULL) {
+		g_hash_table_iter_init (&iter, details->metadata);
+		while (g_hash_table_iter_next (&iter, &key, &value)) {
+			if (GPOINTER_TO_UINT (key) & METADATA_ID_IS_LIST_MASK) {
+				char **strv;
+
+				for (strv = value; *strv != NULL; strv++) {
+					usage->metadata += sizeof (char *) + string_size (*strv);
+				}
+				usage->metadata += sizeof (char *);
+			} else {
+				usage->metadata += string_size (value);
+			}
+			/* Rough per-entry overhead of a GHashTable */
+			usage->metadata += 3 * sizeof (gpointer);
+		}
+	}
+
+	for (l = details->mime_list; l != NULL; l = l->next) {
+		usage->mime_lists += sizeof (GList) + string_size (l->data);
+	}
+}
+
+static void
+append_memory_usage_line (GString *report,
+			  const char *component,
+			  gsize bytes,
+			  guint files)
+{
+	g_string_append_printf (report, "  %-16s %12" G_GSIZE_FORMAT " bytes  %8.1f bytes/file\n",
+				component, bytes,
+				files > 0 ? (double) bytes / files : 0.0);
+}
+
+/**
+ * peony_file_get_memory_report
+ *
+ * Debugging call, summarizes how much memory all the files in all
+ * loaded directories use, broken down by component.
+ *
+ * Returns: newly allocated, human-readable report.
+ **/
+char *
+peony_file_get_memory_report (void)
+{
+	FileMemoryUsage usage = { 0 };
+	GList *directories, *d, *l;
+	PeonyDirectory *directory;
+	GString *report;
+	gsize total;
+
+	directories = peony_directory_list_all ();
+	for (d = directories; d != NULL; d = d->next) {
+		directory = d->data;
+		for (l = directory->details->file_list; l != NULL; l = l->next) {
+			add_file_memory_usage (l->data, &usage);
+		}
+	}
+	peony_directory_list_free (directories);
+
+	total = usage.objects + usage.names + usage.info_strings +
+		usage.rare + usage.metadata + usage.mime_lists;
+
+	report = g_string_new (NULL);
+	g_string_append_printf (report, "%u files in loaded directories\n", usage.files);
+	append_memory_usage_line (report, "objects", usage.objects, usage.files);
+	append_memory_usage_line (report, "names", usage.names, usage.files);
+	append_memory_usage_line (report, "info strings", usage.info_strings, usage.files);
+	append_memory_usage_line (report, "rare details", usage.rare, usage.files);
+	append_memory_usage_line (report, "metadata", usage.metadata, usage.files);
+	append_memory_usage_line (report, "mime lists", usage.mime_lists, usage.files);
+	append_memory_usage_line (report, "total", total, usage.files);
+	g_string_append_printf (report, "%u files with rare details\n", rare_details_count);
+	g_string_append_printf (report, "thumbnail cache: %u thumbnails, %" G_GSIZE_FORMAT
+				" of %d bytes\n",
+				thumbnail_cache_lru.length,
+				thumbnail_cache_size,
+				THUMBNAIL_CACHE_MAX_SIZE);
+
+	return g_string_free (report, FALSE);
+}
+
 /**
  * peony_file_list_ref
  *
@@ -8296,12 +8753,15 @@ static void
 peony_file_add_emblem (PeonyFile *file,
 			  const char *emblem_name)
 {
+	PeonyFileRareDetails *rare;
+
+	rare = get_rare_details (file);
 	if (file->details->pending_info_providers) {
-		file->details->pending_extension_emblems = g_list_prepend (file->details->pending_extension_emblems,
-									   g_strdup (emblem_name));
+		rare->pending_extension_emblems = g_list_prepend (rare->pending_extension_emblems,
+								  g_strdup (emblem_name));
 	} else {
-		file->details->extension_emblems = g_list_prepend (file->details->extension_emblems,
-								   g_strdup (emblem_name));
+		rare->extension_emblems = g_list_prepend (rare->extension_emblems,
+							  g_strdup (emblem_name));
 	}
 
 	peony_file_changed (file);
@@ -8312,25 +8772,28 @@ peony_file_add_string_attribute (PeonyFile *file,
 				    const char *attribute_name,
 				    const char *value)
 {
+	PeonyFileRareDetails *rare;
+
+	rare = get_rare_details (file);
 	if (file->details->pending_info_providers) {
 		/* Lazily create hashtable */
-		if (!file->details->pending_extension_attributes) {
-			file->details->pending_extension_attributes =
+		if (!rare->pending_extension_attributes) {
+			rare->pending_extension_attributes =
 				g_hash_table_new_full (g_direct_hash, g_direct_equal,
 						       NULL,
 						       (GDestroyNotify)g_free);
 		}
-		g_hash_table_insert (file->details->pending_extension_attributes,
+		g_hash_table_insert (rare->pending_extension_attributes,
 				     GINT_TO_POINTER (g_quark_from_string (attribute_name)),
 				     g_strdup (value));
 	} else {
-		if (!file->details->extension_attributes) {
-			file->details->extension_attributes =
+		if (!rare->extension_attributes) {
+			rare->extension_attributes =
 				g_hash_table_new_full (g_direct_hash, g_direct_equal,
 						       NULL,
 						       (GDestroyNotify)g_free);
 		}
-		g_hash_table_insert (file->details->extension_attributes,
+		g_hash_table_insert (rare->extension_attributes,
 				     GINT_TO_POINTER (g_quark_from_string (attribute_name)),
 				     g_strdup (value));
 	}
@@ -8347,16 +8810,23 @@ peony_file_invalidate_extension_info (PeonyFile *file)
 void
 peony_file_info_providers_done (PeonyFile *file)
 {
-	g_list_free_full (file->details->extension_emblems, g_free);
-	file->details->extension_emblems = file->details->pending_extension_emblems;
-	file->details->pending_extension_emblems = NULL;
+	PeonyFileRareDetails *rare;
 
-	if (file->details->extension_attributes) {
-		g_hash_table_destroy (file->details->extension_attributes);
-	}
+	rare = file->details->rare;
+	if (rare != NULL) {
+		g_list_free_full (rare->extension_emblems, g_free);
+		rare->extension_emblems = rare->pending_extension_emblems;
+		rare->pending_extension_emblems = NULL;
 
-	file->details->extension_attributes = file->details->pending_extension_attributes;
-	file->details->pending_extension_attributes = NULL;
+		if (rare->extension_attributes) {
+			g_hash_table_destroy (rare->extension_attributes);
+		}
+
+		rare->extension_attributes = rare->pending_extension_attributes;
+		rare->pending_extension_attributes = NULL;
+
+		trim_rare_details (file);
+	}
 
 	peony_file_changed (file);
 }
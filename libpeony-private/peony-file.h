@@ -158,6 +158,7 @@ gboolean                peony_file_check_if_ready                    (PeonyFile
 void                    peony_file_invalidate_attributes             (PeonyFile                   *file,
         PeonyFileAttributes          attributes);
 void                    peony_file_invalidate_all_attributes         (PeonyFile                   *file);
+void                    peony_file_prioritize_attributes             (PeonyFile                   *file);
 
 /* Basic attributes for file objects. */
 gboolean                peony_file_contains_text                     (PeonyFile                   *file);
@@ -462,6 +463,9 @@ void                    peony_file_set_has_open_window               (PeonyFile
 
 /* Thumbnailing handling */
 gboolean                peony_file_is_thumbnailing                   (PeonyFile                   *file);
+/* Thumbnails of files on screen stay in memory whatever the budget, calls nest */
+void                    peony_file_pin_thumbnail                     (PeonyFile                   *file);
+void                    peony_file_unpin_thumbnail                   (PeonyFile                   *file);
 
 /* Convenience functions for dealing with a list of PeonyFile objects that each have a ref.
  * These are just convenient names for functions that work on lists of GtkObject *.
@@ -480,6 +484,7 @@ void                    peony_file_list_cancel_call_when_ready       (PeonyFileL
 
 /* Debugging */
 void                    peony_file_dump                              (PeonyFile                   *file);
+char *                  peony_file_get_memory_report                 (void);
 
 typedef struct PeonyFileDetails PeonyFileDetails;
 
@@ -35,6 +35,7 @@
 #include "peony-global-preferences.h"
 #include "peony-icon-private.h"
 #include <eel/eel-art-extensions.h>
+#include <eel/eel-debug.h>
 #include <eel/eel-gdk-extensions.h>
 #include <eel/eel-gdk-pixbuf-extensions.h>
 #include <eel/eel-glib-extensions.h>
@@ -67,6 +68,14 @@
 
 #define LAYOUT_HEIGHT 24
 
+/* Label sizes kept for all items: the least recently used ones go
+ * once there are more than this many, or LABEL_METRICS_PER_ITEM for
+ * each item alive if that is more. That leaves room for both labels of
+ * every item at the current and the previous zoom level.
+ */
+#define LABEL_METRICS_CACHE_MIN_SIZE 20000
+#define LABEL_METRICS_PER_ITEM 4
+
 #define BURN "burn:///"
 #define FTP "ftp://"
 #define AFP "afp://"
@@ -203,6 +212,9 @@ typedef struct
 
 static int click_policy_auto_value;
 
+/* Items alive, which the label size cache is sized to */
+static guint live_item_count;
+
 static void peony_icon_canvas_item_text_interface_init (EelAccessibleTextIface *iface);
 static GType peony_icon_canvas_item_accessible_factory_get_type (void);
 
@@ -230,6 +242,9 @@ static void     draw_pixbuf                          (GdkPixbuf
     						      cairo_t                   *cr,
     						      int                       x,
     						      int                       y);
+static const char *get_label_layout_text             (PeonyIconCanvasItem        *item,
+        const char                *text);
+static PangoFontDescription *get_label_font_description (PeonyIconCanvasItem     *item);
 static PangoLayout *get_label_layout                 (PangoLayout               **layout,
     						      PeonyIconCanvasItem        *item,
     						      const char                *text);
@@ -262,6 +277,8 @@ peony_icon_canvas_item_init (PeonyIconCanvasItem *icon_item)
 
     icon_item->details = G_TYPE_INSTANCE_GET_PRIVATE ((icon_item), PEONY_TYPE_ICON_CANVAS_ITEM, PeonyIconCanvasItemDetails);
     peony_icon_canvas_item_invalidate_label_size (icon_item);
+
+    live_item_count++;
 }
 
 gint
@@ -428,6 +445,8 @@ peony_icon_canvas_item_finalize (GObject *object)
 
     details = PEONY_ICON_CANVAS_ITEM (object)->details;
 
+    live_item_count--;
+
     if (details->cursor_window != NULL)
     {
         gdk_window_set_cursor (details->cursor_window, NULL);
@@ -1398,67 +1417,278 @@ prepare_pango_layout_width (PeonyIconCanvasItem *item,
     }
 }
 
-static void
-prepare_pango_layout_for_measure_entire_text (PeonyIconCanvasItem *item,
-        PangoLayout *layout)
+static int
+get_layout_height_for_measure_entire_text (PeonyIconCanvasItem *item)
 {
     PeonyIconContainer *container;
 
-    prepare_pango_layout_width (item, layout);
-
     container = PEONY_ICON_CONTAINER (EEL_CANVAS_ITEM (item)->canvas);
 
     if (IS_COMPACT_VIEW (container))
     {
-        pango_layout_set_height (layout, -1);
-    }
-    else
-    {
-		pango_layout_set_height (layout, LAYOUT_HEIGHT);
+        return -1;
     }
+
+    return LAYOUT_HEIGHT;
 }
 
 static void
-prepare_pango_layout_for_draw (PeonyIconCanvasItem *item,
-                               PangoLayout *layout)
+prepare_pango_layout_for_measure_entire_text (PeonyIconCanvasItem *item,
+        PangoLayout *layout)
+{
+    prepare_pango_layout_width (item, layout);
+    pango_layout_set_height (layout, get_layout_height_for_measure_entire_text (item));
+}
+
+static int
+get_layout_height_for_draw (PeonyIconCanvasItem *item)
 {
     PeonyIconCanvasItemDetails *details;
     PeonyIconContainer *container;
     gboolean needs_highlight;
 
-    prepare_pango_layout_width (item, layout);
-
     container = PEONY_ICON_CONTAINER (EEL_CANVAS_ITEM (item)->canvas);
     details = item->details;
 
     needs_highlight = details->is_highlighted_for_selection || details->is_highlighted_for_drop;
 
-    if (IS_COMPACT_VIEW (container))
+    if (IS_COMPACT_VIEW (container) ||
+        container->details->label_position == PEONY_ICON_LABEL_POSITION_BESIDE)
     {
-        pango_layout_set_height (layout, -1);
+        return -1;
     }
     else if (needs_highlight ||
              details->is_prelit ||
              details->is_highlighted_as_keyboard_focus ||
-             details->entire_text ||
-             container->details->label_position == PEONY_ICON_LABEL_POSITION_BESIDE)
+             details->entire_text)
     {
         /* VOODOO-TODO, cf. compute_text_rectangle() */
-        pango_layout_set_height (layout, G_MININT);
+        return G_MININT;
     }
-    else
+
+    /* TODO? we might save some resources, when the re-layout is not neccessary in case
+     * the layout height already fits into max. layout lines. But pango should figure this
+     * out itself (which it doesn't ATM).
+     */
+    return -2/*peony_icon_container_get_max_layout_lines_for_pango (container)*/;
+}
+
+static void
+prepare_pango_layout_for_draw (PeonyIconCanvasItem *item,
+                               PangoLayout *layout)
+{
+    prepare_pango_layout_width (item, layout);
+    pango_layout_set_height (layout, get_layout_height_for_draw (item));
+}
+
+/* Sizes of a label as measured by measure_label_text (). Items with the
+ * same text and the same settings share them, so that a zoom or font
+ * change only shapes each distinct label once, and going back to a zoom
+ * level shapes nothing.
+ */
+typedef struct
+{
+    int width;
+    int height;
+    int dx;
+    int height_for_layout;
+    int height_for_entire_text;
+} LabelMetrics;
+
+/* The settings part of a key is interned, there are only a few of them
+ * at any time, one per zoom level and font.
+ */
+typedef struct
+{
+    const char *settings;
+    char *text;
+    LabelMetrics metrics;
+    GList link; /* in label_metrics_lru, most recently used first */
+} LabelMetricsEntry;
+
+static GHashTable *label_metrics_cache;
+static GQueue label_metrics_lru = G_QUEUE_INIT;
+
+static guint
+label_metrics_entry_hash (gconstpointer key)
+{
+    const LabelMetricsEntry *entry = key;
+
+    return g_direct_hash (entry->settings) ^ g_str_hash (entry->text);
+}
+
+static gboolean
+label_metrics_entry_equal (gconstpointer a,
+                           gconstpointer b)
+{
+    const LabelMetricsEntry *entry_a = a;
+    const LabelMetricsEntry *entry_b = b;
+
+    return entry_a->settings == entry_b->settings &&
+           strcmp (entry_a->text, entry_b->text) == 0;
+}
+
+static void
+label_metrics_entry_free (LabelMetricsEntry *entry)
+{
+    g_queue_unlink (&label_metrics_lru, &entry->link);
+    g_free (entry->text);
+    g_slice_free (LabelMetricsEntry, entry);
+}
+
+static void
+free_label_metrics_cache (void)
+{
+    g_hash_table_destroy (label_metrics_cache);
+    label_metrics_cache = NULL;
+}
+
+/* Everything but the text that the layout of a label depends on */
+static const char *
+get_label_metrics_settings (PeonyIconCanvasItem *item,
+                            gboolean editable)
+{
+    PeonyIconContainer *container;
+    PangoContext *context;
+    PangoFontDescription *desc;
+    const cairo_font_options_t *options;
+    const char *settings;
+    char *font;
+    char *str;
+
+    container = PEONY_ICON_CONTAINER (EEL_CANVAS_ITEM (item)->canvas);
+    context = gtk_widget_get_pango_context (GTK_WIDGET (container));
+    options = pango_cairo_context_get_font_options (context);
+
+    desc = get_label_font_description (item);
+    font = pango_font_description_to_string (desc);
+    pango_font_description_free (desc);
+
+    str = g_strdup_printf ("%d|%s|%g|%lu|%d|%d|%d|%d|%d|%d",
+                           editable,
+                           font,
+                           pango_cairo_context_get_resolution (context),
+                           options != NULL ? cairo_font_options_hash (options) : 0,
+                           (int) floor (peony_icon_canvas_item_get_max_text_width (item)),
+                           container->details->label_position,
+                           peony_icon_container_is_layout_rtl (container),
+                           editable ? get_layout_height_for_measure_entire_text (item) : 0,
+                           get_layout_height_for_draw (item),
+                           editable ? peony_icon_container_get_max_layout_lines (container) : 0);
+    settings = g_intern_string (str);
+    g_free (str);
+    g_free (font);
+
+    return settings;
+}
+
+static gboolean
+lookup_label_metrics (const char *settings,
+                      const char *text,
+                      LabelMetrics *metrics)
+{
+    LabelMetricsEntry key, *entry;
+
+    if (label_metrics_cache == NULL)
+    {
+        return FALSE;
+    }
+
+    key.settings = settings;
+    key.text = (char *) text;
+    entry = g_hash_table_lookup (label_metrics_cache, &key);
+    if (entry == NULL)
+    {
+        return FALSE;
+    }
+
+    g_queue_unlink (&label_metrics_lru, &entry->link);
+    g_queue_push_head_link (&label_metrics_lru, &entry->link);
+
+    *metrics = entry->metrics;
+    return TRUE;
+}
+
+static void
+store_label_metrics (const char *settings,
+                     const char *text,
+                     const LabelMetrics *metrics)
+{
+    LabelMetricsEntry *entry;
+    guint limit;
+
+    if (label_metrics_cache == NULL)
+    {
+        label_metrics_cache = g_hash_table_new_full (label_metrics_entry_hash,
+                              label_metrics_entry_equal,
+                              (GDestroyNotify) label_metrics_entry_free,
+                              NULL);
+        eel_debug_call_at_shutdown (free_label_metrics_cache);
+    }
+
+    limit = MAX (LABEL_METRICS_CACHE_MIN_SIZE, LABEL_METRICS_PER_ITEM * live_item_count);
+    while (g_hash_table_size (label_metrics_cache) >= limit)
+    {
+        g_hash_table_remove (label_metrics_cache, label_metrics_lru.tail->data);
+    }
+
+    entry = g_slice_new (LabelMetricsEntry);
+    entry->settings = settings;
+    entry->text = g_strdup (text);
+    entry->metrics = *metrics;
+    entry->link.data = entry;
+    entry->link.prev = entry->link.next = NULL;
+    g_queue_push_head_link (&label_metrics_lru, &entry->link);
+    g_hash_table_add (label_metrics_cache, entry);
+}
+
+/* Fills in @metrics from the cache, or shapes the label */
+static void
+measure_label_layout (PeonyIconCanvasItem *item,
+                      PangoLayout **layout_cache,
+                      const char *text,
+                      gboolean editable,
+                      LabelMetrics *metrics)
+{
+    PangoLayout *layout;
+    const char *settings, *layout_text;
+
+    settings = get_label_metrics_settings (item, editable);
+    layout_text = get_label_layout_text (item, text);
+    if (lookup_label_metrics (settings, layout_text, metrics))
+    {
+        return;
+    }
+
+    memset (metrics, 0, sizeof (LabelMetrics));
+    layout = get_label_layout (layout_cache, item, text);
+
+    if (editable)
     {
-        /* TODO? we might save some resources, when the re-layout is not neccessary in case
-         * the layout height already fits into max. layout lines. But pango should figure this
-         * out itself (which it doesn't ATM).
+        /* first, measure required text height: height_for_entire_text
+         * then, measure text height applicable for layout: height_for_layout
+         * next, measure actually displayed height: height
          */
-        pango_layout_set_height (layout,
-                                 -2/*peony_icon_container_get_max_layout_lines_for_pango (container)*/);
-	}
-	if(container->details->label_position == PEONY_ICON_LABEL_POSITION_BESIDE)
-	{
-		pango_layout_set_height (layout, -1);
+        prepare_pango_layout_for_measure_entire_text (item, layout);
+        layout_get_full_size (layout,
+                              NULL,
+                              &metrics->height_for_entire_text,
+                              NULL);
+        layout_get_size_for_layout (layout,
+                                    peony_icon_container_get_max_layout_lines (PEONY_ICON_CONTAINER (EEL_CANVAS_ITEM (item)->canvas)),
+                                    metrics->height_for_entire_text,
+                                    &metrics->height_for_layout);
     }
+
+    prepare_pango_layout_for_draw (item, layout);
+    layout_get_full_size (layout,
+                          &metrics->width,
+                          &metrics->height,
+                          &metrics->dx);
+
+    g_object_unref (layout);
+
+    store_label_metrics (settings, layout_text, metrics);
 }
 
 static void
@@ -1468,8 +1698,7 @@ measure_label_text (PeonyIconCanvasItem *item)
     PeonyIconContainer *container;
     gint editable_height, editable_height_for_layout, editable_height_for_entire_text, editable_width, editable_dx;
     gint additional_height, additional_width, additional_dx;
-    PangoLayout *editable_layout;
-    PangoLayout *additional_layout;
+    LabelMetrics metrics;
     gboolean have_editable, have_additional;
 
     /* check to see if the cached values are still valid; if so, there's
@@ -1515,40 +1744,25 @@ measure_label_text (PeonyIconCanvasItem *item)
     additional_dx = 0;
 
     container = PEONY_ICON_CONTAINER (EEL_CANVAS_ITEM (item)->canvas);
-    editable_layout = NULL;
-    additional_layout = NULL;
 
     if (have_editable)
     {
-        /* first, measure required text height: editable_height_for_entire_text
-         * then, measure text height applicable for layout: editable_height_for_layout
-         * next, measure actually displayed height: editable_height
-         */
-        editable_layout = get_label_layout (&details->editable_text_layout, item, details->editable_text);
-
-        prepare_pango_layout_for_measure_entire_text (item, editable_layout);
-        layout_get_full_size (editable_layout,
-                              NULL,
-                              &editable_height_for_entire_text,
-                              NULL);
-        layout_get_size_for_layout (editable_layout,
-                                    peony_icon_container_get_max_layout_lines (container),
-                                    editable_height_for_entire_text,
-                                    &editable_height_for_layout);
-
-        prepare_pango_layout_for_draw (item, editable_layout);
-        layout_get_full_size (editable_layout,
-                              &editable_width,
-                              &editable_height,
-                              &editable_dx);
+        measure_label_layout (item, &details->editable_text_layout,
+                              details->editable_text, TRUE, &metrics);
+        editable_width = metrics.width;
+        editable_height = metrics.height;
+        editable_dx = metrics.dx;
+        editable_height_for_layout = metrics.height_for_layout;
+        editable_height_for_entire_text = metrics.height_for_entire_text;
     }
 
     if (have_additional)
     {
-        additional_layout = get_label_layout (&details->additional_text_layout, item, details->additional_text);
-        prepare_pango_layout_for_draw (item, additional_layout);
-        layout_get_full_size (additional_layout,
-                              &additional_width, &additional_height, &additional_dx);
+        measure_label_layout (item, &details->additional_text_layout,
+                              details->additional_text, FALSE, &metrics);
+        additional_width = metrics.width;
+        additional_height = metrics.height;
+        additional_dx = metrics.dx;
     }
 
     details->editable_text_height = editable_height;
@@ -1601,16 +1815,6 @@ measure_label_text (PeonyIconCanvasItem *item)
 
     /* extra to make it look nicer */
     details->text_width += TEXT_BACK_PADDING_X*2;
-
-    if (editable_layout)
-    {
-        g_object_unref (editable_layout);
-    }
-
-    if (additional_layout)
-    {
-        g_object_unref (additional_layout);
-    }
 }
 
 static void
@@ -2520,6 +2724,38 @@ peony_icon_canvas_item_draw (EelCanvasItem *item,
     gtk_style_context_restore (context);
 }
 
+void
+peony_icon_canvas_item_draw_plain (PeonyIconCanvasItem *item,
+                                   cairo_t *cr)
+{
+    PeonyIconCanvasItemDetails *details;
+    PeonyIconCanvasItemDetails saved;
+
+    g_return_if_fail (PEONY_IS_ICON_CANVAS_ITEM (item));
+
+    details = item->details;
+    saved = *details;
+
+    details->is_active = FALSE;
+    details->is_highlighted_for_selection = FALSE;
+    details->is_highlighted_as_keyboard_focus = FALSE;
+    details->is_highlighted_for_drop = FALSE;
+    details->is_highlighted_for_clipboard = FALSE;
+    details->show_stretch_handles = FALSE;
+    details->is_prelit = FALSE;
+
+    peony_icon_canvas_item_draw (EEL_CANVAS_ITEM (item), cr, NULL);
+
+    /* The next regular draw maps the pixbuf for the real state again */
+    details->is_active = saved.is_active;
+    details->is_highlighted_for_selection = saved.is_highlighted_for_selection;
+    details->is_highlighted_as_keyboard_focus = saved.is_highlighted_as_keyboard_focus;
+    details->is_highlighted_for_drop = saved.is_highlighted_for_drop;
+    details->is_highlighted_for_clipboard = saved.is_highlighted_for_clipboard;
+    details->show_stretch_handles = saved.show_stretch_handles;
+    details->is_prelit = saved.is_prelit;
+}
+
 #define ZERO_WIDTH_SPACE "\xE2\x80\x8B"
 
 #define ZERO_OR_THREE_DIGITS(p) \
@@ -2528,6 +2764,31 @@ peony_icon_canvas_item_draw (EelCanvasItem *item,
 	  g_ascii_isdigit (*(p+2))))
 
 
+static PangoFontDescription *
+get_label_font_description (PeonyIconCanvasItem *item)
+{
+    PeonyIconContainer *container;
+    PangoContext *context;
+    PangoFontDescription *desc;
+
+    container = PEONY_ICON_CONTAINER (EEL_CANVAS_ITEM (item)->canvas);
+
+    if (container->details->font)
+    {
+        desc = pango_font_description_from_string (container->details->font);
+    }
+    else
+    {
+        context = gtk_widget_get_pango_context (GTK_WIDGET (container));
+        desc = pango_font_description_copy (pango_context_get_font_description (context));
+        pango_font_description_set_size (desc,
+                                         pango_font_description_get_size (desc) +
+                                         container->details->font_size_table [container->details->zoom_level]);
+    }
+
+    return desc;
+}
+
 static PangoLayout *
 create_label_layout (PeonyIconCanvasItem *item,
                      const char *text)
@@ -2592,18 +2853,7 @@ create_label_layout (PeonyIconCanvasItem *item,
     pango_layout_set_spacing (layout, LABEL_LINE_SPACING);
     pango_layout_set_wrap (layout, PANGO_WRAP_WORD_CHAR);
 
-    /* Create a font description */
-    if (container->details->font)
-    {
-        desc = pango_font_description_from_string (container->details->font);
-    }
-    else
-    {
-        desc = pango_font_description_copy (pango_context_get_font_description (context));
-        pango_font_description_set_size (desc,
-                                         pango_font_description_get_size (desc) +
-                                         container->details->font_size_table [container->details->zoom_level]);
-    }
+    desc = get_label_font_description (item);
     pango_layout_set_font_description (layout, desc);
     pango_font_description_free (desc);
     g_free (zeroified_text);
@@ -2612,6 +2862,24 @@ create_label_layout (PeonyIconCanvasItem *item,
 }
 
 
+//we want to simplify the label text, only show disk label, rather than disk fullname and label if possible.
+static const char *
+get_label_layout_text (PeonyIconCanvasItem *item,
+                       const char *text)
+{
+    PeonyIconContainer *container;
+    const char *suffix;
+
+    container = PEONY_ICON_CONTAINER (EEL_CANVAS_ITEM (item)->canvas);
+    if(container->name){
+	    suffix = strchr(text,':');
+	    if(suffix != NULL)
+		    return suffix + 2;
+    }
+
+    return text;
+}
+
 //when get_label_layout, deal with the disk label all together.
 static PangoLayout *
 get_label_layout (PangoLayout **layout_cache,
@@ -2619,26 +2887,13 @@ get_label_layout (PangoLayout **layout_cache,
                   const char *text)
 {
     PangoLayout *layout;
-    
-    char *label_layout_text;
-    label_layout_text = text;
-
 
-    //we want to simplify the label text, only show disk label, rather than disk fullname and label if possible.
-    PeonyIconContainer *container;
-    container = PEONY_ICON_CONTAINER (EEL_CANVAS_ITEM (item)->canvas);
-    if(container->name){
-	    char* suffix;
-	    suffix = strchr(text,':');
-	    if(suffix != NULL)
-		    label_layout_text = (char*)(suffix + 2);
-    }
     if (*layout_cache != NULL)
     {
         return g_object_ref (*layout_cache);
     }
 
-    layout = create_label_layout (item, label_layout_text);
+    layout = create_label_layout (item, get_label_layout_text (item, text));
     
 
     //layout = create_label_layout (item, text);
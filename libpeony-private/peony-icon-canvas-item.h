@@ -321,6 +321,12 @@ typedef struct
     void        peony_icon_canvas_item_set_renaming             (PeonyIconCanvasItem       *icon_item,
             gboolean                      state);
 
+    /* drawing */
+    /* Draws the item as it looks when not selected, focused, hovered or
+     * highlighted, for pictures of the container kept beyond those states. */
+    void        peony_icon_canvas_item_draw_plain               (PeonyIconCanvasItem       *item,
+            cairo_t                      *cr);
+
     /* geometry and hit testing */
     gboolean    peony_icon_canvas_item_hit_test_rectangle       (PeonyIconCanvasItem       *item,
             EelIRect                      canvas_rect);
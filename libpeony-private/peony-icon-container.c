@@ -73,6 +73,14 @@
 
 #define CONTEXT_MENU_TIMEOUT_INTERVAL 500
 
+/* Layouts with more lines than this position the visible lines first and
+ * the others in slices of at most LAYOUT_SLICE_USEC, so that frames keep
+ * coming while a huge folder is laid out again. Anything that looks at
+ * where the icons are has to finish_pending_layout () first.
+ */
+#define LAYOUT_SLICE_MIN_LINES 200
+#define LAYOUT_SLICE_USEC 8000
+
 /* Maximum amount of milliseconds the mouse button is allowed to stay down
  * and still be considered a click.
  */
@@ -217,6 +225,9 @@ static void          handle_vadjustment_changed                     (GtkAdjustme
         PeonyIconContainer *container);
 static GList *       peony_icon_container_get_selected_icons (PeonyIconContainer *container);
 static void          peony_icon_container_update_visible_icons   (PeonyIconContainer *container);
+static void          icon_set_visible                               (PeonyIconContainer *container,
+        PeonyIcon *icon,
+        gboolean visible);
 static void          reveal_icon                                    (PeonyIconContainer *container,
         PeonyIcon *icon);
 
@@ -490,6 +501,21 @@ emit_stretch_ended (PeonyIconContainer *container, PeonyIcon *icon)
                    icon->data);
 }
 
+/* Selection changes alternate for each icon, so a change that undoes
+ * the pending one leaves nothing to report.
+ */
+static void
+record_selection_change (PeonyIconContainer *container,
+                         PeonyIconData *data,
+                         gboolean selected)
+{
+    if (!g_hash_table_remove (container->details->selection_changes, data))
+    {
+        g_hash_table_insert (container->details->selection_changes,
+                             data, GINT_TO_POINTER (selected));
+    }
+}
+
 static void
 icon_toggle_selected (PeonyIconContainer *container,
                       PeonyIcon *icon)
@@ -497,6 +523,15 @@ icon_toggle_selected (PeonyIconContainer *container,
     end_renaming_mode (container, TRUE);
 
     icon->is_selected = !icon->is_selected;
+    if (icon->is_selected)
+    {
+        g_hash_table_add (container->details->selected_icons, icon);
+    }
+    else
+    {
+        g_hash_table_remove (container->details->selected_icons, icon);
+    }
+    record_selection_change (container, icon->data, icon->is_selected);
     eel_canvas_item_set (EEL_CANVAS_ITEM (icon->item),
                          "highlighted_for_selection", (gboolean) icon->is_selected,
                          NULL);
@@ -750,6 +785,8 @@ icon_get_row_and_column_bounds (PeonyIconContainer *container,
 
 }
 
+static void finish_pending_layout (PeonyIconContainer *container);
+
 static void
 reveal_icon (PeonyIconContainer *container,
              PeonyIcon *icon)
@@ -758,6 +795,9 @@ reveal_icon (PeonyIconContainer *container,
     GtkAdjustment *hadj, *vadj;
     EelIRect bounds;
 
+    /* The row bounds below need the lines around the icon in place */
+    finish_pending_layout (container);
+
     if (!icon_is_positioned (icon)) {
         set_pending_icon_to_reveal (container, icon);
         return;
@@ -1260,6 +1300,8 @@ compare_icons (gconstpointer a, gconstpointer b, gpointer icon_container)
     return klass->compare_icons (icon_container, icon_a->data, icon_b->data);
 }
 
+static void restart_pending_layout (PeonyIconContainer *container);
+
 static void
 sort_icons (PeonyIconContainer *container,
             GList                **icons)
@@ -1269,13 +1311,31 @@ sort_icons (PeonyIconContainer *container,
     klass = PEONY_ICON_CONTAINER_GET_CLASS (container);
     g_assert (klass->compare_icons != NULL);
 
+    /* Sorting relinks the list a pending layout walks */
+    if (icons == &container->details->icons)
+    {
+        restart_pending_layout (container);
+    }
+
     *icons = g_list_sort_with_data (*icons, compare_icons, container);
 }
 
 static void
 resort (PeonyIconContainer *container)
 {
-    sort_icons (container, &container->details->icons);
+    GList *p;
+
+    /* Most relayouts come with the order unchanged, checking that is
+     * far cheaper than sorting again.
+     */
+    for (p = container->details->icons; p != NULL && p->next != NULL; p = p->next)
+    {
+        if (compare_icons (p->data, p->next->data, container) > 0)
+        {
+            sort_icons (container, &container->details->icons);
+            return;
+        }
+    }
 }
 
 typedef struct
@@ -1286,13 +1346,36 @@ typedef struct
     double y_offset;
 } IconPositions;
 
+/* A line of icons, laid out but not positioned yet */
+typedef struct
+{
+    GList *start;
+    GList *end;
+    double y;
+    double max_height;
+    guint first_position;
+    gboolean whole_text;
+    /* Extent of the line, to tell whether it is visible */
+    double top;
+    double bottom;
+    gboolean done;
+} IconLine;
+
+struct PeonyIconPendingLayout
+{
+    GArray *lines;
+    GArray *positions;
+    guint next_line;
+    guint idle_id;
+};
+
 static void
 lay_down_one_line (PeonyIconContainer *container,
                    GList *line_start,
                    GList *line_end,
                    double y,
                    double max_height,
-                   GArray *positions,
+                   IconPositions *positions,
                    gboolean whole_text)
 {
     GList *p;
@@ -1311,7 +1394,7 @@ lay_down_one_line (PeonyIconContainer *container,
     {
         icon = p->data;
 
-        position = &g_array_index (positions, IconPositions, i++);
+        position = &positions[i++];
 
         if (container->details->label_position == PEONY_ICON_LABEL_POSITION_BESIDE)
         {
@@ -1334,6 +1417,185 @@ lay_down_one_line (PeonyIconContainer *container,
     }
 }
 
+static void
+lay_down_icon_line (PeonyIconContainer *container,
+                    IconLine *line,
+                    GArray *positions)
+{
+    lay_down_one_line (container, line->start, line->end, line->y, line->max_height,
+                       &g_array_index (positions, IconPositions, line->first_position),
+                       line->whole_text);
+    line->done = TRUE;
+}
+
+static void
+pending_layout_free (PeonyIconPendingLayout *pending)
+{
+    if (pending->idle_id != 0)
+    {
+        g_source_remove (pending->idle_id);
+    }
+    g_array_free (pending->lines, TRUE);
+    g_array_free (pending->positions, TRUE);
+    g_free (pending);
+}
+
+/* The lines refer to list links, anything that changes the list or
+ * starts another layout has to drop the rest first.
+ */
+static void
+cancel_pending_layout (PeonyIconContainer *container)
+{
+    if (container->details->pending_layout != NULL)
+    {
+        pending_layout_free (container->details->pending_layout);
+        container->details->pending_layout = NULL;
+    }
+}
+
+static void schedule_redo_layout (PeonyIconContainer *container);
+
+/* When the list changes under a pending layout, lays it all out again.
+ * The lines refer to links of the old list, so the new layout starts
+ * over from the first line and the slices already done count for
+ * nothing; they only cost the time they took.
+ */
+static void
+restart_pending_layout (PeonyIconContainer *container)
+{
+    if (container->details->pending_layout != NULL)
+    {
+        cancel_pending_layout (container);
+        schedule_redo_layout (container);
+    }
+}
+
+static void redo_layout_finish (PeonyIconContainer *container);
+
+static gboolean
+pending_layout_callback (gpointer callback_data)
+{
+    PeonyIconContainer *container;
+    PeonyIconPendingLayout *pending;
+    IconLine *line;
+    gint64 deadline;
+
+    container = PEONY_ICON_CONTAINER (callback_data);
+    pending = container->details->pending_layout;
+    deadline = g_get_monotonic_time () + LAYOUT_SLICE_USEC;
+
+    while (pending->next_line < pending->lines->len)
+    {
+        line = &g_array_index (pending->lines, IconLine, pending->next_line++);
+        if (!line->done)
+        {
+            lay_down_icon_line (container, line, pending->positions);
+        }
+
+        if (g_get_monotonic_time () >= deadline)
+        {
+            return TRUE;
+        }
+    }
+
+    pending->idle_id = 0;
+    cancel_pending_layout (container);
+    redo_layout_finish (container);
+
+    return FALSE;
+}
+
+/* For when the icons have to be in place right away */
+static void
+finish_pending_layout (PeonyIconContainer *container)
+{
+    PeonyIconPendingLayout *pending;
+    IconLine *line;
+
+    pending = container->details->pending_layout;
+    if (pending == NULL)
+    {
+        return;
+    }
+
+    while (pending->next_line < pending->lines->len)
+    {
+        line = &g_array_index (pending->lines, IconLine, pending->next_line++);
+        if (!line->done)
+        {
+            lay_down_icon_line (container, line, pending->positions);
+        }
+    }
+
+    cancel_pending_layout (container);
+    redo_layout_finish (container);
+}
+
+/* Positions the lines in view now and leaves the others for later */
+static void
+lay_down_icon_lines_sliced (PeonyIconContainer *container,
+                            GArray *lines,
+                            GArray *positions)
+{
+    PeonyIconPendingLayout *pending;
+    GtkAdjustment *vadj;
+    GtkAllocation allocation;
+    IconLine *line;
+    double min_x, min_y, max_x, max_y;
+    guint i;
+
+    vadj = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (container));
+    gtk_widget_get_allocation (GTK_WIDGET (container), &allocation);
+
+    /* A page of margin on either side hides the seams when scrolling */
+    min_y = gtk_adjustment_get_value (vadj) - allocation.height;
+    max_y = gtk_adjustment_get_value (vadj) + 2 * allocation.height;
+    min_x = max_x = 0;
+    eel_canvas_c2w (EEL_CANVAS (container), min_x, min_y, &min_x, &min_y);
+    eel_canvas_c2w (EEL_CANVAS (container), max_x, max_y, &max_x, &max_y);
+
+    for (i = 0; i < lines->len; i++)
+    {
+        line = &g_array_index (lines, IconLine, i);
+        if (line->bottom >= min_y && line->top <= max_y)
+        {
+            lay_down_icon_line (container, line, positions);
+        }
+    }
+
+    pending = g_new0 (PeonyIconPendingLayout, 1);
+    pending->lines = lines;
+    pending->positions = positions;
+    pending->idle_id = g_idle_add (pending_layout_callback, container);
+    container->details->pending_layout = pending;
+}
+
+static void
+add_icon_line (GArray *lines,
+               GList *start,
+               GList *end,
+               double y,
+               double max_height,
+               guint first_position,
+               gboolean whole_text,
+               double top,
+               double bottom)
+{
+    IconLine line;
+
+    line.start = start;
+    line.end = end;
+    line.y = y;
+    line.max_height = max_height;
+    line.first_position = first_position;
+    line.whole_text = whole_text;
+    line.top = top;
+    line.bottom = bottom;
+    line.done = FALSE;
+
+    g_array_append_val (lines, line);
+}
+
 static void
 lay_down_one_column (PeonyIconContainer *container,
                      GList *line_start,
@@ -1379,8 +1641,10 @@ lay_down_icons_horizontal (PeonyIconContainer *container,
 {
     GList *p, *line_start;
     PeonyIcon *icon;
-    double canvas_width, y;
+    double canvas_width, y, line_top;
     GArray *positions;
+    GArray *lines;
+    guint line_first_position;
     IconPositions *position;
     EelDRect bounds;
     EelDRect icon_bounds;
@@ -1392,7 +1656,7 @@ lay_down_icons_horizontal (PeonyIconContainer *container,
     double grid_width;
     double max_text_width, max_icon_width;
     int icon_width;
-    int i;
+    guint i;
     GtkAllocation allocation;
 
     g_assert (PEONY_IS_ICON_CONTAINER (container));
@@ -1402,7 +1666,11 @@ lay_down_icons_horizontal (PeonyIconContainer *container,
         return;
     }
 
+    /* First find the lines and where each icon goes in its line, which
+     * only takes the bounds the items already have. Then move the icons.
+     */
     positions = g_array_new (FALSE, FALSE, sizeof (IconPositions));
+    lines = g_array_new (FALSE, FALSE, sizeof (IconLine));
     gtk_widget_get_allocation (GTK_WIDGET (container), &allocation);
 
     /* Lay out icons a line at a time. */
@@ -1434,8 +1702,9 @@ lay_down_icons_horizontal (PeonyIconContainer *container,
 
     line_width = container->details->label_position == PEONY_ICON_LABEL_POSITION_BESIDE ? ICON_PAD_LEFT : 0;
     line_start = icons;
+    line_first_position = 0;
     y = start_y + CONTAINER_PAD_TOP(container);
-    i = 0;
+    line_top = y;
 
     max_height_above = 0;
     max_height_below = 0;
@@ -1479,7 +1748,9 @@ lay_down_icons_horizontal (PeonyIconContainer *container,
                 y += ICON_PAD_TOP + max_height_above;
             }
 
-            lay_down_one_line (container, line_start, p, y, max_height_above, positions, FALSE);
+            add_icon_line (lines, line_start, p, y, max_height_above,
+                           line_first_position, FALSE, line_top,
+                           y + max_height_above + max_height_below);
 
             if (container->details->label_position == PEONY_ICON_LABEL_POSITION_BESIDE)
             {
@@ -1493,7 +1764,8 @@ lay_down_icons_horizontal (PeonyIconContainer *container,
 
             line_width = container->details->label_position == PEONY_ICON_LABEL_POSITION_BESIDE ? ICON_PAD_LEFT : 0;
             line_start = p;
-            i = 0;
+            line_first_position = positions->len;
+            line_top = y;
 
             max_height_above = height_above;
             max_height_below = height_below;
@@ -1510,8 +1782,8 @@ lay_down_icons_horizontal (PeonyIconContainer *container,
             }
         }
 
-        g_array_set_size (positions, i + 1);
-        position = &g_array_index (positions, IconPositions, i++);
+        g_array_set_size (positions, positions->len + 1);
+        position = &g_array_index (positions, IconPositions, positions->len - 1);
         position->width = icon_width;
         position->height = icon_bounds.y1 - icon_bounds.y0;
 
@@ -1550,12 +1822,28 @@ lay_down_icons_horizontal (PeonyIconContainer *container,
             y += ICON_PAD_TOP + max_height_above;
         }
 
-        lay_down_one_line (container, line_start, NULL, y, max_height_above, positions, TRUE);
+        add_icon_line (lines, line_start, NULL, y, max_height_above,
+                       line_first_position, TRUE, line_top,
+                       y + max_height_above + max_height_below);
+    }
 
-        /* Advance to next line. */
-        y += max_height_below + ICON_PAD_BOTTOM(container->details->zoom_level);
+    /* Only a whole relayout can be left for later, the lines are
+     * links of the container's list.
+     */
+    if (icons == container->details->icons
+            && lines->len > LAYOUT_SLICE_MIN_LINES
+            && gtk_widget_get_realized (GTK_WIDGET (container)))
+    {
+        lay_down_icon_lines_sliced (container, lines, positions);
+        return;
     }
 
+    for (i = 0; i < lines->len; i++)
+    {
+        lay_down_icon_line (container, &g_array_index (lines, IconLine, i), positions);
+    }
+
+    g_array_free (lines, TRUE);
     g_array_free (positions, TRUE);
 }
 
@@ -3007,9 +3295,25 @@ lay_down_icons (PeonyIconContainer *container, GList *icons, double start_y)
     }
 }
 
+static void
+redo_layout_finish (PeonyIconContainer *container)
+{
+    if (peony_icon_container_is_layout_rtl (container))
+    {
+        peony_icon_container_set_rtl_positions (container);
+    }
+
+    peony_icon_container_update_scroll_region (container);
+
+    process_pending_icon_to_reveal (container);
+    process_pending_icon_to_rename (container);
+    peony_icon_container_update_visible_icons (container);
+}
+
 static void
 redo_layout_internal (PeonyIconContainer *container)
 {
+    cancel_pending_layout (container);
 
     finish_adding_new_icons (container);
 
@@ -3053,16 +3357,14 @@ redo_layout_internal (PeonyIconContainer *container)
         lay_down_icons (container, container->details->icons, 0);
     }
 
-    if (peony_icon_container_is_layout_rtl (container))
+    /* The rest waits for the lines left for later */
+    if (container->details->pending_layout != NULL)
     {
-        peony_icon_container_set_rtl_positions (container);
+        peony_icon_container_update_visible_icons (container);
+        return;
     }
 
-    peony_icon_container_update_scroll_region (container);
-
-    process_pending_icon_to_reveal (container);
-    process_pending_icon_to_rename (container);
-    peony_icon_container_update_visible_icons (container);
+    redo_layout_finish (container);
 }
 
 static gboolean
@@ -3264,17 +3566,27 @@ select_one_unselect_others (PeonyIconContainer *container,
                             PeonyIcon *icon_to_select)
 {
     gboolean selection_changed;
-    GList *p;
+    GList *selected, *p;
     PeonyIcon *icon;
 
     selection_changed = FALSE;
 
-    for (p = container->details->icons; p != NULL; p = p->next)
+    /* Only the selected icons can change, no need to visit the rest */
+    selected = g_hash_table_get_keys (container->details->selected_icons);
+    for (p = selected; p != NULL; p = p->next)
     {
         icon = p->data;
 
-        selection_changed |= icon_set_selected
-                             (container, icon, icon == icon_to_select);
+        if (icon != icon_to_select)
+        {
+            selection_changed |= icon_set_selected (container, icon, FALSE);
+        }
+    }
+    g_list_free (selected);
+
+    if (icon_to_select != NULL)
+    {
+        selection_changed |= icon_set_selected (container, icon_to_select, TRUE);
     }
 
     if (selection_changed && icon_to_select != NULL)
@@ -3665,6 +3977,9 @@ start_rubberbanding (PeonyIconContainer *container,
 	details = container->details;
 	band_info = &details->rubberband_info;
 
+	/* The band selects by where the icons are */
+	finish_pending_layout (container);
+
 	g_signal_emit (container,
 		       signals[BAND_SELECT_STARTED], 0);
 
@@ -4700,6 +5015,7 @@ keyboard_home (PeonyIconContainer *container,
     /* Home selects the first icon.
      * Control-Home sets the keyboard focus to the first icon.
      */
+    finish_pending_layout (container);
 
     from = find_best_selected_icon (container, NULL,
                                     rightmost_in_bottom_row,
@@ -4719,6 +5035,7 @@ keyboard_end (PeonyIconContainer *container,
     /* End selects the last icon.
      * Control-End sets the keyboard focus to the last icon.
      */
+    finish_pending_layout (container);
     from = find_best_selected_icon (container, NULL,
                                     leftmost_in_top_row,
                                     NULL);
@@ -4763,6 +5080,9 @@ keyboard_arrow_key (PeonyIconContainer *container,
     PeonyIcon *to;
     int data;
 
+    /* The icons are found by where they are */
+    finish_pending_layout (container);
+
     /* Chose the icon to start with.
      * If we have a keyboard focus, start with it.
      * Otherwise, use the single selected icon.
@@ -5159,6 +5479,8 @@ destroy (GtkWidget *object)
         container->details->idle_id = 0;
     }
 
+    cancel_pending_layout (container);
+
     if (container->details->stretch_idle_id != 0)
     {
         g_source_remove (container->details->stretch_idle_id);
@@ -5219,6 +5541,18 @@ finalize (GObject *object)
     g_hash_table_destroy (details->icon_set);
     details->icon_set = NULL;
 
+    if (details->clipboard_icon_data != NULL)
+    {
+        g_hash_table_unref (details->clipboard_icon_data);
+        details->clipboard_icon_data = NULL;
+    }
+    g_hash_table_destroy (details->clipboard_highlighted);
+    details->clipboard_highlighted = NULL;
+    g_hash_table_destroy (details->selected_icons);
+    details->selected_icons = NULL;
+    g_hash_table_destroy (details->selection_changes);
+    details->selection_changes = NULL;
+
     g_free (details->font);
 
     if (details->a11y_item_action_queue != NULL)
@@ -7544,6 +7878,9 @@ peony_icon_container_init (PeonyIconContainer *container)
     details = g_new0 (PeonyIconContainerDetails, 1);
 
     details->icon_set = g_hash_table_new (g_direct_hash, g_direct_equal);
+    details->clipboard_highlighted = g_hash_table_new (g_direct_hash, g_direct_equal);
+    details->selected_icons = g_hash_table_new (g_direct_hash, g_direct_equal);
+    details->selection_changes = g_hash_table_new (g_direct_hash, g_direct_equal);
     details->layout_timestamp = UNDEFINED_TIME;
 
     details->zoom_level = PEONY_ZOOM_LEVEL_STANDARD;
@@ -7836,6 +8173,8 @@ peony_icon_container_clear (PeonyIconContainer *container)
 {
     PeonyIconContainerDetails *details;
     PeonyIcon *icon;
+    GHashTableIter iter;
+    gpointer selected;
     GList *p;
 
     g_return_if_fail (PEONY_IS_ICON_CONTAINER (container));
@@ -7851,6 +8190,7 @@ peony_icon_container_clear (PeonyIconContainer *container)
 
     end_renaming_mode (container, TRUE);
 
+    cancel_pending_layout (container);
     clear_keyboard_focus (container);
     clear_keyboard_rubberband_start (container);
     unschedule_keyboard_icon_reveal (container);
@@ -7868,6 +8208,7 @@ peony_icon_container_clear (PeonyIconContainer *container)
                     icon->data,
                     icon);
         }
+        icon_set_visible (container, icon, FALSE);
         icon_free (p->data);
     }
     g_list_free (details->icons);
@@ -7877,6 +8218,13 @@ peony_icon_container_clear (PeonyIconContainer *container)
 
     g_hash_table_destroy (details->icon_set);
     details->icon_set = g_hash_table_new (g_direct_hash, g_direct_equal);
+    g_hash_table_remove_all (details->clipboard_highlighted);
+    g_hash_table_iter_init (&iter, details->selected_icons);
+    while (g_hash_table_iter_next (&iter, &selected, NULL))
+    {
+        record_selection_change (container, ((PeonyIcon *) selected)->data, FALSE);
+    }
+    g_hash_table_remove_all (details->selected_icons);
 
     peony_icon_container_update_scroll_region (container);
 }
@@ -7899,6 +8247,8 @@ peony_icon_container_get_first_visible_icon (PeonyIconContainer *container)
     gboolean better_icon;
     gboolean compare_lt;
 
+    finish_pending_layout (container);
+
     hadj_v = gtk_adjustment_get_value (gtk_scrollable_get_hadjustment (GTK_SCROLLABLE (container)));
     vadj_v = gtk_adjustment_get_value (gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (container)));
     h_page_size = gtk_adjustment_get_page_size (gtk_scrollable_get_hadjustment (GTK_SCROLLABLE (container)));
@@ -8091,11 +8441,19 @@ icon_destroy (PeonyIconContainer *container,
     item = item->next ? item->next : item->prev;
     icon_to_focus = (item != NULL) ? item->data : NULL;
 
+    restart_pending_layout (container);
+
     details->icons = g_list_remove (details->icons, icon);
     details->new_icons = g_list_remove (details->new_icons, icon);
     g_hash_table_remove (details->icon_set, icon->data);
+    g_hash_table_remove (details->clipboard_highlighted, icon->data);
+    g_hash_table_remove (details->selected_icons, icon);
 
     was_selected = icon->is_selected;
+    if (was_selected)
+    {
+        record_selection_change (container, icon->data, FALSE);
+    }
 
     if (details->keyboard_focus == icon ||
             details->keyboard_focus == NULL)
@@ -8146,6 +8504,7 @@ icon_destroy (PeonyIconContainer *container,
                 icon->data,
                 icon);
     }
+    icon_set_visible (container, icon, FALSE);
     icon_free (icon);
 
     if (was_selected)
@@ -8288,6 +8647,28 @@ peony_icon_container_prioritize_thumbnailing (PeonyIconContainer *container,
     klass->prioritize_thumbnailing (container, icon->data);
 }
 
+static void
+icon_set_visible (PeonyIconContainer *container,
+                  PeonyIcon *icon,
+                  gboolean visible)
+{
+    PeonyIconContainerClass *klass;
+
+    peony_icon_canvas_item_set_is_visible (icon->item, visible);
+
+    if (icon->is_visible == visible)
+    {
+        return;
+    }
+    icon->is_visible = visible;
+
+    klass = PEONY_ICON_CONTAINER_GET_CLASS (container);
+    if (klass->icon_visibility_changed != NULL)
+    {
+        klass->icon_visibility_changed (container, icon->data, visible);
+    }
+}
+
 static void
 peony_icon_container_update_visible_icons (PeonyIconContainer *container)
 {
@@ -8345,16 +8726,12 @@ peony_icon_container_update_visible_icons (PeonyIconContainer *container)
                 visible = y1 >= min_y && y0 <= max_y;
             }
 
+            icon_set_visible (container, icon, visible);
             if (visible)
             {
-                peony_icon_canvas_item_set_is_visible (icon->item, TRUE);
                 peony_icon_container_prioritize_thumbnailing (container,
                         icon);
             }
-            else
-            {
-                peony_icon_canvas_item_set_is_visible (icon->item, FALSE);
-            }
         }
     }
 }
@@ -8752,6 +9129,15 @@ peony_icon_container_add (PeonyIconContainer *container,
 
     g_hash_table_insert (details->icon_set, data, icon);
 
+    if (details->clipboard_icon_data != NULL &&
+        g_hash_table_contains (details->clipboard_icon_data, data))
+    {
+        eel_canvas_item_set (EEL_CANVAS_ITEM (icon->item),
+                             "highlighted-for-clipboard", TRUE,
+                             NULL);
+        g_hash_table_add (details->clipboard_highlighted, data);
+    }
+
     /* Run an idle function to add the icons. */
     schedule_redo_layout (container);
 
@@ -8767,6 +9153,8 @@ peony_icon_container_layout_now (PeonyIconContainer *container)
         redo_layout_internal (container);
     }
 
+    finish_pending_layout (container);
+
     /* Also need to make sure we're properly resized, for instance
      * newly added files may trigger a change in the size allocation and
      * thus toggle scrollbars on */
@@ -9035,47 +9423,113 @@ peony_icon_container_reveal (PeonyIconContainer *container, PeonyIconData *data)
 GList *
 peony_icon_container_get_selection (PeonyIconContainer *container)
 {
-    GList *list, *p;
+    GList *list, *icons;
 
     g_return_val_if_fail (PEONY_IS_ICON_CONTAINER (container), NULL);
 
     list = NULL;
-    for (p = container->details->icons; p != NULL; p = p->next)
+    icons = peony_icon_container_get_selected_icons (container);
+    for (; icons != NULL; icons = g_list_delete_link (icons, icons))
     {
-        PeonyIcon *icon;
-
-        icon = p->data;
-        if (icon->is_selected)
-        {
-            list = g_list_prepend (list, icon->data);
-        }
+        list = g_list_prepend (list, ((PeonyIcon *) icons->data)->data);
     }
 
     return g_list_reverse (list);
 }
 
+/* In display order, like the selection always was. An automatic layout
+ * shows the icons sorted, so a selection that is small next to the
+ * folder is sorted on its own; otherwise the walk stops as soon as
+ * every selected icon was seen.
+ */
 static GList *
 peony_icon_container_get_selected_icons (PeonyIconContainer *container)
 {
     GList *list, *p;
+    guint remaining;
 
     g_return_val_if_fail (PEONY_IS_ICON_CONTAINER (container), NULL);
 
-    list = NULL;
-    for (p = container->details->icons; p != NULL; p = p->next)
+    remaining = g_hash_table_size (container->details->selected_icons);
+    if (remaining == 0)
     {
-        PeonyIcon *icon;
+        return NULL;
+    }
 
-        icon = p->data;
-        if (icon->is_selected)
+    if (container->details->auto_layout &&
+            remaining < g_hash_table_size (container->details->icon_set) / 16)
+    {
+        list = g_hash_table_get_keys (container->details->selected_icons);
+        return g_list_sort_with_data (list, compare_icons, container);
+    }
+
+    list = NULL;
+    for (p = container->details->icons; p != NULL && remaining > 0; p = p->next)
+    {
+        if (g_hash_table_contains (container->details->selected_icons, p->data))
         {
-            list = g_list_prepend (list, icon);
+            list = g_list_prepend (list, p->data);
+            remaining--;
         }
     }
 
     return g_list_reverse (list);
 }
 
+/**
+ * peony_icon_container_take_selection_changes:
+ * @container: An icon container widget.
+ * @selected: Return location for the data of icons selected since the
+ * last call.
+ * @unselected: Return location for the data of icons unselected or
+ * removed since the last call.
+ *
+ * Lets a caller that keeps its own copy of the selection follow it
+ * without asking for the whole selection each time. The lists must be
+ * freed with g_list_free(); their data is not referenced.
+ **/
+void
+peony_icon_container_take_selection_changes (PeonyIconContainer *container,
+        GList **selected,
+        GList **unselected)
+{
+    GHashTableIter iter;
+    gpointer data, is_selected;
+
+    g_return_if_fail (PEONY_IS_ICON_CONTAINER (container));
+
+    *selected = NULL;
+    *unselected = NULL;
+
+    g_hash_table_iter_init (&iter, container->details->selection_changes);
+    while (g_hash_table_iter_next (&iter, &data, &is_selected))
+    {
+        if (GPOINTER_TO_INT (is_selected))
+        {
+            *selected = g_list_prepend (*selected, data);
+        }
+        else
+        {
+            *unselected = g_list_prepend (*unselected, data);
+        }
+    }
+    g_hash_table_remove_all (container->details->selection_changes);
+}
+
+/**
+ * peony_icon_container_get_selection_count:
+ * @container: An icon container widget.
+ *
+ * Return value: The number of selected icons, without building a list.
+ **/
+guint
+peony_icon_container_get_selection_count (PeonyIconContainer *container)
+{
+    g_return_val_if_fail (PEONY_IS_ICON_CONTAINER (container), 0);
+
+    return g_hash_table_size (container->details->selected_icons);
+}
+
 /**
  * peony_icon_container_invert_selection:
  * @container: An icon container.
@@ -9139,6 +9593,8 @@ peony_icon_container_get_selected_icon_locations (PeonyIconContainer *container)
 
     g_return_val_if_fail (PEONY_IS_ICON_CONTAINER (container), NULL);
 
+    finish_pending_layout (container);
+
     icons = peony_icon_container_get_selected_icons (container);
     result = peony_icon_container_get_icon_locations (container, icons);
     g_list_free (icons);
@@ -9161,6 +9617,11 @@ peony_icon_container_select_all (PeonyIconContainer *container)
 
     g_return_if_fail (PEONY_IS_ICON_CONTAINER (container));
 
+    if (all_selected (container))
+    {
+        return;
+    }
+
     selection_changed = FALSE;
 
     for (p = container->details->icons; p != NULL; p = p->next)
@@ -9191,25 +9652,38 @@ peony_icon_container_set_selection (PeonyIconContainer *container,
 {
     gboolean selection_changed;
     GHashTable *hash;
-    GList *p;
+    GList *selected, *p;
     PeonyIcon *icon;
 
     g_return_if_fail (PEONY_IS_ICON_CONTAINER (container));
 
     selection_changed = FALSE;
 
+    /* Visit the icons that are or will be selected, not all of them */
     hash = g_hash_table_new (NULL, NULL);
     for (p = selection; p != NULL; p = p->next)
     {
         g_hash_table_insert (hash, p->data, p->data);
     }
-    for (p = container->details->icons; p != NULL; p = p->next)
+    selected = g_hash_table_get_keys (container->details->selected_icons);
+    for (p = selected; p != NULL; p = p->next)
     {
         icon = p->data;
 
-        selection_changed |= icon_set_selected
-                             (container, icon,
-                              g_hash_table_lookup (hash, icon->data) != NULL);
+        if (g_hash_table_lookup (hash, icon->data) == NULL)
+        {
+            selection_changed |= icon_set_selected (container, icon, FALSE);
+        }
+    }
+    g_list_free (selected);
+    for (p = selection; p != NULL; p = p->next)
+    {
+        icon = g_hash_table_lookup (container->details->icon_set, p->data);
+
+        if (icon != NULL)
+        {
+            selection_changed |= icon_set_selected (container, icon, TRUE);
+        }
     }
     g_hash_table_destroy (hash);
 
@@ -9233,7 +9707,7 @@ peony_icon_container_select_list_unselect_others (PeonyIconContainer *container,
 {
     gboolean selection_changed;
     GHashTable *hash;
-    GList *p;
+    GList *selected, *p;
     PeonyIcon *icon;
 
     g_return_if_fail (PEONY_IS_ICON_CONTAINER (container));
@@ -9245,13 +9719,20 @@ peony_icon_container_select_list_unselect_others (PeonyIconContainer *container,
     {
         g_hash_table_insert (hash, p->data, p->data);
     }
-    for (p = container->details->icons; p != NULL; p = p->next)
+    selected = g_hash_table_get_keys (container->details->selected_icons);
+    for (p = selected; p != NULL; p = p->next)
     {
         icon = p->data;
 
-        selection_changed |= icon_set_selected
-                             (container, icon,
-                              g_hash_table_lookup (hash, icon) != NULL);
+        if (g_hash_table_lookup (hash, icon) == NULL)
+        {
+            selection_changed |= icon_set_selected (container, icon, FALSE);
+        }
+    }
+    g_list_free (selected);
+    for (p = selection; p != NULL; p = p->next)
+    {
+        selection_changed |= icon_set_selected (container, p->data, TRUE);
     }
     g_hash_table_destroy (hash);
 
@@ -9351,36 +9832,90 @@ get_nth_selected_icon (PeonyIconContainer *container, int index)
 static PeonyIcon *
 get_first_selected_icon (PeonyIconContainer *container)
 {
+    GHashTableIter iter;
+    gpointer icon;
+
+    /* With a single selected icon there is no need to walk the list */
+    if (g_hash_table_size (container->details->selected_icons) == 1)
+    {
+        g_hash_table_iter_init (&iter, container->details->selected_icons);
+        g_hash_table_iter_next (&iter, &icon, NULL);
+        return icon;
+    }
+
     return get_nth_selected_icon (container, 1);
 }
 
+/**
+ * peony_icon_container_get_adjacent_icon_data:
+ * @container: An icon container.
+ * @count: How many icons to return on each side.
+ *
+ * Get the data of the icons around the first selected one, in the order
+ * the icons are laid out, nearest first and alternating after and before.
+ *
+ * Return value: A GList of the icons' data, not reffed. The caller
+ * frees the list.
+ **/
+GList *
+peony_icon_container_get_adjacent_icon_data (PeonyIconContainer *container,
+        int count)
+{
+    PeonyIcon *icon;
+    GList *link, *next, *previous, *result;
+    int i;
+
+    g_return_val_if_fail (PEONY_IS_ICON_CONTAINER (container), NULL);
+
+    icon = get_first_selected_icon (container);
+    if (icon == NULL)
+    {
+        return NULL;
+    }
+
+    link = g_list_find (container->details->icons, icon);
+    if (link == NULL)
+    {
+        return NULL;
+    }
+
+    result = NULL;
+    next = link->next;
+    previous = link->prev;
+    for (i = 0; i < count && (next != NULL || previous != NULL); i++)
+    {
+        if (next != NULL)
+        {
+            result = g_list_prepend (result, ((PeonyIcon *) next->data)->data);
+            next = next->next;
+        }
+        if (previous != NULL)
+        {
+            result = g_list_prepend (result, ((PeonyIcon *) previous->data)->data);
+            previous = previous->prev;
+        }
+    }
+
+    return g_list_reverse (result);
+}
+
 static gboolean
 has_multiple_selection (PeonyIconContainer *container)
 {
-    return get_nth_selected_icon (container, 2) != NULL;
+    return g_hash_table_size (container->details->selected_icons) > 1;
 }
 
 static gboolean
 all_selected (PeonyIconContainer *container)
 {
-    GList *p;
-    PeonyIcon *icon;
-
-    for (p = container->details->icons; p != NULL; p = p->next)
-    {
-        icon = p->data;
-        if (!icon->is_selected)
-        {
-            return FALSE;
-        }
-    }
-    return TRUE;
+    return g_hash_table_size (container->details->selected_icons) ==
+           g_hash_table_size (container->details->icon_set);
 }
 
 static gboolean
 has_selection (PeonyIconContainer *container)
 {
-    return get_nth_selected_icon (container, 1) != NULL;
+    return g_hash_table_size (container->details->selected_icons) > 0;
 }
 
 /**
@@ -9459,13 +9994,15 @@ peony_icon_container_has_stretch_handles (PeonyIconContainer *container)
 gboolean
 peony_icon_container_is_stretched (PeonyIconContainer *container)
 {
-    GList *p;
+    GHashTableIter iter;
+    gpointer key;
     PeonyIcon *icon;
 
-    for (p = container->details->icons; p != NULL; p = p->next)
+    g_hash_table_iter_init (&iter, container->details->selected_icons);
+    while (g_hash_table_iter_next (&iter, &key, NULL))
     {
-        icon = p->data;
-        if (icon->is_selected && icon->scale != 1.0)
+        icon = key;
+        if (icon->scale != 1.0)
         {
             return TRUE;
         }
@@ -10362,29 +10899,63 @@ peony_icon_container_set_all_columns_same_width (PeonyIconContainer *container,
 /**
  * peony_icon_container_set_highlighted_for_clipboard
  * @container: An icon container widget.
- * @data: Icon Data associated with all icons that should be highlighted.
- *        Others will be unhighlighted.
+ * @clipboard_icon_data: Set of the icon data of all icons that should be
+ *        highlighted, or %NULL. Others will be unhighlighted. Icons added
+ *        later are checked against it as well.
+ *
+ * Only icons whose highlight actually changes are touched.
  **/
 void
 peony_icon_container_set_highlighted_for_clipboard (PeonyIconContainer *container,
-        GList                 *clipboard_icon_data)
+        GHashTable            *clipboard_icon_data)
 {
-    GList *l;
+    PeonyIconContainerDetails *details;
+    GHashTableIter iter;
     PeonyIcon *icon;
-    gboolean highlighted_for_clipboard;
+    gpointer data;
 
     g_return_if_fail (PEONY_IS_ICON_CONTAINER (container));
 
-    for (l = container->details->icons; l != NULL; l = l->next)
+    details = container->details;
+
+    g_hash_table_iter_init (&iter, details->clipboard_highlighted);
+    while (g_hash_table_iter_next (&iter, &data, NULL))
     {
-        icon = l->data;
-        highlighted_for_clipboard = (g_list_find (clipboard_icon_data, icon->data) != NULL);
+        if (clipboard_icon_data == NULL ||
+            !g_hash_table_contains (clipboard_icon_data, data))
+        {
+            icon = g_hash_table_lookup (details->icon_set, data);
+            eel_canvas_item_set (EEL_CANVAS_ITEM (icon->item),
+                                 "highlighted-for-clipboard", FALSE,
+                                 NULL);
+            g_hash_table_iter_remove (&iter);
+        }
+    }
 
-        eel_canvas_item_set (EEL_CANVAS_ITEM (icon->item),
-                             "highlighted-for-clipboard", highlighted_for_clipboard,
-                             NULL);
+    if (clipboard_icon_data != NULL)
+    {
+        g_hash_table_iter_init (&iter, clipboard_icon_data);
+        while (g_hash_table_iter_next (&iter, &data, NULL))
+        {
+            icon = g_hash_table_lookup (details->icon_set, data);
+            if (icon != NULL &&
+                !g_hash_table_contains (details->clipboard_highlighted, data))
+            {
+                eel_canvas_item_set (EEL_CANVAS_ITEM (icon->item),
+                                     "highlighted-for-clipboard", TRUE,
+                                     NULL);
+                g_hash_table_add (details->clipboard_highlighted, data);
+            }
+        }
+
+        g_hash_table_ref (clipboard_icon_data);
     }
 
+    if (details->clipboard_icon_data != NULL)
+    {
+        g_hash_table_unref (details->clipboard_icon_data);
+    }
+    details->clipboard_icon_data = clipboard_icon_data;
 }
 
 /* PeonyIconContainerAccessible */
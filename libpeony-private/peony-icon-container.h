@@ -180,6 +180,10 @@ typedef struct
             gconstpointer client);
     void         (* prioritize_thumbnailing)  (PeonyIconContainer *container,
             PeonyIconData *data);
+    /* The icon came into view or went out of it, or was removed while in view */
+    void         (* icon_visibility_changed)  (PeonyIconContainer *container,
+            PeonyIconData *data,
+            gboolean visible);
 
     /* Queries on icons for subclass/client.
      * These must be implemented => These are signals !
@@ -296,7 +300,7 @@ int               peony_icon_container_get_max_layout_lines           (PeonyIcon
 int               peony_icon_container_get_max_layout_lines_for_pango (PeonyIconContainer  *container);
 
 void              peony_icon_container_set_highlighted_for_clipboard (PeonyIconContainer  *container,
-        GList                  *clipboard_icon_data);
+        GHashTable             *clipboard_icon_data);
 
 /* operations on all icons */
 void              peony_icon_container_unselect_all                  (PeonyIconContainer  *view);
@@ -305,6 +309,12 @@ void              peony_icon_container_select_all                    (PeonyIconC
 
 /* operations on the selection */
 GList     *       peony_icon_container_get_selection                 (PeonyIconContainer  *view);
+guint             peony_icon_container_get_selection_count           (PeonyIconContainer  *view);
+void              peony_icon_container_take_selection_changes        (PeonyIconContainer  *view,
+        GList                 **selected,
+        GList                 **unselected);
+GList *           peony_icon_container_get_adjacent_icon_data        (PeonyIconContainer  *container,
+        int                  count);
 void			  peony_icon_container_invert_selection				(PeonyIconContainer  *view);
 void              peony_icon_container_set_selection                 (PeonyIconContainer  *view,
         GList                  *selection);
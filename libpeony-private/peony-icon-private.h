@@ -125,6 +125,8 @@ enum
     LAST_LABEL_COLOR
 };
 
+typedef struct PeonyIconPendingLayout PeonyIconPendingLayout;
+
 struct PeonyIconContainerDetails
 {
     /* List of icons. */
@@ -132,6 +134,20 @@ struct PeonyIconContainerDetails
     GList *new_icons;
     GHashTable *icon_set;
 
+    /* The selected icons, kept in step with icon->is_selected */
+    GHashTable *selected_icons;
+    /* Icon data whose selection changed since the last
+     * peony_icon_container_take_selection_changes(), mapped to
+     * whether it is selected now.
+     */
+    GHashTable *selection_changes;
+
+    /* Icon data that should be highlighted as cut, and the subset of
+     * it that is currently shown highlighted.
+     */
+    GHashTable *clipboard_icon_data;
+    GHashTable *clipboard_highlighted;
+
     /* Current icon for keyboard navigation. */
     PeonyIcon *keyboard_focus;
     PeonyIcon *keyboard_rubberband_start;
@@ -195,6 +211,9 @@ struct PeonyIconContainerDetails
     /* Idle ID. */
     guint idle_id;
 
+    /* Lines of the last layout still to be positioned */
+    PeonyIconPendingLayout *pending_layout;
+
     /* Idle handler for stretch code */
     guint stretch_idle_id;
 
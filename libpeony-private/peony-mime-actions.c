@@ -37,6 +37,7 @@
 
 #include "peony-file-attributes.h"
 #include "peony-file.h"
+#include "peony-file-private.h"
 #include "peony-autorun.h"
 #include "peony-file-operations.h"
 #include "peony-metadata.h"
@@ -45,6 +46,7 @@
 #include "peony-global-preferences.h"
 #include "peony-debug-log.h"
 #include "peony-open-with-dialog.h"
+#include "peony-signaller.h"
 
 #include "../src/file-manager/office-utils.h"
 
@@ -364,42 +366,6 @@ peony_mime_get_default_application_for_file (PeonyFile *file)
     return app;
 }
 
-static int
-file_compare_by_mime_type (PeonyFile *file_a,
-                           PeonyFile *file_b)
-{
-    char *mime_type_a, *mime_type_b;
-    int ret;
-
-    mime_type_a = peony_file_get_mime_type (file_a);
-    mime_type_b = peony_file_get_mime_type (file_b);
-
-    ret = strcmp (mime_type_a, mime_type_b);
-
-    g_free (mime_type_a);
-    g_free (mime_type_b);
-
-    return ret;
-}
-
-static int
-file_compare_by_parent_uri (PeonyFile *file_a,
-                            PeonyFile *file_b)
-{
-    char *parent_uri_a, *parent_uri_b;
-    int ret;
-
-    parent_uri_a = peony_file_get_parent_uri (file_a);
-    parent_uri_b = peony_file_get_parent_uri (file_b);
-
-    ret = strcmp (parent_uri_a, parent_uri_b);
-
-    g_free (parent_uri_a);
-    g_free (parent_uri_b);
-
-    return ret;
-}
-
 static int
 application_compare_by_name (const GAppInfo *app_a,
                              const GAppInfo *app_b)
@@ -528,59 +494,6 @@ peony_mime_has_any_applications_for_file (PeonyFile *file)
     return result;
 }
 
-GAppInfo *
-peony_mime_get_default_application_for_files (GList *files)
-{
-    GList *l, *sorted_files;
-    PeonyFile *file;
-    GAppInfo *app, *one_app;
-
-    g_assert (files != NULL);
-
-    sorted_files = g_list_sort (g_list_copy (files), (GCompareFunc) file_compare_by_mime_type);
-
-    app = NULL;
-    for (l = sorted_files; l != NULL; l = l->next)
-    {
-        file = l->data;
-
-        if (l->prev &&
-                file_compare_by_mime_type (file, l->prev->data) == 0 &&
-                file_compare_by_parent_uri (file, l->prev->data) == 0)
-        {
-            continue;
-        }
-
-        one_app = peony_mime_get_default_application_for_file (file);
-        if (one_app == NULL || (app != NULL && !g_app_info_equal (app, one_app)))
-        {
-            if (app)
-            {
-                g_object_unref (app);
-            }
-            if (one_app)
-            {
-                g_object_unref (one_app);
-            }
-            app = NULL;
-            break;
-        }
-
-        if (app == NULL)
-        {
-            app = one_app;
-        }
-        else
-        {
-            g_object_unref (one_app);
-        }
-    }
-
-    g_list_free (sorted_files);
-
-    return app;
-}
-
 /* returns an intersection of two mime application lists,
  * and returns a new list, freeing a, b and all applications
  * that are not in the intersection set.
@@ -633,51 +546,682 @@ intersect_application_lists (GList *a,
     return g_list_reverse (ret);
 }
 
-GList *
-peony_mime_get_applications_for_files (GList *files)
+/* Applications are looked up once per (MIME type, URI scheme, local
+ * path) combination and kept until the MIME or application database
+ * changes, so rebuilding the menus for a big selection costs no more
+ * than a hash lookup per group of files.
+ */
+typedef struct
 {
-    GList *l, *sorted_files;
-    PeonyFile *file;
-    GList *one_ret, *ret;
+    GList *applications; /* sorted by id */
+    GAppInfo *default_application;
+} ApplicationCacheEntry;
 
-    g_assert (files != NULL);
+/* Files in the same directory with the same MIME type always get
+ * the same applications, so a selection only has to be looked up
+ * once per such group.
+ */
+typedef struct
+{
+    eel_ref_str mime_type;
+    PeonyDirectory *directory;
+} SelectionGroupKey;
 
-    sorted_files = g_list_sort (g_list_copy (files), (GCompareFunc) file_compare_by_mime_type);
+static GHashTable *application_cache = NULL;
 
-    ret = NULL;
-    for (l = sorted_files; l != NULL; l = l->next)
+/* Bumped whenever the application cache is emptied, so that results
+ * memoized by a PeonyMimeSelection know to recompute.
+ */
+static guint application_cache_generation = 0;
+
+/* The result for the last selection, since the menus ask for the
+ * default and the full application list of the same selection several
+ * times in a row.
+ */
+static char *last_selection_signature = NULL;
+static GList *last_selection_applications = NULL;
+static gboolean last_selection_got_applications = FALSE;
+static GAppInfo *last_selection_default_application = NULL;
+static gboolean last_selection_got_default_application = FALSE;
+
+static void
+application_cache_entry_free (ApplicationCacheEntry *entry)
+{
+    g_list_free_full (entry->applications, g_object_unref);
+    if (entry->default_application != NULL)
+    {
+        g_object_unref (entry->default_application);
+    }
+    g_free (entry);
+}
+
+static void
+forget_last_selection (void)
+{
+    g_free (last_selection_signature);
+    last_selection_signature = NULL;
+    g_list_free_full (last_selection_applications, g_object_unref);
+    last_selection_applications = NULL;
+    last_selection_got_applications = FALSE;
+    if (last_selection_default_application != NULL)
+    {
+        g_object_unref (last_selection_default_application);
+        last_selection_default_application = NULL;
+    }
+    last_selection_got_default_application = FALSE;
+}
+
+static void
+application_cache_invalidate (void)
+{
+    if (application_cache != NULL)
+    {
+        g_hash_table_remove_all (application_cache);
+    }
+    application_cache_generation++;
+    forget_last_selection ();
+}
+
+static void
+application_data_changed_callback (GObject *object,
+                                   gpointer user_data)
+{
+    application_cache_invalidate ();
+}
+
+static void
+application_cache_ensure (void)
+{
+    if (application_cache != NULL)
+    {
+        return;
+    }
+
+    application_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+                        g_free,
+                        (GDestroyNotify) application_cache_entry_free);
+
+    g_signal_connect (peony_signaller_get_current (),
+                      "mime_data_changed",
+                      G_CALLBACK (application_data_changed_callback),
+                      NULL);
+#if GLIB_CHECK_VERSION (2, 40, 0)
+    g_signal_connect (g_app_info_monitor_get (),
+                      "changed",
+                      G_CALLBACK (application_data_changed_callback),
+                      NULL);
+#endif
+}
+
+static char *
+get_application_cache_key (PeonyFile *file)
+{
+    char *mime_type, *uri_scheme, *key;
+
+    mime_type = peony_file_get_mime_type (file);
+    uri_scheme = peony_file_get_uri_scheme (file);
+
+    key = g_strdup_printf ("%s\n%s\n%c",
+                           mime_type,
+                           uri_scheme != NULL ? uri_scheme : "",
+                           file_has_local_path (file) ? 'l' : 'r');
+
+    g_free (mime_type);
+    g_free (uri_scheme);
+
+    return key;
+}
+
+/* Returns NULL if the file isn't ready yet; such files have no
+ * applications, just like with peony_mime_get_applications_for_file().
+ */
+static ApplicationCacheEntry *
+application_cache_lookup (PeonyFile *file,
+                          const char *key)
+{
+    ApplicationCacheEntry *entry;
+
+    if (!peony_mime_actions_check_if_required_attributes_ready (file))
+    {
+        return NULL;
+    }
+
+    application_cache_ensure ();
+
+    entry = g_hash_table_lookup (application_cache, key);
+    if (entry == NULL)
+    {
+        entry = g_new0 (ApplicationCacheEntry, 1);
+        entry->applications = g_list_sort (peony_mime_get_applications_for_file (file),
+                                           (GCompareFunc) application_compare_by_id);
+        entry->default_application = peony_mime_get_default_application_for_file (file);
+        g_hash_table_insert (application_cache, g_strdup (key), entry);
+    }
+
+    return entry;
+}
+
+static guint
+selection_group_key_hash (gconstpointer key)
+{
+    const SelectionGroupKey *group_key = key;
+
+    return g_direct_hash (group_key->mime_type) ^ g_direct_hash (group_key->directory);
+}
+
+static gboolean
+selection_group_key_equal (gconstpointer a,
+                           gconstpointer b)
+{
+    const SelectionGroupKey *key_a = a;
+    const SelectionGroupKey *key_b = b;
+
+    return key_a->mime_type == key_b->mime_type &&
+           key_a->directory == key_b->directory;
+}
+
+/* Picks one file out of every group of files that share a directory
+ * and a MIME type. MIME types are interned, so this needs no string
+ * work per file.
+ */
+static GList *
+get_selection_group_representatives (GList *files)
+{
+    GHashTable *groups;
+    SelectionGroupKey key, *new_key;
+    GList *l, *representatives;
+    PeonyFile *file;
+
+    groups = g_hash_table_new_full (selection_group_key_hash,
+                                    selection_group_key_equal,
+                                    g_free, NULL);
+    representatives = NULL;
+
+    for (l = files; l != NULL; l = l->next)
     {
         file = l->data;
 
-        if (l->prev &&
-                file_compare_by_mime_type (file, l->prev->data) == 0 &&
-                file_compare_by_parent_uri (file, l->prev->data) == 0)
+        key.mime_type = file->details->mime_type;
+        key.directory = file->details->directory;
+        if (g_hash_table_lookup_extended (groups, &key, NULL, NULL))
         {
             continue;
         }
 
-        one_ret = peony_mime_get_applications_for_file (file);
-        one_ret = g_list_sort (one_ret, (GCompareFunc) application_compare_by_id);
-        if (ret != NULL)
+        new_key = g_memdup (&key, sizeof (SelectionGroupKey));
+        g_hash_table_insert (groups, new_key, NULL);
+        representatives = g_list_prepend (representatives, file);
+    }
+
+    g_hash_table_destroy (groups);
+
+    return g_list_reverse (representatives);
+}
+
+/* Collects the cache entries for a selection and a signature string
+ * that identifies the set of entries. Returns FALSE if some file in
+ * the selection has no applications at all.
+ */
+static gboolean
+get_selection_cache_entries (GList *files,
+                             GList **entries,
+                             char **signature)
+{
+    GList *representatives, *keys, *l;
+    GHashTable *seen;
+    ApplicationCacheEntry *entry;
+    GString *str;
+    char *key;
+    gboolean ok;
+
+    representatives = get_selection_group_representatives (files);
+
+    seen = g_hash_table_new (g_str_hash, g_str_equal);
+    keys = NULL;
+    *entries = NULL;
+    ok = TRUE;
+
+    for (l = representatives; l != NULL; l = l->next)
+    {
+        key = get_application_cache_key (l->data);
+        if (g_hash_table_lookup (seen, key) != NULL)
         {
-            ret = intersect_application_lists (ret, one_ret);
+            g_free (key);
+            continue;
         }
-        else
+
+        entry = application_cache_lookup (l->data, key);
+        if (entry == NULL)
+        {
+            g_free (key);
+            ok = FALSE;
+            break;
+        }
+
+        g_hash_table_insert (seen, key, entry);
+        keys = g_list_prepend (keys, key);
+        *entries = g_list_prepend (*entries, entry);
+    }
+
+    str = g_string_new (NULL);
+    keys = g_list_sort (keys, (GCompareFunc) strcmp);
+    for (l = keys; l != NULL; l = l->next)
+    {
+        g_string_append (str, l->data);
+        g_string_append_c (str, '\t');
+    }
+    *signature = g_string_free (str, FALSE);
+
+    g_list_free_full (keys, g_free);
+    g_hash_table_destroy (seen);
+    g_list_free (representatives);
+
+    if (!ok)
+    {
+        g_list_free (*entries);
+        *entries = NULL;
+    }
+
+    return ok;
+}
+
+/* Makes the memoized results below belong to the given selection */
+static void
+use_last_selection (const char *signature)
+{
+    if (g_strcmp0 (signature, last_selection_signature) != 0)
+    {
+        forget_last_selection ();
+        last_selection_signature = g_strdup (signature);
+    }
+}
+
+GAppInfo *
+peony_mime_get_default_application_for_files (GList *files)
+{
+    GList *entries, *l;
+    ApplicationCacheEntry *entry;
+    GAppInfo *app;
+    char *signature;
+
+    g_assert (files != NULL);
+
+    if (!get_selection_cache_entries (files, &entries, &signature))
+    {
+        g_free (signature);
+        return NULL;
+    }
+
+    use_last_selection (signature);
+    g_free (signature);
+
+    if (!last_selection_got_default_application)
+    {
+        app = NULL;
+        for (l = entries; l != NULL; l = l->next)
         {
-            ret = one_ret;
+            entry = l->data;
+
+            if (entry->default_application == NULL ||
+                    (app != NULL && !g_app_info_equal (app, entry->default_application)))
+            {
+                app = NULL;
+                break;
+            }
+
+            app = entry->default_application;
         }
 
-        if (ret == NULL)
+        last_selection_default_application = app != NULL ? g_object_ref (app) : NULL;
+        last_selection_got_default_application = TRUE;
+    }
+
+    g_list_free (entries);
+
+    if (last_selection_default_application == NULL)
+    {
+        return NULL;
+    }
+
+    return g_object_ref (last_selection_default_application);
+}
+
+GList *
+peony_mime_get_applications_for_files (GList *files)
+{
+    GList *entries, *l;
+    ApplicationCacheEntry *entry;
+    GList *one_ret, *ret;
+    char *signature;
+
+    g_assert (files != NULL);
+
+    if (!get_selection_cache_entries (files, &entries, &signature))
+    {
+        g_free (signature);
+        return NULL;
+    }
+
+    use_last_selection (signature);
+    g_free (signature);
+
+    if (!last_selection_got_applications)
+    {
+        ret = NULL;
+        for (l = entries; l != NULL; l = l->next)
         {
-            break;
+            entry = l->data;
+
+            one_ret = g_list_copy_deep (entry->applications, (GCopyFunc) g_object_ref, NULL);
+            if (l != entries)
+            {
+                ret = intersect_application_lists (ret, one_ret);
+            }
+            else
+            {
+                ret = one_ret;
+            }
+
+            if (ret == NULL)
+            {
+                break;
+            }
+        }
+
+        last_selection_applications = g_list_sort (ret, (GCompareFunc) application_compare_by_name);
+        last_selection_got_applications = TRUE;
+    }
+
+    g_list_free (entries);
+
+    return g_list_copy_deep (last_selection_applications, (GCopyFunc) g_object_ref, NULL);
+}
+
+/* A PeonyMimeSelection keeps the files of a selection grouped by
+ * application cache key, so that adding or removing a file costs a
+ * single key lookup and asking for the applications only looks at one
+ * file per group.
+ */
+typedef struct
+{
+    char *key;
+    GQueue files; /* the head is the representative */
+} MimeSelectionGroup;
+
+typedef struct
+{
+    MimeSelectionGroup *group;
+    GList *link;
+} MimeSelectionMember;
+
+struct PeonyMimeSelection
+{
+    GHashTable *groups; /* key -> MimeSelectionGroup */
+    GHashTable *members; /* PeonyFile -> MimeSelectionMember */
+
+    gboolean results_valid;
+    guint results_generation;
+    GList *applications;
+    gboolean got_applications;
+    GAppInfo *default_application;
+    gboolean got_default_application;
+};
+
+static void
+mime_selection_group_free (MimeSelectionGroup *group)
+{
+    g_free (group->key);
+    g_queue_clear (&group->files);
+    g_free (group);
+}
+
+static void
+mime_selection_forget_results (PeonyMimeSelection *selection)
+{
+    g_list_free_full (selection->applications, g_object_unref);
+    selection->applications = NULL;
+    selection->got_applications = FALSE;
+    if (selection->default_application != NULL)
+    {
+        g_object_unref (selection->default_application);
+        selection->default_application = NULL;
+    }
+    selection->got_default_application = FALSE;
+    selection->results_valid = FALSE;
+}
+
+/* Drops the memoized results if the groups or the application cache
+ * changed since they were computed.
+ */
+static void
+mime_selection_check_results (PeonyMimeSelection *selection)
+{
+    if (!selection->results_valid ||
+            selection->results_generation != application_cache_generation)
+    {
+        mime_selection_forget_results (selection);
+        selection->results_valid = TRUE;
+        selection->results_generation = application_cache_generation;
+    }
+}
+
+PeonyMimeSelection *
+peony_mime_selection_new (void)
+{
+    PeonyMimeSelection *selection;
+
+    selection = g_new0 (PeonyMimeSelection, 1);
+    selection->groups = g_hash_table_new_full (g_str_hash, g_str_equal,
+                        NULL,
+                        (GDestroyNotify) mime_selection_group_free);
+    selection->members = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                         (GDestroyNotify) peony_file_unref,
+                         g_free);
+
+    return selection;
+}
+
+void
+peony_mime_selection_free (PeonyMimeSelection *selection)
+{
+    if (selection == NULL)
+    {
+        return;
+    }
+
+    mime_selection_forget_results (selection);
+    g_hash_table_destroy (selection->members);
+    g_hash_table_destroy (selection->groups);
+    g_free (selection);
+}
+
+void
+peony_mime_selection_add_file (PeonyMimeSelection *selection,
+                               PeonyFile *file)
+{
+    MimeSelectionGroup *group;
+    MimeSelectionMember *member;
+    char *key;
+
+    g_return_if_fail (PEONY_IS_FILE (file));
+
+    if (g_hash_table_lookup (selection->members, file) != NULL)
+    {
+        return;
+    }
+
+    key = get_application_cache_key (file);
+    group = g_hash_table_lookup (selection->groups, key);
+    if (group == NULL)
+    {
+        group = g_new0 (MimeSelectionGroup, 1);
+        group->key = key;
+        g_queue_init (&group->files);
+        g_hash_table_insert (selection->groups, group->key, group);
+        selection->results_valid = FALSE;
+    }
+    else
+    {
+        g_free (key);
+    }
+
+    member = g_new0 (MimeSelectionMember, 1);
+    member->group = group;
+    g_queue_push_tail (&group->files, file);
+    member->link = group->files.tail;
+    g_hash_table_insert (selection->members, peony_file_ref (file), member);
+}
+
+void
+peony_mime_selection_remove_file (PeonyMimeSelection *selection,
+                                  PeonyFile *file)
+{
+    MimeSelectionMember *member;
+    MimeSelectionGroup *group;
+
+    member = g_hash_table_lookup (selection->members, file);
+    if (member == NULL)
+    {
+        return;
+    }
+
+    group = member->group;
+    if (member->link == group->files.head)
+    {
+        /* The representative changes; it may not be ready yet */
+        selection->results_valid = FALSE;
+    }
+    g_queue_delete_link (&group->files, member->link);
+    if (g_queue_is_empty (&group->files))
+    {
+        g_hash_table_remove (selection->groups, group->key);
+        selection->results_valid = FALSE;
+    }
+
+    g_hash_table_remove (selection->members, file);
+}
+
+void
+peony_mime_selection_clear (PeonyMimeSelection *selection)
+{
+    g_hash_table_remove_all (selection->members);
+    g_hash_table_remove_all (selection->groups);
+    mime_selection_forget_results (selection);
+}
+
+/* Collects one cache entry per group, or returns FALSE if some group
+ * has no applications at all.
+ */
+static gboolean
+mime_selection_get_entries (PeonyMimeSelection *selection,
+                            GList **entries)
+{
+    GHashTableIter iter;
+    MimeSelectionGroup *group;
+    ApplicationCacheEntry *entry;
+
+    *entries = NULL;
+
+    g_hash_table_iter_init (&iter, selection->groups);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &group))
+    {
+        entry = application_cache_lookup (g_queue_peek_head (&group->files),
+                                          group->key);
+        if (entry == NULL)
+        {
+            g_list_free (*entries);
+            *entries = NULL;
+            return FALSE;
         }
+        *entries = g_list_prepend (*entries, entry);
     }
 
-    g_list_free (sorted_files);
+    return *entries != NULL;
+}
+
+GAppInfo *
+peony_mime_selection_get_default_application (PeonyMimeSelection *selection)
+{
+    GList *entries, *l;
+    ApplicationCacheEntry *entry;
+    GAppInfo *app;
 
-    ret = g_list_sort (ret, (GCompareFunc) application_compare_by_name);
+    mime_selection_check_results (selection);
+
+    if (!selection->got_default_application)
+    {
+        app = NULL;
+        if (mime_selection_get_entries (selection, &entries))
+        {
+            for (l = entries; l != NULL; l = l->next)
+            {
+                entry = l->data;
+
+                if (entry->default_application == NULL ||
+                        (app != NULL && !g_app_info_equal (app, entry->default_application)))
+                {
+                    app = NULL;
+                    break;
+                }
+
+                app = entry->default_application;
+            }
+            g_list_free (entries);
+        }
+
+        selection->default_application = app != NULL ? g_object_ref (app) : NULL;
+        selection->got_default_application = TRUE;
+    }
+
+    if (selection->default_application == NULL)
+    {
+        return NULL;
+    }
+
+    return g_object_ref (selection->default_application);
+}
+
+GList *
+peony_mime_selection_get_applications (PeonyMimeSelection *selection)
+{
+    GList *entries, *l;
+    ApplicationCacheEntry *entry;
+    GList *one_ret, *ret;
+
+    mime_selection_check_results (selection);
+
+    if (!selection->got_applications)
+    {
+        ret = NULL;
+        if (mime_selection_get_entries (selection, &entries))
+        {
+            for (l = entries; l != NULL; l = l->next)
+            {
+                entry = l->data;
+
+                one_ret = g_list_copy_deep (entry->applications, (GCopyFunc) g_object_ref, NULL);
+                if (l != entries)
+                {
+                    ret = intersect_application_lists (ret, one_ret);
+                }
+                else
+                {
+                    ret = one_ret;
+                }
+
+                if (ret == NULL)
+                {
+                    break;
+                }
+            }
+            g_list_free (entries);
+        }
+
+        selection->applications = g_list_sort (ret, (GCompareFunc) application_compare_by_name);
+        selection->got_applications = TRUE;
+    }
 
-    return ret;
+    return g_list_copy_deep (selection->applications, (GCopyFunc) g_object_ref, NULL);
 }
 
 static void
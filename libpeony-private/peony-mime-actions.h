@@ -39,6 +39,19 @@ GList *                peony_mime_get_applications_for_file            (PeonyFil
 GAppInfo *             peony_mime_get_default_application_for_files    (GList                   *files);
 GList *                peony_mime_get_applications_for_files           (GList                   *file);
 
+/* The applications of a selection that is kept up to date file by file */
+typedef struct PeonyMimeSelection PeonyMimeSelection;
+
+PeonyMimeSelection *   peony_mime_selection_new                        (void);
+void                   peony_mime_selection_free                       (PeonyMimeSelection   *selection);
+void                   peony_mime_selection_add_file                   (PeonyMimeSelection   *selection,
+        PeonyFile            *file);
+void                   peony_mime_selection_remove_file                (PeonyMimeSelection   *selection,
+        PeonyFile            *file);
+void                   peony_mime_selection_clear                      (PeonyMimeSelection   *selection);
+GAppInfo *             peony_mime_selection_get_default_application    (PeonyMimeSelection   *selection);
+GList *                peony_mime_selection_get_applications           (PeonyMimeSelection   *selection);
+
 gboolean               peony_mime_has_any_applications_for_file        (PeonyFile            *file);
 
 gboolean               peony_mime_file_opens_in_view                   (PeonyFile            *file);
@@ -27,7 +27,17 @@
 #include <eel/eel-gtk-macros.h>
 #include <eel/eel-debug.h>
 #include <gmodule.h>
+#include <glib/gstdio.h>
 #include <libpeony-private/peony-extensions.h>
+#include <string.h>
+
+/* The manifest, in the user's cache directory, keeps for every
+ * extension library its types, their parent classes and the interfaces
+ * they implement, so libraries only get opened once something asks for
+ * one of those.
+ */
+#define MANIFEST_GROUP "Manifest"
+#define MANIFEST_VERSION 2
 
 #define PEONY_TYPE_MODULE    	(peony_module_get_type ())
 #define PEONY_MODULE(obj)		(G_TYPE_CHECK_INSTANCE_CAST ((obj), PEONY_TYPE_MODULE, PeonyModule))
@@ -62,6 +72,38 @@ struct _PeonyModuleClass
 
 static GList *module_objects = NULL;
 
+typedef struct
+{
+    char *path;
+    /* Type names, from the manifest */
+    char **types;
+    char **classes; /* the types and their parents */
+    char **interfaces;
+} LazyModule;
+
+/* Libraries known from the manifest that have not been opened yet */
+static GList *lazy_modules = NULL;
+
+typedef struct
+{
+    GType type;
+    PeonyModuleObjectFunc func;
+    gpointer user_data;
+} TypeWatch;
+
+/* Told about extension objects as their libraries are opened */
+static GList *type_watches = NULL;
+
+/* Libraries opened by peony_module_preload (), so that loading the
+ * extensions finds them already mapped and relocated. All of these
+ * are protected by preload_lock.
+ */
+static GList *preloaded_libraries = NULL;
+static gboolean preload_running = FALSE;
+static gboolean preload_cancelled = FALSE;
+static GMutex preload_lock;
+static GCond preload_finished;
+
 static GType peony_module_get_type (void);
 
 G_DEFINE_TYPE (PeonyModule, peony_module, G_TYPE_TYPE_MODULE);
@@ -191,8 +233,67 @@ add_module_objects (PeonyModule *module)
     }
 }
 
+static void
+add_unique_name (GPtrArray  *names,
+                 const char *name)
+{
+    guint i;
+
+    for (i = 0; i < names->len; i++)
+    {
+        if (strcmp (g_ptr_array_index (names, i), name) == 0)
+        {
+            return;
+        }
+    }
+
+    g_ptr_array_add (names, g_strdup (name));
+}
+
+/* Adds the names of the module's types, of the classes they derive
+ * from and of the interfaces they implement, for the manifest.
+ */
+static void
+add_module_names (PeonyModule *module,
+                  GPtrArray   *types_out,
+                  GPtrArray   *classes,
+                  GPtrArray   *interfaces)
+{
+    const GType *types = NULL;
+    GType *implemented;
+    GType parent;
+    guint n_implemented;
+    int num_types = 0;
+    int i;
+    guint j;
+
+    module->list_types (&types, &num_types);
+
+    for (i = 0; i < num_types && types[i] != 0; i++)
+    {
+        /* One entry per type, as add_module_objects () registers them */
+        g_ptr_array_add (types_out, g_strdup (g_type_name (types[i])));
+
+        for (parent = types[i]; parent != 0; parent = g_type_parent (parent))
+        {
+            add_unique_name (classes, g_type_name (parent));
+        }
+
+        implemented = g_type_interfaces (types[i], &n_implemented);
+        for (j = 0; j < n_implemented; j++)
+        {
+            add_unique_name (interfaces, g_type_name (implemented[j]));
+        }
+        g_free (implemented);
+    }
+}
+
 static PeonyModule *
-peony_module_load_file (const char *filename)
+peony_module_load_file (const char *filename,
+                        GPtrArray  *types,
+                        GPtrArray  *classes,
+                        GPtrArray  *interfaces,
+                        gboolean   *is_python)
 {
     PeonyModule *module;
 
@@ -202,6 +303,14 @@ peony_module_load_file (const char *filename)
     if (g_type_module_use (G_TYPE_MODULE (module)))
     {
         add_module_objects (module);
+        if (types != NULL)
+        {
+            add_module_names (module, types, classes, interfaces);
+        }
+        if (is_python != NULL)
+        {
+            *is_python = module->list_pyfiles != NULL;
+        }
         g_type_module_unuse (G_TYPE_MODULE (module));
         return module;
     }
@@ -212,10 +321,119 @@ peony_module_load_file (const char *filename)
     }
 }
 
+static char *
+get_manifest_filename (void)
+{
+    return g_build_filename (g_get_user_cache_dir (), "peony",
+                             "extensions-manifest", NULL);
+}
+
+static GKeyFile *
+load_manifest (void)
+{
+    GKeyFile *manifest;
+    char *filename;
+
+    manifest = g_key_file_new ();
+    filename = get_manifest_filename ();
+
+    if (!g_key_file_load_from_file (manifest, filename, G_KEY_FILE_NONE, NULL) ||
+        g_key_file_get_integer (manifest, MANIFEST_GROUP, "Version", NULL) != MANIFEST_VERSION)
+    {
+        g_key_file_free (manifest);
+        manifest = g_key_file_new ();
+    }
+    g_free (filename);
+
+    return manifest;
+}
+
+static void
+save_manifest (GKeyFile *manifest)
+{
+    char *filename;
+    char *dirname;
+    char *contents;
+    gsize length;
+
+    g_key_file_set_integer (manifest, MANIFEST_GROUP, "Version", MANIFEST_VERSION);
+
+    filename = get_manifest_filename ();
+    dirname = g_path_get_dirname (filename);
+    contents = g_key_file_to_data (manifest, &length, NULL);
+
+    if (g_mkdir_with_parents (dirname, 0700) == 0)
+    {
+        g_file_set_contents (filename, contents, length, NULL);
+    }
+
+    g_free (contents);
+    g_free (dirname);
+    g_free (filename);
+}
+
+/* An entry is only used while the library is the one it describes */
+static gboolean
+manifest_entry_is_current (GKeyFile   *manifest,
+                           const char *path,
+                           GStatBuf   *info)
+{
+    GError *error = NULL;
+    gint64 mtime, size;
+
+    mtime = g_key_file_get_int64 (manifest, path, "Mtime", &error);
+    if (error == NULL)
+    {
+        size = g_key_file_get_int64 (manifest, path, "Size", &error);
+    }
+    if (error != NULL)
+    {
+        g_error_free (error);
+        return FALSE;
+    }
+
+    return mtime == (gint64) info->st_mtime && size == (gint64) info->st_size &&
+           !g_key_file_get_boolean (manifest, path, "Python", NULL);
+}
+
+static gsize
+manifest_entry_count (GKeyFile *manifest)
+{
+    char **groups;
+    gsize n_groups, i, count;
+
+    groups = g_key_file_get_groups (manifest, &n_groups);
+    count = 0;
+    for (i = 0; i < n_groups; i++)
+    {
+        if (strcmp (groups[i], MANIFEST_GROUP) != 0)
+        {
+            count++;
+        }
+    }
+    g_strfreev (groups);
+
+    return count;
+}
+
+static void
+set_manifest_names (GKeyFile    *manifest,
+                    const char  *path,
+                    const char  *key,
+                    char       **names,
+                    gsize        n_names)
+{
+    g_key_file_set_string_list (manifest, path, key,
+                                (const char * const *) names, n_names);
+}
+
 static void
 load_module_dir (const char *dirname)
 {
     GDir *dir;
+    GKeyFile *manifest;
+    GKeyFile *new_manifest;
+    gboolean manifest_changed;
 
     dir = g_dir_open (dirname, 0, NULL);
 
@@ -223,19 +441,102 @@ load_module_dir (const char *dirname)
     {
         const char *name;
 
+        manifest = load_manifest ();
+        new_manifest = g_key_file_new ();
+        manifest_changed = FALSE;
+
         while ((name = g_dir_read_name (dir)))
         {
             if (g_str_has_suffix (name, "." G_MODULE_SUFFIX))
             {
                 char *filename;
+                GStatBuf info;
+                GPtrArray *types, *classes, *interfaces;
+                gboolean is_python;
+                LazyModule *lazy;
+                int i;
 
                 filename = g_build_filename (dirname,
                                              name,
                                              NULL);
-                peony_module_load_file (filename);
+                if (g_stat (filename, &info) != 0)
+                {
+                    g_free (filename);
+                    continue;
+                }
+
+                if (manifest_entry_is_current (manifest, filename, &info))
+                {
+                    /* Known library, opened when one of its types is
+                     * first asked for.
+                     */
+                    lazy = g_new0 (LazyModule, 1);
+                    lazy->path = filename;
+                    lazy->types = g_key_file_get_string_list (manifest, filename,
+                                  "Types", NULL, NULL);
+                    lazy->classes = g_key_file_get_string_list (manifest, filename,
+                                    "Classes", NULL, NULL);
+                    lazy->interfaces = g_key_file_get_string_list (manifest, filename,
+                                       "Interfaces", NULL, NULL);
+                    lazy_modules = g_list_prepend (lazy_modules, lazy);
+
+                    /* One entry per type, each filled in as the type
+                     * is registered once the library is opened.
+                     */
+                    for (i = 0; lazy->types != NULL && lazy->types[i] != NULL; i++)
+                    {
+                        peony_extension_register ((char *) name, NULL);
+                    }
+
+                    g_key_file_set_int64 (new_manifest, filename, "Mtime", info.st_mtime);
+                    g_key_file_set_int64 (new_manifest, filename, "Size", info.st_size);
+                    set_manifest_names (new_manifest, filename, "Types", lazy->types,
+                                        lazy->types != NULL ? g_strv_length (lazy->types) : 0);
+                    set_manifest_names (new_manifest, filename, "Classes", lazy->classes,
+                                        lazy->classes != NULL ? g_strv_length (lazy->classes) : 0);
+                    set_manifest_names (new_manifest, filename, "Interfaces", lazy->interfaces,
+                                        lazy->interfaces != NULL ? g_strv_length (lazy->interfaces) : 0);
+                    continue;
+                }
+
+                types = g_ptr_array_new_with_free_func (g_free);
+                classes = g_ptr_array_new_with_free_func (g_free);
+                interfaces = g_ptr_array_new_with_free_func (g_free);
+                is_python = FALSE;
+                if (peony_module_load_file (filename, types, classes, interfaces, &is_python) != NULL)
+                {
+                    g_key_file_set_int64 (new_manifest, filename, "Mtime", info.st_mtime);
+                    g_key_file_set_int64 (new_manifest, filename, "Size", info.st_size);
+                    set_manifest_names (new_manifest, filename, "Types",
+                                        (char **) types->pdata, types->len);
+                    set_manifest_names (new_manifest, filename, "Classes",
+                                        (char **) classes->pdata, classes->len);
+                    set_manifest_names (new_manifest, filename, "Interfaces",
+                                        (char **) interfaces->pdata, interfaces->len);
+                    /* Python extensions come and go without the library
+                     * changing, so that one is always loaded.
+                     */
+                    g_key_file_set_boolean (new_manifest, filename, "Python", is_python);
+                }
+                manifest_changed = TRUE;
+
+                g_ptr_array_unref (types);
+                g_ptr_array_unref (classes);
+                g_ptr_array_unref (interfaces);
+                g_free (filename);
             }
         }
         g_dir_close (dir);
+
+        /* Libraries that were removed also change it */
+        if (manifest_changed ||
+            manifest_entry_count (manifest) != manifest_entry_count (new_manifest))
+        {
+            save_manifest (new_manifest);
+        }
+
+        g_key_file_free (new_manifest);
+        g_key_file_free (manifest);
     }
 }
 
@@ -251,21 +552,190 @@ free_module_objects (void)
     }
 
     g_list_free (module_objects);
+
+    g_list_free_full (type_watches, g_free);
+    type_watches = NULL;
+}
+
+static void
+lazy_module_free (LazyModule *lazy)
+{
+    g_free (lazy->path);
+    g_strfreev (lazy->types);
+    g_strfreev (lazy->classes);
+    g_strfreev (lazy->interfaces);
+    g_free (lazy);
+}
+
+static void
+free_lazy_modules (void)
+{
+    g_list_free_full (lazy_modules, (GDestroyNotify) lazy_module_free);
+    lazy_modules = NULL;
+}
+
+static gboolean
+names_contain (char       **names,
+               const char  *name)
+{
+    int i;
+
+    for (i = 0; names != NULL && names[i] != NULL; i++)
+    {
+        if (strcmp (names[i], name) == 0)
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static gboolean
+lazy_module_implements (LazyModule *lazy,
+                        GType       type)
+{
+    if (G_TYPE_IS_INTERFACE (type))
+    {
+        return names_contain (lazy->interfaces, g_type_name (type));
+    }
+
+    return names_contain (lazy->classes, g_type_name (type));
+}
+
+void
+peony_module_load_for_type (GType type)
+{
+    GList *l, *next;
+    LazyModule *lazy;
+
+    peony_module_setup ();
+
+    for (l = lazy_modules; l != NULL; l = next)
+    {
+        next = l->next;
+        lazy = l->data;
+
+        if (lazy_module_implements (lazy, type))
+        {
+            lazy_modules = g_list_delete_link (lazy_modules, l);
+            peony_module_load_file (lazy->path, NULL, NULL, NULL, NULL);
+            lazy_module_free (lazy);
+        }
+    }
+}
+
+/* Stops a preload still running, waiting for the library it is
+ * opening, so none is opened after this.
+ */
+static void
+close_preloaded_libraries (void)
+{
+    GList *l;
+
+    g_mutex_lock (&preload_lock);
+    preload_cancelled = TRUE;
+    while (preload_running)
+    {
+        g_cond_wait (&preload_finished, &preload_lock);
+    }
+
+    for (l = preloaded_libraries; l != NULL; l = l->next)
+    {
+        g_module_close (l->data);
+    }
+    g_list_free (preloaded_libraries);
+    preloaded_libraries = NULL;
+    g_mutex_unlock (&preload_lock);
+}
+
+void
+peony_module_preload (void)
+{
+    GDir *dir;
+    GKeyFile *manifest;
+    const char *name;
+    char *filename;
+    GStatBuf info;
+    GModule *library;
+    gboolean cancelled;
+
+    g_mutex_lock (&preload_lock);
+    cancelled = preload_cancelled;
+    preload_running = !cancelled;
+    g_mutex_unlock (&preload_lock);
+
+    if (cancelled)
+    {
+        return;
+    }
+
+    dir = g_dir_open (PEONY_EXTENSIONDIR, 0, NULL);
+    manifest = load_manifest ();
+
+    while (dir != NULL && (name = g_dir_read_name (dir)))
+    {
+        g_mutex_lock (&preload_lock);
+        cancelled = preload_cancelled;
+        g_mutex_unlock (&preload_lock);
+
+        if (cancelled)
+        {
+            break;
+        }
+
+        if (!g_str_has_suffix (name, "." G_MODULE_SUFFIX))
+        {
+            continue;
+        }
+
+        filename = g_build_filename (PEONY_EXTENSIONDIR, name, NULL);
+
+        /* Those in the manifest are opened later, if at all */
+        if (g_stat (filename, &info) != 0 ||
+            manifest_entry_is_current (manifest, filename, &info))
+        {
+            g_free (filename);
+            continue;
+        }
+
+        library = g_module_open (filename, G_MODULE_BIND_LAZY | G_MODULE_BIND_LOCAL);
+        g_free (filename);
+
+        if (library != NULL)
+        {
+            g_mutex_lock (&preload_lock);
+            preloaded_libraries = g_list_prepend (preloaded_libraries, library);
+            g_mutex_unlock (&preload_lock);
+        }
+    }
+
+    if (dir != NULL)
+    {
+        g_dir_close (dir);
+    }
+    g_key_file_free (manifest);
+
+    g_mutex_lock (&preload_lock);
+    preload_running = FALSE;
+    g_cond_broadcast (&preload_finished);
+    g_mutex_unlock (&preload_lock);
 }
 
 void
 peony_module_setup (void)
 {
     static gboolean initialized = FALSE;
-    GList *res;
 
     if (!initialized)
     {
         initialized = TRUE;
 
         load_module_dir (PEONY_EXTENSIONDIR);
+        close_preloaded_libraries ();
 
         eel_debug_call_at_shutdown (free_module_objects);
+        eel_debug_call_at_shutdown (free_lazy_modules);
     }
 }
 
@@ -275,6 +745,12 @@ peony_module_get_extensions_for_type (GType type)
     GList *l;
     GList *ret = NULL;
 
+    /* Startup loads the extensions after the first window is shown,
+     * anything asking before then loads them now. Libraries are only
+     * opened once one of their interfaces is asked for.
+     */
+    peony_module_load_for_type (type);
+
     for (l = module_objects; l != NULL; l = l->next)
     {
         if (G_TYPE_CHECK_INSTANCE_TYPE (G_OBJECT (l->data),
@@ -301,10 +777,35 @@ peony_module_extension_list_free (GList *extensions)
     g_list_free (extensions);
 }
 
+void
+peony_module_watch_type (GType                 type,
+                         PeonyModuleObjectFunc func,
+                         gpointer              user_data)
+{
+    TypeWatch *watch;
+    GList *l;
+
+    for (l = module_objects; l != NULL; l = l->next)
+    {
+        if (G_TYPE_CHECK_INSTANCE_TYPE (G_OBJECT (l->data), type))
+        {
+            func (G_OBJECT (l->data), user_data);
+        }
+    }
+
+    watch = g_new0 (TypeWatch, 1);
+    watch->type = type;
+    watch->func = func;
+    watch->user_data = user_data;
+    type_watches = g_list_prepend (type_watches, watch);
+}
+
 GObject *
 peony_module_add_type (GType type)
 {
     GObject *object;
+    TypeWatch *watch;
+    GList *l;
 
     object = g_object_new (type, NULL);
     g_object_weak_ref (object,
@@ -312,5 +813,15 @@ peony_module_add_type (GType type)
                        NULL);
 
     module_objects = g_list_prepend (module_objects, object);
+
+    for (l = type_watches; l != NULL; l = l->next)
+    {
+        watch = l->data;
+        if (G_TYPE_CHECK_INSTANCE_TYPE (object, watch->type))
+        {
+            watch->func (object, watch->user_data);
+        }
+    }
+
     return object;
 }
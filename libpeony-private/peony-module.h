@@ -31,9 +31,27 @@ extern "C" {
 #endif
 
     void   peony_module_setup                   (void);
+    /* Opens the extension libraries ahead of peony_module_setup (),
+     * may be called from any thread. peony_module_setup () stops it
+     * and waits for it if it is still running. */
+    void   peony_module_preload                 (void);
     GList *peony_module_get_extensions_for_type (GType  type);
+    /* Opens the extension libraries with a type implementing or
+     * deriving from @type that have not been opened yet. Libraries in
+     * the manifest are only opened from here, see
+     * peony-extension-types.h */
+    void   peony_module_load_for_type           (GType  type);
     void   peony_module_extension_list_free     (GList *list);
 
+    typedef void (*PeonyModuleObjectFunc) (GObject  *object,
+                                           gpointer  user_data);
+    /* Calls @func for the extension objects implementing or deriving
+     * from @type that exist now, and for each one created later as
+     * its library is opened. Opens no library itself. */
+    void   peony_module_watch_type              (GType                 type,
+                                                 PeonyModuleObjectFunc func,
+                                                 gpointer              user_data);
+
 
     /* Add a type to the module interface - allows peony to add its own modules
      * without putting them in separate shared libraries */
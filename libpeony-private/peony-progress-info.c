@@ -444,8 +444,9 @@ progress_info_set_waiting(PeonyProgressInfo *info, gboolean waiting)
 {
      G_LOCK (progress_info);
      info->waiting = waiting;
+     /* Jobs may wait in several threads */
      if (! waiting)
-        g_cond_signal (&info->waiting_c);
+        g_cond_broadcast (&info->waiting_c);
      G_UNLOCK (progress_info);
 }
 
@@ -1037,7 +1038,7 @@ peony_progress_info_cancel (PeonyProgressInfo *info)
 
     g_cancellable_cancel (info->cancellable);
     info->waiting = FALSE;
-    g_cond_signal (&info->waiting_c);
+    g_cond_broadcast (&info->waiting_c);
 
     G_UNLOCK (progress_info);
 }
@@ -220,7 +220,7 @@ peony_search_directory_file_init (PeonySearchDirectoryFile *search_file)
 
     file->details->file_info_is_up_to_date = TRUE;
 
-    file->details->custom_icon = NULL;
+    peony_file_set_custom_icon_internal (file, NULL);
     file->details->activation_uri = NULL;
     file->details->got_link_info = TRUE;
     file->details->link_info_is_up_to_date = TRUE;
@@ -31,6 +31,7 @@
 #include "peony-file-private.h"
 #include "peony-file-utilities.h"
 #include "peony-search-engine.h"
+#include "peony-trace.h"
 #include <eel/eel-glib-extensions.h>
 #include <gtk/gtk.h>
 #include <gio/gio.h>
@@ -50,7 +51,12 @@ struct PeonySearchDirectoryDetails
     gboolean search_running;
     gboolean search_finished;
 
+    /* Hits in the order the engine reported them. file_hash maps each
+     * PeonyFile to its link in files, so lookups and removals don't
+     * walk the list, and files_tail makes appending cheap.
+     */
     GList *files;
+    GList *files_tail;
     GHashTable *file_hash;
 
     GList *monitor_list;
@@ -86,11 +92,19 @@ G_DEFINE_TYPE (PeonySearchDirectory, peony_search_directory,
                PEONY_TYPE_DIRECTORY);
 
 static void search_engine_hits_added (PeonySearchEngine *engine, GList *hits, PeonySearchDirectory *search);
+static void search_engine_hits_added_with_info (PeonySearchEngine *engine, GList *hits, PeonySearchDirectory *search);
 static void search_engine_hits_subtracted (PeonySearchEngine *engine, GList *hits, PeonySearchDirectory *search);
 static void search_engine_finished (PeonySearchEngine *engine, PeonySearchDirectory *search);
 static void search_engine_error (PeonySearchEngine *engine, const char *error, PeonySearchDirectory *search);
 static void search_callback_file_ready_callback (PeonyFile *file, gpointer data);
-static void file_changed (PeonyFile *file, PeonySearchDirectory *search);
+
+/* Live search directories, for the shared "changed" emission hook.
+ * The hook is only installed while there is at least one.
+ */
+static GList *search_directories = NULL;
+static gulong file_changed_hook_id = 0;
+static guint file_changed_signal_id = 0;
+static gpointer file_class = NULL;
 
 static void
 ensure_search_engine (PeonySearchDirectory *search)
@@ -112,6 +126,9 @@ ensure_search_engine (PeonySearchDirectory *search)
         g_signal_connect (search->details->engine, "hits-added",
                           G_CALLBACK (search_engine_hits_added),
                           search);
+        g_signal_connect (search->details->engine, "hits-added-with-info",
+                          G_CALLBACK (search_engine_hits_added_with_info),
+                          search);
         g_signal_connect (search->details->engine, "hits-subtracted",
                           G_CALLBACK (search_engine_hits_subtracted),
                           search);
@@ -124,6 +141,101 @@ ensure_search_engine (PeonySearchDirectory *search)
     }
 }
 
+static gboolean
+file_set_contains (PeonySearchDirectory *search, PeonyFile *file)
+{
+    return g_hash_table_lookup (search->details->file_hash, file) != NULL;
+}
+
+/* Takes over the reference to file. Returns FALSE (and drops the
+ * reference) if the file already is a hit.
+ */
+static gboolean
+file_set_append (PeonySearchDirectory *search, PeonyFile *file)
+{
+    GList *link;
+
+    if (file_set_contains (search, file))
+    {
+        peony_file_unref (file);
+        return FALSE;
+    }
+
+    link = g_list_alloc ();
+    link->data = file;
+    link->prev = search->details->files_tail;
+    link->next = NULL;
+
+    if (search->details->files_tail != NULL)
+    {
+        search->details->files_tail->next = link;
+    }
+    else
+    {
+        search->details->files = link;
+    }
+    search->details->files_tail = link;
+
+    g_hash_table_insert (search->details->file_hash, file, link);
+
+    return TRUE;
+}
+
+/* Returns the reference the set held, or NULL if file isn't a hit. */
+static PeonyFile *
+file_set_remove (PeonySearchDirectory *search, PeonyFile *file)
+{
+    GList *link;
+
+    link = g_hash_table_lookup (search->details->file_hash, file);
+    if (link == NULL)
+    {
+        return NULL;
+    }
+
+    g_hash_table_remove (search->details->file_hash, file);
+
+    if (link == search->details->files_tail)
+    {
+        search->details->files_tail = link->prev;
+    }
+    search->details->files = g_list_delete_link (search->details->files, link);
+
+    return file;
+}
+
+/* One emission hook serves all search directories, instead of a
+ * "changed" handler connected to every single hit.
+ */
+static gboolean
+file_changed_emission_hook (GSignalInvocationHint *ihint,
+                            guint n_param_values,
+                            const GValue *param_values,
+                            gpointer data)
+{
+    PeonyFile *file;
+    PeonySearchDirectory *search;
+    GList *node, list;
+
+    file = g_value_get_object (&param_values[0]);
+
+    list.data = file;
+    list.next = NULL;
+    list.prev = NULL;
+
+    for (node = search_directories; node != NULL; node = node->next)
+    {
+        search = node->data;
+
+        if (file_set_contains (search, file))
+        {
+            peony_directory_emit_files_changed (PEONY_DIRECTORY (search), &list);
+        }
+    }
+
+    return TRUE;
+}
+
 static void
 reset_file_list (PeonySearchDirectory *search)
 {
@@ -136,9 +248,6 @@ reset_file_list (PeonySearchDirectory *search)
     {
         file = list->data;
 
-        /* Disconnect change handler */
-        g_signal_handlers_disconnect_by_func (file, file_changed, search);
-
         /* Remove monitors */
         for (monitor_list = search->details->monitor_list; monitor_list;
                 monitor_list = monitor_list->next)
@@ -148,8 +257,10 @@ reset_file_list (PeonySearchDirectory *search)
         }
     }
 
+    g_hash_table_remove_all (search->details->file_hash);
     peony_file_list_free (search->details->files);
     search->details->files = NULL;
+    search->details->files_tail = NULL;
 }
 
 static void
@@ -183,17 +294,6 @@ start_or_stop_search_engine (PeonySearchDirectory *search, gboolean adding)
 
 }
 
-static void
-file_changed (PeonyFile *file, PeonySearchDirectory *search)
-{
-    GList list;
-
-    list.data = file;
-    list.next = NULL;
-
-    peony_directory_emit_files_changed (PEONY_DIRECTORY (search), &list);
-}
-
 static void
 search_monitor_add (PeonyDirectory *directory,
                     gconstpointer client,
@@ -510,6 +610,66 @@ search_cancel_callback (PeonyDirectory *directory,
 }
 
 
+/* Adds one hit and returns its file, or NULL if it was skipped. info,
+ * if not NULL, has all the default attributes and saves the async
+ * machinery from querying the file again.
+ */
+static PeonyFile *
+search_add_hit (PeonySearchDirectory *search,
+                const char *uri,
+                GFileInfo *info)
+{
+    PeonyFile *file;
+    SearchMonitor *monitor;
+    GList *monitor_list;
+
+    if (g_str_has_suffix (uri, PEONY_SAVED_SEARCH_EXTENSION))
+    {
+        /* Never return saved searches themselves as hits */
+        return NULL;
+    }
+
+    file = peony_file_get_by_uri (uri);
+
+    if (!file_set_append (search, file))
+    {
+        /* Engines may report a hit more than once */
+        return NULL;
+    }
+
+    if (info != NULL)
+    {
+        peony_file_update_partial_info (file, info);
+    }
+
+    for (monitor_list = search->details->monitor_list; monitor_list; monitor_list = monitor_list->next)
+    {
+        monitor = monitor_list->data;
+
+        /* Add monitors */
+        peony_file_monitor_add (file, monitor, monitor->monitor_attributes);
+    }
+
+    return file;
+}
+
+static void
+search_emit_hits_added (PeonySearchDirectory *search, GList *file_list)
+{
+    PeonyFile *file;
+
+    if (file_list == NULL)
+    {
+        return;
+    }
+
+    peony_directory_emit_files_added (PEONY_DIRECTORY (search), file_list);
+
+    file = peony_directory_get_corresponding_file (PEONY_DIRECTORY (search));
+    peony_file_emit_changed (file);
+    peony_file_unref (file);
+}
+
 static void
 search_engine_hits_added (PeonySearchEngine *engine, GList *hits,
                           PeonySearchDirectory *search)
@@ -517,44 +677,58 @@ search_engine_hits_added (PeonySearchEngine *engine, GList *hits,
     GList *hit_list;
     GList *file_list;
     PeonyFile *file;
-    char *uri;
-    SearchMonitor *monitor;
-    GList *monitor_list;
+    gint64 trace_begin;
 
+    trace_begin = PEONY_TRACE_BEGIN ();
     file_list = NULL;
 
     for (hit_list = hits; hit_list != NULL; hit_list = hit_list->next)
     {
-        uri = hit_list->data;
-
-        if (g_str_has_suffix (uri, PEONY_SAVED_SEARCH_EXTENSION))
+        file = search_add_hit (search, hit_list->data, NULL);
+        if (file != NULL)
         {
-            /* Never return saved searches themselves as hits */
-            continue;
+            file_list = g_list_prepend (file_list, file);
         }
+    }
 
-        file = peony_file_get_by_uri (uri);
+    file_list = g_list_reverse (file_list);
+    search_emit_hits_added (search, file_list);
+    g_list_free (file_list);
 
-        for (monitor_list = search->details->monitor_list; monitor_list; monitor_list = monitor_list->next)
-        {
-            monitor = monitor_list->data;
+    PEONY_TRACE_COUNTER ("search hits", g_list_length (hits));
+    PEONY_TRACE_END (PEONY_TRACE_CATEGORY_SEARCH, "hits batch", trace_begin);
+}
 
-            /* Add monitors */
-            peony_file_monitor_add (file, monitor, monitor->monitor_attributes);
-        }
+static void
+search_engine_hits_added_with_info (PeonySearchEngine *engine, GList *hits,
+                                    PeonySearchDirectory *search)
+{
+    GList *hit_list;
+    GList *file_list;
+    PeonySearchHit *hit;
+    PeonyFile *file;
+    gint64 trace_begin;
 
-        g_signal_connect (file, "changed", G_CALLBACK (file_changed), search),
+    trace_begin = PEONY_TRACE_BEGIN ();
+    file_list = NULL;
 
-                         file_list = g_list_prepend (file_list, file);
-    }
+    for (hit_list = hits; hit_list != NULL; hit_list = hit_list->next)
+    {
+        hit = hit_list->data;
 
-    search->details->files = g_list_concat (search->details->files, file_list);
+        file = search_add_hit (search, hit->uri, hit->info);
+        if (file != NULL)
+        {
+            file_list = g_list_prepend (file_list, file);
+        }
+    }
 
-    peony_directory_emit_files_added (PEONY_DIRECTORY (search), file_list);
+    file_list = g_list_reverse (file_list);
+    search_emit_hits_added (search, file_list);
+    g_list_free (file_list);
 
-    file = peony_directory_get_corresponding_file (PEONY_DIRECTORY (search));
-    peony_file_emit_changed (file);
-    peony_file_unref (file);
+    PEONY_TRACE_COUNTER ("search hits", g_list_length (hits));
+    PEONY_TRACE_END (PEONY_TRACE_CATEGORY_SEARCH, "hits batch", trace_begin);
 }
 
 static void
@@ -573,7 +747,18 @@ search_engine_hits_subtracted (PeonySearchEngine *engine, GList *hits,
     for (hit_list = hits; hit_list != NULL; hit_list = hit_list->next)
     {
         uri = hit_list->data;
-        file = peony_file_get_by_uri (uri);
+        file = peony_file_get_existing_by_uri (uri);
+
+        if (file == NULL)
+        {
+            continue;
+        }
+
+        if (file_set_remove (search, file) == NULL)
+        {
+            peony_file_unref (file);
+            continue;
+        }
 
         for (monitor_list = search->details->monitor_list; monitor_list;
                 monitor_list = monitor_list->next)
@@ -583,13 +768,17 @@ search_engine_hits_subtracted (PeonySearchEngine *engine, GList *hits,
             peony_file_monitor_remove (file, monitor);
         }
 
-        g_signal_handlers_disconnect_by_func (file, file_changed, search);
-
-        search->details->files = g_list_remove (search->details->files, file);
+        /* Drop the reference the result set held; file_list keeps ours */
+        peony_file_unref (file);
 
         file_list = g_list_prepend (file_list, file);
     }
 
+    if (file_list == NULL)
+    {
+        return;
+    }
+
     peony_directory_emit_files_changed (PEONY_DIRECTORY (search), file_list);
 
     peony_file_list_free (file_list);
@@ -686,8 +875,7 @@ search_contains_file (PeonyDirectory *directory,
 
     search = PEONY_SEARCH_DIRECTORY (directory);
 
-    /* FIXME: Maybe put the files in a hash */
-    return (g_list_find (search->details->files, file) != NULL);
+    return file_set_contains (search, file);
 }
 
 static GList *
@@ -773,7 +961,18 @@ search_finalize (GObject *object)
 
     search = PEONY_SEARCH_DIRECTORY (object);
 
+    search_directories = g_list_remove (search_directories, search);
+    if (search_directories == NULL)
+    {
+        g_signal_remove_emission_hook (file_changed_signal_id,
+                                       file_changed_hook_id);
+        file_changed_hook_id = 0;
+        g_type_class_unref (file_class);
+        file_class = NULL;
+    }
+
     g_free (search->details->saved_search_uri);
+    g_hash_table_destroy (search->details->file_hash);
 
     g_free (search->details);
 
@@ -784,6 +983,18 @@ static void
 peony_search_directory_init (PeonySearchDirectory *search)
 {
     search->details = g_new0 (PeonySearchDirectoryDetails, 1);
+    search->details->file_hash = g_hash_table_new (NULL, NULL);
+
+    if (search_directories == NULL)
+    {
+        /* The signal only exists once the file class is initialized */
+        file_class = g_type_class_ref (PEONY_TYPE_FILE);
+        file_changed_signal_id = g_signal_lookup ("changed", PEONY_TYPE_FILE);
+        file_changed_hook_id =
+            g_signal_add_emission_hook (file_changed_signal_id, 0,
+                                        file_changed_emission_hook, NULL, NULL);
+    }
+    search_directories = g_list_prepend (search_directories, search);
 }
 
 static void
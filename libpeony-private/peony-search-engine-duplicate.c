@@ -25,6 +25,7 @@
 
 #include <config.h>
 #include "peony-search-engine-duplicate.h"
+#include "peony-file-private.h"
 
 #include <string.h>
 #include <glib.h>
@@ -49,7 +50,7 @@ typedef struct
     GHashTable *pFileList;
     GHashTable *pFileRes;
     gint n_processed_files;
-    GList *uri_hits;
+    GList *hits; /* PeonySearchHit */
 	
     GList *pListRes;
 } SearchThreadData;
@@ -106,7 +107,7 @@ search_thread_data_new (PeonySearchEngineDuplicate *engine,
     data->engine = engine;
     data->directories = g_queue_new ();
     data->visited = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
-    data->pFileList = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    data->pFileList = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
     data->pFileRes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
     uri = peony_query_get_location (query);
     location = NULL;
@@ -148,7 +149,7 @@ search_thread_data_free (SearchThreadData *data)
     g_object_unref (data->cancellable);
     g_strfreev (data->words);
     g_list_free_full (data->mime_types, g_free);
-    g_list_free_full (data->uri_hits, g_free);
+    g_list_free_full (data->hits, (GDestroyNotify) peony_search_hit_free);
     g_free (data);
 }
 
@@ -172,7 +173,7 @@ search_thread_done_idle (gpointer user_data)
 
 typedef struct
 {
-    GList *uris;
+    GList *hits; /* PeonySearchHit */
     SearchThreadData *thread_data;
 } SearchHits;
 
@@ -186,11 +187,11 @@ search_thread_add_hits_idle (gpointer user_data)
 
     if (!g_cancellable_is_cancelled (hits->thread_data->cancellable))
     {
-        peony_search_engine_hits_added (PEONY_SEARCH_ENGINE (hits->thread_data->engine),
-                                       hits->uris);
+        peony_search_engine_hits_added_with_info (PEONY_SEARCH_ENGINE (hits->thread_data->engine),
+                hits->hits);
     }
 
-    g_list_free_full (hits->uris, g_free);
+    g_list_free_full (hits->hits, (GDestroyNotify) peony_search_hit_free);
     g_free (hits);
 
     return FALSE;
@@ -203,22 +204,22 @@ send_batch (SearchThreadData *data)
 
     data->n_processed_files = 0;
 
-    if (data->uri_hits)
+    if (data->hits)
     {
         hits = g_new (SearchHits, 1);
-        hits->uris = data->uri_hits;
+        hits->hits = g_list_reverse (data->hits);
         hits->thread_data = data;
+
         g_idle_add (search_thread_add_hits_idle, hits);
     }
-    data->uri_hits = NULL;
+    data->hits = NULL;
 }
 
+/* Only what matching needs is asked for, since most files walked
+ * have no duplicate. Hits keep it as their partial info.
+ */
 #define STD_ATTRIBUTES \
-	G_FILE_ATTRIBUTE_STANDARD_NAME "," \
-	G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME "," \
-	G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN "," \
-	G_FILE_ATTRIBUTE_STANDARD_TYPE "," \
-	G_FILE_ATTRIBUTE_ID_FILE
+	PEONY_SEARCH_HIT_ATTRIBUTES
 	
 static void
 visit_directory_duplicate (GFile *dir, SearchThreadData *data)
@@ -233,16 +234,10 @@ visit_directory_duplicate (GFile *dir, SearchThreadData *data)
 	GList *l;
 	const char *id;
 	gboolean visited;
-	char *pUri = NULL;
 	char *pOldKey = NULL;
 	char *pOldUri = NULL;
-	enumerator = g_file_enumerate_children (dir,
-											data->mime_types != NULL ?
-											STD_ATTRIBUTES ","
-											G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE
-											:
-											STD_ATTRIBUTES
-											,
+	GFile *pOldFile = NULL;
+	enumerator = g_file_enumerate_children (dir, STD_ATTRIBUTES,
 											0, data->cancellable, NULL);
 
 	if (enumerator == NULL)
@@ -289,30 +284,33 @@ visit_directory_duplicate (GFile *dir, SearchThreadData *data)
 			}
 
 			hit = FALSE;
-			pUri = g_file_get_uri (child);
-			if(NULL != pUri)
+			/* Only the URI of the first file of each name is kept,
+			 * it becomes a hit too once a duplicate shows up.
+			 */
+			if (g_hash_table_lookup_extended (data->pFileList,
+											  display_name, (gpointer *)&pOldKey, (gpointer *)&pOldUri))
 			{
-				if (g_hash_table_lookup_extended (data->pFileList,
-												  display_name, (gpointer *)&pOldKey, (gpointer *)&pOldUri))
-				{
-					hit = TRUE;
-				}
-				else
-				{
-					g_hash_table_insert (data->pFileList, g_strdup (display_name), g_strdup (pUri));
-				}
-				g_free(pUri);
+				hit = TRUE;
+			}
+			else
+			{
+				g_hash_table_insert (data->pFileList, g_strdup (display_name),
+									 g_file_get_uri (child));
 			}
-						
+
 			if (hit)
 			{
 				if (!g_hash_table_lookup_extended (data->pFileRes,
 												  pOldUri, NULL, NULL))
 				{
 					g_hash_table_insert (data->pFileRes, g_strdup (pOldUri), NULL);
-					data->uri_hits = g_list_prepend (data->uri_hits, g_strdup (pOldUri));
+					pOldFile = g_file_new_for_uri (pOldUri);
+					data->hits = g_list_prepend (data->hits,
+												 peony_search_hit_new (pOldFile, NULL));
+					g_object_unref (pOldFile);
 				}
-				data->uri_hits = g_list_prepend (data->uri_hits, g_file_get_uri (child));
+				data->hits = g_list_prepend (data->hits,
+											 peony_search_hit_new (child, info));
 			}
 
 			data->n_processed_files++;
@@ -366,6 +364,20 @@ search_duplicate_thread_func_new (gpointer user_data)
     return NULL;
 }
 
+/* Takes the URI. The listing only has names, so the directory queries
+ * these hits itself.
+ */
+static void
+add_uri_hit (SearchThreadData *data, char *uri)
+{
+    GFile *location;
+
+    location = g_file_new_for_uri (uri);
+    data->hits = g_list_prepend (data->hits, peony_search_hit_new (location, NULL));
+    g_object_unref (location);
+    g_free (uri);
+}
+
 static gpointer
 find_duplicate_thread (SearchThreadData *data)
 {
@@ -427,7 +439,7 @@ find_duplicate_thread (SearchThreadData *data)
 				}
 				if(0 == strcmp(pFileUri,pFileNextUri))
 				{
-					data->uri_hits = g_list_prepend (data->uri_hits, pUriNext);
+					add_uri_hit (data, pUriNext);
 					bFind = TRUE;
 					data->n_processed_files++;
 			        if (data->n_processed_files > BATCH_SIZE)
@@ -452,7 +464,7 @@ find_duplicate_thread (SearchThreadData *data)
 			}
 			if(TRUE == bFind)
 			{
-				data->uri_hits = g_list_prepend (data->uri_hits, pUri);
+				add_uri_hit (data, pUri);
 			}
 		}
 		
@@ -23,6 +23,7 @@
 
 #include <config.h>
 #include "peony-search-engine-simple.h"
+#include "peony-file-private.h"
 
 #include <string.h>
 #include <glib.h>
@@ -46,7 +47,7 @@ typedef struct
     GHashTable *visited;
 
     gint n_processed_files;
-    GList *uri_hits;
+    GList *hits; /* PeonySearchHit */
 } SearchThreadData;
 
 
@@ -138,7 +139,7 @@ search_thread_data_free (SearchThreadData *data)
     g_object_unref (data->cancellable);
     g_strfreev (data->words);
     g_list_free_full (data->mime_types, g_free);
-    g_list_free_full (data->uri_hits, g_free);
+    g_list_free_full (data->hits, (GDestroyNotify) peony_search_hit_free);
     g_free (data);
 }
 
@@ -162,7 +163,7 @@ search_thread_done_idle (gpointer user_data)
 
 typedef struct
 {
-    GList *uris;
+    GList *hits; /* PeonySearchHit */
     SearchThreadData *thread_data;
 } SearchHits;
 
@@ -176,11 +177,11 @@ search_thread_add_hits_idle (gpointer user_data)
 
     if (!g_cancellable_is_cancelled (hits->thread_data->cancellable))
     {
-        peony_search_engine_hits_added (PEONY_SEARCH_ENGINE (hits->thread_data->engine),
-                                       hits->uris);
+        peony_search_engine_hits_added_with_info (PEONY_SEARCH_ENGINE (hits->thread_data->engine),
+                hits->hits);
     }
 
-    g_list_free_full (hits->uris, g_free);
+    g_list_free_full (hits->hits, (GDestroyNotify) peony_search_hit_free);
     g_free (hits);
 
     return FALSE;
@@ -193,22 +194,26 @@ send_batch (SearchThreadData *data)
 
     data->n_processed_files = 0;
 
-    if (data->uri_hits)
+    if (data->hits)
     {
         hits = g_new (SearchHits, 1);
-        hits->uris = data->uri_hits;
+        hits->hits = g_list_reverse (data->hits);
         hits->thread_data = data;
+
         g_idle_add (search_thread_add_hits_idle, hits);
     }
-    data->uri_hits = NULL;
+    data->hits = NULL;
 }
 
+/* Only what matching needs is asked for, since most files walked
+ * don't match. Hits keep it as their partial info.
+ */
 #define STD_ATTRIBUTES \
-	G_FILE_ATTRIBUTE_STANDARD_NAME "," \
-	G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME "," \
-	G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN "," \
-	G_FILE_ATTRIBUTE_STANDARD_TYPE "," \
-	G_FILE_ATTRIBUTE_ID_FILE
+	PEONY_SEARCH_HIT_ATTRIBUTES
+
+#define STD_ATTRIBUTES_WITH_MIME_TYPE \
+	PEONY_SEARCH_HIT_ATTRIBUTES "," \
+	G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE
 
 static void
 visit_directory (GFile *dir, SearchThreadData *data)
@@ -226,11 +231,7 @@ visit_directory (GFile *dir, SearchThreadData *data)
 
     enumerator = g_file_enumerate_children (dir,
                                             data->mime_types != NULL ?
-                                            STD_ATTRIBUTES ","
-                                            G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE
-                                            :
-                                            STD_ATTRIBUTES
-                                            ,
+                                            STD_ATTRIBUTES_WITH_MIME_TYPE : STD_ATTRIBUTES,
                                             0, data->cancellable, NULL);
 
     if (enumerator == NULL)
@@ -285,7 +286,8 @@ visit_directory (GFile *dir, SearchThreadData *data)
 
         if (hit)
         {
-            data->uri_hits = g_list_prepend (data->uri_hits, g_file_get_uri (child));
+            data->hits = g_list_prepend (data->hits,
+                                         peony_search_hit_new (child, info));
         }
 
         data->n_processed_files++;
@@ -41,6 +41,7 @@ struct PeonySearchEngineDetails
 enum
 {
     HITS_ADDED,
+    HITS_ADDED_WITH_INFO,
     HITS_SUBTRACTED,
     FINISHED,
     ERROR,
@@ -90,6 +91,16 @@ peony_search_engine_class_init (PeonySearchEngineClass *class)
                       G_TYPE_NONE, 1,
                       G_TYPE_POINTER);
 
+    signals[HITS_ADDED_WITH_INFO] =
+        g_signal_new ("hits-added-with-info",
+                      G_TYPE_FROM_CLASS (class),
+                      G_SIGNAL_RUN_LAST,
+                      G_STRUCT_OFFSET (PeonySearchEngineClass, hits_added_with_info),
+                      NULL, NULL,
+                      g_cclosure_marshal_VOID__POINTER,
+                      G_TYPE_NONE, 1,
+                      G_TYPE_POINTER);
+
     signals[HITS_SUBTRACTED] =
         g_signal_new ("hits-subtracted",
                       G_TYPE_FROM_CLASS (class),
@@ -202,6 +213,17 @@ peony_search_engine_hits_added (PeonySearchEngine *engine, GList *hits)
     g_signal_emit (engine, signals[HITS_ADDED], 0, hits);
 }
 
+/* Like peony_search_engine_hits_added(), but hits is a list of
+ * PeonySearchHit. Engines that look at the files anyway should use
+ * this, so the results don't have to be queried a second time.
+ */
+void
+peony_search_engine_hits_added_with_info (PeonySearchEngine *engine, GList *hits)
+{
+    g_return_if_fail (PEONY_IS_SEARCH_ENGINE (engine));
+
+    g_signal_emit (engine, signals[HITS_ADDED_WITH_INFO], 0, hits);
+}
 
 void
 peony_search_engine_hits_subtracted (PeonySearchEngine *engine, GList *hits)
@@ -227,3 +249,29 @@ peony_search_engine_error (PeonySearchEngine *engine, const char *error_message)
 
     g_signal_emit (engine, signals[ERROR], 0, error_message);
 }
+
+PeonySearchHit *
+peony_search_hit_new (GFile *location, GFileInfo *info)
+{
+    PeonySearchHit *hit;
+
+    hit = g_new0 (PeonySearchHit, 1);
+    hit->uri = g_file_get_uri (location);
+    if (info != NULL)
+    {
+        hit->info = g_object_ref (info);
+    }
+
+    return hit;
+}
+
+void
+peony_search_hit_free (PeonySearchHit *hit)
+{
+    g_free (hit->uri);
+    if (hit->info != NULL)
+    {
+        g_object_unref (hit->info);
+    }
+    g_free (hit);
+}
@@ -27,6 +27,7 @@
 #define PEONY_SEARCH_ENGINE_H
 
 #include <glib-object.h>
+#include <gio/gio.h>
 #include <libpeony-private/peony-query.h>
 
 #define PEONY_TYPE_SEARCH_ENGINE		(peony_search_engine_get_type ())
@@ -38,6 +39,24 @@
 
 typedef struct PeonySearchEngineDetails PeonySearchEngineDetails;
 
+/* A hit together with what the engine already knows about it. info,
+ * if set, only has the few standard attributes the engine needed to
+ * match the file (PEONY_SEARCH_HIT_ATTRIBUTES at most); the search
+ * directory shows the hit with those and loads the rest as usual.
+ */
+typedef struct
+{
+    char *uri;
+    GFileInfo *info;
+} PeonySearchHit;
+
+#define PEONY_SEARCH_HIT_ATTRIBUTES \
+    G_FILE_ATTRIBUTE_STANDARD_NAME "," \
+    G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME "," \
+    G_FILE_ATTRIBUTE_STANDARD_TYPE "," \
+    G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN "," \
+    G_FILE_ATTRIBUTE_ID_FILE
+
 typedef struct PeonySearchEngine
 {
     GObject parent;
@@ -56,6 +75,7 @@ typedef struct
 
     /* Signals */
     void (*hits_added) (PeonySearchEngine *engine, GList *hits);
+    void (*hits_added_with_info) (PeonySearchEngine *engine, GList *hits);
     void (*hits_subtracted) (PeonySearchEngine *engine, GList *hits);
     void (*finished) (PeonySearchEngine *engine);
     void (*error) (PeonySearchEngine *engine, const char *error_message);
@@ -72,8 +92,12 @@ void	       peony_search_engine_stop (PeonySearchEngine *engine);
 gboolean       peony_search_engine_is_indexed (PeonySearchEngine *engine);
 
 void	       peony_search_engine_hits_added (PeonySearchEngine *engine, GList *hits);
+void	       peony_search_engine_hits_added_with_info (PeonySearchEngine *engine, GList *hits);
 void	       peony_search_engine_hits_subtracted (PeonySearchEngine *engine, GList *hits);
 void	       peony_search_engine_finished (PeonySearchEngine *engine);
 void	       peony_search_engine_error (PeonySearchEngine *engine, const char *error_message);
 
+PeonySearchHit *peony_search_hit_new (GFile *location, GFileInfo *info);
+void	       peony_search_hit_free (PeonySearchHit *hit);
+
 #endif /* PEONY_SEARCH_ENGINE_H */
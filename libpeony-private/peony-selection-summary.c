@@ -0,0 +1,402 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4; tab-width: 8 -*-
+
+   peony-selection-summary.c: facts about a selection, kept up to date
+   as files enter and leave it.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include <config.h>
+#include "peony-selection-summary.h"
+
+#include <string.h>
+
+#include "peony-desktop-icon-file.h"
+#include "peony-mime-actions.h"
+
+typedef struct
+{
+    guint facts; /* bit per PeonySelectionFact */
+    guint generation;
+    gboolean is_directory;
+    gboolean item_count_known;
+    guint item_count;
+    gboolean size_known;
+    goffset size;
+} FileFacts;
+
+struct PeonySelectionSummary
+{
+    /* PeonyFile to FileFacts */
+    GHashTable *files;
+    guint generation;
+
+    guint fact_counts[PEONY_SELECTION_FACT_LAST];
+    guint folder_count;
+    guint folder_item_count;
+    guint folders_with_unknown_item_count;
+    goffset non_folder_size;
+    guint non_folders_with_known_size;
+
+    /* The same files, grouped for the application lookups */
+    PeonyMimeSelection *mime_selection;
+};
+
+static void
+file_facts_free (FileFacts *facts)
+{
+    g_slice_free (FileFacts, facts);
+}
+
+static void
+compute_facts (PeonyFile *file,
+               FileFacts *facts)
+{
+    facts->facts = 0;
+    if (peony_file_can_delete (file))
+    {
+        facts->facts |= 1 << PEONY_SELECTION_FACT_CAN_DELETE;
+    }
+    if (PEONY_IS_DESKTOP_ICON_FILE (file))
+    {
+        facts->facts |= 1 << PEONY_SELECTION_FACT_SPECIAL_LINK;
+    }
+    if (peony_file_is_home (file) || peony_file_is_desktop_directory (file))
+    {
+        facts->facts |= 1 << PEONY_SELECTION_FACT_HOME_OR_DESKTOP;
+    }
+    if (peony_file_is_in_trash (file))
+    {
+        facts->facts |= 1 << PEONY_SELECTION_FACT_IN_TRASH;
+    }
+    if (peony_mime_file_opens_in_external_app (file))
+    {
+        facts->facts |= 1 << PEONY_SELECTION_FACT_OPENS_IN_EXTERNAL_APP;
+    }
+
+    facts->is_directory = peony_file_is_directory (file);
+    facts->item_count_known = FALSE;
+    facts->item_count = 0;
+    facts->size_known = FALSE;
+    facts->size = 0;
+
+    if (facts->is_directory)
+    {
+        facts->item_count_known =
+            peony_file_get_directory_item_count (file, &facts->item_count, NULL);
+    }
+    else if (!peony_file_can_get_size (file))
+    {
+        /* The status bar has always counted the size this way round */
+        facts->size_known = TRUE;
+        facts->size = peony_file_get_size (file);
+    }
+}
+
+static void
+add_facts (PeonySelectionSummary *summary,
+           FileFacts *facts,
+           int sign)
+{
+    int i;
+
+    for (i = 0; i < PEONY_SELECTION_FACT_LAST; i++)
+    {
+        if (facts->facts & (1 << i))
+        {
+            summary->fact_counts[i] += sign;
+        }
+    }
+
+    if (facts->is_directory)
+    {
+        summary->folder_count += sign;
+        if (facts->item_count_known)
+        {
+            summary->folder_item_count += sign * (int) facts->item_count;
+        }
+        else
+        {
+            summary->folders_with_unknown_item_count += sign;
+        }
+    }
+    else if (facts->size_known)
+    {
+        summary->non_folders_with_known_size += sign;
+        summary->non_folder_size += sign * facts->size;
+    }
+}
+
+static void
+summary_add_file (PeonySelectionSummary *summary,
+                  PeonyFile *file)
+{
+    FileFacts *facts;
+
+    facts = g_hash_table_lookup (summary->files, file);
+    if (facts == NULL)
+    {
+        facts = g_slice_new (FileFacts);
+        compute_facts (file, facts);
+        add_facts (summary, facts, 1);
+        g_hash_table_insert (summary->files, peony_file_ref (file), facts);
+        peony_mime_selection_add_file (summary->mime_selection, file);
+    }
+    facts->generation = summary->generation;
+}
+
+PeonySelectionSummary *
+peony_selection_summary_new (void)
+{
+    PeonySelectionSummary *summary;
+
+    summary = g_new0 (PeonySelectionSummary, 1);
+    summary->files = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                            (GDestroyNotify) peony_file_unref,
+                                            (GDestroyNotify) file_facts_free);
+    summary->mime_selection = peony_mime_selection_new ();
+
+    return summary;
+}
+
+void
+peony_selection_summary_free (PeonySelectionSummary *summary)
+{
+    if (summary == NULL)
+    {
+        return;
+    }
+
+    peony_mime_selection_free (summary->mime_selection);
+    g_hash_table_destroy (summary->files);
+    g_free (summary);
+}
+
+void
+peony_selection_summary_set_files (PeonySelectionSummary *summary,
+                                   GList *files)
+{
+    GHashTableIter iter;
+    FileFacts *facts;
+    gpointer file;
+    GList *l;
+
+    g_return_if_fail (summary != NULL);
+
+    summary->generation++;
+
+    for (l = files; l != NULL; l = l->next)
+    {
+        summary_add_file (summary, l->data);
+    }
+
+    /* Whatever was not seen above has left the selection */
+    if (g_hash_table_size (summary->files) != 0)
+    {
+        g_hash_table_iter_init (&iter, summary->files);
+        while (g_hash_table_iter_next (&iter, &file, (gpointer *) &facts))
+        {
+            if (facts->generation != summary->generation)
+            {
+                add_facts (summary, facts, -1);
+                peony_mime_selection_remove_file (summary->mime_selection, file);
+                g_hash_table_iter_remove (&iter);
+            }
+        }
+    }
+}
+
+void
+peony_selection_summary_add_files (PeonySelectionSummary *summary,
+                                   GList *files)
+{
+    GList *l;
+
+    g_return_if_fail (summary != NULL);
+
+    for (l = files; l != NULL; l = l->next)
+    {
+        summary_add_file (summary, l->data);
+    }
+}
+
+void
+peony_selection_summary_remove_files (PeonySelectionSummary *summary,
+                                      GList *files)
+{
+    FileFacts *facts;
+    GList *l;
+
+    g_return_if_fail (summary != NULL);
+
+    for (l = files; l != NULL; l = l->next)
+    {
+        facts = g_hash_table_lookup (summary->files, l->data);
+        if (facts != NULL)
+        {
+            add_facts (summary, facts, -1);
+            peony_mime_selection_remove_file (summary->mime_selection, l->data);
+            g_hash_table_remove (summary->files, l->data);
+        }
+    }
+}
+
+gboolean
+peony_selection_summary_files_changed (PeonySelectionSummary *summary,
+                                       GList *files)
+{
+    FileFacts *facts;
+    gboolean changed;
+    GList *l;
+
+    g_return_val_if_fail (summary != NULL, FALSE);
+
+    changed = FALSE;
+    for (l = files; l != NULL; l = l->next)
+    {
+        facts = g_hash_table_lookup (summary->files, l->data);
+        if (facts != NULL)
+        {
+            add_facts (summary, facts, -1);
+            compute_facts (l->data, facts);
+            add_facts (summary, facts, 1);
+            /* The MIME type may have changed, or become known */
+            peony_mime_selection_remove_file (summary->mime_selection, l->data);
+            peony_mime_selection_add_file (summary->mime_selection, l->data);
+            changed = TRUE;
+        }
+    }
+
+    return changed;
+}
+
+void
+peony_selection_summary_invalidate (PeonySelectionSummary *summary)
+{
+    g_return_if_fail (summary != NULL);
+
+    peony_mime_selection_clear (summary->mime_selection);
+    g_hash_table_remove_all (summary->files);
+    memset (summary->fact_counts, 0, sizeof (summary->fact_counts));
+    summary->folder_count = 0;
+    summary->folder_item_count = 0;
+    summary->folders_with_unknown_item_count = 0;
+    summary->non_folder_size = 0;
+    summary->non_folders_with_known_size = 0;
+}
+
+guint
+peony_selection_summary_get_count (PeonySelectionSummary *summary)
+{
+    g_return_val_if_fail (summary != NULL, 0);
+
+    return g_hash_table_size (summary->files);
+}
+
+gboolean
+peony_selection_summary_all (PeonySelectionSummary *summary,
+                             PeonySelectionFact fact)
+{
+    g_return_val_if_fail (summary != NULL, FALSE);
+    g_return_val_if_fail (fact < PEONY_SELECTION_FACT_LAST, FALSE);
+
+    return summary->fact_counts[fact] == g_hash_table_size (summary->files);
+}
+
+gboolean
+peony_selection_summary_any (PeonySelectionSummary *summary,
+                             PeonySelectionFact fact)
+{
+    g_return_val_if_fail (summary != NULL, FALSE);
+    g_return_val_if_fail (fact < PEONY_SELECTION_FACT_LAST, FALSE);
+
+    return summary->fact_counts[fact] != 0;
+}
+
+guint
+peony_selection_summary_get_folder_count (PeonySelectionSummary *summary)
+{
+    g_return_val_if_fail (summary != NULL, 0);
+
+    return summary->folder_count;
+}
+
+gboolean
+peony_selection_summary_get_folder_item_count (PeonySelectionSummary *summary,
+        guint *count)
+{
+    g_return_val_if_fail (summary != NULL, FALSE);
+
+    *count = summary->folder_item_count;
+
+    return summary->folders_with_unknown_item_count == 0;
+}
+
+gboolean
+peony_selection_summary_get_non_folder_size (PeonySelectionSummary *summary,
+        goffset *size)
+{
+    g_return_val_if_fail (summary != NULL, FALSE);
+
+    *size = summary->non_folder_size;
+
+    return summary->non_folders_with_known_size != 0;
+}
+
+PeonyFile *
+peony_selection_summary_peek_file (PeonySelectionSummary *summary)
+{
+    GHashTableIter iter;
+    gpointer file;
+
+    g_return_val_if_fail (summary != NULL, NULL);
+
+    g_hash_table_iter_init (&iter, summary->files);
+    if (g_hash_table_iter_next (&iter, &file, NULL))
+    {
+        return file;
+    }
+
+    return NULL;
+}
+
+GList *
+peony_selection_summary_get_files (PeonySelectionSummary *summary)
+{
+    GList *files;
+
+    g_return_val_if_fail (summary != NULL, NULL);
+
+    files = g_hash_table_get_keys (summary->files);
+
+    return peony_file_list_ref (files);
+}
+
+GAppInfo *
+peony_selection_summary_get_default_application (PeonySelectionSummary *summary)
+{
+    g_return_val_if_fail (summary != NULL, NULL);
+
+    return peony_mime_selection_get_default_application (summary->mime_selection);
+}
+
+GList *
+peony_selection_summary_get_applications (PeonySelectionSummary *summary)
+{
+    g_return_val_if_fail (summary != NULL, NULL);
+
+    return peony_mime_selection_get_applications (summary->mime_selection);
+}
@@ -0,0 +1,96 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4; tab-width: 8 -*-
+
+   peony-selection-summary.h: facts about a selection, kept up to date
+   as files enter and leave it.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef PEONY_SELECTION_SUMMARY_H
+#define PEONY_SELECTION_SUMMARY_H
+
+#include <gio/gio.h>
+#include "peony-file.h"
+
+/* Menus and the status bar ask the same questions about every selected
+ * file each time the selection changes. The summary answers them once
+ * per file when it enters the selection and keeps the totals, so
+ * selecting a few more files out of thousands only looks at those.
+ */
+
+typedef enum
+{
+    PEONY_SELECTION_FACT_CAN_DELETE,
+    PEONY_SELECTION_FACT_SPECIAL_LINK,
+    PEONY_SELECTION_FACT_HOME_OR_DESKTOP,
+    PEONY_SELECTION_FACT_IN_TRASH,
+    PEONY_SELECTION_FACT_OPENS_IN_EXTERNAL_APP,
+    PEONY_SELECTION_FACT_LAST
+} PeonySelectionFact;
+
+typedef struct PeonySelectionSummary PeonySelectionSummary;
+
+PeonySelectionSummary *peony_selection_summary_new                   (void);
+void                   peony_selection_summary_free                  (PeonySelectionSummary *summary);
+
+/* Makes @files the selection. Facts are only computed for files that
+ * were not selected before.
+ */
+void                   peony_selection_summary_set_files             (PeonySelectionSummary *summary,
+        GList                 *files);
+/* Follow a selection change without passing the whole selection */
+void                   peony_selection_summary_add_files             (PeonySelectionSummary *summary,
+        GList                 *files);
+void                   peony_selection_summary_remove_files          (PeonySelectionSummary *summary,
+        GList                 *files);
+/* Recomputes the facts of those of @files that are selected. Returns
+ * TRUE if any of them was.
+ */
+gboolean               peony_selection_summary_files_changed         (PeonySelectionSummary *summary,
+        GList                 *files);
+/* Forgets all facts, for changes that can affect every file at once,
+ * like the default applications or the folder's permissions. The next
+ * peony_selection_summary_set_files() computes them again.
+ */
+void                   peony_selection_summary_invalidate            (PeonySelectionSummary *summary);
+
+guint                  peony_selection_summary_get_count             (PeonySelectionSummary *summary);
+gboolean               peony_selection_summary_all                   (PeonySelectionSummary *summary,
+        PeonySelectionFact     fact);
+gboolean               peony_selection_summary_any                   (PeonySelectionSummary *summary,
+        PeonySelectionFact     fact);
+
+guint                  peony_selection_summary_get_folder_count      (PeonySelectionSummary *summary);
+/* Returns FALSE if the item count of some folder is not known yet */
+gboolean               peony_selection_summary_get_folder_item_count (PeonySelectionSummary *summary,
+        guint                 *count);
+/* Returns FALSE if the size of no selected file is known */
+gboolean               peony_selection_summary_get_non_folder_size   (PeonySelectionSummary *summary,
+        goffset               *size);
+
+/* Returns one of the selected files, not reffed, or NULL if empty */
+PeonyFile *            peony_selection_summary_peek_file             (PeonySelectionSummary *summary);
+
+/* Returns the selected files, reffed, in no particular order */
+GList *                peony_selection_summary_get_files             (PeonySelectionSummary *summary);
+
+/* Like peony_mime_get_default_application_for_files() and
+ * peony_mime_get_applications_for_files(), for the selection.
+ */
+GAppInfo *             peony_selection_summary_get_default_application (PeonySelectionSummary *summary);
+GList *                peony_selection_summary_get_applications      (PeonySelectionSummary *summary);
+
+#endif /* PEONY_SELECTION_SUMMARY_H */
@@ -31,6 +31,7 @@
 #include "peony-directory-notify.h"
 #include "peony-global-preferences.h"
 #include "peony-file-utilities.h"
+#include "peony-trace.h"
 #include <math.h>
 #include <eel/eel-gdk-pixbuf-extensions.h>
 #include <eel/eel-graphic-effects.h>
@@ -209,6 +210,7 @@ peony_thumbnail_remove_from_queue (const char *file_uri)
             g_hash_table_remove (thumbnails_to_make_hash, file_uri);
             free_thumbnail_info (node->data);
             g_queue_delete_link ((GQueue *)&thumbnails_to_make, node);
+            PEONY_TRACE_COUNTER ("thumbnail queue", -1);
         }
     }
 
@@ -440,6 +442,7 @@ peony_create_thumbnail (PeonyFile *file)
         g_hash_table_insert (thumbnails_to_make_hash,
                              info->image_uri,
                              node);
+        PEONY_TRACE_COUNTER ("thumbnail queue", 1);
         /* If the thumbnail thread isn't running, and we haven't
            scheduled an idle function to start it up, do that now.
            We don't want to start it until all the other work is done,
@@ -484,6 +487,7 @@ thumbnail_thread_func (GTask        *task,
     time_t current_orig_mtime = 0;
     time_t current_time;
     GList *node;
+    gint64 trace_begin;
 
     /* We loop until there are no more thumbails to make, at which point
        we exit the thread. */
@@ -514,6 +518,7 @@ thumbnail_thread_func (GTask        *task,
             g_hash_table_remove (thumbnails_to_make_hash, info->image_uri);
             free_thumbnail_info (info);
             g_queue_delete_link ((GQueue *)&thumbnails_to_make, node);
+            PEONY_TRACE_COUNTER ("thumbnail queue", -1);
         }
         currently_thumbnailing = NULL;
 
@@ -568,6 +573,7 @@ thumbnail_thread_func (GTask        *task,
                    info->image_uri);
 #endif
 
+        trace_begin = PEONY_TRACE_BEGIN ();
         pixbuf = mate_desktop_thumbnail_factory_generate_thumbnail (thumbnail_factory,
                  info->image_uri,
                  info->mime_type);
@@ -594,6 +600,8 @@ thumbnail_thread_func (GTask        *task,
                     info->image_uri,
                     current_orig_mtime);
         }
+        PEONY_TRACE_END (PEONY_TRACE_CATEGORY_THUMBNAILS, "generate", trace_begin);
+
         /* We need to call peony_file_changed(), but I don't think that is
            thread safe. So add an idle handler and do it from the main loop. */
         g_idle_add_full (G_PRIORITY_HIGH_IDLE,
@@ -0,0 +1,440 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4; tab-width: 8 -*-
+
+   peony-trace.c: Performance counters, latency histograms and timelines
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "peony-trace.h"
+
+/* Events kept for the timeline; older ones are overwritten */
+#define MAX_EVENTS 65536
+
+/* Power of two buckets, from 1 microsecond to about 8 seconds */
+#define HISTOGRAM_BUCKETS 24
+
+/* Main loop iterations shorter than this only go to the histogram */
+#define MAIN_LOOP_MIN_EVENT_USEC 1000
+
+typedef struct {
+    const char *category;
+    const char *name;
+    gint64 timestamp;
+    gint64 duration; /* -1 for counter samples */
+    gint64 value;
+    int thread_id;
+} TraceEvent;
+
+typedef struct {
+    const char *category;
+    guint64 count;
+    gint64 total;
+    gint64 max;
+    guint64 buckets[HISTOGRAM_BUCKETS];
+} TraceHistogram;
+
+gboolean peony_trace_enabled;
+
+static GMutex trace_mutex;
+
+static TraceEvent *events;
+static int events_next_index;
+static int events_num;
+
+static GHashTable *histograms;
+static GHashTable *counters;
+
+static GPrivate thread_id_key;
+static volatile gint next_thread_id = 1;
+
+static GPollFunc default_poll_func;
+static gint64 poll_returned_time;
+
+static int
+get_thread_id (void)
+{
+    int id;
+
+    id = GPOINTER_TO_INT (g_private_get (&thread_id_key));
+    if (id == 0)
+    {
+        id = g_atomic_int_add (&next_thread_id, 1);
+        g_private_set (&thread_id_key, GINT_TO_POINTER (id));
+    }
+
+    return id;
+}
+
+/* Called with the lock held */
+static void
+add_event (const char *category,
+           const char *name,
+           gint64 timestamp,
+           gint64 duration,
+           gint64 value)
+{
+    TraceEvent *event;
+
+    if (events == NULL)
+    {
+        events = g_new0 (TraceEvent, MAX_EVENTS);
+    }
+
+    event = &events[events_next_index];
+    event->category = category;
+    event->name = name;
+    event->timestamp = timestamp;
+    event->duration = duration;
+    event->value = value;
+    event->thread_id = get_thread_id ();
+
+    events_next_index = (events_next_index + 1) % MAX_EVENTS;
+    if (events_num < MAX_EVENTS)
+    {
+        events_num++;
+    }
+}
+
+/* Called with the lock held */
+static void
+add_to_histogram (const char *category,
+                  const char *name,
+                  gint64 duration)
+{
+    TraceHistogram *histogram;
+    int bucket;
+
+    if (histograms == NULL)
+    {
+        histograms = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+    }
+
+    histogram = g_hash_table_lookup (histograms, name);
+    if (histogram == NULL)
+    {
+        histogram = g_new0 (TraceHistogram, 1);
+        histogram->category = category;
+        g_hash_table_insert (histograms, (char *) name, histogram);
+    }
+
+    bucket = duration > 0 ? g_bit_storage (duration) - 1 : 0;
+    bucket = MIN (bucket, HISTOGRAM_BUCKETS - 1);
+
+    histogram->count++;
+    histogram->total += duration;
+    histogram->max = MAX (histogram->max, duration);
+    histogram->buckets[bucket]++;
+}
+
+void
+peony_trace_add_duration (const char *category,
+                          const char *name,
+                          gint64 begin,
+                          gint64 end)
+{
+    g_mutex_lock (&trace_mutex);
+
+    if (peony_trace_enabled)
+    {
+        add_event (category, name, begin, end - begin, 0);
+        add_to_histogram (category, name, end - begin);
+    }
+
+    g_mutex_unlock (&trace_mutex);
+}
+
+void
+peony_trace_add_to_counter (const char *name,
+                            gint64 delta)
+{
+    gint64 *value;
+
+    g_mutex_lock (&trace_mutex);
+
+    if (peony_trace_enabled)
+    {
+        if (counters == NULL)
+        {
+            counters = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+        }
+
+        value = g_hash_table_lookup (counters, name);
+        if (value == NULL)
+        {
+            value = g_new0 (gint64, 1);
+            g_hash_table_insert (counters, (char *) name, value);
+        }
+        /* Counters are levels like queue lengths. An end whose start
+         * happened before tracing was enabled would take one below
+         * zero for the rest of the run.
+         */
+        *value = MAX (*value + delta, 0);
+
+        add_event (NULL, name, g_get_monotonic_time (), -1, *value);
+    }
+
+    g_mutex_unlock (&trace_mutex);
+}
+
+/* Everything between two polls of the main context is one iteration of
+ * dispatching sources, idles included, so timing that gap shows what
+ * kept the main loop busy.
+ */
+static gint
+trace_poll_func (GPollFD *fds,
+                 guint nfds,
+                 gint timeout)
+{
+    gint64 now;
+    int result;
+
+    now = g_get_monotonic_time ();
+    if (poll_returned_time != 0 && peony_trace_enabled)
+    {
+        g_mutex_lock (&trace_mutex);
+        if (now - poll_returned_time >= MAIN_LOOP_MIN_EVENT_USEC)
+        {
+            add_event (PEONY_TRACE_CATEGORY_MAIN_LOOP, "dispatch",
+                       poll_returned_time, now - poll_returned_time, 0);
+        }
+        add_to_histogram (PEONY_TRACE_CATEGORY_MAIN_LOOP, "dispatch",
+                          now - poll_returned_time);
+        g_mutex_unlock (&trace_mutex);
+    }
+
+    result = default_poll_func (fds, nfds, timeout);
+    poll_returned_time = g_get_monotonic_time ();
+
+    return result;
+}
+
+/* Must be called from the main thread */
+void
+peony_trace_set_enabled (gboolean enabled)
+{
+    if (peony_trace_enabled == enabled)
+    {
+        return;
+    }
+
+    if (enabled)
+    {
+        default_poll_func = g_main_context_get_poll_func (NULL);
+        poll_returned_time = 0;
+        g_main_context_set_poll_func (NULL, trace_poll_func);
+    }
+    else
+    {
+        g_main_context_set_poll_func (NULL, default_poll_func);
+    }
+
+    g_mutex_lock (&trace_mutex);
+    peony_trace_enabled = enabled;
+    g_mutex_unlock (&trace_mutex);
+}
+
+gboolean
+peony_trace_is_enabled (void)
+{
+    return peony_trace_enabled;
+}
+
+GHashTable *
+peony_trace_get_counters (void)
+{
+    GHashTable *result;
+    GHashTableIter iter;
+    gpointer name, value;
+
+    result = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+    g_mutex_lock (&trace_mutex);
+    if (counters != NULL)
+    {
+        g_hash_table_iter_init (&iter, counters);
+        while (g_hash_table_iter_next (&iter, &name, &value))
+        {
+            g_hash_table_insert (result, g_strdup (name), g_memdup (value, sizeof (gint64)));
+        }
+    }
+    g_mutex_unlock (&trace_mutex);
+
+    return result;
+}
+
+/* g_strescape() produces C escapes like \a and octal, which aren't
+ * JSON, and mangles UTF-8. Only quotes, backslashes and control
+ * characters need escaping in JSON, everything else passes through.
+ */
+static void
+append_json_string (GString *str,
+                    const char *value)
+{
+    const char *p;
+
+    g_string_append_c (str, '"');
+    for (p = value; *p != '\0'; p++)
+    {
+        switch (*p)
+        {
+        case '"':
+            g_string_append (str, "\\\"");
+            break;
+        case '\\':
+            g_string_append (str, "\\\\");
+            break;
+        case '\n':
+            g_string_append (str, "\\n");
+            break;
+        case '\r':
+            g_string_append (str, "\\r");
+            break;
+        case '\t':
+            g_string_append (str, "\\t");
+            break;
+        default:
+            if ((guchar) *p < 0x20)
+            {
+                g_string_append_printf (str, "\\u%04x", (guchar) *p);
+            }
+            else
+            {
+                g_string_append_c (str, *p);
+            }
+            break;
+        }
+    }
+    g_string_append_c (str, '"');
+}
+
+/* Called with the lock held */
+static char *
+build_trace_json (void)
+{
+    GString *str;
+    GHashTableIter iter;
+    TraceHistogram *histogram;
+    TraceEvent *event;
+    gpointer name, value;
+    gboolean first;
+    int pid, i, bucket;
+
+    str = g_string_new ("{\"traceEvents\": [\n");
+    pid = getpid ();
+
+    for (i = 0; i < events_num; i++)
+    {
+        event = &events[(events_next_index - events_num + i + MAX_EVENTS) % MAX_EVENTS];
+
+        g_string_append (str, i == 0 ? "  " : ",\n  ");
+        g_string_append (str, "{\"name\": ");
+        append_json_string (str, event->name);
+        if (event->duration >= 0)
+        {
+            g_string_append (str, ", \"cat\": ");
+            append_json_string (str, event->category);
+            g_string_append_printf (str,
+                                    ", \"ph\": \"X\", \"ts\": %" G_GINT64_FORMAT
+                                    ", \"dur\": %" G_GINT64_FORMAT
+                                    ", \"pid\": %d, \"tid\": %d}",
+                                    event->timestamp, event->duration,
+                                    pid, event->thread_id);
+        }
+        else
+        {
+            g_string_append_printf (str,
+                                    ", \"ph\": \"C\", \"ts\": %" G_GINT64_FORMAT
+                                    ", \"pid\": %d, \"tid\": %d"
+                                    ", \"args\": {\"value\": %" G_GINT64_FORMAT "}}",
+                                    event->timestamp, pid, event->thread_id,
+                                    event->value);
+        }
+    }
+
+    g_string_append (str, "\n],\n\"displayTimeUnit\": \"ms\",\n\"metadata\": {\n  \"counters\": {");
+
+    first = TRUE;
+    if (counters != NULL)
+    {
+        g_hash_table_iter_init (&iter, counters);
+        while (g_hash_table_iter_next (&iter, &name, &value))
+        {
+            g_string_append (str, first ? "\n    " : ",\n    ");
+            append_json_string (str, name);
+            g_string_append_printf (str, ": %" G_GINT64_FORMAT, *(gint64 *) value);
+            first = FALSE;
+        }
+    }
+
+    g_string_append (str, "},\n  \"histograms\": {");
+
+    first = TRUE;
+    if (histograms != NULL)
+    {
+        g_hash_table_iter_init (&iter, histograms);
+        while (g_hash_table_iter_next (&iter, &name, (gpointer *) &histogram))
+        {
+            g_string_append (str, first ? "\n    " : ",\n    ");
+            append_json_string (str, name);
+            g_string_append (str, ": {\"category\": ");
+            append_json_string (str, histogram->category);
+            g_string_append_printf (str,
+                                    ", \"count\": %" G_GUINT64_FORMAT
+                                    ", \"total_us\": %" G_GINT64_FORMAT
+                                    ", \"max_us\": %" G_GINT64_FORMAT
+                                    ", \"buckets_us\": {",
+                                    histogram->count, histogram->total,
+                                    histogram->max);
+            for (bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++)
+            {
+                /* Keyed by the upper bound of the bucket */
+                g_string_append_printf (str, "%s\"%" G_GINT64_FORMAT "\": %" G_GUINT64_FORMAT,
+                                        bucket == 0 ? "" : ", ",
+                                        (gint64) 1 << (bucket + 1),
+                                        histogram->buckets[bucket]);
+            }
+            g_string_append (str, "}}");
+            first = FALSE;
+        }
+    }
+
+    g_string_append (str, "}\n}}\n");
+
+    return g_string_free (str, FALSE);
+}
+
+gboolean
+peony_trace_dump (const char *filename,
+                  GError **error)
+{
+    char *contents;
+    gboolean success;
+
+    g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+    g_return_val_if_fail (filename != NULL, FALSE);
+
+    g_mutex_lock (&trace_mutex);
+    contents = build_trace_json ();
+    g_mutex_unlock (&trace_mutex);
+
+    success = g_file_set_contents (filename, contents, -1, error);
+    g_free (contents);
+
+    return success;
+}
@@ -0,0 +1,79 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4; tab-width: 8 -*-
+
+   peony-trace.h: Performance counters, latency histograms and timelines
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef PEONY_TRACE_H
+#define PEONY_TRACE_H
+
+#include <glib.h>
+
+/* Tracing is off unless PEONY_TRACE is set in the environment or it is
+ * turned on over D-Bus. While off, the macros below cost a single load
+ * and branch; use them rather than the functions on hot paths.
+ *
+ * Categories and names must be static strings, they are stored as is.
+ */
+
+#define PEONY_TRACE_CATEGORY_DIRECTORY "directory"
+#define PEONY_TRACE_CATEGORY_FILE_OPS "file-ops"
+#define PEONY_TRACE_CATEGORY_MAIN_LOOP "main-loop"
+#define PEONY_TRACE_CATEGORY_SEARCH "search"
+#define PEONY_TRACE_CATEGORY_STARTUP "startup"
+#define PEONY_TRACE_CATEGORY_THUMBNAILS "thumbnails"
+
+extern gboolean peony_trace_enabled;
+
+/* Returns a start time to hand to PEONY_TRACE_END, 0 when disabled */
+#define PEONY_TRACE_BEGIN() \
+    (G_UNLIKELY (peony_trace_enabled) ? g_get_monotonic_time () : 0)
+
+/* Adds a duration event to the timeline and to the name's histogram */
+#define PEONY_TRACE_END(category, name, begin) \
+    G_STMT_START { \
+        if (G_UNLIKELY ((begin) != 0)) \
+            peony_trace_add_duration ((category), (name), (begin), g_get_monotonic_time ()); \
+    } G_STMT_END
+
+#define PEONY_TRACE_COUNTER(name, delta) \
+    G_STMT_START { \
+        if (G_UNLIKELY (peony_trace_enabled)) \
+            peony_trace_add_to_counter ((name), (delta)); \
+    } G_STMT_END
+
+void     peony_trace_set_enabled    (gboolean     enabled);
+gboolean peony_trace_is_enabled     (void);
+
+void     peony_trace_add_duration   (const char  *category,
+                                     const char  *name,
+                                     gint64       begin,
+                                     gint64       end);
+void     peony_trace_add_to_counter (const char  *name,
+                                     gint64       delta);
+
+/* Current value of every counter, name to gint64 */
+GHashTable *peony_trace_get_counters (void);
+
+/* Writes the recorded timeline in the Chrome trace event format, which
+ * chrome://tracing and Perfetto load. Counters and histograms go in
+ * its "metadata" section.
+ */
+gboolean peony_trace_dump           (const char  *filename,
+                                     GError     **error);
+
+#endif /* PEONY_TRACE_H */
@@ -0,0 +1,668 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4; tab-width: 8 -*- */
+
+/*
+   peony-user-directory.c: Cached view of the user and group databases.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include <config.h>
+#include "peony-user-directory.h"
+
+#include <eel/eel-debug.h>
+#include <eel/eel-string.h>
+#include <errno.h>
+#include <grp.h>
+#include <pwd.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Time in seconds before a loaded copy of the databases is re-read */
+#define USER_DIRECTORY_CACHE_TIME (5*60)
+
+/* Buffer for a single getpwuid_r()/getgrgid_r() entry when the system
+ * doesn't suggest one; grown for entries that don't fit.
+ */
+#define ENTRY_BUFFER_SIZE 1024
+
+typedef struct
+{
+    char *name; /* NULL for ids known to have no entry */
+    char *real_name;
+    guint32 id;
+} DirectoryEntry;
+
+/* Everything a load produces. Built on the worker thread and handed
+ * over to the main thread as a whole.
+ */
+typedef struct
+{
+    GPtrArray *users; /* DirectoryEntry, sorted by name */
+    GPtrArray *groups;
+    GHashTable *users_by_id; /* id -> entry in users */
+    GHashTable *groups_by_id;
+} DirectorySnapshot;
+
+struct PeonyUserDirectoryDetails
+{
+    DirectorySnapshot *snapshot;
+
+    /* Entries found by single lookups, for ids the snapshot lacks */
+    GHashTable *extra_users_by_id;
+    GHashTable *extra_groups_by_id;
+
+    gboolean loading;
+    gint64 load_time;
+    struct LoadState *load_state;
+};
+
+enum
+{
+    LOADED,
+    LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL] = { 0 };
+static PeonyUserDirectory *peony_user_directory = NULL;
+
+G_DEFINE_TYPE (PeonyUserDirectory, peony_user_directory, G_TYPE_OBJECT)
+
+static DirectoryEntry *
+directory_entry_new (const char *name,
+                     const char *real_name,
+                     guint32 id)
+{
+    DirectoryEntry *entry;
+
+    entry = g_slice_new (DirectoryEntry);
+    entry->name = g_strdup (name);
+    entry->real_name = g_strdup (real_name);
+    entry->id = id;
+
+    return entry;
+}
+
+static void
+directory_entry_free (DirectoryEntry *entry)
+{
+    g_free (entry->name);
+    g_free (entry->real_name);
+    g_slice_free (DirectoryEntry, entry);
+}
+
+static int
+directory_entry_compare (gconstpointer a,
+                         gconstpointer b)
+{
+    const DirectoryEntry *entry_a = *(const DirectoryEntry **) a;
+    const DirectoryEntry *entry_b = *(const DirectoryEntry **) b;
+
+    return strcmp (entry_a->name, entry_b->name);
+}
+
+static GHashTable *
+index_entries_by_id (GPtrArray *entries)
+{
+    GHashTable *by_id;
+    DirectoryEntry *entry;
+    guint i;
+
+    by_id = g_hash_table_new (NULL, NULL);
+    for (i = 0; i < entries->len; i++)
+    {
+        entry = g_ptr_array_index (entries, i);
+        /* Keep the first name for ids that have several */
+        if (!g_hash_table_contains (by_id, GUINT_TO_POINTER (entry->id)))
+        {
+            g_hash_table_insert (by_id, GUINT_TO_POINTER (entry->id), entry);
+        }
+    }
+
+    return by_id;
+}
+
+static void
+directory_snapshot_free (DirectorySnapshot *snapshot)
+{
+    if (snapshot == NULL)
+    {
+        return;
+    }
+
+    g_hash_table_destroy (snapshot->users_by_id);
+    g_hash_table_destroy (snapshot->groups_by_id);
+    g_ptr_array_unref (snapshot->users);
+    g_ptr_array_unref (snapshot->groups);
+    g_free (snapshot);
+}
+
+char *
+peony_user_directory_parse_real_name (const char *name,
+                                      const char *gecos)
+{
+    char *locale_string, *part_before_comma, *capitalized_login_name, *real_name;
+
+    if (gecos == NULL)
+    {
+        return NULL;
+    }
+
+    locale_string = eel_str_strip_substring_and_after (gecos, ",");
+    if (!g_utf8_validate (locale_string, -1, NULL))
+    {
+        part_before_comma = g_locale_to_utf8 (locale_string, -1, NULL, NULL, NULL);
+        g_free (locale_string);
+    }
+    else
+    {
+        part_before_comma = locale_string;
+    }
+
+    if (!g_utf8_validate (name, -1, NULL))
+    {
+        locale_string = g_locale_to_utf8 (name, -1, NULL, NULL, NULL);
+    }
+    else
+    {
+        locale_string = g_strdup (name);
+    }
+
+    capitalized_login_name = eel_str_capitalize (locale_string);
+    g_free (locale_string);
+
+    if (capitalized_login_name == NULL)
+    {
+        real_name = part_before_comma;
+    }
+    else
+    {
+        real_name = eel_str_replace_substring
+                    (part_before_comma, "&", capitalized_login_name);
+        g_free (part_before_comma);
+    }
+
+
+    if (eel_str_is_empty (real_name)
+            || eel_strcmp (name, real_name) == 0
+            || eel_strcmp (capitalized_login_name, real_name) == 0)
+    {
+        g_free (real_name);
+        real_name = NULL;
+    }
+
+    g_free (capitalized_login_name);
+
+    return real_name;
+}
+
+/* Runs on the worker thread, or on the main thread from
+ * peony_user_directory_load_sync() when no worker is running. Nothing
+ * else in Peony walks the databases with getpwent()/getgrent(), so the
+ * iteration state is ours.
+ */
+static DirectorySnapshot *
+read_databases (void)
+{
+    DirectorySnapshot *snapshot;
+    struct passwd *user;
+    struct group *group;
+    char *real_name;
+
+    snapshot = g_new0 (DirectorySnapshot, 1);
+    snapshot->users = g_ptr_array_new_with_free_func ((GDestroyNotify) directory_entry_free);
+    snapshot->groups = g_ptr_array_new_with_free_func ((GDestroyNotify) directory_entry_free);
+
+    setpwent ();
+    while ((user = getpwent ()) != NULL)
+    {
+        real_name = peony_user_directory_parse_real_name (user->pw_name, user->pw_gecos);
+        g_ptr_array_add (snapshot->users,
+                         directory_entry_new (user->pw_name, real_name, user->pw_uid));
+        g_free (real_name);
+    }
+    endpwent ();
+
+    setgrent ();
+    while ((group = getgrent ()) != NULL)
+    {
+        g_ptr_array_add (snapshot->groups,
+                         directory_entry_new (group->gr_name, NULL, group->gr_gid));
+    }
+    endgrent ();
+
+    g_ptr_array_sort (snapshot->users, directory_entry_compare);
+    g_ptr_array_sort (snapshot->groups, directory_entry_compare);
+    snapshot->users_by_id = index_entries_by_id (snapshot->users);
+    snapshot->groups_by_id = index_entries_by_id (snapshot->groups);
+
+    return snapshot;
+}
+
+typedef struct LoadState
+{
+    PeonyUserDirectory *user_directory;
+    GThread *thread; /* NULL once joined */
+} LoadState;
+
+static void
+set_snapshot (PeonyUserDirectory *user_directory,
+              DirectorySnapshot *snapshot)
+{
+    directory_snapshot_free (user_directory->details->snapshot);
+    user_directory->details->snapshot = snapshot;
+    g_hash_table_remove_all (user_directory->details->extra_users_by_id);
+    g_hash_table_remove_all (user_directory->details->extra_groups_by_id);
+
+    user_directory->details->loading = FALSE;
+    user_directory->details->load_state = NULL;
+    user_directory->details->load_time = g_get_monotonic_time ();
+
+    g_signal_emit (user_directory, signals[LOADED], 0);
+}
+
+static gboolean
+load_done_callback (gpointer user_data)
+{
+    LoadState *state;
+    PeonyUserDirectory *user_directory;
+
+    state = user_data;
+    user_directory = state->user_directory;
+
+    /* Unless peony_user_directory_load_sync() already waited for it */
+    if (state->thread != NULL)
+    {
+        set_snapshot (user_directory, g_thread_join (state->thread));
+    }
+
+    g_object_unref (user_directory);
+    g_free (state);
+
+    return FALSE;
+}
+
+static gpointer
+load_thread_main (gpointer user_data)
+{
+    LoadState *state;
+    gpointer snapshot;
+
+    state = user_data;
+    snapshot = read_databases ();
+
+    g_idle_add (load_done_callback, state);
+
+    return snapshot;
+}
+
+void
+peony_user_directory_load (PeonyUserDirectory *user_directory)
+{
+    LoadState *state;
+
+    g_return_if_fail (PEONY_IS_USER_DIRECTORY (user_directory));
+
+    if (user_directory->details->loading)
+    {
+        return;
+    }
+
+    if (user_directory->details->load_time != 0 &&
+            g_get_monotonic_time () - user_directory->details->load_time <
+            (gint64) USER_DIRECTORY_CACHE_TIME * G_USEC_PER_SEC)
+    {
+        return;
+    }
+
+    user_directory->details->loading = TRUE;
+
+    state = g_new0 (LoadState, 1);
+    state->user_directory = g_object_ref (user_directory);
+    /* load_done_callback joins the thread, so it may only run once
+     * state->thread is set; the idle can't be dispatched before we
+     * return to the main loop.
+     */
+    state->thread = g_thread_new ("peony-user-directory", load_thread_main, state);
+    user_directory->details->load_state = state;
+}
+
+void
+peony_user_directory_load_sync (PeonyUserDirectory *user_directory)
+{
+    LoadState *state;
+    DirectorySnapshot *snapshot;
+
+    g_return_if_fail (PEONY_IS_USER_DIRECTORY (user_directory));
+
+    if (user_directory->details->snapshot != NULL)
+    {
+        return;
+    }
+
+    state = user_directory->details->load_state;
+    if (state != NULL)
+    {
+        snapshot = g_thread_join (state->thread);
+        state->thread = NULL;
+    }
+    else
+    {
+        snapshot = read_databases ();
+    }
+
+    set_snapshot (user_directory, snapshot);
+}
+
+gboolean
+peony_user_directory_is_loaded (PeonyUserDirectory *user_directory)
+{
+    g_return_val_if_fail (PEONY_IS_USER_DIRECTORY (user_directory), FALSE);
+
+    return user_directory->details->snapshot != NULL;
+}
+
+/* Index of the first entry whose name is not less than prefix */
+static guint
+find_first_with_prefix (GPtrArray *entries,
+                        const char *prefix)
+{
+    DirectoryEntry *entry;
+    guint low, high, middle;
+
+    low = 0;
+    high = entries->len;
+    while (low < high)
+    {
+        middle = low + (high - low) / 2;
+        entry = g_ptr_array_index (entries, middle);
+        if (strcmp (entry->name, prefix) < 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+static GList *
+search_entries (GPtrArray *entries,
+                const char *prefix,
+                guint max_results,
+                gboolean include_real_name)
+{
+    DirectoryEntry *entry;
+    GList *result;
+    gsize prefix_length;
+    guint i, count;
+
+    if (prefix == NULL)
+    {
+        prefix = "";
+    }
+    prefix_length = strlen (prefix);
+
+    result = NULL;
+    count = 0;
+    for (i = find_first_with_prefix (entries, prefix);
+            i < entries->len && count < max_results;
+            i++, count++)
+    {
+        entry = g_ptr_array_index (entries, i);
+        if (strncmp (entry->name, prefix, prefix_length) != 0)
+        {
+            break;
+        }
+
+        if (include_real_name && entry->real_name != NULL)
+        {
+            result = g_list_prepend (result,
+                                     g_strconcat (entry->name, "\n", entry->real_name, NULL));
+        }
+        else
+        {
+            result = g_list_prepend (result, g_strdup (entry->name));
+        }
+    }
+
+    return g_list_reverse (result);
+}
+
+GList *
+peony_user_directory_search_users (PeonyUserDirectory *user_directory,
+                                   const char *prefix,
+                                   guint max_results)
+{
+    g_return_val_if_fail (PEONY_IS_USER_DIRECTORY (user_directory), NULL);
+
+    if (user_directory->details->snapshot == NULL)
+    {
+        return NULL;
+    }
+
+    return search_entries (user_directory->details->snapshot->users,
+                           prefix, max_results, TRUE);
+}
+
+GList *
+peony_user_directory_search_groups (PeonyUserDirectory *user_directory,
+                                    const char *prefix,
+                                    guint max_results)
+{
+    g_return_val_if_fail (PEONY_IS_USER_DIRECTORY (user_directory), NULL);
+
+    if (user_directory->details->snapshot == NULL)
+    {
+        return NULL;
+    }
+
+    return search_entries (user_directory->details->snapshot->groups,
+                           prefix, max_results, FALSE);
+}
+
+/* The worker thread may be walking the databases meanwhile, so only
+ * the reentrant lookups are safe here.
+ */
+static DirectoryEntry *
+read_entry (guint32 id,
+            gboolean is_group)
+{
+    DirectoryEntry *entry;
+    struct passwd user_buffer, *user;
+    struct group group_buffer, *group;
+    char *buffer, *real_name;
+    long buffer_size;
+    int res;
+
+    buffer_size = sysconf (is_group ? _SC_GETGR_R_SIZE_MAX : _SC_GETPW_R_SIZE_MAX);
+    if (buffer_size <= 0)
+    {
+        buffer_size = ENTRY_BUFFER_SIZE;
+    }
+
+    user = NULL;
+    group = NULL;
+    while (TRUE)
+    {
+        buffer = g_malloc (buffer_size);
+        if (is_group)
+        {
+            res = getgrgid_r (id, &group_buffer, buffer, buffer_size, &group);
+        }
+        else
+        {
+            res = getpwuid_r (id, &user_buffer, buffer, buffer_size, &user);
+        }
+
+        if (res != ERANGE)
+        {
+            break;
+        }
+        g_free (buffer);
+        buffer_size *= 2;
+    }
+
+    if (is_group)
+    {
+        entry = directory_entry_new (group != NULL ? group->gr_name : NULL, NULL, id);
+    }
+    else
+    {
+        real_name = user != NULL ?
+                    peony_user_directory_parse_real_name (user->pw_name, user->pw_gecos) :
+                    NULL;
+        entry = directory_entry_new (user != NULL ? user->pw_name : NULL, real_name, id);
+        g_free (real_name);
+    }
+    g_free (buffer);
+
+    return entry;
+}
+
+static DirectoryEntry *
+lookup_entry (PeonyUserDirectory *user_directory,
+              guint32 id,
+              gboolean is_group)
+{
+    DirectorySnapshot *snapshot;
+    DirectoryEntry *entry;
+    GHashTable *extra;
+
+    snapshot = user_directory->details->snapshot;
+    if (snapshot != NULL)
+    {
+        entry = g_hash_table_lookup (is_group ? snapshot->groups_by_id : snapshot->users_by_id,
+                                     GUINT_TO_POINTER (id));
+        if (entry != NULL)
+        {
+            return entry;
+        }
+    }
+
+    extra = is_group ?
+            user_directory->details->extra_groups_by_id :
+            user_directory->details->extra_users_by_id;
+    entry = g_hash_table_lookup (extra, GUINT_TO_POINTER (id));
+    if (entry != NULL)
+    {
+        return entry;
+    }
+
+    /* Not loaded yet, or added since; ask once and remember the
+     * answer, including that there is none.
+     */
+    entry = read_entry (id, is_group);
+    g_hash_table_insert (extra, GUINT_TO_POINTER (id), entry);
+
+    return entry;
+}
+
+const char *
+peony_user_directory_get_user_name (PeonyUserDirectory *user_directory,
+                                    uid_t uid)
+{
+    g_return_val_if_fail (PEONY_IS_USER_DIRECTORY (user_directory), NULL);
+
+    return lookup_entry (user_directory, uid, FALSE)->name;
+}
+
+const char *
+peony_user_directory_get_real_name (PeonyUserDirectory *user_directory,
+                                    uid_t uid)
+{
+    g_return_val_if_fail (PEONY_IS_USER_DIRECTORY (user_directory), NULL);
+
+    return lookup_entry (user_directory, uid, FALSE)->real_name;
+}
+
+const char *
+peony_user_directory_get_group_name (PeonyUserDirectory *user_directory,
+                                     gid_t gid)
+{
+    g_return_val_if_fail (PEONY_IS_USER_DIRECTORY (user_directory), NULL);
+
+    return lookup_entry (user_directory, gid, TRUE)->name;
+}
+
+static void
+peony_user_directory_finalize (GObject *object)
+{
+    PeonyUserDirectory *user_directory;
+
+    user_directory = PEONY_USER_DIRECTORY (object);
+
+    directory_snapshot_free (user_directory->details->snapshot);
+    g_hash_table_destroy (user_directory->details->extra_users_by_id);
+    g_hash_table_destroy (user_directory->details->extra_groups_by_id);
+
+    G_OBJECT_CLASS (peony_user_directory_parent_class)->finalize (object);
+}
+
+static void
+peony_user_directory_class_init (PeonyUserDirectoryClass *klass)
+{
+    GObjectClass *object_class;
+
+    object_class = G_OBJECT_CLASS (klass);
+
+    object_class->finalize = peony_user_directory_finalize;
+
+    signals[LOADED] = g_signal_new
+                      ("loaded",
+                       G_TYPE_FROM_CLASS (object_class),
+                       G_SIGNAL_RUN_LAST,
+                       G_STRUCT_OFFSET (PeonyUserDirectoryClass, loaded),
+                       NULL, NULL,
+                       g_cclosure_marshal_VOID__VOID,
+                       G_TYPE_NONE, 0);
+
+    g_type_class_add_private (object_class, sizeof (PeonyUserDirectoryDetails));
+}
+
+static void
+peony_user_directory_init (PeonyUserDirectory *user_directory)
+{
+    user_directory->details = G_TYPE_INSTANCE_GET_PRIVATE (user_directory,
+                              PEONY_TYPE_USER_DIRECTORY,
+                              PeonyUserDirectoryDetails);
+
+    user_directory->details->extra_users_by_id =
+        g_hash_table_new_full (NULL, NULL, NULL, (GDestroyNotify) directory_entry_free);
+    user_directory->details->extra_groups_by_id =
+        g_hash_table_new_full (NULL, NULL, NULL, (GDestroyNotify) directory_entry_free);
+}
+
+static void
+unref_user_directory (void)
+{
+    g_object_unref (peony_user_directory);
+}
+
+PeonyUserDirectory *
+peony_user_directory_get (void)
+{
+    if (peony_user_directory == NULL)
+    {
+        peony_user_directory = PEONY_USER_DIRECTORY
+                               (g_object_new (PEONY_TYPE_USER_DIRECTORY, NULL));
+        eel_debug_call_at_shutdown (unref_user_directory);
+    }
+
+    return peony_user_directory;
+}
@@ -0,0 +1,106 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4; tab-width: 8 -*- */
+
+/*
+   peony-user-directory.h: Cached view of the user and group databases.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef PEONY_USER_DIRECTORY_H
+#define PEONY_USER_DIRECTORY_H
+
+#include <glib-object.h>
+#include <sys/types.h>
+
+/* PeonyUserDirectory reads the passwd and group databases on a worker
+ * thread, so that hosts with huge (LDAP, SSSD) account databases don't
+ * block the UI, and answers prefix searches and id to name lookups
+ * from the cached copy.
+ */
+
+typedef struct PeonyUserDirectory PeonyUserDirectory;
+typedef struct PeonyUserDirectoryClass PeonyUserDirectoryClass;
+typedef struct PeonyUserDirectoryDetails PeonyUserDirectoryDetails;
+
+#define PEONY_TYPE_USER_DIRECTORY peony_user_directory_get_type()
+#define PEONY_USER_DIRECTORY(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), PEONY_TYPE_USER_DIRECTORY, PeonyUserDirectory))
+#define PEONY_USER_DIRECTORY_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), PEONY_TYPE_USER_DIRECTORY, PeonyUserDirectoryClass))
+#define PEONY_IS_USER_DIRECTORY(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), PEONY_TYPE_USER_DIRECTORY))
+#define PEONY_IS_USER_DIRECTORY_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), PEONY_TYPE_USER_DIRECTORY))
+#define PEONY_USER_DIRECTORY_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), PEONY_TYPE_USER_DIRECTORY, PeonyUserDirectoryClass))
+
+struct PeonyUserDirectory
+{
+    GObject object;
+    PeonyUserDirectoryDetails *details;
+};
+
+struct PeonyUserDirectoryClass
+{
+    GObjectClass parent_class;
+
+    /* Emitted on the main thread whenever a (re)load finished */
+    void (* loaded) (PeonyUserDirectory *user_directory);
+};
+
+GType                peony_user_directory_get_type         (void);
+
+PeonyUserDirectory  *peony_user_directory_get              (void);
+
+/* Starts reading the databases in the background, unless that is
+ * already happening or the cached copy is still fresh.
+ */
+void                 peony_user_directory_load             (PeonyUserDirectory *user_directory);
+/* Makes sure there is a loaded copy, reading the databases on this
+ * thread or waiting for the load in progress.
+ */
+void                 peony_user_directory_load_sync        (PeonyUserDirectory *user_directory);
+gboolean             peony_user_directory_is_loaded        (PeonyUserDirectory *user_directory);
+
+/* Returns at most max_results entries whose name starts with prefix,
+ * sorted by name. User entries have the same "name\nreal name" format
+ * as peony_get_user_names(). Empty until the first load finished.
+ */
+GList *              peony_user_directory_search_users     (PeonyUserDirectory *user_directory,
+        const char         *prefix,
+        guint               max_results);
+GList *              peony_user_directory_search_groups    (PeonyUserDirectory *user_directory,
+        const char         *prefix,
+        guint               max_results);
+
+/* Cached id to name lookups. These fall back to a single getpwuid() /
+ * getgrgid() call for ids that aren't known yet. Return NULL for ids
+ * without an entry.
+ */
+const char *         peony_user_directory_get_user_name    (PeonyUserDirectory *user_directory,
+        uid_t               uid);
+const char *         peony_user_directory_get_real_name    (PeonyUserDirectory *user_directory,
+        uid_t               uid);
+const char *         peony_user_directory_get_group_name   (PeonyUserDirectory *user_directory,
+        gid_t               gid);
+
+/* Real name from a passwd gecos field, or NULL if it adds nothing to
+ * the login name.
+ */
+char *               peony_user_directory_parse_real_name  (const char         *name,
+        const char         *gecos);
+
+#endif /* PEONY_USER_DIRECTORY_H */
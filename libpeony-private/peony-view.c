@@ -327,4 +327,16 @@ peony_view_drop_proxy_received_netscape_url (PeonyView         *view,
     }
 }
 
+GList *
+peony_view_get_adjacent_locations (PeonyView *view,
+                                   int        count)
+{
+    g_return_val_if_fail (PEONY_IS_VIEW (view), NULL);
 
+    if (PEONY_VIEW_GET_IFACE (view)->get_adjacent_locations != NULL)
+    {
+        return (* PEONY_VIEW_GET_IFACE (view)->get_adjacent_locations) (view, count);
+    }
+
+    return NULL;
+}
@@ -135,8 +135,13 @@ extern "C" {
         void           (* set_is_active)                    (PeonyView         *view,
                 gboolean              is_active);
 
+        /* Returns the locations of up to @count items on each side of the
+         * first selected item, in display order, nearest first. Optional,
+         * used to prepare previews ahead of keyboard navigation. */
+        GList *        (* get_adjacent_locations)           (PeonyView         *view,
+                int                   count);
+
         /* Padding for future expansion */
-        void (*_reserved1) (void);
         void (*_reserved2) (void);
         void (*_reserved3) (void);
         void (*_reserved4) (void);
@@ -185,6 +190,8 @@ extern "C" {
             GdkDragAction         action);
     void              peony_view_set_is_active              (PeonyView      *view,
             gboolean           is_active);
+    GList *           peony_view_get_adjacent_locations     (PeonyView      *view,
+            int                count);
 
 #ifdef __cplusplus
 }
@@ -3302,12 +3302,12 @@ computer_view_notify_clipboard_info (PeonyClipboardMonitor *monitor,
                                  PeonyClipboardInfo *info,
                                  FMComputerView *computer_view)
 {
-    GList *icon_data;
+    GHashTable *icon_data;
 
     icon_data = NULL;
     if (info && info->cut)
     {
-        icon_data = info->files;
+        icon_data = info->file_set;
     }
 
     peony_icon_container_set_highlighted_for_clipboard (
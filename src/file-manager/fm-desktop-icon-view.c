@@ -29,6 +29,7 @@
 #include <config.h>
 #include "fm-icon-container.h"
 #include "fm-desktop-icon-view.h"
+#include "fm-desktop-snapshot.h"
 #include "fm-actions.h"
 
 #include <X11/Xatom.h>
@@ -55,6 +56,7 @@
 #include <libpeony-private/peony-trash-monitor.h>
 #include <libpeony-private/peony-icon-private.h>
 #include <limits.h>
+#include <math.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
@@ -65,6 +67,10 @@
 /* Timeout to check the desktop directory for updates */
 #define RESCAN_TIMEOUT 4
 
+/* Seconds the icons have to stay put before they are saved as the
+ * snapshot shown at the next login */
+#define SNAPSHOT_SAVE_DELAY 2
+
 struct FMDesktopIconViewDetails
 {
     GdkWindow *root_window;
@@ -76,6 +82,15 @@ struct FMDesktopIconViewDetails
     gulong delayed_init_signal;
     guint reload_desktop_timeout;
     gboolean pending_rescan;
+
+    /* Painted over the empty container until the directory has loaded */
+    FMDesktopSnapshot *snapshot;
+    GCancellable *snapshot_cancellable;
+    /* The layout last saved or loaded, to skip saving the same again */
+    char *snapshot_layout;
+    gboolean directory_loaded;
+    guint snapshot_drop_idle_id;
+    guint snapshot_save_timeout_id;
 };
 
 static void     default_zoom_level_changed                        (gpointer                user_data);
@@ -89,6 +104,7 @@ static gboolean real_supports_zooming                             (FMDirectoryVi
 static void     fm_desktop_icon_view_update_icon_container_fonts  (FMDesktopIconView      *view);
 static void     font_changed_callback                             (gpointer                callback_data);
 static PeonyZoomLevel get_default_zoom_level (void);
+static void     schedule_snapshot_save                            (FMDesktopIconView      *icon_view);
 
 G_DEFINE_TYPE (FMDesktopIconView, fm_desktop_icon_view, FM_TYPE_ICON_VIEW)
 
@@ -272,6 +288,26 @@ fm_desktop_icon_view_dispose (GObject *object)
         icon_view->details->reload_desktop_timeout = 0;
     }
 
+    if (icon_view->details->snapshot_cancellable != NULL)
+    {
+        g_cancellable_cancel (icon_view->details->snapshot_cancellable);
+        g_clear_object (&icon_view->details->snapshot_cancellable);
+    }
+    if (icon_view->details->snapshot_drop_idle_id != 0)
+    {
+        g_source_remove (icon_view->details->snapshot_drop_idle_id);
+        icon_view->details->snapshot_drop_idle_id = 0;
+    }
+    if (icon_view->details->snapshot_save_timeout_id != 0)
+    {
+        g_source_remove (icon_view->details->snapshot_save_timeout_id);
+        icon_view->details->snapshot_save_timeout_id = 0;
+    }
+    fm_desktop_snapshot_free (icon_view->details->snapshot);
+    icon_view->details->snapshot = NULL;
+    g_free (icon_view->details->snapshot_layout);
+    icon_view->details->snapshot_layout = NULL;
+
     ui_manager = fm_directory_view_get_ui_manager (FM_DIRECTORY_VIEW (icon_view));
     if (ui_manager != NULL)
     {
@@ -587,6 +623,7 @@ default_zoom_level_changed (gpointer user_data)
 
     peony_icon_container_set_zoom_level (get_icon_container (desktop_icon_view),
                                         new_level,FALSE);
+    schedule_snapshot_save (desktop_icon_view);
 }
 
 static gboolean
@@ -678,6 +715,261 @@ fm_desktop_icon_view_update_icon_container_fonts (FMDesktopIconView *icon_view)
     peony_icon_container_set_font (icon_container, font);
 
     g_free (font);
+
+    schedule_snapshot_save (icon_view);
+}
+
+/* Everything that changes how the same icons would be drawn */
+static char *
+get_snapshot_key (FMDesktopIconView *icon_view)
+{
+    PeonyIconContainer *icon_container;
+    GdkScreen *screen;
+    char *font;
+    char *key;
+
+    icon_container = get_icon_container (icon_view);
+    screen = gtk_widget_get_screen (GTK_WIDGET (icon_container));
+    font = g_settings_get_string (peony_desktop_preferences, PEONY_PREFERENCES_DESKTOP_FONT);
+
+    key = g_strdup_printf ("%dx%d@%d zoom=%d font=%s %s %s",
+                           gdk_screen_get_width (screen),
+                           gdk_screen_get_height (screen),
+                           gtk_widget_get_scale_factor (GTK_WIDGET (icon_container)),
+                           peony_icon_container_get_zoom_level (icon_container),
+                           font,
+                           gtk_widget_get_direction (GTK_WIDGET (icon_container)) == GTK_TEXT_DIR_RTL ? "rtl" : "ltr",
+                           desktop_directory);
+    g_free (font);
+
+    return key;
+}
+
+static gboolean
+save_snapshot_timeout_callback (gpointer data)
+{
+    FMDesktopIconView *icon_view;
+    PeonyIconContainer *icon_container;
+    FMDesktopSnapshot *snapshot;
+    GKeyFile *key_file;
+    EelCanvasItem *item;
+    PeonyIcon *icon;
+    GList *l;
+    cairo_t *cr;
+    char *uri;
+    char *checksum;
+    const char *label;
+    double x1, y1, x2, y2;
+
+    icon_view = FM_DESKTOP_ICON_VIEW (data);
+    icon_view->details->snapshot_save_timeout_id = 0;
+
+    icon_container = get_icon_container (icon_view);
+    if (!gtk_widget_get_realized (GTK_WIDGET (icon_container)))
+    {
+        return FALSE;
+    }
+
+    /* Only the area the icons cover is kept */
+    x1 = y1 = G_MAXDOUBLE;
+    x2 = y2 = -G_MAXDOUBLE;
+    for (l = icon_container->details->icons; l != NULL; l = l->next)
+    {
+        item = EEL_CANVAS_ITEM (((PeonyIcon *) l->data)->item);
+        x1 = MIN (x1, item->x1);
+        y1 = MIN (y1, item->y1);
+        x2 = MAX (x2, item->x2);
+        y2 = MAX (y2, item->y2);
+    }
+    if (x1 > x2)
+    {
+        x1 = y1 = 0;
+        x2 = y2 = 1;
+    }
+
+    snapshot = g_new0 (FMDesktopSnapshot, 1);
+    snapshot->key = get_snapshot_key (icon_view);
+    snapshot->x = floor (x1);
+    snapshot->y = floor (y1);
+    snapshot->surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+                                                    ceil (x2) - snapshot->x,
+                                                    ceil (y2) - snapshot->y);
+
+    cr = cairo_create (snapshot->surface);
+    cairo_translate (cr, -snapshot->x, -snapshot->y);
+    for (l = icon_container->details->icons; l != NULL; l = l->next)
+    {
+        peony_icon_canvas_item_draw_plain (((PeonyIcon *) l->data)->item, cr);
+    }
+    cairo_destroy (cr);
+    cairo_surface_flush (snapshot->surface);
+
+    key_file = g_key_file_new ();
+    checksum = g_compute_checksum_for_data (G_CHECKSUM_MD5,
+                                            cairo_image_surface_get_data (snapshot->surface),
+                                            cairo_image_surface_get_stride (snapshot->surface) *
+                                            cairo_image_surface_get_height (snapshot->surface));
+    g_key_file_set_string (key_file, FM_DESKTOP_SNAPSHOT_GROUP, "Key", snapshot->key);
+    g_key_file_set_integer (key_file, FM_DESKTOP_SNAPSHOT_GROUP, "X", snapshot->x);
+    g_key_file_set_integer (key_file, FM_DESKTOP_SNAPSHOT_GROUP, "Y", snapshot->y);
+    g_key_file_set_string (key_file, FM_DESKTOP_SNAPSHOT_GROUP, "Checksum", checksum);
+    g_free (checksum);
+
+    for (l = icon_container->details->icons; l != NULL; l = l->next)
+    {
+        icon = l->data;
+        uri = peony_file_get_uri (PEONY_FILE (icon->data));
+        g_key_file_set_double (key_file, uri, "X", icon->x);
+        g_key_file_set_double (key_file, uri, "Y", icon->y);
+        label = peony_icon_canvas_item_get_editable_text (icon->item);
+        g_key_file_set_string (key_file, uri, "Label", label != NULL ? label : "");
+        g_free (uri);
+    }
+
+    snapshot->layout = g_key_file_to_data (key_file, NULL, NULL);
+    g_key_file_free (key_file);
+
+    if (g_strcmp0 (snapshot->layout, icon_view->details->snapshot_layout) == 0)
+    {
+        fm_desktop_snapshot_free (snapshot);
+        return FALSE;
+    }
+
+    g_free (icon_view->details->snapshot_layout);
+    icon_view->details->snapshot_layout = g_strdup (snapshot->layout);
+    fm_desktop_snapshot_save (snapshot);
+
+    return FALSE;
+}
+
+static void
+schedule_snapshot_save (FMDesktopIconView *icon_view)
+{
+    /* A half loaded desktop is not worth showing next time */
+    if (!icon_view->details->directory_loaded)
+    {
+        return;
+    }
+
+    if (icon_view->details->snapshot_save_timeout_id != 0)
+    {
+        g_source_remove (icon_view->details->snapshot_save_timeout_id);
+    }
+    icon_view->details->snapshot_save_timeout_id =
+        g_timeout_add_seconds (SNAPSHOT_SAVE_DELAY, save_snapshot_timeout_callback, icon_view);
+}
+
+static void
+snapshot_loaded_callback (GObject *source_object,
+                          GAsyncResult *result,
+                          gpointer user_data)
+{
+    FMDesktopIconView *icon_view;
+    FMDesktopSnapshot *snapshot;
+    GError *error = NULL;
+
+    snapshot = fm_desktop_snapshot_load_finish (result, &error);
+    if (snapshot == NULL)
+    {
+        /* Cancelled means the view is gone */
+        g_error_free (error);
+        return;
+    }
+
+    icon_view = FM_DESKTOP_ICON_VIEW (user_data);
+    g_clear_object (&icon_view->details->snapshot_cancellable);
+
+    if (icon_view->details->snapshot_layout == NULL)
+    {
+        icon_view->details->snapshot_layout = g_strdup (snapshot->layout);
+    }
+
+    if (icon_view->details->directory_loaded)
+    {
+        fm_desktop_snapshot_free (snapshot);
+        return;
+    }
+
+    icon_view->details->snapshot = snapshot;
+    gtk_widget_queue_draw (GTK_WIDGET (get_icon_container (icon_view)));
+}
+
+/* The snapshot goes over the background and under the icons already
+ * loaded, which are drawn where the snapshot has them anyway. The
+ * canvas has already moved @cr to its bin window.
+ */
+static void
+icon_container_draw_snapshot_callback (EelCanvas *canvas,
+                                       cairo_t *cr,
+                                       FMDesktopIconView *icon_view)
+{
+    FMDesktopSnapshot *snapshot;
+
+    snapshot = icon_view->details->snapshot;
+    if (snapshot == NULL)
+    {
+        return;
+    }
+
+    cairo_save (cr);
+    cairo_set_source_surface (cr, snapshot->surface, snapshot->x, snapshot->y);
+    cairo_paint (cr);
+    cairo_restore (cr);
+}
+
+static gboolean
+drop_snapshot_idle_callback (gpointer data)
+{
+    FMDesktopIconView *icon_view;
+
+    icon_view = FM_DESKTOP_ICON_VIEW (data);
+    icon_view->details->snapshot_drop_idle_id = 0;
+
+    if (icon_view->details->snapshot != NULL)
+    {
+        fm_desktop_snapshot_free (icon_view->details->snapshot);
+        icon_view->details->snapshot = NULL;
+        gtk_widget_queue_draw (GTK_WIDGET (get_icon_container (icon_view)));
+    }
+
+    /* Saves nothing when the directory still looks like the snapshot */
+    schedule_snapshot_save (icon_view);
+
+    return FALSE;
+}
+
+static void
+end_loading_callback (FMDirectoryView *view,
+                      gboolean all_files_seen,
+                      FMDesktopIconView *icon_view)
+{
+    icon_view->details->directory_loaded = TRUE;
+
+    if (icon_view->details->snapshot_cancellable != NULL)
+    {
+        g_cancellable_cancel (icon_view->details->snapshot_cancellable);
+        g_clear_object (&icon_view->details->snapshot_cancellable);
+    }
+
+    /* Below the priority of the container's layout idle, so the real
+     * icons are in place when the snapshot goes away */
+    if (icon_view->details->snapshot_drop_idle_id == 0)
+    {
+        icon_view->details->snapshot_drop_idle_id =
+            g_idle_add_full (G_PRIORITY_LOW, drop_snapshot_idle_callback, icon_view, NULL);
+    }
+}
+
+static void
+load_snapshot (FMDesktopIconView *icon_view)
+{
+    char *key;
+
+    key = get_snapshot_key (icon_view);
+    icon_view->details->snapshot_cancellable = g_cancellable_new ();
+    fm_desktop_snapshot_load_async (key, icon_view->details->snapshot_cancellable,
+                                    snapshot_loaded_callback, icon_view);
+    g_free (key);
 }
 
 static void
@@ -773,6 +1065,20 @@ fm_desktop_icon_view_init (FMDesktopIconView *desktop_icon_view)
                               G_CALLBACK (fm_directory_view_update_menus),
                               desktop_icon_view);
 
+    /* Paint the icons of the last session until the directory is loaded,
+     * then keep the snapshot up to date with what is on the desktop.
+     */
+    g_signal_connect_object (icon_container, "draw_background",
+                             G_CALLBACK (icon_container_draw_snapshot_callback), desktop_icon_view, G_CONNECT_AFTER);
+    g_signal_connect_object (desktop_icon_view, "end_loading",
+                             G_CALLBACK (end_loading_callback), desktop_icon_view, G_CONNECT_AFTER);
+    g_signal_connect_object (desktop_icon_view, "end_file_changes",
+                             G_CALLBACK (schedule_snapshot_save), desktop_icon_view, G_CONNECT_SWAPPED);
+    g_signal_connect_object (icon_container, "layout_changed",
+                             G_CALLBACK (schedule_snapshot_save), desktop_icon_view, G_CONNECT_SWAPPED);
+    g_signal_connect_object (icon_container, "icon_position_changed",
+                             G_CALLBACK (schedule_snapshot_save), desktop_icon_view, G_CONNECT_SWAPPED);
+    load_snapshot (desktop_icon_view);
 }
 
 static void
@@ -0,0 +1,226 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4; tab-width: 8 -*- */
+
+/* fm-desktop-snapshot.c - picture of the desktop icons kept across sessions.
+
+   The Ukui Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   The Ukui Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with the Ukui Library; see the file COPYING.LIB.  If not,
+   write to the Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include <config.h>
+#include "fm-desktop-snapshot.h"
+
+#include <glib/gstdio.h>
+
+static char *
+get_snapshot_filename (const char *name)
+{
+    return g_build_filename (g_get_user_cache_dir (), "peony",
+                             "desktop-snapshot", name, NULL);
+}
+
+void
+fm_desktop_snapshot_free (FMDesktopSnapshot *snapshot)
+{
+    if (snapshot == NULL)
+    {
+        return;
+    }
+
+    g_free (snapshot->key);
+    if (snapshot->surface != NULL)
+    {
+        cairo_surface_destroy (snapshot->surface);
+    }
+    g_free (snapshot->layout);
+    g_free (snapshot);
+}
+
+static void
+load_thread (GTask *task,
+             gpointer source_object,
+             gpointer task_data,
+             GCancellable *cancellable)
+{
+    FMDesktopSnapshot *snapshot;
+    GKeyFile *key_file;
+    char *filename;
+    char *key;
+    GError *error = NULL;
+
+    snapshot = g_new0 (FMDesktopSnapshot, 1);
+
+    filename = get_snapshot_filename ("layout");
+    g_file_get_contents (filename, &snapshot->layout, NULL, &error);
+    g_free (filename);
+
+    key_file = g_key_file_new ();
+    if (error == NULL)
+    {
+        g_key_file_load_from_data (key_file, snapshot->layout, -1,
+                                   G_KEY_FILE_NONE, &error);
+    }
+
+    key = NULL;
+    if (error == NULL)
+    {
+        key = g_key_file_get_string (key_file, FM_DESKTOP_SNAPSHOT_GROUP, "Key", NULL);
+        snapshot->x = g_key_file_get_integer (key_file, FM_DESKTOP_SNAPSHOT_GROUP, "X", NULL);
+        snapshot->y = g_key_file_get_integer (key_file, FM_DESKTOP_SNAPSHOT_GROUP, "Y", NULL);
+    }
+    g_key_file_free (key_file);
+
+    if (error == NULL && g_strcmp0 (key, task_data) != 0)
+    {
+        g_set_error_literal (&error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                             "The desktop snapshot was taken with other settings");
+    }
+    g_free (key);
+
+    if (error == NULL && !g_cancellable_set_error_if_cancelled (cancellable, &error))
+    {
+        filename = get_snapshot_filename ("icons.png");
+        snapshot->surface = cairo_image_surface_create_from_png (filename);
+        g_free (filename);
+
+        if (cairo_surface_status (snapshot->surface) != CAIRO_STATUS_SUCCESS)
+        {
+            g_set_error_literal (&error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                                 "The desktop snapshot has no picture");
+        }
+    }
+
+    if (error != NULL)
+    {
+        fm_desktop_snapshot_free (snapshot);
+        g_task_return_error (task, error);
+        return;
+    }
+
+    snapshot->key = g_strdup (task_data);
+    g_task_return_pointer (task, snapshot, (GDestroyNotify) fm_desktop_snapshot_free);
+}
+
+void
+fm_desktop_snapshot_load_async (const char *key,
+                                GCancellable *cancellable,
+                                GAsyncReadyCallback callback,
+                                gpointer user_data)
+{
+    GTask *task;
+
+    task = g_task_new (NULL, cancellable, callback, user_data);
+    g_task_set_task_data (task, g_strdup (key), g_free);
+    g_task_run_in_thread (task, load_thread);
+    g_object_unref (task);
+}
+
+FMDesktopSnapshot *
+fm_desktop_snapshot_load_finish (GAsyncResult *result,
+                                 GError **error)
+{
+    g_return_val_if_fail (g_task_is_valid (result, NULL), NULL);
+
+    return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+static void
+save_thread (GTask *task,
+             gpointer source_object,
+             gpointer task_data,
+             GCancellable *cancellable)
+{
+    FMDesktopSnapshot *snapshot;
+    char *filename;
+    char *temp_filename;
+    char *dirname;
+
+    snapshot = task_data;
+
+    filename = get_snapshot_filename ("icons.png");
+    dirname = g_path_get_dirname (filename);
+    temp_filename = g_strconcat (filename, ".tmp", NULL);
+
+    /* The picture goes first, so a layout is never newer than the
+     * picture next to it. */
+    if (g_mkdir_with_parents (dirname, 0700) == 0 &&
+        cairo_surface_write_to_png (snapshot->surface, temp_filename) == CAIRO_STATUS_SUCCESS &&
+        g_rename (temp_filename, filename) == 0)
+    {
+        g_free (filename);
+        filename = get_snapshot_filename ("layout");
+        g_file_set_contents (filename, snapshot->layout, -1, NULL);
+    }
+    else
+    {
+        g_unlink (temp_filename);
+    }
+
+    g_free (temp_filename);
+    g_free (dirname);
+    g_free (filename);
+
+    g_task_return_boolean (task, TRUE);
+}
+
+static void start_save (FMDesktopSnapshot *snapshot);
+
+/* One save at a time, so an older snapshot never lands after a newer
+ * one. Only the latest of those asked for meanwhile is written.
+ */
+static gboolean save_running = FALSE;
+static FMDesktopSnapshot *pending_save = NULL;
+
+static void
+save_done (GObject *source_object,
+           GAsyncResult *result,
+           gpointer user_data)
+{
+    FMDesktopSnapshot *snapshot;
+
+    save_running = FALSE;
+
+    if (pending_save != NULL)
+    {
+        snapshot = pending_save;
+        pending_save = NULL;
+        start_save (snapshot);
+    }
+}
+
+static void
+start_save (FMDesktopSnapshot *snapshot)
+{
+    GTask *task;
+
+    save_running = TRUE;
+
+    task = g_task_new (NULL, NULL, save_done, NULL);
+    g_task_set_task_data (task, snapshot, (GDestroyNotify) fm_desktop_snapshot_free);
+    g_task_run_in_thread (task, save_thread);
+    g_object_unref (task);
+}
+
+void
+fm_desktop_snapshot_save (FMDesktopSnapshot *snapshot)
+{
+    if (save_running)
+    {
+        fm_desktop_snapshot_free (pending_save);
+        pending_save = snapshot;
+        return;
+    }
+
+    start_save (snapshot);
+}
@@ -0,0 +1,65 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4; tab-width: 8 -*- */
+
+/* fm-desktop-snapshot.h - picture of the desktop icons kept across sessions.
+
+   The Ukui Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   The Ukui Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with the Ukui Library; see the file COPYING.LIB.  If not,
+   write to the Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef FM_DESKTOP_SNAPSHOT_H
+#define FM_DESKTOP_SNAPSHOT_H
+
+#include <gio/gio.h>
+#include <cairo.h>
+
+/* The layout is a key file. This group has the key and the position of
+ * the picture, every other group is an icon, named by its URI.
+ */
+#define FM_DESKTOP_SNAPSHOT_GROUP "Snapshot"
+
+/* The desktop icons as they were last drawn, labels included, and the
+ * layout they were drawn in. The desktop paints it at login while its
+ * directory is still loading.
+ */
+typedef struct
+{
+    /* Screen size, zoom level, font and the like. A snapshot taken
+     * with another key does not match what the desktop would draw. */
+    char *key;
+
+    /* The icons, and where the top left corner goes in the container */
+    cairo_surface_t *surface;
+    int x, y;
+
+    /* The layout file, which lists the icons and their positions */
+    char *layout;
+} FMDesktopSnapshot;
+
+void               fm_desktop_snapshot_free        (FMDesktopSnapshot   *snapshot);
+
+/* Fails with G_IO_ERROR_NOT_FOUND if there is no snapshot for @key */
+void               fm_desktop_snapshot_load_async  (const char          *key,
+                                                    GCancellable        *cancellable,
+                                                    GAsyncReadyCallback  callback,
+                                                    gpointer             user_data);
+FMDesktopSnapshot *fm_desktop_snapshot_load_finish (GAsyncResult        *result,
+                                                    GError             **error);
+
+/* Writes the snapshot in a worker thread, taking ownership of it. A
+ * save asked for while one is running waits for it, replacing any
+ * other that was waiting. */
+void               fm_desktop_snapshot_save        (FMDesktopSnapshot   *snapshot);
+
+#endif /* FM_DESKTOP_SNAPSHOT_H */
@@ -63,6 +63,7 @@
 #include <libpeony-private/peony-desktop-directory.h>
 #include <libpeony-private/peony-extensions.h>
 #include <libpeony-private/peony-search-directory.h>
+#include <libpeony-private/peony-selection-summary.h>
 #include <libpeony-private/peony-directory-background.h>
 #include <libpeony-private/peony-directory.h>
 #include <libpeony-private/peony-dnd.h>
@@ -247,6 +248,13 @@ struct FMDirectoryViewDetails
 
 	gboolean selection_was_removed;
 
+	/* Refreshed from the selection only when someone asks */
+	PeonySelectionSummary *selection_summary;
+	gboolean selection_summary_is_stale;
+	/* What the folder's permissions were when the facts were computed */
+	guint directory_permissions;
+	gboolean directory_can_write;
+
 	gboolean metadata_for_directory_as_file_pending;
 	gboolean metadata_for_files_in_directory_pending;
 
@@ -335,6 +343,8 @@ static void     fm_directory_view_select_file                  (FMDirectoryView
 static GdkDragAction ask_link_action                           (FMDirectoryView      *view);
 static void     update_templates_directory                     (FMDirectoryView *view);
 static void     user_dirs_changed                              (FMDirectoryView *view);
+static PeonySelectionSummary *get_selection_summary            (FMDirectoryView *view);
+static void     invalidate_selection_summary                   (FMDirectoryView *view);
 static void     fm_directory_view_set_is_active                (FMDirectoryView *view,
 								gboolean         is_active);
 
@@ -1591,38 +1601,15 @@ action_location_properties_callback (GtkAction *action,
 	peony_file_list_free (files);
 }
 
-static gboolean
-all_files_in_trash (GList *files)
-{
-	GList *node;
-
-	/* Result is ambiguous if called on NULL, so disallow. */
-	g_return_val_if_fail (files != NULL, FALSE);
-
-	for (node = files; node != NULL; node = node->next) {
-		if (!peony_file_is_in_trash (PEONY_FILE (node->data))) {
-			return FALSE;
-		}
-	}
-
-	return TRUE;
-}
-
 static gboolean
 all_selected_items_in_trash (FMDirectoryView *view)
 {
-	GList *selection;
-	gboolean result;
+	PeonySelectionSummary *summary;
 
-	/* If the contents share a parent directory, we need only
-	 * check that parent directory. Otherwise we have to inspect
-	 * each selected item.
-	 */
-	selection = fm_directory_view_get_selection (view);
-	result = (selection == NULL) ? FALSE : all_files_in_trash (selection);
-	peony_file_list_free (selection);
+	summary = get_selection_summary (view);
 
-	return result;
+	return peony_selection_summary_get_count (summary) != 0 &&
+		peony_selection_summary_all (summary, PEONY_SELECTION_FACT_IN_TRASH);
 }
 
 static gboolean
@@ -1945,15 +1932,8 @@ fm_directory_view_get_widget (PeonyView *view)
 static int
 fm_directory_view_get_selection_count (PeonyView *view)
 {
-	/* FIXME: This could be faster if we special cased it in subclasses */
-	GList *files;
-	int len;
-
-	files = fm_directory_view_get_selection (FM_DIRECTORY_VIEW (view));
-	len = g_list_length (files);
-	peony_file_list_free (files);
-
-	return len;
+	return peony_selection_summary_get_count
+		(get_selection_summary (FM_DIRECTORY_VIEW (view)));
 }
 
 static GList *
@@ -2060,6 +2040,9 @@ fm_directory_view_init (FMDirectoryView *view)
 	/* Default to true; desktop-icon-view sets to false */
 	view->details->show_foreign_files = TRUE;
 
+	view->details->selection_summary = peony_selection_summary_new ();
+	view->details->selection_summary_is_stale = TRUE;
+
 	view->details->non_ready_files =
 		g_hash_table_new_full (file_and_directory_hash,
 				       file_and_directory_equal,
@@ -2101,6 +2084,10 @@ fm_directory_view_init (FMDirectoryView *view)
 	g_signal_connect_object (peony_clipboard_monitor_get (), "clipboard_changed",
 				 G_CALLBACK (clipboard_changed_callback), view, 0);
 
+	/* Whether files open in an external app depends on the handlers */
+	g_signal_connect_object (peony_signaller_get_current (), "mime_data_changed",
+				 G_CALLBACK (invalidate_selection_summary), view, G_CONNECT_SWAPPED);
+
         /* Register to menu provider extension signal managing menu updates */
         g_signal_connect_object (peony_signaller_get_current (), "popup_menu_changed",
                          G_CALLBACK (fm_directory_view_update_menus), view, G_CONNECT_SWAPPED);
@@ -2265,6 +2252,7 @@ fm_directory_view_finalize (GObject *object)
 	}
 
 	g_hash_table_destroy (view->details->non_ready_files);
+	peony_selection_summary_free (view->details->selection_summary);
 
 	g_free (view->details);
 
@@ -2281,13 +2269,11 @@ fm_directory_view_finalize (GObject *object)
 void
 fm_directory_view_display_selection_info (FMDirectoryView *view)
 {
-	GList *selection;
+	PeonySelectionSummary *summary;
 	goffset non_folder_size;
 	gboolean non_folder_size_known;
 	guint non_folder_count, folder_count, folder_item_count;
 	gboolean folder_item_count_known;
-	guint file_item_count;
-	GList *p;
 	char *first_item_name;
 	char *non_folder_str;
 	char *folder_count_str;
@@ -2295,49 +2281,31 @@ fm_directory_view_display_selection_info (FMDirectoryView *view)
 	char *status_string;
 	char *free_space_str;
 	char *obj_selected_free_space_str;
-	PeonyFile *file;
 
 	g_return_if_fail (FM_IS_DIRECTORY_VIEW (view));
 
-	selection = fm_directory_view_get_selection (view);
+	summary = get_selection_summary (view);
+
+	folder_count = peony_selection_summary_get_folder_count (summary);
+	folder_item_count_known =
+		peony_selection_summary_get_folder_item_count (summary, &folder_item_count);
+	non_folder_count = peony_selection_summary_get_count (summary) - folder_count;
+	non_folder_size_known =
+		peony_selection_summary_get_non_folder_size (summary, &non_folder_size);
 
-	folder_item_count_known = TRUE;
-	folder_count = 0;
-	folder_item_count = 0;
-	non_folder_count = 0;
-	non_folder_size_known = FALSE;
-	non_folder_size = 0;
+	/* Only shown when a single item is selected */
 	first_item_name = NULL;
+	if (peony_selection_summary_get_count (summary) == 1) {
+		first_item_name = peony_file_get_display_name
+			(peony_selection_summary_peek_file (summary));
+	}
+
 	folder_count_str = NULL;
 	non_folder_str = NULL;
 	folder_item_count_str = NULL;
 	free_space_str = NULL;
 	obj_selected_free_space_str = NULL;
 
-	for (p = selection; p != NULL; p = p->next) {
-		file = p->data;
-		if (peony_file_is_directory (file)) {
-			folder_count++;
-			if (peony_file_get_directory_item_count (file, &file_item_count, NULL)) {
-				folder_item_count += file_item_count;
-			} else {
-				folder_item_count_known = FALSE;
-			}
-		} else {
-			non_folder_count++;
-			if (!peony_file_can_get_size (file)) {
-				non_folder_size_known = TRUE;
-				non_folder_size += peony_file_get_size (file);
-			}
-		}
-
-		if (first_item_name == NULL) {
-			first_item_name = peony_file_get_display_name (file);
-		}
-	}
-
-	peony_file_list_free (selection);
-
 	/* Break out cases for localization's sake. But note that there are still pieces
 	 * being assembled in a particular order, which may be a problem for some localizers.
 	 */
@@ -2974,7 +2942,7 @@ process_old_files (FMDirectoryView *view)
 {
 	GList *files_added, *files_changed, *node;
 	FileAndDirectory *pending;
-	GList *selection, *files;
+	GList *files;
 	gboolean send_selection_change;
 
 	files_added = view->details->old_added_files;
@@ -3002,12 +2970,10 @@ process_old_files (FMDirectoryView *view)
 		g_signal_emit (view, signals[END_FILE_CHANGES], 0);
 
 		if (files_changed != NULL) {
-			selection = fm_directory_view_get_selection (view);
 			files = file_and_directory_list_to_files (files_changed);
-			send_selection_change = eel_g_lists_sort_and_check_for_intersection
-				(&files, &selection);
+			send_selection_change = peony_selection_summary_files_changed
+				(get_selection_summary (view), files);
 			peony_file_list_free (files);
-			peony_file_list_free (selection);
 		}
 
 		file_and_directory_list_free (view->details->old_added_files);
@@ -3568,6 +3534,7 @@ fm_directory_view_clear (FMDirectoryView *view)
 	g_return_if_fail (FM_IS_DIRECTORY_VIEW (view));
 
 	g_signal_emit (view, signals[CLEAR], 0);
+	view->details->selection_summary_is_stale = TRUE;
 }
 
 /**
@@ -3817,6 +3784,62 @@ fm_directory_view_get_selection (FMDirectoryView *view)
 		 get_selection, (view));
 }
 
+static void
+invalidate_selection_summary (FMDirectoryView *view)
+{
+	peony_selection_summary_invalidate (view->details->selection_summary);
+	view->details->selection_summary_is_stale = TRUE;
+	schedule_update_menus (view);
+}
+
+static gboolean
+take_selection_changes (FMDirectoryView *view,
+			GList **selected,
+			GList **unselected)
+{
+	FMDirectoryViewClass *klass;
+
+	klass = FM_DIRECTORY_VIEW_GET_CLASS (view);
+	if (klass->take_selection_changes == NULL) {
+		return FALSE;
+	}
+
+	klass->take_selection_changes (view, selected, unselected);
+	return TRUE;
+}
+
+/* Views that report their selection changes keep the summary up to date
+ * change by change; the whole selection is only read after a reset.
+ */
+static PeonySelectionSummary *
+get_selection_summary (FMDirectoryView *view)
+{
+	GList *selection, *selected, *unselected;
+
+	if (view->details->selection_summary_is_stale) {
+		/* The whole selection covers whatever changed before */
+		if (take_selection_changes (view, &selected, &unselected)) {
+			peony_file_list_free (selected);
+			peony_file_list_free (unselected);
+		}
+
+		selection = fm_directory_view_get_selection (view);
+		peony_selection_summary_set_files (view->details->selection_summary,
+						   selection);
+		peony_file_list_free (selection);
+		view->details->selection_summary_is_stale = FALSE;
+	} else if (take_selection_changes (view, &selected, &unselected)) {
+		peony_selection_summary_remove_files (view->details->selection_summary,
+						      unselected);
+		peony_selection_summary_add_files (view->details->selection_summary,
+						   selected);
+		peony_file_list_free (selected);
+		peony_file_list_free (unselected);
+	}
+
+	return view->details->selection_summary;
+}
+
 void
 fm_directory_view_invert_selection (FMDirectoryView *view)
 {
@@ -3995,29 +4018,10 @@ fm_directory_view_duplicate_selection (FMDirectoryView *view, GList *files,
 static gboolean
 special_link_in_selection (FMDirectoryView *view)
 {
-	gboolean saw_link;
-	GList *selection, *node;
-	PeonyFile *file;
-
 	g_return_val_if_fail (FM_IS_DIRECTORY_VIEW (view), FALSE);
 
-	saw_link = FALSE;
-
-	selection = fm_directory_view_get_selection (FM_DIRECTORY_VIEW (view));
-
-	for (node = selection; node != NULL; node = node->next) {
-		file = PEONY_FILE (node->data);
-
-		saw_link = PEONY_IS_DESKTOP_ICON_FILE (file);
-
-		if (saw_link) {
-			break;
-		}
-	}
-
-	peony_file_list_free (selection);
-
-	return saw_link;
+	return peony_selection_summary_any (get_selection_summary (view),
+					    PEONY_SELECTION_FACT_SPECIAL_LINK);
 }
 
 /* desktop_or_home_dir_in_selection
@@ -4028,31 +4032,10 @@ special_link_in_selection (FMDirectoryView *view)
 static gboolean
 desktop_or_home_dir_in_selection (FMDirectoryView *view)
 {
-	gboolean saw_desktop_or_home_dir;
-	GList *selection, *node;
-	PeonyFile *file;
-
 	g_return_val_if_fail (FM_IS_DIRECTORY_VIEW (view), FALSE);
 
-	saw_desktop_or_home_dir = FALSE;
-
-	selection = fm_directory_view_get_selection (FM_DIRECTORY_VIEW (view));
-
-	for (node = selection; node != NULL; node = node->next) {
-		file = PEONY_FILE (node->data);
-
-		saw_desktop_or_home_dir =
-			peony_file_is_home (file)
-			|| peony_file_is_desktop_directory (file);
-
-		if (saw_desktop_or_home_dir) {
-			break;
-		}
-	}
-
-	peony_file_list_free (selection);
-
-	return saw_desktop_or_home_dir;
+	return peony_selection_summary_any (get_selection_summary (view),
+					    PEONY_SELECTION_FACT_HOME_OR_DESKTOP);
 }
 
 static void
@@ -4955,15 +4938,17 @@ reset_open_with_menu (FMDirectoryView *view, GList *selection)
 
 	default_app = NULL;
 	if (filter_default) {
-		default_app = peony_mime_get_default_application_for_files (selection);
+		default_app = peony_selection_summary_get_default_application
+			(get_selection_summary (view));
 	}
 
 	applications = NULL;
 	if (other_applications_visible) {
-		applications = peony_mime_get_applications_for_files (selection);
+		applications = peony_selection_summary_get_applications
+			(get_selection_summary (view));
 	}
 
-	if (g_list_length (selection) == 1) {
+	if (selection != NULL && selection->next == NULL) {
 		add_x_content_apps (view, PEONY_FILE (selection->data), &applications);
 	}
 
@@ -9065,21 +9050,6 @@ clipboard_changed_callback (PeonyClipboardMonitor *monitor, FMDirectoryView *vie
 
 }
 
-static gboolean
-can_delete_all (GList *files)
-{
-	PeonyFile *file;
-	GList *l;
-
-	for (l = files; l != NULL; l = l->next) {
-		file = l->data;
-		if (!peony_file_can_delete (file)) {
-			return FALSE;
-		}
-	}
-	return TRUE;
-}
-
 static gboolean
 has_writable_extra_pane (FMDirectoryView *view)
 {
@@ -9095,7 +9065,7 @@ has_writable_extra_pane (FMDirectoryView *view)
 static void
 real_update_menus (FMDirectoryView *view)
 {
-	GList *selection, *l;
+	GList *selection;
 	gint selection_count;
 	const char *tip, *label;
 	char *label_with_underscore;
@@ -9126,14 +9096,15 @@ real_update_menus (FMDirectoryView *view)
 	gboolean bEnable = FALSE;
 	
 	selection = fm_directory_view_get_selection (view);
-	selection_count = g_list_length (selection);
+	selection_count = peony_selection_summary_get_count (get_selection_summary (view));
 
 	selection_contains_special_link = special_link_in_selection (view);
 	selection_contains_desktop_or_home_dir = desktop_or_home_dir_in_selection (view);
 
 	can_create_files = fm_directory_view_supports_creating_files (view);
 	can_delete_files =
-		can_delete_all (selection) &&
+		peony_selection_summary_all (get_selection_summary (view),
+					     PEONY_SELECTION_FACT_CAN_DELETE) &&
 		selection_count != 0 &&
 		!selection_contains_special_link &&
 		!selection_contains_desktop_or_home_dir;
@@ -9159,21 +9130,10 @@ real_update_menus (FMDirectoryView *view)
 					      FM_ACTION_OPEN);
 	gtk_action_set_sensitive (action, selection_count != 0);
 
-	can_open = show_app = selection_count != 0;
-
-	for (l = selection; l != NULL; l = l->next) {
-		PeonyFile *file;
-
-		file = PEONY_FILE (selection->data);
-
-		if (!peony_mime_file_opens_in_external_app (file)) {
-			show_app = FALSE;
-		}
-
-		if (!show_app) {
-			break;
-		}
-	}
+	can_open = selection_count != 0;
+	show_app = can_open &&
+		peony_selection_summary_all (get_selection_summary (view),
+					     PEONY_SELECTION_FACT_OPENS_IN_EXTERNAL_APP);
 
 	label_with_underscore = NULL;
 
@@ -9181,7 +9141,8 @@ real_update_menus (FMDirectoryView *view)
 	app_icon = NULL;
 
 	if (can_open && show_app) {
-		app = peony_mime_get_default_application_for_files (selection);
+		app = peony_selection_summary_get_default_application
+			(get_selection_summary (view));
 	}
 
 	if (app != NULL) {
@@ -9914,6 +9875,9 @@ fm_directory_view_notify_selection_changed (FMDirectoryView *view)
 	}
 
 	view->details->selection_was_removed = FALSE;
+	if (FM_DIRECTORY_VIEW_GET_CLASS (view)->take_selection_changes == NULL) {
+		view->details->selection_summary_is_stale = TRUE;
+	}
 
 	if (!view->details->selection_change_is_due_to_shell) {
 		view->details->send_selection_change_to_shell = TRUE;
@@ -9944,9 +9908,21 @@ static void
 file_changed_callback (PeonyFile *file, gpointer callback_data)
 {
 	FMDirectoryView *view = FM_DIRECTORY_VIEW (callback_data);
+	guint permissions;
+	gboolean can_write;
 
 	schedule_changes (view);
 
+	/* Whether the selected files can be deleted follows the folder */
+	permissions = peony_file_get_permissions (file);
+	can_write = peony_file_can_write (file);
+	if (permissions != view->details->directory_permissions ||
+	    can_write != view->details->directory_can_write) {
+		view->details->directory_permissions = permissions;
+		view->details->directory_can_write = can_write;
+		invalidate_selection_summary (view);
+	}
+
 	schedule_update_menus (view);
 	schedule_update_status (view);
 
@@ -163,6 +163,16 @@ struct FMDirectoryViewClass
      */
     GList *	(* get_selection_for_file_transfer)(FMDirectoryView *view);
 
+    /* take_selection_changes is a function pointer that subclasses may
+     * override to hand over the files selected and unselected since
+     * the last call, as newly-allocated GLists of reffed PeonyFile
+     * pointers. Views that do are not asked for their whole selection
+     * each time it changes.
+     */
+    void	(* take_selection_changes)	(FMDirectoryView *view,
+                                         GList **selected,
+                                         GList **unselected);
+
     /* select_all is a function pointer that subclasses must override to
      * select all of the items in the view */
     void     (* select_all)	         	(FMDirectoryView *view);
@@ -192,6 +192,11 @@ fm_icon_container_prioritize_thumbnailing (PeonyIconContainer *container,
 
     g_assert (PEONY_IS_FILE (file));
 
+    /* Visible icons come in bottom to top, so the top one ends up
+     * first in its folder's queue.
+     */
+    peony_file_prioritize_attributes (file);
+
     if (peony_file_is_thumbnailing (file))
     {
         uri = peony_file_get_uri (file);
@@ -200,6 +205,28 @@ fm_icon_container_prioritize_thumbnailing (PeonyIconContainer *container,
     }
 }
 
+/* Thumbnails on screen are kept out of the shared cache's eviction */
+static void
+fm_icon_container_icon_visibility_changed (PeonyIconContainer *container,
+        PeonyIconData      *data,
+        gboolean            visible)
+{
+    PeonyFile *file;
+
+    file = (PeonyFile *) data;
+
+    g_assert (PEONY_IS_FILE (file));
+
+    if (visible)
+    {
+        peony_file_pin_thumbnail (file);
+    }
+    else
+    {
+        peony_file_unpin_thumbnail (file);
+    }
+}
+
 static void
 update_auto_strv_as_quarks_everytime (GSettings   *settings,
                             const gchar *key,
@@ -621,6 +648,7 @@ fm_icon_container_class_init (FMIconContainerClass *klass)
     ic_class->start_monitor_top_left = fm_icon_container_start_monitor_top_left;
     ic_class->stop_monitor_top_left = fm_icon_container_stop_monitor_top_left;
     ic_class->prioritize_thumbnailing = fm_icon_container_prioritize_thumbnailing;
+    ic_class->icon_visibility_changed = fm_icon_container_icon_visibility_changed;
 
     ic_class->compare_icons = fm_icon_container_compare_icons;
     ic_class->compare_icons_by_name = fm_icon_container_compare_icons_by_name;
@@ -1358,12 +1358,12 @@ icon_view_notify_clipboard_info (PeonyClipboardMonitor *monitor,
                                  PeonyClipboardInfo *info,
                                  FMIconView *icon_view)
 {
-    GList *icon_data;
+    GHashTable *icon_data;
 
     icon_data = NULL;
     if (info && info->cut)
     {
-        icon_data = info->files;
+        icon_data = info->file_set;
     }
 
     peony_icon_container_set_highlighted_for_clipboard (
@@ -1534,6 +1534,19 @@ fm_icon_view_get_selection (FMDirectoryView *view)
     return list;
 }
 
+static void
+fm_icon_view_take_selection_changes (FMDirectoryView *view,
+                                     GList **selected,
+                                     GList **unselected)
+{
+    g_return_if_fail (FM_IS_ICON_VIEW (view));
+
+    peony_icon_container_take_selection_changes
+    (get_icon_container (FM_ICON_VIEW (view)), selected, unselected);
+    peony_file_list_ref (*selected);
+    peony_file_list_ref (*unselected);
+}
+
 static void
 count_item (PeonyIconData *icon_data,
             gpointer callback_data)
@@ -1866,8 +1879,7 @@ static void
 fm_icon_view_update_menus (FMDirectoryView *view)
 {
     FMIconView *icon_view;
-    GList *selection;
-    int selection_count;
+    guint selection_count;
     GtkAction *action;
     PeonyIconContainer *icon_container;
     gboolean editable;
@@ -1876,9 +1888,10 @@ fm_icon_view_update_menus (FMDirectoryView *view)
 
     FM_DIRECTORY_VIEW_CLASS (fm_icon_view_parent_class)->update_menus(view);
 
-    selection = fm_directory_view_get_selection (view);
-    selection_count = g_list_length (selection);
     icon_container = get_icon_container (icon_view);
+    selection_count = icon_container != NULL
+                      ? peony_icon_container_get_selection_count (icon_container)
+                      : 0;
 
     action = gtk_action_group_get_action (icon_view->details->icon_action_group,
                                           FM_ACTION_STRETCH);
@@ -1893,7 +1906,7 @@ fm_icon_view_update_menus (FMDirectoryView *view)
     action = gtk_action_group_get_action (icon_view->details->icon_action_group,
                                           FM_ACTION_UNSTRETCH);
     g_object_set (action, "label",
-                  eel_g_list_more_than_one_item (selection)
+                  selection_count > 1
                   ? _("Restore Icons' Original Si_zes")
                   : _("Restore Icon's Original Si_ze"),
                   NULL);
@@ -1904,8 +1917,6 @@ fm_icon_view_update_menus (FMDirectoryView *view)
     gtk_action_set_visible (action,
                             fm_icon_view_supports_scaling (icon_view));
 
-    peony_file_list_free (selection);
-
     editable = fm_directory_view_is_editable (view);
     action = gtk_action_group_get_action (icon_view->details->icon_action_group,
                                           FM_ACTION_MANUAL_LAYOUT);
@@ -3108,6 +3119,25 @@ icon_view_get_first_visible_file (PeonyView *view)
     return NULL;
 }
 
+static GList *
+icon_view_get_adjacent_locations (PeonyView *view,
+                                  int count)
+{
+    GList *files, *locations, *l;
+
+    files = peony_icon_container_get_adjacent_icon_data (get_icon_container (FM_ICON_VIEW (view)),
+            count);
+
+    locations = NULL;
+    for (l = files; l != NULL; l = l->next)
+    {
+        locations = g_list_prepend (locations, peony_file_get_location (PEONY_FILE (l->data)));
+    }
+    g_list_free (files);
+
+    return g_list_reverse (locations);
+}
+
 static void
 icon_view_scroll_to_file (PeonyView *view,
                           const char *uri)
@@ -3192,6 +3222,7 @@ fm_icon_view_class_init (FMIconViewClass *klass)
     fm_directory_view_class->get_selected_icon_locations = fm_icon_view_get_selected_icon_locations;
     fm_directory_view_class->get_selection = fm_icon_view_get_selection;
     fm_directory_view_class->get_selection_for_file_transfer = fm_icon_view_get_selection;
+    fm_directory_view_class->take_selection_changes = fm_icon_view_take_selection_changes;
     fm_directory_view_class->get_item_count = fm_icon_view_get_item_count;
     fm_directory_view_class->is_empty = fm_icon_view_is_empty;
     fm_directory_view_class->remove_file = fm_icon_view_remove_file;
@@ -3267,6 +3298,7 @@ fm_icon_view_iface_init (PeonyViewIface *iface)
     iface->get_view_id = fm_icon_view_get_id;
     iface->get_first_visible_file = icon_view_get_first_visible_file;
     iface->scroll_to_file = icon_view_scroll_to_file;
+    iface->get_adjacent_locations = icon_view_get_adjacent_locations;
     iface->get_title = NULL;
 }
 
@@ -76,7 +76,7 @@ struct FMListModelDetails
 
     GPtrArray *columns;
 
-    GList *highlight_files;
+    GHashTable *highlight_files; /* the clipboard monitor's, reffed */
 };
 
 typedef struct
@@ -383,8 +383,7 @@ fm_list_model_get_value (GtkTreeModel *tree_model, GtkTreeIter *iter, int column
             g_object_unref (gicon);
 
             if (model->details->highlight_files != NULL &&
-                    g_list_find_custom (model->details->highlight_files,
-                                        file, (GCompareFunc) peony_file_compare_location))
+                    g_hash_table_contains (model->details->highlight_files, file))
             {
                 rendered_icon = eel_create_spotlight_pixbuf (icon);
 
@@ -1632,7 +1631,7 @@ fm_list_model_finalize (GObject *object)
 
     if (model->details->highlight_files != NULL)
     {
-        peony_file_list_free (model->details->highlight_files);
+        g_hash_table_unref (model->details->highlight_files);
         model->details->highlight_files = NULL;
     }
 
@@ -1780,23 +1779,51 @@ refresh_row (gpointer data,
     g_list_free_full (iters, g_free);
 }
 
+/* Only rows whose highlight changes are refreshed, so cutting or
+ * copying a few files does not redraw every row that was highlighted.
+ * The set is the clipboard monitor's own and is only kept, not copied.
+ */
 void
 fm_list_model_set_highlight_for_files (FMListModel *model,
-                                       GList *files)
+                                       GHashTable *file_set)
 {
-    if (model->details->highlight_files != NULL)
+    GHashTable *old_files, *new_files;
+    GHashTableIter iter;
+    gpointer file;
+
+    old_files = model->details->highlight_files;
+    new_files = file_set != NULL ? g_hash_table_ref (file_set) : NULL;
+
+    model->details->highlight_files = new_files;
+
+    if (old_files != NULL)
     {
-        g_list_foreach (model->details->highlight_files,
-                        refresh_row, model);
-        peony_file_list_free (model->details->highlight_files);
-        model->details->highlight_files = NULL;
+        g_hash_table_iter_init (&iter, old_files);
+        while (g_hash_table_iter_next (&iter, &file, NULL))
+        {
+            if (new_files == NULL ||
+                !g_hash_table_contains (new_files, file))
+            {
+                refresh_row (file, model);
+            }
+        }
     }
 
-    if (files != NULL)
+    if (new_files != NULL)
     {
-        model->details->highlight_files = peony_file_list_copy (files);
-        g_list_foreach (model->details->highlight_files,
-                        refresh_row, model);
+        g_hash_table_iter_init (&iter, new_files);
+        while (g_hash_table_iter_next (&iter, &file, NULL))
+        {
+            if (old_files == NULL ||
+                !g_hash_table_contains (old_files, file))
+            {
+                refresh_row (file, model);
+            }
+        }
+    }
 
+    if (old_files != NULL)
+    {
+        g_hash_table_unref (old_files);
     }
 }
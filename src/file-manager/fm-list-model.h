@@ -132,6 +132,6 @@ void              fm_list_model_subdirectory_done_loading (FMListModel       *mo
         PeonyDirectory *directory);
 
 void              fm_list_model_set_highlight_for_files (FMListModel *model,
-        GList *files);
+        GHashTable *file_set);
 
 #endif /* FM_LIST_MODEL_H */
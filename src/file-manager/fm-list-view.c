@@ -3320,7 +3320,7 @@ list_view_notify_clipboard_info (PeonyClipboardMonitor *monitor,
 
     if (info != NULL && info->cut)
     {
-        fm_list_model_set_highlight_for_files (view->details->model, info->files);
+        fm_list_model_set_highlight_for_files (view->details->model, info->file_set);
     }
     else
     {
@@ -3437,6 +3437,72 @@ fm_list_view_get_id (PeonyView *view)
 }
 
 
+static void
+prepend_location_at (FMListView *list_view,
+                     GtkTreeIter *iter,
+                     GList **locations)
+{
+    PeonyFile *file;
+
+    gtk_tree_model_get (GTK_TREE_MODEL (list_view->details->model),
+                        iter,
+                        FM_LIST_MODEL_FILE_COLUMN, &file,
+                        -1);
+    if (file != NULL)
+    {
+        *locations = g_list_prepend (*locations, peony_file_get_location (file));
+        peony_file_unref (file);
+    }
+}
+
+static GList *
+fm_list_view_get_adjacent_locations (PeonyView *view,
+                                     int count)
+{
+    FMListView *list_view;
+    GtkTreeModel *model;
+    GtkTreeSelection *selection;
+    GList *selected_rows, *locations;
+    GtkTreeIter iter, next, previous;
+    gboolean has_next, has_previous;
+    int i;
+
+    list_view = FM_LIST_VIEW (view);
+    model = GTK_TREE_MODEL (list_view->details->model);
+    selection = gtk_tree_view_get_selection (list_view->details->tree_view);
+
+    selected_rows = gtk_tree_selection_get_selected_rows (selection, NULL);
+    if (selected_rows == NULL)
+    {
+        return NULL;
+    }
+    gtk_tree_model_get_iter (model, &iter, selected_rows->data);
+    g_list_free_full (selected_rows, (GDestroyNotify) gtk_tree_path_free);
+
+    /* Only rows at the same level, expanded folders are not entered */
+    locations = NULL;
+    next = iter;
+    previous = iter;
+    has_next = gtk_tree_model_iter_next (model, &next);
+    has_previous = gtk_tree_model_iter_previous (model, &previous);
+    for (i = 0; i < count && (has_next || has_previous); i++)
+    {
+        if (has_next)
+        {
+            prepend_location_at (list_view, &next, &locations);
+            has_next = gtk_tree_model_iter_next (model, &next);
+        }
+        if (has_previous)
+        {
+            prepend_location_at (list_view, &previous, &locations);
+            has_previous = gtk_tree_model_iter_previous (model, &previous);
+        }
+    }
+
+    return g_list_reverse (locations);
+}
+
+
 static void
 fm_list_view_iface_init (PeonyViewIface *iface)
 {
@@ -3445,6 +3511,7 @@ fm_list_view_iface_init (PeonyViewIface *iface)
     iface->get_view_id = fm_list_view_get_id;
     iface->get_first_visible_file = fm_list_view_get_first_visible_file;
     iface->scroll_to_file = list_view_scroll_to_file;
+    iface->get_adjacent_locations = fm_list_view_get_adjacent_locations;
     iface->get_title = NULL;
 }
 
@@ -55,8 +55,10 @@
 #include <libpeony-private/peony-metadata.h>
 #include <libpeony-private/peony-module.h>
 #include <libpeony-private/peony-mime-actions.h>
+#include <libpeony-private/peony-user-directory.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #include <cairo.h>
 
 #if HAVE_SYS_VFS_H
@@ -177,6 +179,7 @@ static const GtkTargetEntry target_table[] = {
 };
 
 #define DIRECTORY_CONTENTS_UPDATE_INTERVAL	200 /* milliseconds */
+#define OWNERSHIP_COMBO_BOX_MAX_ENTRIES		500
 #define FILES_UPDATE_INTERVAL			200 /* milliseconds */
 #define STANDARD_EMBLEM_HEIGHT			52
 #define EMBLEM_LABEL_SPACING			2
@@ -1605,29 +1608,55 @@ unschedule_or_cancel_group_change (FMPropertiesWindow *window)
 }
 
 static void
-changed_group_callback (GtkComboBox *combo_box, PeonyFile *file)
+change_group (GtkComboBox *combo_box, PeonyFile *file, const char *group)
 {
 	FMPropertiesWindow *window;
-	char *group;
 	char *cur_group;
 
-	g_assert (GTK_IS_COMBO_BOX (combo_box));
-	g_assert (PEONY_IS_FILE (file));
-
-	group = gtk_combo_box_text_get_active_text (GTK_COMBO_BOX_TEXT (combo_box));
 	cur_group = peony_file_get_group_name (file);
 
-	if (group != NULL && strcmp (group, cur_group) != 0) {
+	if (group != NULL && group[0] != '\0' && g_strcmp0 (group, cur_group) != 0) {
 		/* Try to change file group. If this fails, complain to user. */
 		window = FM_PROPERTIES_WINDOW (gtk_widget_get_ancestor (GTK_WIDGET (combo_box), GTK_TYPE_WINDOW));
 
 		unschedule_or_cancel_group_change (window);
 		schedule_group_change (window, file, group);
 	}
-	g_free (group);
 	g_free (cur_group);
 }
 
+static void refill_groups_combo_box (GtkComboBox *combo_box,
+				     PeonyFile   *file);
+
+static void
+changed_group_callback (GtkComboBox *combo_box, PeonyFile *file)
+{
+	char *group;
+
+	g_assert (GTK_IS_COMBO_BOX (combo_box));
+	g_assert (PEONY_IS_FILE (file));
+
+	if (gtk_combo_box_get_active (combo_box) < 0) {
+		/* The user is typing, narrow the list down to what matches */
+		refill_groups_combo_box (combo_box, file);
+		return;
+	}
+
+	group = gtk_combo_box_text_get_active_text (GTK_COMBO_BOX_TEXT (combo_box));
+	change_group (combo_box, file, group);
+	g_free (group);
+}
+
+static void
+group_entry_activate_callback (GtkEntry *entry, PeonyFile *file)
+{
+	g_assert (GTK_IS_ENTRY (entry));
+	g_assert (PEONY_IS_FILE (file));
+
+	change_group (GTK_COMBO_BOX (gtk_widget_get_parent (GTK_WIDGET (entry))),
+		      file, gtk_entry_get_text (entry));
+}
+
 /* checks whether the given column at the first level
  * of model has the specified entries in the given order. */
 static gboolean
@@ -1735,27 +1764,49 @@ tree_model_get_entry_index (GtkTreeModel *model,
 }
 
 
-static void
-synch_groups_combo_box (GtkComboBox *combo_box, PeonyFile *file)
+/* Lists the groups the file can be given whose name starts with prefix.
+ * Root can choose from every group, which is served from the cached
+ * user directory so that huge group databases aren't walked here.
+ */
+static GList *
+get_settable_group_names (PeonyFile *file, const char *prefix)
 {
 	GList *groups;
-	GList *node;
-	GtkTreeModel *model;
-	GtkListStore *store;
-	const char *group_name;
-	char *current_group_name;
-	int group_index;
-	int current_group_index;
+	GList *node, *next;
 
-	g_assert (GTK_IS_COMBO_BOX (combo_box));
-	g_assert (PEONY_IS_FILE (file));
+	if (!peony_file_can_set_group (file)) {
+		return NULL;
+	}
 
-	if (peony_file_is_gone (file)) {
-		return;
+	if (geteuid () == 0) {
+		return peony_user_directory_search_groups (peony_user_directory_get (),
+							   prefix,
+							   OWNERSHIP_COMBO_BOX_MAX_ENTRIES);
 	}
 
 	groups = peony_file_get_settable_group_names (file);
 
+	if (prefix != NULL) {
+		for (node = groups; node != NULL; node = next) {
+			next = node->next;
+			if (!g_str_has_prefix (node->data, prefix)) {
+				g_free (node->data);
+				groups = g_list_delete_link (groups, node);
+			}
+		}
+	}
+
+	return groups;
+}
+
+static void
+fill_groups_combo_box (GtkComboBox *combo_box, GList *groups)
+{
+	GList *node;
+	GtkTreeModel *model;
+	GtkListStore *store;
+	const char *group_name;
+
 	model = gtk_combo_box_get_model (combo_box);
 	store = GTK_LIST_STORE (model);
 	g_assert (GTK_IS_LIST_STORE (model));
@@ -1767,12 +1818,44 @@ synch_groups_combo_box (GtkComboBox *combo_box, PeonyFile *file)
 		 */
 		gtk_list_store_clear (store);
 
-		for (node = groups, group_index = 0; node != NULL; node = node->next, ++group_index) {
+		for (node = groups; node != NULL; node = node->next) {
 			group_name = (const char *)node->data;
 			gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (combo_box), group_name);
 		}
 	}
+}
+
+static void
+refill_groups_combo_box (GtkComboBox *combo_box, PeonyFile *file)
+{
+	GList *groups;
+	const char *prefix;
+
+	prefix = gtk_entry_get_text (GTK_ENTRY (gtk_bin_get_child (GTK_BIN (combo_box))));
+	groups = get_settable_group_names (file, prefix);
+	fill_groups_combo_box (combo_box, groups);
+	g_list_free_full (groups, g_free);
+}
+
+static void
+synch_groups_combo_box (GtkComboBox *combo_box, PeonyFile *file)
+{
+	GList *groups;
+	GtkTreeModel *model;
+	char *current_group_name;
+	int current_group_index;
+
+	g_assert (GTK_IS_COMBO_BOX (combo_box));
+	g_assert (PEONY_IS_FILE (file));
+
+	if (peony_file_is_gone (file)) {
+		return;
+	}
 
+	groups = get_settable_group_names (file, NULL);
+	fill_groups_combo_box (combo_box, groups);
+
+	model = gtk_combo_box_get_model (combo_box);
 	current_group_name = peony_file_get_group_name (file);
 	current_group_index = tree_model_get_entry_index (model, 0, current_group_name);
 
@@ -1819,6 +1902,18 @@ combo_box_row_separator_func (GtkTreeModel *model,
   	return ret;
 }
 
+/* Both ownership combo boxes have an entry, so that accounts which
+ * didn't make it into the list can be found by typing a prefix.
+ */
+
+/* Whether resyncing with the file would overwrite what is being typed */
+static gboolean
+combo_box_entry_is_being_edited (GtkComboBox *combo_box)
+{
+	return gtk_combo_box_get_active (combo_box) < 0 ||
+	       gtk_widget_has_focus (gtk_bin_get_child (GTK_BIN (combo_box)));
+}
+
 static GtkComboBox *
 attach_combo_box (GtkGrid *grid,
                   GtkWidget *sibling,
@@ -1827,20 +1922,14 @@ attach_combo_box (GtkGrid *grid,
 	GtkWidget *combo_box;
 
 	if (!two_columns) {
-		combo_box = gtk_combo_box_text_new ();
+		combo_box = gtk_combo_box_text_new_with_entry ();
 	} else {
 		GtkTreeModel *model;
-		GtkCellRenderer *renderer;
 
 		model = GTK_TREE_MODEL (gtk_list_store_new (2, G_TYPE_STRING, G_TYPE_STRING));
-		combo_box = gtk_combo_box_new_with_model (model);
+		combo_box = gtk_combo_box_new_with_model_and_entry (model);
+		gtk_combo_box_set_entry_text_column (GTK_COMBO_BOX (combo_box), 0);
 		g_object_unref (G_OBJECT (model));
-
-		renderer = gtk_cell_renderer_text_new ();
-		gtk_cell_layout_pack_start (GTK_CELL_LAYOUT (combo_box), renderer, TRUE);
-		gtk_cell_layout_add_attribute (GTK_CELL_LAYOUT (combo_box), renderer,
-					       "text", 0);
-
 	}
 
 	gtk_widget_set_halign (combo_box, GTK_ALIGN_START);
@@ -1858,25 +1947,65 @@ attach_combo_box (GtkGrid *grid,
 	return GTK_COMBO_BOX (combo_box);
 }
 
+static void
+group_file_changed_callback (GtkComboBox *combo_box, PeonyFile *file)
+{
+	if (!combo_box_entry_is_being_edited (combo_box)) {
+		synch_groups_combo_box (combo_box, file);
+	}
+}
+
+static void
+groups_loaded_callback (PeonyUserDirectory *user_directory,
+			GtkComboBox *combo_box)
+{
+	PeonyFile *file;
+
+	file = g_object_get_data (G_OBJECT (combo_box), "peony_file");
+
+	if (combo_box_entry_is_being_edited (combo_box)) {
+		refill_groups_combo_box (combo_box, file);
+	} else {
+		synch_groups_combo_box (combo_box, file);
+	}
+}
+
 static GtkComboBox*
 attach_group_combo_box (GtkGrid *grid,
                         GtkWidget *sibling,
                         PeonyFile *file)
 {
 	GtkComboBox *combo_box;
+	PeonyUserDirectory *user_directory;
 
 	combo_box = attach_combo_box (grid, sibling, FALSE);
+	g_object_set_data_full (G_OBJECT (combo_box), "peony_file",
+				peony_file_ref (file),
+				(GDestroyNotify) peony_file_unref);
+
+	/* Until the group database has been read in the background
+	 * the combo box only offers the current group.
+	 */
+	user_directory = peony_user_directory_get ();
+	peony_user_directory_load (user_directory);
 
 	synch_groups_combo_box (combo_box, file);
 
 	/* Connect to signal to update menu when file changes. */
 	g_signal_connect_object (file, "changed",
-				 G_CALLBACK (synch_groups_combo_box),
+				 G_CALLBACK (group_file_changed_callback),
 				 combo_box, G_CONNECT_SWAPPED);
+	g_signal_connect_object (user_directory, "loaded",
+				 G_CALLBACK (groups_loaded_callback),
+				 combo_box, 0);
 	g_signal_connect_data (combo_box, "changed",
 			       G_CALLBACK (changed_group_callback),
 			       peony_file_ref (file),
 			       (GClosureNotify)peony_file_unref, 0);
+	g_signal_connect_data (gtk_bin_get_child (GTK_BIN (combo_box)), "activate",
+			       G_CALLBACK (group_entry_activate_callback),
+			       peony_file_ref (file),
+			       (GClosureNotify)peony_file_unref, 0);
 
 	return combo_box;
 }
@@ -2015,26 +2144,19 @@ unschedule_or_cancel_owner_change (FMPropertiesWindow *window)
 }
 
 static void
-changed_owner_callback (GtkComboBox *combo_box, PeonyFile* file)
+change_owner (GtkComboBox *combo_box, PeonyFile *file, const char *owner_text)
 {
 	FMPropertiesWindow *window;
-	char *owner_text;
 	char **name_array;
 	char *new_owner;
 	char *cur_owner;
 
-	g_assert (GTK_IS_COMBO_BOX (combo_box));
-	g_assert (PEONY_IS_FILE (file));
-
-	owner_text = combo_box_get_active_entry (combo_box, 0);
-        if (! owner_text)
-	    return;
-    	name_array = g_strsplit (owner_text, " - ", 2);
+	name_array = g_strsplit (owner_text, " - ", 2);
 	new_owner = name_array[0];
-	g_free (owner_text);
 	cur_owner = peony_file_get_owner_name (file);
 
-	if (strcmp (new_owner, cur_owner) != 0) {
+	if (new_owner != NULL && new_owner[0] != '\0' &&
+	    g_strcmp0 (new_owner, cur_owner) != 0) {
 		/* Try to change file owner. If this fails, complain to user. */
 		window = FM_PROPERTIES_WINDOW (gtk_widget_get_ancestor (GTK_WIDGET (combo_box), GTK_TYPE_WINDOW));
 
@@ -2045,29 +2167,49 @@ changed_owner_callback (GtkComboBox *combo_box, PeonyFile* file)
 	g_free (cur_owner);
 }
 
+static void refill_user_menu (GtkComboBox *combo_box);
+
 static void
-synch_user_menu (GtkComboBox *combo_box, PeonyFile *file)
+changed_owner_callback (GtkComboBox *combo_box, PeonyFile* file)
 {
-	GList *users;
-	GList *node;
-	GtkTreeModel *model;
-	GtkListStore *store;
-	GtkTreeIter iter;
-	char *user_name;
-	char *owner_name;
-	int user_index;
-	int owner_index;
-	char **name_array;
-	char *combo_text;
+	char *owner_text;
 
 	g_assert (GTK_IS_COMBO_BOX (combo_box));
 	g_assert (PEONY_IS_FILE (file));
 
-	if (peony_file_is_gone (file)) {
+	if (gtk_combo_box_get_active (combo_box) < 0) {
+		/* The user is typing, narrow the list down to what matches */
+		refill_user_menu (combo_box);
 		return;
 	}
 
-	users = peony_get_user_names ();
+	owner_text = combo_box_get_active_entry (combo_box, 0);
+        if (! owner_text)
+	    return;
+	change_owner (combo_box, file, owner_text);
+	g_free (owner_text);
+}
+
+static void
+owner_entry_activate_callback (GtkEntry *entry, PeonyFile *file)
+{
+	g_assert (GTK_IS_ENTRY (entry));
+	g_assert (PEONY_IS_FILE (file));
+
+	change_owner (GTK_COMBO_BOX (gtk_widget_get_parent (GTK_WIDGET (entry))),
+		      file, gtk_entry_get_text (entry));
+}
+
+static void
+fill_user_menu (GtkComboBox *combo_box, GList *users)
+{
+	GList *node;
+	GtkTreeModel *model;
+	GtkListStore *store;
+	GtkTreeIter iter;
+	char *user_name;
+	char **name_array;
+	char *combo_text;
 
 	model = gtk_combo_box_get_model (combo_box);
 	store = GTK_LIST_STORE (model);
@@ -2080,7 +2222,7 @@ synch_user_menu (GtkComboBox *combo_box, PeonyFile *file)
 		 */
 		gtk_list_store_clear (store);
 
-		for (node = users, user_index = 0; node != NULL; node = node->next, ++user_index) {
+		for (node = users; node != NULL; node = node->next) {
 			user_name = (char *)node->data;
 
 			name_array = g_strsplit (user_name, "\n", 2);
@@ -2100,6 +2242,48 @@ synch_user_menu (GtkComboBox *combo_box, PeonyFile *file)
 			g_free (combo_text);
 		}
 	}
+}
+
+static void
+refill_user_menu (GtkComboBox *combo_box)
+{
+	GList *users;
+	const char *prefix;
+
+	prefix = gtk_entry_get_text (GTK_ENTRY (gtk_bin_get_child (GTK_BIN (combo_box))));
+	users = peony_user_directory_search_users (peony_user_directory_get (),
+						   prefix,
+						   OWNERSHIP_COMBO_BOX_MAX_ENTRIES);
+	fill_user_menu (combo_box, users);
+	g_list_free_full (users, g_free);
+}
+
+static void
+synch_user_menu (GtkComboBox *combo_box, PeonyFile *file)
+{
+	GList *users;
+	GtkTreeModel *model;
+	GtkListStore *store;
+	GtkTreeIter iter;
+	char *user_name;
+	char *owner_name;
+	int owner_index;
+	char **name_array;
+
+	g_assert (GTK_IS_COMBO_BOX (combo_box));
+	g_assert (PEONY_IS_FILE (file));
+
+	if (peony_file_is_gone (file)) {
+		return;
+	}
+
+	users = peony_user_directory_search_users (peony_user_directory_get (),
+						   NULL,
+						   OWNERSHIP_COMBO_BOX_MAX_ENTRIES);
+	fill_user_menu (combo_box, users);
+
+	model = gtk_combo_box_get_model (combo_box);
+	store = GTK_LIST_STORE (model);
 
 	owner_name = peony_file_get_string_attribute (file, "owner");
 	owner_index = tree_model_get_entry_index (model, 0, owner_name);
@@ -2142,25 +2326,65 @@ synch_user_menu (GtkComboBox *combo_box, PeonyFile *file)
     	g_list_free_full (users, g_free);
 }
 
+static void
+owner_file_changed_callback (GtkComboBox *combo_box, PeonyFile *file)
+{
+	if (!combo_box_entry_is_being_edited (combo_box)) {
+		synch_user_menu (combo_box, file);
+	}
+}
+
+static void
+users_loaded_callback (PeonyUserDirectory *user_directory,
+		       GtkComboBox *combo_box)
+{
+	PeonyFile *file;
+
+	file = g_object_get_data (G_OBJECT (combo_box), "peony_file");
+
+	if (combo_box_entry_is_being_edited (combo_box)) {
+		refill_user_menu (combo_box);
+	} else {
+		synch_user_menu (combo_box, file);
+	}
+}
+
 static GtkComboBox*
 attach_owner_combo_box (GtkGrid *grid,
                         GtkWidget *sibling,
                         PeonyFile *file)
 {
 	GtkComboBox *combo_box;
+	PeonyUserDirectory *user_directory;
 
 	combo_box = attach_combo_box (grid, sibling, TRUE);
+	g_object_set_data_full (G_OBJECT (combo_box), "peony_file",
+				peony_file_ref (file),
+				(GDestroyNotify) peony_file_unref);
+
+	/* Until the passwd database has been read in the background
+	 * the combo box only offers the current owner.
+	 */
+	user_directory = peony_user_directory_get ();
+	peony_user_directory_load (user_directory);
 
 	synch_user_menu (combo_box, file);
 
 	/* Connect to signal to update menu when file changes. */
 	g_signal_connect_object (file, "changed",
-				 G_CALLBACK (synch_user_menu),
+				 G_CALLBACK (owner_file_changed_callback),
 				 combo_box, G_CONNECT_SWAPPED);
+	g_signal_connect_object (user_directory, "loaded",
+				 G_CALLBACK (users_loaded_callback),
+				 combo_box, 0);
 	g_signal_connect_data (combo_box, "changed",
 			       G_CALLBACK (changed_owner_callback),
 			       peony_file_ref (file),
 			       (GClosureNotify)peony_file_unref, 0);
+	g_signal_connect_data (gtk_bin_get_child (GTK_BIN (combo_box)), "activate",
+			       G_CALLBACK (owner_entry_activate_callback),
+			       peony_file_ref (file),
+			       (GClosureNotify)peony_file_unref, 0);
 
 	return combo_box;
 }
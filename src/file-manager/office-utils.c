@@ -25,457 +25,848 @@
 #include <gdk/gdkx.h>
 #include <glib/gstdio.h>
 
+#include <signal.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include <eel/eel-debug.h>
 #include <libpeony-private/peony-signaller.h>
 
-static PeonyWindowInfo *current_window;
-static char* todo_filename;
+/* Converted documents live in their own directory under the cache,
+ * named after a hash of the document's path, size and modification
+ * time, so a changed or different document never gets a stale preview.
+ * The directories least recently shown are removed once they add up
+ * to more than this.
+ */
+#define PREVIEW_CACHE_MAX_SIZE (256 * 1024 * 1024)
+
+/* Other selected documents converted ahead of time */
+#define MAX_PREFETCH_FILES 3
+
+/* The office listener is stopped after this many idle seconds */
+#define LISTENER_IDLE_TIMEOUT 300
+
+/* How long unoconv waits for the listener to come up, in seconds */
+#define LISTENER_CONNECT_TIMEOUT "30"
 
-//static GPid old_pid = -1;
+/* Partial conversions older than this were left by an earlier run */
+#define STALE_PART_AGE (24 * 60 * 60)
 
-static gboolean is_busy = FALSE;
+typedef struct {
+	char *source;
+	char *output;
+	char *key_dir;
+	gboolean is_excel;
+	/* Nobody is waiting for it, it's only converted ahead of time */
+	gboolean speculative;
+	/* Weak, the window waiting for the result, or NULL */
+	PeonyWindowInfo *window;
+} OfficeJob;
 
-void clean_cache_files_anyway ();
+static GQueue job_queue = G_QUEUE_INIT;
+static OfficeJob *running_job;
+static GPid running_pid;
+static gboolean running_job_cancelled;
 
-char* get_html_tmp_name (char* filename);
-char* get_pdf_tmp_name(char* filename);
+static GPid listener_pid;
+static guint listener_idle_id;
 
-void prepare_to_trans_file_by_window (PeonyWindowInfo* window, char* filename);
-void excel2html_by_window_internal (PeonyWindowInfo *window, char *html_filename, char *excel_filename);
-void office2pdf_by_window_internal (PeonyWindowInfo *window, char *pdf_filename, char* office_filename);
-void excel2html_by_window_internal_unoconv (PeonyWindowInfo *window, char *html_filename, char *excel_filename);
-void office2pdf_by_window_internal_unoconv (PeonyWindowInfo *window, char *pdf_filename, char* office_filename);
+static gboolean cache_trim_running;
+static gboolean cache_trim_again;
 
-void clean_cache_files_anyway (){
-    char* tmp_path;
-    tmp_path = g_build_filename (g_get_user_cache_dir (), "peony", NULL);
-    if(g_remove(tmp_path) != 0){
-        //printf ("remove cache path failed: %s\n",tmp_path);
-		char* cmd = g_strdup_printf ("rm -rf %s",tmp_path);
-		//printf ("cmd: %s", cmd);
-        system (cmd);
-    }
-    g_free (tmp_path);
+static void start_next_job (void);
+
+static char *
+get_cache_dir (void)
+{
+	return g_build_filename (g_get_user_cache_dir (), "peony", "office-previews", NULL);
 }
 
-gboolean is_office_busy(){
-	return is_busy;
+static char *
+get_listener_connection (void)
+{
+	return g_strdup_printf ("pipe,name=peony-office-%d;urp;StarOffice.ComponentContext",
+				(int) getuid ());
 }
 
-static void trans_next_file (PeonyWindowInfo* window) {
+/* Searching PATH is done once, previews are looked up every time the
+ * selection changes.
+ */
+static gboolean
+have_program (const char *program, int *cached)
+{
+	char *path;
+
+	if (*cached < 0) {
+		path = g_find_program_in_path (program);
+		*cached = path != NULL;
+		g_free (path);
+	}
 
-	if (!todo_filename){
-		//printf ("no next file\n");
+	return *cached;
+}
+
+static gboolean
+have_unoconv (void)
+{
+	static int found = -1;
+
+	return have_program ("unoconv", &found);
+}
+
+static gboolean
+have_libreoffice (void)
+{
+	static int found = -1;
+
+	return have_program ("libreoffice", &found);
+}
+
+/* Symlinks are removed, never followed: a document may well contain
+ * one pointing anywhere.
+ */
+static void
+remove_recursively (const char *path)
+{
+	struct stat info;
+	GDir *dir;
+	const char *name;
+	char *child;
+
+	if (g_lstat (path, &info) != 0) {
 		return;
 	}
 
-	//printf ("next file\n\n\n\n\n");
+	if (!S_ISDIR (info.st_mode)) {
+		g_unlink (path);
+		return;
+	}
 
-	prepare_to_trans_file_by_window (window, todo_filename);
+	dir = g_dir_open (path, 0, NULL);
+	if (dir != NULL) {
+		while ((name = g_dir_read_name (dir)) != NULL) {
+			child = g_build_filename (path, name, NULL);
+			remove_recursively (child);
+			g_free (child);
+		}
+		g_dir_close (dir);
+	}
 
-	todo_filename = NULL;
+	g_rmdir (path);
 }
 
-void office_utils_conncet_window_info (PeonyWindowInfo *window_info) {
-	g_signal_connect (window_info, "office_trans_ready", G_CALLBACK (trans_next_file), todo_filename);
+static goffset
+get_size_recursively (const char *path, struct stat *info)
+{
+	GDir *dir;
+	const char *name;
+	char *child;
+	struct stat child_info;
+	goffset size;
+
+	size = info->st_blocks * 512;
+
+	if (!S_ISDIR (info->st_mode)) {
+		return size;
+	}
+
+	dir = g_dir_open (path, 0, NULL);
+	if (dir != NULL) {
+		while ((name = g_dir_read_name (dir)) != NULL) {
+			child = g_build_filename (path, name, NULL);
+			if (g_lstat (child, &child_info) == 0) {
+				size += get_size_recursively (child, &child_info);
+			}
+			g_free (child);
+		}
+		g_dir_close (dir);
+	}
+
+	return size;
 }
 
-void office_utils_disconnect_window_info (PeonyWindowInfo *window_info) {
-	g_signal_handlers_disconnect_by_func (window_info, G_CALLBACK (trans_next_file), todo_filename);
+/* Cache trimming, done in a thread */
+
+typedef struct {
+	char *path;
+	time_t last_used;
+	goffset size;
+} CacheEntry;
+
+static gint
+compare_cache_entries_by_age (gconstpointer a, gconstpointer b)
+{
+	const CacheEntry *entry_a = a;
+	const CacheEntry *entry_b = b;
+
+	if (entry_a->last_used != entry_b->last_used) {
+		return entry_a->last_used < entry_b->last_used ? -1 : 1;
+	}
+	return 0;
 }
 
-void prepare_to_trans_file_by_window (PeonyWindowInfo* window, char* filename) {
-	//printf ("prepare_to_trans_file_by_window\n");
-	if (!is_busy) {
-		is_busy = TRUE;
-
-		//printf ("...................\n");
-		char *doing_filename = peony_navigation_window_get_current_previewing_office_file_by_window_info (window);
-		//printf ("doing %s\n",doing_filename);
-		char *pending_preview_filename = get_pending_preview_filename(doing_filename);
-		//printf ("pending: %s\n", pending_preview_filename);
-		peony_navigation_window_set_pending_preview_file_by_window_info (window, pending_preview_filename);
-		g_free (pending_preview_filename);
-		pending_preview_filename = peony_navigation_window_get_pending_preview_file_by_window_info (window);
-		//printf ("pending: %s\n", pending_preview_filename);
-
-		gboolean use_unoconv = FALSE;
-		if (g_find_program_in_path ("unoconv"))
-			use_unoconv = TRUE;
-
-		if (is_excel_doc(filename)) {
-			//printf ("is excel\n");
-			pending_preview_filename = get_html_tmp_name(filename);
-			if (!use_unoconv)
-				excel2html_by_window_internal (window, pending_preview_filename, doing_filename);
-			else
-				excel2html_by_window_internal_unoconv (window, pending_preview_filename, doing_filename);
-		} else {
-			//printf ("is doc or ppt\n");
-			pending_preview_filename = get_pdf_tmp_name(filename);
-			if (!use_unoconv)
-				office2pdf_by_window_internal (window, pending_preview_filename, doing_filename);
-			else
-				office2pdf_by_window_internal_unoconv (window, pending_preview_filename, doing_filename);
-		}		
-	} else {
-		todo_filename = peony_navigation_window_get_current_previewing_office_file_by_window_info (window);
-		//do nothing
-		//g_signal_connect (window, "office_trans_ready", G_CALLBACK (trans_next_file), todo_filename);
+static void
+trim_cache_thread (GTask *task,
+		   gpointer source_object,
+		   gpointer task_data,
+		   GCancellable *cancellable)
+{
+	char *cache_dir;
+	GDir *dir;
+	const char *name;
+	GList *entries, *l;
+	CacheEntry *entry;
+	struct stat info;
+	goffset total;
+	time_t now;
+
+	cache_dir = get_cache_dir ();
+	now = time (NULL);
+
+	entries = NULL;
+	total = 0;
+	dir = g_dir_open (cache_dir, 0, NULL);
+	if (dir != NULL) {
+		while ((name = g_dir_read_name (dir)) != NULL) {
+			entry = g_new0 (CacheEntry, 1);
+			entry->path = g_build_filename (cache_dir, name, NULL);
+
+			if (g_lstat (entry->path, &info) != 0) {
+				g_free (entry->path);
+				g_free (entry);
+				continue;
+			}
+
+			if (g_str_has_suffix (name, ".part")) {
+				if (now - info.st_mtime > STALE_PART_AGE) {
+					remove_recursively (entry->path);
+				}
+				g_free (entry->path);
+				g_free (entry);
+				continue;
+			}
+
+			/* Showing a preview touches its directory */
+			entry->last_used = info.st_mtime;
+			entry->size = get_size_recursively (entry->path, &info);
+			total += entry->size;
+			entries = g_list_prepend (entries, entry);
+		}
+		g_dir_close (dir);
 	}
+
+	entries = g_list_sort (entries, compare_cache_entries_by_age);
+	for (l = entries; l != NULL && total > PREVIEW_CACHE_MAX_SIZE; l = l->next) {
+		entry = l->data;
+		remove_recursively (entry->path);
+		total -= entry->size;
+	}
+
+	for (l = entries; l != NULL; l = l->next) {
+		entry = l->data;
+		g_free (entry->path);
+		g_free (entry);
+	}
+	g_list_free (entries);
+	g_free (cache_dir);
+
+	g_task_return_boolean (task, TRUE);
 }
 
-char* get_html_tmp_name (char* filename){
-	gchar *doc_path, *doc_name, *tmp_name, *html_dir, *html_path;
-	GFile *file;
-	gboolean res;
-	gchar *cmd;
-
-	gint argc;
-	GPid pid;
-	gchar **argv = NULL;
-	GError *error = NULL;
-	const gchar *libreoffice_path;
-
-	libreoffice_path = g_find_program_in_path ("libreoffice");
-	if (libreoffice_path == NULL) {
-		//printf("libreoffice is not found\n");
-		//openoffice_missing_libreoffice (self);
-		return NULL;
+static void trim_cache (void);
+
+static void
+trim_cache_done (GObject *source_object,
+		 GAsyncResult *result,
+		 gpointer user_data)
+{
+	cache_trim_running = FALSE;
+
+	if (cache_trim_again) {
+		trim_cache ();
 	}
+}
 
-	//printf("pid: %d\n",getpid());
+static void
+trim_cache (void)
+{
+	GTask *task;
 
-	file = g_file_new_for_path(filename);
-	doc_path = g_file_get_path (file);
-	doc_name = g_file_get_basename (file);
-	g_object_unref (file);
-	tmp_name = g_strrstr (doc_name, ".");
-	if (tmp_name){
-		*tmp_name = '\0';
+	if (cache_trim_running) {
+		cache_trim_again = TRUE;
+		return;
 	}
-	tmp_name = g_strdup_printf ("%s.html", doc_name);
-	g_free (doc_name);
 
-	html_dir = g_build_filename (g_get_user_cache_dir (), "peony", NULL);
-	html_path = g_build_filename (html_dir, tmp_name, NULL);
+	cache_trim_running = TRUE;
+	cache_trim_again = FALSE;
 
-	return html_path;
+	task = g_task_new (NULL, NULL, trim_cache_done, NULL);
+	g_task_run_in_thread (task, trim_cache_thread);
+	g_object_unref (task);
 }
 
-char* get_pdf_tmp_name(char* filename){
-	gchar *doc_path, *doc_name, *tmp_name, *pdf_dir, *pdf_path;
-	GFile *file;
-	gboolean res;
-	gchar *cmd;
-
-	gint argc;
-	GPid pid;
-	gchar **argv = NULL;
-	GError *error = NULL;
-	const gchar *libreoffice_path;
-
-	libreoffice_path = g_find_program_in_path ("libreoffice");
-	if (libreoffice_path == NULL) {
-		//printf("libreoffice is not found\n");
-		//openoffice_missing_libreoffice (self);
-		return NULL;
+/* The office listener, one LibreOffice kept running for all conversions */
+
+static void
+child_setup (gpointer user_data)
+{
+	/* Own process group, so the office processes it starts can be
+	 * stopped along with it, and don't outlive us.
+	 */
+	setpgid (0, 0);
+	prctl (PR_SET_PDEATHSIG, SIGTERM);
+}
+
+static void
+listener_exited (GPid pid,
+		 gint status,
+		 gpointer user_data)
+{
+	g_spawn_close_pid (pid);
+
+	if (pid == listener_pid) {
+		listener_pid = 0;
 	}
+}
 
-	//printf("pid: %d\n",getpid());
+static void
+stop_listener (void)
+{
+	if (listener_idle_id != 0) {
+		g_source_remove (listener_idle_id);
+		listener_idle_id = 0;
+	}
 
-	file = g_file_new_for_path(filename);
-	doc_path = g_file_get_path (file);
-	doc_name = g_file_get_basename (file);
-	g_object_unref (file);
-	tmp_name = g_strrstr (doc_name, ".");
-	if (tmp_name){
-		*tmp_name = '\0';
+	if (listener_pid != 0) {
+		kill (-listener_pid, SIGTERM);
+		listener_pid = 0;
 	}
-	tmp_name = g_strdup_printf ("%s.pdf", doc_name);
-	g_free (doc_name);
+}
 
-	pdf_dir = g_build_filename (g_get_user_cache_dir (), "peony", NULL);
-	pdf_path = g_build_filename (pdf_dir, tmp_name, NULL);
+static gboolean
+listener_idle_timeout (gpointer user_data)
+{
+	listener_idle_id = 0;
+	stop_listener ();
 
-	return pdf_path;
+	return FALSE;
 }
 
-char* get_pending_preview_filename (char* filename){
-	if (is_excel_doc(filename)) {
-		//printf ("is excel\n");
-		return get_html_tmp_name(filename);
+static void
+ensure_listener (void)
+{
+	static gboolean registered_shutdown = FALSE;
+	char *connection;
+	char *argv[5];
+	GError *error;
+
+	if (listener_idle_id != 0) {
+		g_source_remove (listener_idle_id);
+		listener_idle_id = 0;
+	}
+
+	if (listener_pid != 0) {
+		return;
+	}
+
+	connection = get_listener_connection ();
+
+	argv[0] = "unoconv";
+	argv[1] = "--listener";
+	argv[2] = "--connection";
+	argv[3] = connection;
+	argv[4] = NULL;
+
+	error = NULL;
+	if (!g_spawn_async (NULL, argv, NULL,
+			    G_SPAWN_DO_NOT_REAP_CHILD |
+			    G_SPAWN_SEARCH_PATH |
+			    G_SPAWN_STDOUT_TO_DEV_NULL |
+			    G_SPAWN_STDERR_TO_DEV_NULL,
+			    child_setup, NULL,
+			    &listener_pid, &error)) {
+		/* Each unoconv will start its own office then */
+		g_warning ("Error while spawning the unoconv listener: %s",
+			   error->message);
+		g_error_free (error);
+		listener_pid = 0;
 	} else {
-		//printf ("is doc or ppt\n");
-		return get_pdf_tmp_name(filename);
+		g_child_watch_add (listener_pid, listener_exited, NULL);
+	}
+
+	if (!registered_shutdown) {
+		eel_debug_call_at_shutdown (stop_listener);
+		registered_shutdown = TRUE;
 	}
+
+	g_free (connection);
 }
 
-libreoffice_child_watch_cb2 (GPid pid,
-                        gint status,
-                        gpointer user_data)
+/* Jobs */
+
+static void
+office_job_set_window (OfficeJob *job, PeonyWindowInfo *window)
 {
-	g_spawn_close_pid (pid);
-	is_busy = FALSE;
-	g_signal_emit_by_name (PEONY_WINDOW_INFO (user_data), "office_trans_ready", NULL);    //office ready cb , if pdf name = global preview file name, show it. else g_remove file.
+	if (job->window == window) {
+		return;
+	}
+
+	if (job->window != NULL) {
+		g_object_remove_weak_pointer (G_OBJECT (job->window), (gpointer *) &job->window);
+	}
+	job->window = window;
+	if (job->window != NULL) {
+		g_object_add_weak_pointer (G_OBJECT (job->window), (gpointer *) &job->window);
+	}
 }
 
-void office2pdf_by_window_internal (PeonyWindowInfo *window, char *pdf_filename, char* office_filename){
+static OfficeJob *
+office_job_new (const char *source, const char *output)
+{
+	OfficeJob *job;
 
-	gchar *doc_path, *doc_name, *tmp_name, *pdf_dir, *pdf_path;
-	GFile *file;
-	gboolean res;
-	gchar *cmd;
-
-	gint argc;
-	GPid pid;
-	gchar **argv = NULL;
-	GError *error = NULL;
-	const gchar *libreoffice_path;
-	
-		libreoffice_path = g_find_program_in_path ("libreoffice");
-	if (libreoffice_path == NULL) {
-		//printf("libreoffice is not found\n");
-		return ;
-	}
-
-	//printf("pid: %d\n",getpid());
-
-	file = g_file_new_for_path(office_filename);
-	doc_path = g_file_get_path (file);
-	doc_name = g_file_get_basename (file);
-	g_object_unref (file);
-	tmp_name = g_strrstr (doc_name, ".");
-	if (tmp_name){
-		*tmp_name = '\0';
-	}
-	tmp_name = g_strdup_printf ("%s.pdf", doc_name);
-	g_free (doc_name);
-
-	//printf("tmp_name: %s\n",tmp_name);
-	pdf_dir = g_build_filename (g_get_user_cache_dir (), "peony", NULL);
-	pdf_path = g_build_filename (pdf_dir, tmp_name, NULL);
-	g_mkdir_with_parents (pdf_dir, 0700);
-
-	g_free (tmp_name);
-
-	const gchar *libreoffice_argv[] = {
-		NULL,
-		"--convert-to", "pdf",
-		"--outdir", NULL,
-		NULL,
-		NULL
-	};
-
-	libreoffice_argv[0] = libreoffice_path;
-	libreoffice_argv[4] = pdf_dir;
-	libreoffice_argv[5] = doc_path;
-
-	argv = g_strdupv ((gchar **) libreoffice_argv);
-
-	res = g_spawn_async (NULL, (gchar **) argv, NULL,
-			G_SPAWN_DO_NOT_REAP_CHILD |
-			G_SPAWN_SEARCH_PATH,
-			NULL, NULL,
-			&pid, &error);
-
-	g_free(pdf_dir);
-	g_free(doc_path);
-	g_free (libreoffice_path);
-	g_strfreev (argv);
+	job = g_new0 (OfficeJob, 1);
+	job->source = g_strdup (source);
+	job->output = g_strdup (output);
+	job->key_dir = g_path_get_dirname (output);
+	job->is_excel = is_excel_doc ((char *) source);
 
-	if (!res) {
-		g_warning ("Error while spawning libreoffice: %s",
-				error->message);
-		g_error_free (error);
+	return job;
+}
 
-		return ;
+static void
+office_job_free (OfficeJob *job)
+{
+	office_job_set_window (job, NULL);
+	g_free (job->source);
+	g_free (job->output);
+	g_free (job->key_dir);
+	g_free (job);
+}
+
+static OfficeJob *
+find_job (const char *key_dir)
+{
+	GList *l;
+	OfficeJob *job;
+
+	if (running_job != NULL && !running_job_cancelled &&
+	    strcmp (running_job->key_dir, key_dir) == 0) {
+		return running_job;
 	}
 
-	g_child_watch_add (pid, libreoffice_child_watch_cb2, window);
+	for (l = job_queue.head; l != NULL; l = l->next) {
+		job = l->data;
+		if (strcmp (job->key_dir, key_dir) == 0) {
+			return job;
+		}
+	}
 
+	return NULL;
 }
 
-void excel2html_by_window_internal (PeonyWindowInfo *window, char *html_filename, char *excel_filename){
+static void
+cancel_running_job (void)
+{
+	if (running_job == NULL || running_job_cancelled) {
+		return;
+	}
 
-	gchar *doc_path, *doc_name, *tmp_name, *html_dir, *html_path;
-	GFile *file;
-	gboolean res;
-	gchar *cmd;
-
-	gint argc;
-	GPid pid;
-	gchar **argv = NULL;
-	GError *error = NULL;
-	const gchar *libreoffice_path;
-	
-		libreoffice_path = g_find_program_in_path ("libreoffice");
-	if (libreoffice_path == NULL) {
-		//printf("libreoffice is not found\n");
-		return ;
-	}
-
-	//printf("pid: %d\n",getpid());
-
-	file = g_file_new_for_path(excel_filename);
-	doc_path = g_file_get_path (file);
-	doc_name = g_file_get_basename (file);
-	g_object_unref (file);
-	tmp_name = g_strrstr (doc_name, ".");
-	if (tmp_name){
-		*tmp_name = '\0';
-	}
-	tmp_name = g_strdup_printf ("%s.html", doc_name);
-	g_free (doc_name);
-
-	//printf("tmp_name: %s\n",tmp_name);
-	html_dir = g_build_filename (g_get_user_cache_dir (), "peony", NULL);
-	html_path = g_build_filename (html_dir, tmp_name, NULL);
-	g_mkdir_with_parents (html_dir, 0700);
-
-	g_free (tmp_name);
-
-	const gchar *libreoffice_argv[] = {
-		NULL,
-		"--convert-to", "html",
-		"--outdir", NULL,
-		NULL,
-		NULL
-	};
-
-	libreoffice_argv[0] = libreoffice_path;
-	libreoffice_argv[4] = html_dir;
-	libreoffice_argv[5] = doc_path;
-
-	argv = g_strdupv ((gchar **) libreoffice_argv);
-
-	res = g_spawn_async (NULL, (gchar **) argv, NULL,
-			G_SPAWN_DO_NOT_REAP_CHILD |
-			G_SPAWN_SEARCH_PATH,
-			NULL, NULL,
-			&pid, &error);
-
-	g_free(html_dir);
-	g_free(doc_path);
-	g_free (libreoffice_path);
-	g_strfreev (argv);
+	running_job_cancelled = TRUE;
 
-	if (!res) {
-		g_warning ("Error while spawning libreoffice: %s",
-				error->message);
-		g_error_free (error);
+	/* Only the unoconv client is stopped. The listener's office may
+	 * still finish the document it was handed, the next job waits for
+	 * that rather than for a whole new office to start.
+	 */
+	kill (-running_pid, SIGTERM);
+}
 
-		return ;
+/* The conversion goes to key_dir.part and is moved in place when it
+ * succeeds, so a preview directory is always complete.
+ */
+static gboolean
+finish_output (OfficeJob *job, const char *part_dir)
+{
+	char *base, *stem, *dot, *converted_name, *converted, *preview;
+	gboolean success;
+
+	base = g_path_get_basename (job->output);
+	preview = g_build_filename (part_dir, base, NULL);
+	g_free (base);
+
+	if (!g_file_test (preview, G_FILE_TEST_EXISTS)) {
+		/* libreoffice names the output after the document */
+		stem = g_path_get_basename (job->source);
+		dot = strrchr (stem, '.');
+		if (dot != NULL) {
+			*dot = '\0';
+		}
+		converted_name = g_strdup_printf ("%s.%s", stem, job->is_excel ? "html" : "pdf");
+		converted = g_build_filename (part_dir, converted_name, NULL);
+		g_rename (converted, preview);
+		g_free (converted);
+		g_free (converted_name);
+		g_free (stem);
 	}
 
-	g_child_watch_add (pid, libreoffice_child_watch_cb2, window);
+	success = g_file_test (preview, G_FILE_TEST_EXISTS);
+	g_free (preview);
+
+	if (success) {
+		remove_recursively (job->key_dir);
+		success = g_rename (part_dir, job->key_dir) == 0;
+	}
 
+	return success;
 }
 
 static void
-unoconv_child_watch_cb2 (GPid pid,
-                        gint status,
-                        gpointer user_data)
+job_exited (GPid pid,
+	    gint status,
+	    gpointer user_data)
 {
+	OfficeJob *job;
+	char *part_dir;
+	gboolean success;
+
 	g_spawn_close_pid (pid);
-	is_busy = FALSE;
-	g_signal_emit_by_name (PEONY_WINDOW_INFO (user_data), "office_trans_ready", NULL);    //office ready cb , if pdf name = global preview file name, show it. else g_remove file.
-}
 
-void office2pdf_by_window_internal_unoconv (PeonyWindowInfo *window, char *pdf_filename, char* office_filename){
+	job = running_job;
+	running_job = NULL;
+	running_pid = 0;
 
-	gboolean res;
-	gchar *cmd;
-
-	gint argc;
-	GPid pid;
-	gchar **argv = NULL;
-	GError *error = NULL;
-	const gchar *unoconv_path;
-	char* pdf_file_quoted_path = g_shell_quote (pdf_filename);
-	char* office_file_quoted_path = g_shell_quote (office_filename);
-
-	cmd = g_strdup_printf ("unoconv -f pdf -o %s %s", pdf_file_quoted_path, office_file_quoted_path);
-	printf("cmd: %s\n",cmd);
-	
-	res = g_shell_parse_argv (cmd, &argc, &argv, &error);
-	//g_free (cmd);
-	g_free (pdf_file_quoted_path);
-	g_free (office_file_quoted_path);
+	part_dir = g_strconcat (job->key_dir, ".part", NULL);
 
-	if (!res) {
-		g_warning ("Error while parsing the unoconv command line: %s",
-				error->message);
-		g_error_free (error);
+	success = !running_job_cancelled &&
+		g_spawn_check_exit_status (status, NULL) &&
+		finish_output (job, part_dir);
+	running_job_cancelled = FALSE;
 
-		return NULL;
+	if (!success) {
+		remove_recursively (part_dir);
+	}
+	g_free (part_dir);
+
+	if (success) {
+		trim_cache ();
+		if (job->window != NULL) {
+			/* office ready cb, if pdf name = global preview file name, show it. */
+			g_signal_emit_by_name (job->window, "office_trans_ready", NULL);
+		}
+	}
+
+	office_job_free (job);
+
+	start_next_job ();
+}
+
+static gboolean
+spawn_job (OfficeJob *job, const char *part_dir)
+{
+	char *argv[12];
+	char *output, *connection, *profile, *profile_uri, *profile_arg;
+	const char *format;
+	GError *error;
+	gboolean res;
+	int i;
+
+	format = job->is_excel ? "html" : "pdf";
+	output = NULL;
+	connection = NULL;
+	profile_arg = NULL;
+
+	i = 0;
+	if (have_unoconv ()) {
+		ensure_listener ();
+
+		connection = get_listener_connection ();
+		output = g_build_filename (part_dir, job->is_excel ? "preview.html" : "preview.pdf", NULL);
+
+		argv[i++] = "unoconv";
+		argv[i++] = "--connection";
+		argv[i++] = connection;
+		argv[i++] = "--timeout";
+		argv[i++] = LISTENER_CONNECT_TIMEOUT;
+		argv[i++] = "-f";
+		argv[i++] = (char *) format;
+		argv[i++] = "-o";
+		argv[i++] = output;
+	} else {
+		/* A profile of our own, so this works while the user has
+		 * LibreOffice open.
+		 */
+		profile = g_build_filename (g_get_user_cache_dir (), "peony", "office-profile", NULL);
+		profile_uri = g_filename_to_uri (profile, NULL, NULL);
+		profile_arg = g_strconcat ("-env:UserInstallation=", profile_uri, NULL);
+		g_free (profile_uri);
+		g_free (profile);
+
+		argv[i++] = "libreoffice";
+		argv[i++] = profile_arg;
+		argv[i++] = "--headless";
+		argv[i++] = "--convert-to";
+		argv[i++] = (char *) format;
+		argv[i++] = "--outdir";
+		argv[i++] = (char *) part_dir;
 	}
+	argv[i++] = job->source;
+	argv[i++] = NULL;
 
+	error = NULL;
 	res = g_spawn_async (NULL, argv, NULL,
-			G_SPAWN_DO_NOT_REAP_CHILD |
-			G_SPAWN_SEARCH_PATH,
-			NULL, NULL,
-			&pid, &error);
+			     G_SPAWN_DO_NOT_REAP_CHILD |
+			     G_SPAWN_SEARCH_PATH |
+			     G_SPAWN_STDOUT_TO_DEV_NULL,
+			     child_setup, NULL,
+			     &running_pid, &error);
 
-	g_strfreev (argv);
+	g_free (output);
+	g_free (connection);
+	g_free (profile_arg);
 
 	if (!res) {
-		g_warning ("Error while spawning unoconv: %s",
-				error->message);
+		g_warning ("Error while spawning %s: %s",
+			   argv[0], error->message);
 		g_error_free (error);
+		return FALSE;
+	}
 
-		return NULL;
+	g_child_watch_add (running_pid, job_exited, NULL);
+
+	return TRUE;
+}
+
+static void
+start_next_job (void)
+{
+	OfficeJob *job;
+	char *part_dir;
+
+	while (running_job == NULL && !g_queue_is_empty (&job_queue)) {
+		job = g_queue_pop_head (&job_queue);
+
+		if (g_file_test (job->output, G_FILE_TEST_EXISTS)) {
+			if (job->window != NULL) {
+				g_signal_emit_by_name (job->window, "office_trans_ready", NULL);
+			}
+			office_job_free (job);
+			continue;
+		}
+
+		part_dir = g_strconcat (job->key_dir, ".part", NULL);
+		remove_recursively (part_dir);
+		g_mkdir_with_parents (part_dir, 0700);
+
+		running_job = job;
+		running_job_cancelled = FALSE;
+		if (!spawn_job (job, part_dir)) {
+			running_job = NULL;
+			remove_recursively (part_dir);
+			office_job_free (job);
+		}
+
+		g_free (part_dir);
 	}
 
-	g_child_watch_add (pid, unoconv_child_watch_cb2, window);
+	if (running_job == NULL && listener_pid != 0 && listener_idle_id == 0) {
+		listener_idle_id = g_timeout_add_seconds (LISTENER_IDLE_TIMEOUT,
+							  listener_idle_timeout, NULL);
+	}
+}
 
-	//g_spawn_close_pid(pid);
+/* Cache hits are reported from an idle, after the caller has set up
+ * its "Loading..." state, like a finished conversion would be.
+ */
+static gboolean
+emit_ready_idle (gpointer data)
+{
+	GWeakRef *ref;
+	GObject *window;
+
+	ref = data;
+	window = g_weak_ref_get (ref);
+	if (window != NULL) {
+		g_signal_emit_by_name (window, "office_trans_ready", NULL);
+		g_object_unref (window);
+	}
+
+	g_weak_ref_clear (ref);
+	g_free (ref);
+
+	return FALSE;
 }
 
-void excel2html_by_window_internal_unoconv (PeonyWindowInfo *window, char *html_filename, char *excel_filename){
+static void
+emit_ready_later (PeonyWindowInfo *window)
+{
+	GWeakRef *ref;
 
-	gboolean res;
-	gchar *cmd;
-
-	gint argc;
-	GPid pid;
-	gchar **argv = NULL;
-	GError *error = NULL;
-	const gchar *unoconv_path;
-	char* html_file_quoted_path = g_shell_quote (html_filename);
-	char* excel_file_quoted_path = g_shell_quote (excel_filename);
-
-	cmd = g_strdup_printf ("unoconv -f html -o %s %s", html_file_quoted_path, excel_file_quoted_path);
-	printf("cmd: %s\n",cmd);	
-	
-	res = g_shell_parse_argv (cmd, &argc, &argv, &error);
-	//g_free (cmd);
-	g_free (html_file_quoted_path);
-	g_free (excel_file_quoted_path);
+	ref = g_new0 (GWeakRef, 1);
+	g_weak_ref_init (ref, window);
+	g_idle_add (emit_ready_idle, ref);
+}
 
-	if (!res) {
-		g_warning ("Error while parsing the unoconv command line: %s",
-				error->message);
-		g_error_free (error);
+/* Drops what window asked for before, unless it's key_dir */
+static void
+forget_window_jobs (PeonyWindowInfo *window, const char *key_dir)
+{
+	GList *l, *next;
+	OfficeJob *job;
 
-		return NULL;
+	for (l = job_queue.head; l != NULL; l = next) {
+		next = l->next;
+		job = l->data;
+
+		if (job->window != window || strcmp (job->key_dir, key_dir) == 0) {
+			continue;
+		}
+
+		if (job->speculative) {
+			office_job_set_window (job, NULL);
+		} else {
+			g_queue_delete_link (&job_queue, l);
+			office_job_free (job);
+		}
 	}
 
-	res = g_spawn_async (NULL, argv, NULL,
-			G_SPAWN_DO_NOT_REAP_CHILD |
-			G_SPAWN_SEARCH_PATH,
-			NULL, NULL,
-			&pid, &error);
+	if (running_job != NULL && running_job->window == window &&
+	    strcmp (running_job->key_dir, key_dir) != 0) {
+		if (running_job->speculative) {
+			office_job_set_window (running_job, NULL);
+		} else {
+			cancel_running_job ();
+		}
+	}
+}
 
-	g_strfreev (argv);
+gboolean is_office_busy(){
+	return running_job != NULL;
+}
 
-	if (!res) {
-		g_warning ("Error while spawning unoconv: %s",
-				error->message);
-		g_error_free (error);
+char* get_pending_preview_filename (char* filename){
+	struct stat info;
+	char *key, *hash, *cache_dir, *key_dir, *output;
+
+	if (!have_unoconv () && !have_libreoffice ()) {
+		return NULL;
+	}
 
+	if (g_stat (filename, &info) != 0) {
 		return NULL;
 	}
 
-	g_child_watch_add (pid, unoconv_child_watch_cb2, window);
+	key = g_strdup_printf ("%s\n%" G_GINT64_FORMAT "\n%" G_GINT64_FORMAT ".%ld",
+			       filename,
+			       (gint64) info.st_size,
+			       (gint64) info.st_mtim.tv_sec,
+			       (long) info.st_mtim.tv_nsec);
+	hash = g_compute_checksum_for_string (G_CHECKSUM_SHA1, key, -1);
+
+	cache_dir = get_cache_dir ();
+	key_dir = g_build_filename (cache_dir, hash, NULL);
+	output = g_build_filename (key_dir,
+				   is_excel_doc (filename) ? "preview.html" : "preview.pdf",
+				   NULL);
+
+	g_free (key_dir);
+	g_free (cache_dir);
+	g_free (hash);
+	g_free (key);
+
+	return output;
+}
+
+void prepare_to_trans_file_by_window (PeonyWindowInfo* window, char* filename) {
+	char *output, *key_dir, *cache_dir;
+	OfficeJob *job;
+
+	output = get_pending_preview_filename (filename);
+	peony_navigation_window_set_pending_preview_file_by_window_info (window, output);
+
+	if (output == NULL) {
+		return;
+	}
+
+	key_dir = g_path_get_dirname (output);
+	forget_window_jobs (window, key_dir);
+
+	if (g_file_test (output, G_FILE_TEST_EXISTS)) {
+		/* Keeps it out of the way of the cache trimming */
+		utime (key_dir, NULL);
+		emit_ready_later (window);
+	} else {
+		job = find_job (key_dir);
+		if (job == NULL) {
+			job = office_job_new (filename, output);
+			g_queue_push_head (&job_queue, job);
+		} else if (job != running_job) {
+			/* Asked for ahead of time, now someone needs it first */
+			g_queue_remove (&job_queue, job);
+			g_queue_push_head (&job_queue, job);
+		}
+		job->speculative = FALSE;
+		office_job_set_window (job, window);
+
+		cache_dir = get_cache_dir ();
+		g_mkdir_with_parents (cache_dir, 0700);
+		g_free (cache_dir);
+
+		start_next_job ();
+	}
+
+	g_free (key_dir);
+	g_free (output);
+}
+
+void office_utils_prefetch_files (GList *filenames) {
+	GList *l, *next;
+	OfficeJob *job;
+	char *output, *key_dir, *cache_dir;
+	int count;
+
+	/* What was prefetched for an earlier selection is not interesting anymore */
+	for (l = job_queue.head; l != NULL; l = next) {
+		next = l->next;
+		job = l->data;
+		if (job->speculative && job->window == NULL) {
+			g_queue_delete_link (&job_queue, l);
+			office_job_free (job);
+		}
+	}
+
+	count = 0;
+	for (l = filenames; l != NULL && count < MAX_PREFETCH_FILES; l = l->next) {
+		if (!is_office_file (l->data)) {
+			continue;
+		}
+
+		output = get_pending_preview_filename (l->data);
+		if (output == NULL) {
+			continue;
+		}
+
+		key_dir = g_path_get_dirname (output);
+		if (!g_file_test (output, G_FILE_TEST_EXISTS) && find_job (key_dir) == NULL) {
+			job = office_job_new (l->data, output);
+			job->speculative = TRUE;
+			g_queue_push_tail (&job_queue, job);
+		}
+		count++;
+
+		g_free (key_dir);
+		g_free (output);
+	}
+
+	if (!g_queue_is_empty (&job_queue)) {
+		cache_dir = get_cache_dir ();
+		g_mkdir_with_parents (cache_dir, 0700);
+		g_free (cache_dir);
 
+		start_next_job ();
+	}
 }
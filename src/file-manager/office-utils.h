@@ -24,13 +24,19 @@
 #include <glib/gstdio.h>
 #include "navigation-window-interface.h"
 
+/* Where the preview of filename ends up once converted, NULL if it can't be */
 char* get_pending_preview_filename (char* filename);
 gboolean is_office_busy();
 
-void office_utils_conncet_window_info (PeonyWindowInfo *window_info);
-void office_utils_disconnect_window_info (PeonyWindowInfo *window_info);
+/* Converts filename for window, which gets "office_trans_ready" when done.
+ * Conversions the window asked for before and no longer needs are dropped.
+ */
+void prepare_to_trans_file_by_window (PeonyWindowInfo* window, char* filename);
 
-void clean_cache_files_anyway (); 
+/* Converts the office files among filenames in the background, after
+ * anything a window is waiting for, so they show at once when selected.
+ */
+void office_utils_prefetch_files (GList *filenames);
 
 static char* office_mime_types[] = {
     "application/wps-office.doc",
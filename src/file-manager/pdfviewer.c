@@ -21,53 +21,166 @@
  */
 
 #include "pdfviewer.h"
+#include <string.h>
+#include <glib/gstdio.h>
 
-static gboolean is_busy;
+/* Documents recently shown keep their loaded document and position, so
+ * going back to one is instant.
+ */
+#define DOCUMENT_CACHE_SIZE 8
+
+/* Selection changes closer together than this only load the last one */
+#define PREVIEW_DELAY_MSEC 150
+
+#define PENDING_LOAD_KEY "peony-pdf-preview-load"
+#define PREVIEW_DELAY_KEY "peony-pdf-preview-delay"
+
+typedef struct {
+	char *uri;
+	time_t mtime;
+	EvDocumentModel *model;
+} CachedDocument;
+
+typedef struct {
+	EvJob *job;
+	EvDocumentModel *model;
+	char *uri;
+	time_t mtime;
+} PendingLoad;
+
+/* Most recently shown first */
+static GQueue document_cache = G_QUEUE_INIT;
 
 static void window_show_pdf_file (PeonyWindowInfo *window) {
 	g_signal_emit_by_name (window, "show_pdf_file", NULL);
 }
 
+static gboolean
+get_uri_and_mtime (char *filename, char **uri, time_t *mtime)
+{
+	GFile *file;
+	struct stat info;
+
+	if (g_stat (filename, &info) != 0) {
+		return FALSE;
+	}
+
+	file = g_file_new_for_commandline_arg (filename);
+	*uri = g_file_get_uri (file);
+	g_object_unref (file);
+	*mtime = info.st_mtime;
+
+	return TRUE;
+}
+
 static void
-ev_previewer_load_job_finished (EvJob           *job,
-				EvDocumentModel *model)
+cached_document_free (CachedDocument *cached)
 {
-	if (ev_job_is_failed (job)) {
-		g_warning ("%s", job->error->message);
-		g_object_unref (job);
+	g_free (cached->uri);
+	g_object_unref (cached->model);
+	g_free (cached);
+}
 
-		return;
+static GList *
+find_cached_document (const char *uri, time_t mtime)
+{
+	GList *l;
+	CachedDocument *cached;
+
+	for (l = document_cache.head; l != NULL; l = l->next) {
+		cached = l->data;
+		if (cached->mtime == mtime && strcmp (cached->uri, uri) == 0) {
+			return l;
+		}
 	}
 
-	//printf ("ev_document_model_set_document\n");
-	if (EV_IS_DOCUMENT_MODEL(model) && EV_IS_DOCUMENT (job->document)){
-		ev_document_model_set_document (model, job->document);
-		//g_message ("ev_previewer_load_job_finished");
+	return NULL;
+}
+
+static CachedDocument *
+lookup_cached_document (const char *uri, time_t mtime)
+{
+	GList *l;
+
+	l = find_cached_document (uri, mtime);
+	if (l == NULL) {
+		return NULL;
+	}
+
+	g_queue_unlink (&document_cache, l);
+	g_queue_push_head_link (&document_cache, l);
+
+	return l->data;
+}
+
+static void
+add_cached_document (const char *uri, time_t mtime, EvDocumentModel *model)
+{
+	CachedDocument *cached;
+
+	cached = g_new0 (CachedDocument, 1);
+	cached->uri = g_strdup (uri);
+	cached->mtime = mtime;
+	cached->model = g_object_ref (model);
+	g_queue_push_head (&document_cache, cached);
+
+	while (g_queue_get_length (&document_cache) > DOCUMENT_CACHE_SIZE) {
+		cached_document_free (g_queue_pop_tail (&document_cache));
+	}
+}
+
+static void
+pending_load_free (PendingLoad *load)
+{
+	g_object_unref (load->model);
+	g_free (load->uri);
+	g_free (load);
+}
+
+static void
+ev_previewer_load_job_finished (EvJob     *job,
+				GtkWidget *view)
+{
+	PendingLoad *load;
+
+	load = g_object_get_data (G_OBJECT (view), PENDING_LOAD_KEY);
+	g_assert (load != NULL && load->job == job);
+
+	if (ev_job_is_failed (job)) {
+		g_warning ("%s", job->error->message);
+	} else if (EV_IS_DOCUMENT (job->document)) {
+		//printf ("ev_document_model_set_document\n");
+		ev_document_model_set_document (load->model, job->document);
+		add_cached_document (load->uri, load->mtime, load->model);
 	}
 
+	g_signal_handlers_disconnect_by_func (job, ev_previewer_load_job_finished, view);
 	g_object_unref (job);
+	g_object_set_data (G_OBJECT (view), PENDING_LOAD_KEY, NULL);
 }
 
+/* The document is opened by the atril job scheduler, off the main thread */
 static void
-ev_previewer_load_document (char     *filename,
+ev_previewer_load_document (GtkWidget       *view,
+			    char            *uri,
+			    time_t           mtime,
 			    EvDocumentModel *model)
 {
-	//g_message ("ev_previewer_load_document: %s", filename);
-	EvJob *job;
-	gchar *uri;
-	GFile  *file;
+	PendingLoad *load;
 
-	file = g_file_new_for_commandline_arg (filename);
-	uri = g_file_get_uri (file);
-	g_object_unref (file);
+	load = g_new0 (PendingLoad, 1);
+	load->job = ev_job_load_new (uri);
+	load->model = g_object_ref (model);
+	load->uri = g_strdup (uri);
+	load->mtime = mtime;
+	g_object_set_data_full (G_OBJECT (view), PENDING_LOAD_KEY,
+				load, (GDestroyNotify) pending_load_free);
 
-	//printf ("ev_job_load_new\n");
-	job = ev_job_load_new (uri);
-	g_signal_connect (job, "finished",
+	g_signal_connect (load->job, "finished",
 			  G_CALLBACK (ev_previewer_load_job_finished),
-			  model);
-	ev_job_scheduler_push_job (job, EV_JOB_PRIORITY_NONE);
-	g_free (uri);
+			  view);
+	/* What is being looked at goes ahead of anything atril has queued */
+	ev_job_scheduler_push_job (load->job, EV_JOB_PRIORITY_URGENT);
 }
 
 void pdf_viewer_init(){
@@ -76,6 +189,8 @@ void pdf_viewer_init(){
 }
 
 void pdf_viewer_shutdown(){
+	g_queue_foreach (&document_cache, (GFunc) cached_document_free, NULL);
+	g_queue_clear (&document_cache);
     ev_shutdown ();
 }
 
@@ -95,17 +210,10 @@ gboolean is_pdf_file(char* name){
 //NOTE: you must use this widget in a gtk_scrolled_window
 
 GtkWidget* get_pdf_previewer_by_filename(char* filename){
-	EvDocumentModel *model;
 	GtkWidget *widget;
-	model = ev_document_model_new ();
-
-	//ev_document_model_set_page_layout(model, EV_PAGE_LAYOUT_AUTOMATIC);
-	ev_document_model_set_continuous(model, TRUE);
-	ev_previewer_load_document (filename, model);
 
 	widget = ev_view_new();
-	ev_view_set_model(EV_VIEW(widget), model);
-	g_object_unref (model);
+	set_pdf_preview_widget_file_by_filename (widget, filename);
 
 	return widget;
 }
@@ -114,73 +222,90 @@ GtkWidget* pdf_preview_widget_new(){
 	return ev_view_new();
 }
 
+void pdf_preview_widget_cancel_load (GtkWidget *widget) {
+	PendingLoad *load;
+
+	load = g_object_get_data (G_OBJECT (widget), PENDING_LOAD_KEY);
+	if (load == NULL) {
+		return;
+	}
+
+	g_signal_handlers_disconnect_by_func (load->job, ev_previewer_load_job_finished, widget);
+	ev_job_cancel (load->job);
+	g_object_unref (load->job);
+	g_object_set_data (G_OBJECT (widget), PENDING_LOAD_KEY, NULL);
+}
+
 void set_pdf_preview_widget_file_by_filename(GtkWidget *widget, char* filename){
 	//printf("set_pdf_preview_widget_file_by_filename\n");
 	EvDocumentModel *model;
+	CachedDocument *cached;
+	char *uri;
+	time_t mtime;
+
+	/* Whatever was loading for the previous selection is not wanted anymore */
+	pdf_preview_widget_cancel_load (widget);
+
+	if (!get_uri_and_mtime (filename, &uri, &mtime)) {
+		return;
+	}
+
+	cached = lookup_cached_document (uri, mtime);
+	if (cached != NULL) {
+		ev_view_set_model (EV_VIEW (widget), cached->model);
+		g_free (uri);
+		return;
+	}
+
 	model = ev_document_model_new ();
 	//ev_document_model_set_page_layout(model, EV_PAGE_LAYOUT_AUTOMATIC);
 	ev_document_model_set_continuous(model, TRUE);
-	//printf("ev_previewer_load_document: %s\n",filename);
-	//char* current_filename = strdup (filename);
-	ev_previewer_load_document (filename, model);
-	//printf("ev_view_set_model\n");
+	ev_previewer_load_document (widget, uri, mtime, model);
 	ev_view_set_model(EV_VIEW(widget), model);
 	g_object_unref (model);
-	//printf("done\n");
-	//show widget
+	g_free (uri);
 }
 
-static void sleep_child_watch_cb (GPid pid,
-                        gint status,
-                        gpointer user_data)
+static gboolean
+show_pdf_file_timeout (gpointer data)
 {
-	PeonyWindowInfo *window = PEONY_WINDOW_INFO (user_data);
-	window_show_pdf_file (window);
-	is_busy = FALSE;
-	g_spawn_close_pid (pid);
-}
+	PeonyWindowInfo *window = PEONY_WINDOW_INFO (data);
 
-void child_sleep_for_fews_times (PeonyWindowInfo *window) {
-	gboolean res;
-	gint argc;
-	GPid pid;
-	gchar **argv = NULL;
-	GError *error = NULL;
-	char* cmd = g_strdup_printf("sleep 0.5");
-	res = g_shell_parse_argv (cmd, &argc, &argv, &error);
-	g_free (cmd);
+	/* The source is done, don't let the data's destroy notify remove it */
+	g_object_steal_data (G_OBJECT (window), PREVIEW_DELAY_KEY);
+	window_show_pdf_file (window);
 
-	if (!res) {
-		g_warning ("Error while parsing the sleep command line: %s",
-				error->message);
-		g_error_free (error);
+	return FALSE;
+}
 
-		return NULL;
-	}
+static void
+remove_source (gpointer data)
+{
+	g_source_remove (GPOINTER_TO_UINT (data));
+}
 
-	res = g_spawn_async (NULL, argv, NULL,
-			G_SPAWN_DO_NOT_REAP_CHILD |
-			G_SPAWN_SEARCH_PATH,
-			NULL, NULL,
-			&pid, &error);
+void window_delay_set_pdf_preview_widget_file_by_filename (PeonyWindowInfo *window, char* filename) {
+	char *uri;
+	time_t mtime;
+	guint delay, id;
 
-	g_strfreev (argv);
+	peony_navigation_window_set_latest_pdf_preview_file_by_window_info (window, filename);
 
-	if (!res) {
-		g_warning ("Error while spawning sleep: %s",
-				error->message);
-		g_error_free (error);
+	/* Restarts the delay, only the last of quick selection changes is shown */
+	g_object_set_data (G_OBJECT (window), PREVIEW_DELAY_KEY, NULL);
 
-		return NULL;
+	/* Documents already open show without waiting, but still from the main
+	 * loop, after the caller has shown its "Loading..." state.
+	 */
+	delay = PREVIEW_DELAY_MSEC;
+	if (get_uri_and_mtime (filename, &uri, &mtime)) {
+		if (find_cached_document (uri, mtime) != NULL) {
+			delay = 0;
+		}
+		g_free (uri);
 	}
 
-	g_child_watch_add (pid, sleep_child_watch_cb, window);
-}
-
-void window_delay_set_pdf_preview_widget_file_by_filename (PeonyWindowInfo *window, char* filename) {
-	peony_navigation_window_set_latest_pdf_preview_file_by_window_info (window, filename);
-	if (!is_busy) {
-		is_busy = TRUE;
-		child_sleep_for_fews_times (window);
-	}
+	id = g_timeout_add (delay, show_pdf_file_timeout, window);
+	g_object_set_data_full (G_OBJECT (window), PREVIEW_DELAY_KEY,
+				GUINT_TO_POINTER (id), remove_source);
 }
@@ -36,6 +36,8 @@ void pdfviewer_disconnect_window (PeonyWindowInfo *window);
 GtkWidget* pdf_preview_widget_new();
 void window_delay_set_pdf_preview_widget_file_by_filename (PeonyWindowInfo *window, char* filename);
 void set_pdf_preview_widget_file_by_filename (GtkWidget *widget, char* filename);
+//stops loading whatever the widget was about to show
+void pdf_preview_widget_cancel_load (GtkWidget *widget);
 
 //void     peony_navigation_window_set_latest_pdf_preview_file_by_window_info (PeonyWindowInfo *window_info, char* filename);
 //char*    peony_navigation_window_get_latest_preview_file_by_window_info (PeonyWindowInfo *window_info);
@@ -0,0 +1,825 @@
+/*
+ *  Peony
+ *
+ *  Copyright (C) 2019, Tianjin KYLIN Information Technology Co., Ltd.
+ *
+ *  Peony is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  Peony is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "preview-loader.h"
+#include "office-utils.h"
+#include <glib/gstdio.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <eel/eel-gdk-pixbuf-extensions.h>
+
+/* Previews kept for files shown lately */
+#define CACHE_SIZE 16
+
+/* Prefetches running at the same time, loads asked for by the pane are
+ * never held back.
+ */
+#define MAX_RUNNING_PREFETCHES 2
+
+/* Text files are previewed from their first bytes only */
+#define TEXT_HEAD_SIZE (64 * 1024)
+
+/* Embedded previews larger than this are not believed */
+#define MAX_EMBEDDED_PREVIEW_SIZE (32 * 1024 * 1024)
+
+/* Bounds the walk through a broken or hostile TIFF structure */
+#define MAX_IFDS 32
+#define MAX_IFD_DEPTH 3
+#define MAX_SUB_IFDS 8
+
+#define TIFF_TYPE_SHORT 3
+
+#define TIFF_TAG_COMPRESSION 0x0103
+#define TIFF_TAG_PHOTOMETRIC 0x0106
+#define TIFF_TAG_STRIP_OFFSETS 0x0111
+#define TIFF_TAG_ORIENTATION 0x0112
+#define TIFF_TAG_STRIP_BYTE_COUNTS 0x0117
+#define TIFF_TAG_SUB_IFDS 0x014a
+#define TIFF_TAG_JPEG_OFFSET 0x0201
+#define TIFF_TAG_JPEG_LENGTH 0x0202
+
+#define TIFF_COMPRESSION_OLD_JPEG 6
+#define TIFF_COMPRESSION_JPEG 7
+#define TIFF_PHOTOMETRIC_CFA 32803
+#define TIFF_PHOTOMETRIC_LINEAR_RAW 34892
+
+typedef struct {
+	char *filename;
+	int size;
+	time_t mtime;
+	PreviewData *data;
+} CacheEntry;
+
+typedef struct {
+	char *key;
+	char *filename;
+	int size;
+	time_t mtime;
+	gboolean prefetch;
+	/* GTasks of the loads waiting for it */
+	GList *tasks;
+} PreviewJob;
+
+typedef struct {
+	char *filename;
+	int size;
+} PrefetchRequest;
+
+typedef struct {
+	FILE *file;
+	/* Offset of the TIFF header in the file */
+	long base;
+	gboolean big_endian;
+	int ifds_visited;
+	guint orientation;
+	guint32 best_offset;
+	guint32 best_length;
+} TiffReader;
+
+/* Most recently used first */
+static GQueue cache = G_QUEUE_INIT;
+
+/* Key to PreviewJob */
+static GHashTable *running_jobs;
+static int running_prefetches;
+
+static GQueue prefetch_queue = G_QUEUE_INIT;
+
+PreviewData *
+preview_data_ref (PreviewData *data)
+{
+	g_atomic_int_inc (&data->ref_count);
+
+	return data;
+}
+
+void
+preview_data_unref (PreviewData *data)
+{
+	if (!g_atomic_int_dec_and_test (&data->ref_count)) {
+		return;
+	}
+
+	g_free (data->filename);
+	g_free (data->content_type);
+	if (data->pixbuf != NULL) {
+		g_object_unref (data->pixbuf);
+	}
+	g_free (data->text);
+	g_free (data);
+}
+
+static PreviewKind
+get_preview_kind (const char *content_type)
+{
+	int i;
+
+	if (content_type == NULL) {
+		return PREVIEW_KIND_NONE;
+	}
+
+	/* In the order the pane has always tried them */
+	if (strstr (content_type, "text/") || strstr (content_type, "script")) {
+		return PREVIEW_KIND_TEXT;
+	}
+	if (strstr (content_type, "image/")) {
+		if (g_content_type_is_a (content_type, "image/gif") ||
+		    g_content_type_is_a (content_type, "image/svg+xml")) {
+			return PREVIEW_KIND_WEB_IMAGE;
+		}
+		return PREVIEW_KIND_IMAGE;
+	}
+	if (strstr (content_type, "pdf")) {
+		return PREVIEW_KIND_PDF;
+	}
+	for (i = 0; office_mime_types[i] != NULL; i++) {
+		if (g_content_type_is_a (content_type, office_mime_types[i])) {
+			return PREVIEW_KIND_OFFICE;
+		}
+	}
+
+	return PREVIEW_KIND_NONE;
+}
+
+static gboolean
+tiff_read (TiffReader *reader, guint32 offset, guchar *buffer, gsize length)
+{
+	return fseek (reader->file, reader->base + offset, SEEK_SET) == 0 &&
+		fread (buffer, 1, length, reader->file) == length;
+}
+
+static guint32
+tiff_get_u16 (TiffReader *reader, const guchar *p)
+{
+	if (reader->big_endian) {
+		return (p[0] << 8) | p[1];
+	}
+	return p[0] | (p[1] << 8);
+}
+
+static guint32
+tiff_get_u32 (TiffReader *reader, const guchar *p)
+{
+	if (reader->big_endian) {
+		return ((guint32) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+	}
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((guint32) p[3] << 24);
+}
+
+/* The value of a single element entry, which is stored in the entry */
+static guint32
+tiff_get_entry_value (TiffReader *reader, const guchar *entry)
+{
+	if (tiff_get_u16 (reader, entry + 2) == TIFF_TYPE_SHORT) {
+		return tiff_get_u16 (reader, entry + 8);
+	}
+	return tiff_get_u32 (reader, entry + 8);
+}
+
+static void
+tiff_consider_jpeg (TiffReader *reader, guint32 offset, guint32 length)
+{
+	/* Too short to even hold the JPEG start marker */
+	if (offset != 0 && length >= 2 && length > reader->best_length &&
+	    length <= MAX_EMBEDDED_PREVIEW_SIZE) {
+		reader->best_offset = offset;
+		reader->best_length = length;
+	}
+}
+
+/* Looks for the largest JPEG image in a chain of image directories and
+ * the directories below them. Camera raw files keep their previews
+ * there, and EXIF keeps its thumbnail in the second directory.
+ */
+static void
+tiff_scan_ifds (TiffReader *reader, guint32 offset, int depth)
+{
+	guchar entry[12];
+	guint32 count, i, n, tag;
+	guint32 compression, photometric;
+	guint32 strip_offset, strip_length, jpeg_offset, jpeg_length;
+	guint32 sub_ifds[MAX_SUB_IFDS];
+	guint32 n_sub_ifds;
+
+	while (offset != 0 && reader->ifds_visited < MAX_IFDS) {
+		reader->ifds_visited++;
+
+		if (!tiff_read (reader, offset, entry, 2)) {
+			return;
+		}
+		count = tiff_get_u16 (reader, entry);
+
+		compression = photometric = 0;
+		strip_offset = strip_length = jpeg_offset = jpeg_length = 0;
+		n_sub_ifds = 0;
+
+		for (i = 0; i < count; i++) {
+			if (!tiff_read (reader, offset + 2 + 12 * i, entry, 12)) {
+				return;
+			}
+			tag = tiff_get_u16 (reader, entry);
+			n = tiff_get_u32 (reader, entry + 4);
+
+			switch (tag) {
+			case TIFF_TAG_COMPRESSION:
+				compression = tiff_get_entry_value (reader, entry);
+				break;
+			case TIFF_TAG_PHOTOMETRIC:
+				photometric = tiff_get_entry_value (reader, entry);
+				break;
+			case TIFF_TAG_STRIP_OFFSETS:
+				if (n == 1) {
+					strip_offset = tiff_get_entry_value (reader, entry);
+				}
+				break;
+			case TIFF_TAG_STRIP_BYTE_COUNTS:
+				if (n == 1) {
+					strip_length = tiff_get_entry_value (reader, entry);
+				}
+				break;
+			case TIFF_TAG_ORIENTATION:
+				if (depth == 0 && reader->ifds_visited == 1) {
+					reader->orientation = tiff_get_entry_value (reader, entry);
+				}
+				break;
+			case TIFF_TAG_JPEG_OFFSET:
+				jpeg_offset = tiff_get_entry_value (reader, entry);
+				break;
+			case TIFF_TAG_JPEG_LENGTH:
+				jpeg_length = tiff_get_entry_value (reader, entry);
+				break;
+			case TIFF_TAG_SUB_IFDS:
+				if (n == 1) {
+					sub_ifds[0] = tiff_get_u32 (reader, entry + 8);
+					n_sub_ifds = 1;
+				} else {
+					guchar offsets[4 * MAX_SUB_IFDS];
+
+					n = MIN (n, MAX_SUB_IFDS);
+					if (tiff_read (reader, tiff_get_u32 (reader, entry + 8), offsets, 4 * n)) {
+						for (n_sub_ifds = 0; n_sub_ifds < n; n_sub_ifds++) {
+							sub_ifds[n_sub_ifds] = tiff_get_u32 (reader, offsets + 4 * n_sub_ifds);
+						}
+					}
+				}
+				break;
+			}
+		}
+
+		tiff_consider_jpeg (reader, jpeg_offset, jpeg_length);
+		/* Sensor data is compressed as lossless JPEG, which is no preview */
+		if (compression == TIFF_COMPRESSION_OLD_JPEG ||
+		    (compression == TIFF_COMPRESSION_JPEG &&
+		     photometric != TIFF_PHOTOMETRIC_CFA &&
+		     photometric != TIFF_PHOTOMETRIC_LINEAR_RAW)) {
+			tiff_consider_jpeg (reader, strip_offset, strip_length);
+		}
+
+		if (depth < MAX_IFD_DEPTH) {
+			for (i = 0; i < n_sub_ifds; i++) {
+				tiff_scan_ifds (reader, sub_ifds[i], depth + 1);
+			}
+		}
+
+		if (!tiff_read (reader, offset + 2 + 12 * count, entry, 4)) {
+			return;
+		}
+		offset = tiff_get_u32 (reader, entry);
+	}
+}
+
+/* Returns the offset of the TIFF header in the EXIF block of a JPEG file */
+static gboolean
+find_exif_in_jpeg (FILE *file, long *tiff_offset)
+{
+	guchar buffer[10];
+	long position;
+	guint length;
+
+	if (fread (buffer, 1, 2, file) != 2 || buffer[0] != 0xff || buffer[1] != 0xd8) {
+		return FALSE;
+	}
+
+	position = 2;
+	for (;;) {
+		if (fseek (file, position, SEEK_SET) != 0 ||
+		    fread (buffer, 1, sizeof (buffer), file) != sizeof (buffer) ||
+		    buffer[0] != 0xff) {
+			return FALSE;
+		}
+		length = (buffer[2] << 8) | buffer[3];
+
+		if (buffer[1] == 0xe1 && memcmp (buffer + 4, "Exif\0\0", 6) == 0) {
+			*tiff_offset = position + sizeof (buffer);
+			return TRUE;
+		}
+		/* EXIF comes before the image data */
+		if (buffer[1] == 0xda || length < 2) {
+			return FALSE;
+		}
+		position += 2 + length;
+	}
+}
+
+static GdkPixbuf *
+load_embedded_preview (const char *filename, gboolean is_jpeg, int size)
+{
+	TiffReader reader;
+	guchar header[8];
+	guchar *jpeg;
+	GInputStream *stream;
+	GdkPixbuf *pixbuf, *oriented;
+	char *orientation;
+
+	memset (&reader, 0, sizeof (reader));
+	reader.file = fopen (filename, "rb");
+	if (reader.file == NULL) {
+		return NULL;
+	}
+
+	if (is_jpeg && !find_exif_in_jpeg (reader.file, &reader.base)) {
+		fclose (reader.file);
+		return NULL;
+	}
+
+	/* Raw formats change the magic number but keep the byte order mark */
+	if (!tiff_read (&reader, 0, header, sizeof (header)) ||
+	    header[0] != header[1] || (header[0] != 'I' && header[0] != 'M')) {
+		fclose (reader.file);
+		return NULL;
+	}
+	reader.big_endian = header[0] == 'M';
+
+	tiff_scan_ifds (&reader, tiff_get_u32 (&reader, header + 4), 0);
+
+	jpeg = NULL;
+	if (reader.best_length != 0) {
+		jpeg = g_malloc (reader.best_length);
+		if (!tiff_read (&reader, reader.best_offset, jpeg, reader.best_length) ||
+		    jpeg[0] != 0xff || jpeg[1] != 0xd8) {
+			g_free (jpeg);
+			jpeg = NULL;
+		}
+	}
+	fclose (reader.file);
+
+	if (jpeg == NULL) {
+		return NULL;
+	}
+
+	stream = g_memory_input_stream_new_from_data (jpeg, reader.best_length, g_free);
+	pixbuf = eel_gdk_pixbuf_load_from_stream_at_size (stream, -1);
+	g_object_unref (stream);
+
+	if (pixbuf == NULL) {
+		return NULL;
+	}
+
+	/* The EXIF thumbnail of a JPEG is usually too small to stand in for it */
+	if (is_jpeg && MAX (gdk_pixbuf_get_width (pixbuf), gdk_pixbuf_get_height (pixbuf)) < size) {
+		g_object_unref (pixbuf);
+		return NULL;
+	}
+
+	/* The preview is stored the way the sensor saw it */
+	if (reader.orientation > 1 && reader.orientation <= 8 &&
+	    gdk_pixbuf_get_option (pixbuf, "orientation") == NULL) {
+		orientation = g_strdup_printf ("%u", reader.orientation);
+		gdk_pixbuf_set_option (pixbuf, "orientation", orientation);
+		g_free (orientation);
+	}
+	oriented = gdk_pixbuf_apply_embedded_orientation (pixbuf);
+	g_object_unref (pixbuf);
+
+	pixbuf = eel_gdk_pixbuf_scale_down_to_fit (oriented, size, size);
+	g_object_unref (oriented);
+
+	return pixbuf;
+}
+
+static GdkPixbuf *
+load_image (const char *filename, const char *content_type, int size)
+{
+	GFile *file;
+	GFileInputStream *stream;
+	GdkPixbuf *pixbuf, *oriented;
+	gboolean is_jpeg;
+	int width, height;
+
+	/* Camera raw files can't be decoded here, but carry a JPEG preview */
+	is_jpeg = g_content_type_is_a (content_type, "image/jpeg");
+	if (is_jpeg || g_content_type_is_a (content_type, "image/x-dcraw")) {
+		pixbuf = load_embedded_preview (filename, is_jpeg, size);
+		if (pixbuf != NULL) {
+			return pixbuf;
+		}
+	}
+
+	if (gdk_pixbuf_get_file_info (filename, &width, &height) == NULL) {
+		return NULL;
+	}
+
+	/* Small images are not blown up */
+	size = MIN (size, MAX (width, height));
+
+	file = g_file_new_for_path (filename);
+	stream = g_file_read (file, NULL, NULL);
+	g_object_unref (file);
+	if (stream == NULL) {
+		return NULL;
+	}
+
+	pixbuf = eel_gdk_pixbuf_load_from_stream_at_size (G_INPUT_STREAM (stream), size);
+	g_object_unref (stream);
+	if (pixbuf == NULL) {
+		return NULL;
+	}
+
+	oriented = gdk_pixbuf_apply_embedded_orientation (pixbuf);
+	g_object_unref (pixbuf);
+
+	return oriented;
+}
+
+static void
+load_text_head (PreviewData *data)
+{
+	GFile *file;
+	GFileInputStream *stream;
+	char *buffer;
+	const char *end;
+	gsize length, i;
+	gboolean success;
+
+	file = g_file_new_for_path (data->filename);
+	stream = g_file_read (file, NULL, NULL);
+	g_object_unref (file);
+	if (stream == NULL) {
+		return;
+	}
+
+	buffer = g_malloc (TEXT_HEAD_SIZE + 1);
+	success = g_input_stream_read_all (G_INPUT_STREAM (stream), buffer, TEXT_HEAD_SIZE,
+					   &length, NULL, NULL);
+	g_object_unref (stream);
+	if (!success) {
+		g_free (buffer);
+		return;
+	}
+
+	data->text_truncated = length == TEXT_HEAD_SIZE;
+	if (data->text_truncated) {
+		/* Stop at the last complete line */
+		i = length;
+		while (i > 0 && buffer[i - 1] != '\n') {
+			i--;
+		}
+		if (i > 0) {
+			length = i;
+		}
+	}
+
+	/* Other encodings are left to the text view, which guesses them */
+	if (!g_utf8_validate (buffer, length, &end)) {
+		/* Except for a character cut off at the end */
+		if (!data->text_truncated || length - (end - buffer) >= 4) {
+			g_free (buffer);
+			return;
+		}
+		length = end - buffer;
+	}
+
+	buffer[length] = '\0';
+	data->text = buffer;
+}
+
+static gboolean
+get_mtime (const char *filename, time_t *mtime)
+{
+	struct stat info;
+
+	if (g_stat (filename, &info) != 0) {
+		return FALSE;
+	}
+	*mtime = info.st_mtime;
+
+	return TRUE;
+}
+
+static void
+load_preview_thread (GTask        *task,
+		     gpointer      source_object,
+		     gpointer      task_data,
+		     GCancellable *cancellable)
+{
+	PreviewJob *job = task_data;
+	PreviewData *data;
+	GFile *file;
+	GFileInfo *info;
+	GError *error = NULL;
+
+	/* Taken before loading, so a change while loading makes it stale.
+	 * Read by preview_job_done () once the task has returned.
+	 */
+	if (!get_mtime (job->filename, &job->mtime)) {
+		job->mtime = 0;
+	}
+
+	file = g_file_new_for_path (job->filename);
+	info = g_file_query_info (file, G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE,
+				  0, NULL, &error);
+	g_object_unref (file);
+	if (info == NULL) {
+		g_task_return_error (task, error);
+		return;
+	}
+
+	data = g_new0 (PreviewData, 1);
+	data->ref_count = 1;
+	data->filename = g_strdup (job->filename);
+	data->content_type = g_strdup (g_file_info_get_content_type (info));
+	data->kind = get_preview_kind (data->content_type);
+	g_object_unref (info);
+
+	if (data->kind == PREVIEW_KIND_IMAGE) {
+		data->pixbuf = load_image (data->filename, data->content_type, job->size);
+	} else if (data->kind == PREVIEW_KIND_TEXT) {
+		load_text_head (data);
+	}
+
+	g_task_return_pointer (task, data, (GDestroyNotify) preview_data_unref);
+}
+
+static void
+cache_entry_free (CacheEntry *entry)
+{
+	g_free (entry->filename);
+	preview_data_unref (entry->data);
+	g_free (entry);
+}
+
+static GList *
+find_cache_link (const char *filename, int size)
+{
+	GList *l;
+	CacheEntry *entry;
+
+	for (l = cache.head; l != NULL; l = l->next) {
+		entry = l->data;
+		if (entry->size == size && strcmp (entry->filename, filename) == 0) {
+			return l;
+		}
+	}
+
+	return NULL;
+}
+
+static void
+add_to_cache (PreviewJob *job, PreviewData *data)
+{
+	CacheEntry *entry;
+	GList *l;
+
+	l = find_cache_link (job->filename, job->size);
+	if (l != NULL) {
+		cache_entry_free (l->data);
+		g_queue_delete_link (&cache, l);
+	}
+
+	entry = g_new0 (CacheEntry, 1);
+	entry->filename = g_strdup (job->filename);
+	entry->size = job->size;
+	entry->mtime = job->mtime;
+	entry->data = preview_data_ref (data);
+	g_queue_push_head (&cache, entry);
+
+	while (g_queue_get_length (&cache) > CACHE_SIZE) {
+		cache_entry_free (g_queue_pop_tail (&cache));
+	}
+}
+
+PreviewData *
+preview_loader_lookup (const char *filename, int size)
+{
+	GList *l;
+	CacheEntry *entry;
+	time_t mtime;
+
+	l = find_cache_link (filename, size);
+	if (l == NULL) {
+		return NULL;
+	}
+	entry = l->data;
+
+	/* Changed since, the preview is stale */
+	if (!get_mtime (filename, &mtime) || mtime != entry->mtime) {
+		cache_entry_free (entry);
+		g_queue_delete_link (&cache, l);
+		return NULL;
+	}
+
+	g_queue_unlink (&cache, l);
+	g_queue_push_head_link (&cache, l);
+
+	return preview_data_ref (entry->data);
+}
+
+static char *
+get_job_key (const char *filename, int size)
+{
+	return g_strdup_printf ("%d:%s", size, filename);
+}
+
+static void
+preview_job_free (PreviewJob *job)
+{
+	g_free (job->key);
+	g_free (job->filename);
+	g_free (job);
+}
+
+static void start_prefetches (void);
+
+static void
+preview_job_done (GObject      *source_object,
+		  GAsyncResult *result,
+		  gpointer      user_data)
+{
+	PreviewJob *job = user_data;
+	PreviewData *data;
+	GError *error = NULL;
+	GList *l;
+
+	data = g_task_propagate_pointer (G_TASK (result), &error);
+	if (data != NULL) {
+		add_to_cache (job, data);
+	}
+
+	for (l = job->tasks; l != NULL; l = l->next) {
+		if (data != NULL) {
+			g_task_return_pointer (l->data, preview_data_ref (data),
+					       (GDestroyNotify) preview_data_unref);
+		} else {
+			g_task_return_error (l->data, g_error_copy (error));
+		}
+		g_object_unref (l->data);
+	}
+	g_list_free (job->tasks);
+	job->tasks = NULL;
+
+	if (data != NULL) {
+		preview_data_unref (data);
+	} else {
+		g_error_free (error);
+	}
+
+	if (job->prefetch) {
+		running_prefetches--;
+	}
+	g_hash_table_remove (running_jobs, job->key);
+
+	start_prefetches ();
+}
+
+static PreviewJob *
+get_job (const char *filename, int size, gboolean prefetch)
+{
+	PreviewJob *job;
+	GTask *task;
+	char *key;
+
+	if (running_jobs == NULL) {
+		running_jobs = g_hash_table_new_full (g_str_hash, g_str_equal,
+						      NULL, (GDestroyNotify) preview_job_free);
+	}
+
+	key = get_job_key (filename, size);
+	job = g_hash_table_lookup (running_jobs, key);
+	if (job != NULL) {
+		g_free (key);
+		return job;
+	}
+
+	job = g_new0 (PreviewJob, 1);
+	job->key = key;
+	job->filename = g_strdup (filename);
+	job->size = size;
+	job->prefetch = prefetch;
+	g_hash_table_insert (running_jobs, job->key, job);
+
+	if (prefetch) {
+		running_prefetches++;
+	}
+
+	task = g_task_new (NULL, NULL, preview_job_done, job);
+	g_task_set_task_data (task, job, NULL);
+	g_task_run_in_thread (task, load_preview_thread);
+	g_object_unref (task);
+
+	return job;
+}
+
+void
+preview_loader_load_async (const char          *filename,
+			   int                  size,
+			   GCancellable        *cancellable,
+			   GAsyncReadyCallback  callback,
+			   gpointer             user_data)
+{
+	GTask *task;
+	PreviewData *data;
+	PreviewJob *job;
+
+	g_return_if_fail (filename != NULL);
+
+	task = g_task_new (NULL, cancellable, callback, user_data);
+
+	data = preview_loader_lookup (filename, size);
+	if (data != NULL) {
+		g_task_return_pointer (task, data, (GDestroyNotify) preview_data_unref);
+		g_object_unref (task);
+		return;
+	}
+
+	/* A prefetch of the same file may already be half way */
+	job = get_job (filename, size, FALSE);
+	job->tasks = g_list_prepend (job->tasks, task);
+}
+
+PreviewData *
+preview_loader_load_finish (GAsyncResult  *result,
+			    GError       **error)
+{
+	g_return_val_if_fail (g_task_is_valid (result, NULL), NULL);
+
+	return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+static void
+prefetch_request_free (PrefetchRequest *request)
+{
+	g_free (request->filename);
+	g_free (request);
+}
+
+static void
+start_prefetches (void)
+{
+	PrefetchRequest *request;
+	PreviewData *data;
+
+	while (running_prefetches < MAX_RUNNING_PREFETCHES &&
+	       !g_queue_is_empty (&prefetch_queue)) {
+		request = g_queue_pop_head (&prefetch_queue);
+
+		data = preview_loader_lookup (request->filename, request->size);
+		if (data != NULL) {
+			preview_data_unref (data);
+		} else {
+			get_job (request->filename, request->size, TRUE);
+		}
+
+		prefetch_request_free (request);
+	}
+}
+
+void
+preview_loader_prefetch (GList *filenames, int size)
+{
+	PrefetchRequest *request;
+	GList *l;
+
+	/* Whatever was near the old selection is not wanted anymore */
+	g_queue_foreach (&prefetch_queue, (GFunc) prefetch_request_free, NULL);
+	g_queue_clear (&prefetch_queue);
+
+	for (l = filenames; l != NULL; l = l->next) {
+		request = g_new0 (PrefetchRequest, 1);
+		request->filename = g_strdup (l->data);
+		request->size = size;
+		g_queue_push_tail (&prefetch_queue, request);
+	}
+
+	start_prefetches ();
+}
@@ -0,0 +1,81 @@
+/*
+ *  Peony
+ *
+ *  Copyright (C) 2019, Tianjin KYLIN Information Technology Co., Ltd.
+ *
+ *  Peony is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  Peony is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef PREVIEW_LOADER_H
+#define PREVIEW_LOADER_H
+
+#include <gio/gio.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+//the preview pane asks the loader what a file is and, for images and text,
+//gets it decoded. the content type query, image decoding and reading text
+//all happen in worker threads, and results are kept for files shown lately.
+
+typedef enum {
+	PREVIEW_KIND_NONE,
+	PREVIEW_KIND_TEXT,
+	//decoded to a pixbuf at the requested size
+	PREVIEW_KIND_IMAGE,
+	//animated or vector images, left to the web view
+	PREVIEW_KIND_WEB_IMAGE,
+	PREVIEW_KIND_PDF,
+	PREVIEW_KIND_OFFICE,
+} PreviewKind;
+
+typedef struct {
+	char *filename;
+	char *content_type;
+	PreviewKind kind;
+
+	//PREVIEW_KIND_IMAGE, NULL if it could not be decoded
+	GdkPixbuf *pixbuf;
+
+	//PREVIEW_KIND_TEXT, the head of the file in UTF-8. NULL if the file is
+	//not UTF-8, the text view then has to load it itself.
+	char *text;
+	gboolean text_truncated;
+
+	/*< private >*/
+	int ref_count;
+} PreviewData;
+
+PreviewData *preview_data_ref (PreviewData *data);
+void         preview_data_unref (PreviewData *data);
+
+//size is the largest width or height images are decoded at
+void         preview_loader_load_async (const char          *filename,
+					int                  size,
+					GCancellable        *cancellable,
+					GAsyncReadyCallback  callback,
+					gpointer             user_data);
+PreviewData *preview_loader_load_finish (GAsyncResult  *result,
+					 GError       **error);
+
+//returns the cached preview of filename, or NULL
+PreviewData *preview_loader_lookup (const char *filename,
+				    int         size);
+
+//loads the previews of filenames in the background, nearest first, so
+//moving on to them shows them at once
+void         preview_loader_prefetch (GList *filenames,
+				      int    size);
+
+#endif
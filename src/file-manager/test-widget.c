@@ -308,6 +308,28 @@ void open_file_cb(TestWidget *widget, char *filename){
 	open_file(widget,filename);
 }
 
+//shows text already read from filename, without loading the file again
+void show_text_cb(TestWidget *widget, char *filename, const char *text){
+	GtkTextIter iter;
+	GFile *location;
+	GtkSourceLanguage *language;
+
+	g_clear_object (&widget->priv->file);
+	remove_all_marks (widget->priv->buffer);
+
+	gtk_source_buffer_begin_not_undoable_action (widget->priv->buffer);
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (widget->priv->buffer), text, -1);
+	gtk_source_buffer_end_not_undoable_action (widget->priv->buffer);
+
+	gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (widget->priv->buffer), &iter);
+	gtk_text_buffer_place_cursor (GTK_TEXT_BUFFER (widget->priv->buffer), &iter);
+
+	location = g_file_new_for_path (filename);
+	language = get_language (GTK_TEXT_BUFFER (widget->priv->buffer), location);
+	gtk_source_buffer_set_language (widget->priv->buffer, language);
+	g_object_unref (location);
+}
+
 void mode_init(TestWidget *self){
 	gboolean enabled = TRUE;
 	gtk_source_view_set_show_line_numbers (self->priv->view, enabled);
@@ -51,6 +51,7 @@ void widget_init(TestWidget *self);
 void mode_init(TestWidget *self);
 
 void open_file_cb(TestWidget *widget, char *filename);
+void show_text_cb(TestWidget *widget, char *filename, const char *text);
 /*
 int
 main (int argc, char *argv[])
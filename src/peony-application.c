@@ -58,6 +58,7 @@
 #include "peony-window-private.h"
 #include "peony-window-manage-views.h"
 #include "peony-freedesktop-dbus.h"
+#include "peony-startup.h"
 #include <libxml/xmlsave.h>
 #include <glib/gstdio.h>
 #include <glib/gi18n.h>
@@ -615,23 +616,23 @@ menu_provider_items_updated_handler (PeonyMenuProvider *provider, GtkWidget* par
 }
 
 static void
-menu_provider_init_callback (void)
+menu_provider_loaded (GObject *provider,
+                      gpointer user_data)
 {
-    GList *providers;
-    GList *l;
-
-    providers = peony_extensions_get_for_type (PEONY_TYPE_MENU_PROVIDER);
-
-    for (l = providers; l != NULL; l = l->next)
-    {
-        PeonyMenuProvider *provider = PEONY_MENU_PROVIDER (l->data);
-
-        g_signal_connect_after (G_OBJECT (provider), "items_updated",
-                                (GCallback)menu_provider_items_updated_handler,
-                                NULL);
-    }
+    g_signal_connect_after (provider, "items_updated",
+                            (GCallback)menu_provider_items_updated_handler,
+                            NULL);
+}
 
-    peony_module_extension_list_free (providers);
+/* Menu provider libraries are opened the first time a menu asks for
+ * them, each one is hooked up as that happens.
+ */
+static void
+menu_provider_init_callback (void)
+{
+    peony_module_watch_type (PEONY_TYPE_MENU_PROVIDER,
+                             menu_provider_loaded,
+                             NULL);
 }
 
 static gboolean
@@ -911,6 +912,7 @@ peony_application_create_desktop_windows (PeonyApplication *application)
 
         g_signal_connect (window, "unrealize",
                           G_CALLBACK (desktop_unrealize_cb), selection_widget);
+        peony_startup_watch_window (GTK_WIDGET (window));
 
         /* We realize it immediately so that the PEONY_DESKTOP_WINDOW_ID
            property is set so ukui-settings-daemon doesn't try to set the
@@ -1140,6 +1142,7 @@ create_window (PeonyApplication *application,
     g_signal_connect_data (window, "delete_event",
                            G_CALLBACK (peony_window_delete_event_callback), NULL, NULL,
                            G_CONNECT_AFTER);
+    peony_startup_watch_window (GTK_WIDGET (window));
 
     gtk_application_add_window (GTK_APPLICATION (application),
 				    GTK_WINDOW (window));
@@ -2406,29 +2409,25 @@ init_gtk_accels (void)
 
 
 static void
-peony_application_startup (GApplication *app)
+startup_preferences (gpointer data)
 {
-    GList *drives;
-    PeonyApplication *application;
-    PeonyApplication *self = PEONY_APPLICATION (app);
-    GApplication *instance;
-    gboolean exit_with_last_window;
-    exit_with_last_window = TRUE;
-
-    /* chain up to the GTK+ implementation early, so gtk_init()
-     * is called for us.
-     */
-    G_APPLICATION_CLASS (peony_application_parent_class)->startup (app);
-
     /* Initialize preferences. This is needed so that proper
      * defaults are available before any preference peeking
      * happens.
      */
     peony_global_preferences_init ();
+}
 
-	/* initialize the session manager client */
-	peony_application_smclient_startup (self);
+static void
+startup_session_client (gpointer data)
+{
+    /* initialize the session manager client */
+    peony_application_smclient_startup (data);
+}
 
+static void
+startup_views (gpointer data)
+{
     /* register views */
     fm_computer_view_register ();
     fm_icon_view_register ();
@@ -2440,7 +2439,11 @@ peony_application_startup (GApplication *app)
 #if ENABLE_EMPTY_VIEW
     fm_empty_view_register ();
 #endif /* ENABLE_EMPTY_VIEW */
+}
 
+static void
+startup_sidebars (gpointer data)
+{
     /* register sidebars */
     peony_places_sidebar_register ();
     //peony_information_panel_register ();
@@ -2451,23 +2454,29 @@ peony_application_startup (GApplication *app)
 
     /* register property pages */
    // peony_image_properties_page_register ();
+}
 
+static void
+startup_styles (gpointer data)
+{
     /* initialize theming */
     init_icons_and_styles ();
+}
+
+static void
+startup_accels (gpointer data)
+{
     init_gtk_accels ();
-    
-    /* initialize peony modules */
-    peony_module_setup ();
+}
 
-    /* attach menu-provider module callback */
-    menu_provider_init_callback ();
-    
-    /* Initialize notifications for eject operations */
-    notify_init (GETTEXT_PACKAGE);  
+static void
+startup_volume_monitor (gpointer data)
+{
+    PeonyApplication *self = data;
 
     /* Watch for unmounts so we can close open windows */
     /* TODO-gio: This should be using the UNMOUNTED feature of GFileMonitor instead */
-     self->priv->volume_monitor = g_volume_monitor_get ();
+    self->priv->volume_monitor = g_volume_monitor_get ();
     g_signal_connect_object ( self->priv->volume_monitor, "mount_removed",
                              G_CALLBACK (mount_removed_callback), self, 0);
     g_signal_connect_object ( self->priv->volume_monitor, "mount_pre_unmount",
@@ -2480,21 +2489,29 @@ peony_application_startup (GApplication *app)
                              G_CALLBACK (volume_removed_callback), self, 0);
     g_signal_connect_object ( self->priv->volume_monitor, "drive_connected",
                              G_CALLBACK (drive_connected_callback), self, 0);
+}
 
-    fdb_manager = peony_freedesktop_dbus_new (self);
-
-    /* listen for eject button presses */
-    drives = g_volume_monitor_get_connected_drives ( self->priv->volume_monitor);
-    self->automount_idle_id =
-    g_idle_add_full (G_PRIORITY_LOW,
-                     automount_all_volumes_idle_cb,
-                     self, NULL);
-
+static void
+startup_required_directories (gpointer data)
+{
     /* Check the user's ~/.peony directories and post warnings
      * if there are problems.
      */
-    check_required_directories (self);
-    init_desktop (self);
+    check_required_directories (data);
+}
+
+static void
+startup_desktop (gpointer data)
+{
+    init_desktop (data);
+}
+
+static void
+startup_exit_with_last_window (gpointer data)
+{
+    GApplication *instance;
+    gboolean exit_with_last_window;
+    exit_with_last_window = TRUE;
 
     /* exit_with_last_window is already set to TRUE, and we need to keep that value
      * on other desktops, running from the command line,  or when running peony as root. 
@@ -2512,7 +2529,127 @@ peony_application_startup (GApplication *app)
             g_application_hold (G_APPLICATION (instance));
         }
     }
+}
+
+static void
+startup_extension_libraries (gpointer data)
+{
+    /* Map and relocate the extensions while the first window is being
+     * built, registering their types has to wait for the main thread.
+     */
+    peony_module_preload ();
+}
+
+static void
+startup_extensions (gpointer data)
+{
+    /* initialize peony modules */
+    peony_module_setup ();
+}
+
+static void
+startup_menu_providers (gpointer data)
+{
+    /* attach menu-provider module callback */
+    menu_provider_init_callback ();
+}
+
+static void
+startup_notifications (gpointer data)
+{
+    /* Initialize notifications for eject operations */
+    notify_init (GETTEXT_PACKAGE);
+}
 
+static void
+startup_freedesktop_dbus (gpointer data)
+{
+    fdb_manager = peony_freedesktop_dbus_new (data);
+}
+
+static void
+startup_automount (gpointer data)
+{
+    PeonyApplication *self = data;
+
+    self->automount_idle_id =
+    g_idle_add_full (G_PRIORITY_LOW,
+                     automount_all_volumes_idle_cb,
+                     self, NULL);
+}
+
+static void
+startup_reclaim_trash (gpointer data)
+{
+    /* Free the space of trash emptied in an earlier session that
+     * didn't get to finish.
+     */
+    peony_file_operations_reclaim_trash ();
+}
+
+static void
+peony_application_startup (GApplication *app)
+{
+    PeonyApplication *self = PEONY_APPLICATION (app);
+
+    /* chain up to the GTK+ implementation early, so gtk_init()
+     * is called for us.
+     */
+    G_APPLICATION_CLASS (peony_application_parent_class)->startup (app);
+
+    /* Only what the first window needs runs before it is shown, the
+     * rest once it has been drawn. See peony-startup.h.
+     */
+    peony_startup_add_task ("preferences", PEONY_STARTUP_EARLY,
+                            startup_preferences, self, NULL);
+    peony_startup_add_task ("session-client", PEONY_STARTUP_EARLY,
+                            startup_session_client, self,
+                            "preferences", NULL);
+    peony_startup_add_task ("views", PEONY_STARTUP_EARLY,
+                            startup_views, self,
+                            "preferences", NULL);
+    peony_startup_add_task ("sidebars", PEONY_STARTUP_EARLY,
+                            startup_sidebars, self,
+                            "preferences", NULL);
+    peony_startup_add_task ("styles", PEONY_STARTUP_EARLY,
+                            startup_styles, self,
+                            "preferences", NULL);
+    peony_startup_add_task ("accels", PEONY_STARTUP_EARLY,
+                            startup_accels, self, NULL);
+    peony_startup_add_task ("volume-monitor", PEONY_STARTUP_EARLY,
+                            startup_volume_monitor, self, NULL);
+    peony_startup_add_task ("required-directories", PEONY_STARTUP_EARLY,
+                            startup_required_directories, self, NULL);
+    peony_startup_add_task ("desktop", PEONY_STARTUP_EARLY,
+                            startup_desktop, self,
+                            "preferences", "views", "styles", "volume-monitor", NULL);
+    peony_startup_add_task ("exit-with-last-window", PEONY_STARTUP_EARLY,
+                            startup_exit_with_last_window, self,
+                            "preferences", NULL);
+    /* Clients that start us to show a file wait for the name, and
+     * owning it is only a request to the bus.
+     */
+    peony_startup_add_task ("freedesktop-dbus", PEONY_STARTUP_EARLY,
+                            startup_freedesktop_dbus, self, NULL);
+
+    peony_startup_add_task ("extension-libraries", PEONY_STARTUP_THREAD,
+                            startup_extension_libraries, self, NULL);
+
+    peony_startup_add_task ("extensions", PEONY_STARTUP_DEFERRED,
+                            startup_extensions, self,
+                            "preferences", "extension-libraries", NULL);
+    peony_startup_add_task ("menu-providers", PEONY_STARTUP_DEFERRED,
+                            startup_menu_providers, self,
+                            "extensions", NULL);
+    peony_startup_add_task ("notifications", PEONY_STARTUP_DEFERRED,
+                            startup_notifications, self, NULL);
+    peony_startup_add_task ("automount", PEONY_STARTUP_DEFERRED,
+                            startup_automount, self,
+                            "volume-monitor", NULL);
+    peony_startup_add_task ("reclaim-trash", PEONY_STARTUP_DEFERRED,
+                            startup_reclaim_trash, self, NULL);
+
+    peony_startup_run ();
 }
 
 static void
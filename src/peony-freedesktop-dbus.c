@@ -27,10 +27,32 @@
 #include "peony-freedesktop-generated.h"
 
 #include <libpeony-private/peony-debug-log.h>
+#include <libpeony-private/peony-trace.h>
 
 #include "file-manager/fm-properties-window.h"
 
 #include <gio/gio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Peony's own interface for collecting performance traces */
+#define PEONY_TRACE_DBUS_IFACE "org.ukui.Peony.Trace"
+#define PEONY_TRACE_DBUS_PATH  "/org/ukui/Peony/Trace"
+
+static const gchar trace_introspection_xml[] =
+    "<node>"
+    "  <interface name='" PEONY_TRACE_DBUS_IFACE "'>"
+    "    <method name='SetEnabled'>"
+    "      <arg type='b' name='Enabled' direction='in'/>"
+    "    </method>"
+    "    <method name='Dump'>"
+    "      <arg type='s' name='Filename' direction='in'/>"
+    "    </method>"
+    "    <method name='GetCounters'>"
+    "      <arg type='a{sx}' name='Counters' direction='out'/>"
+    "    </method>"
+    "  </interface>"
+    "</node>";
 
 struct _PeonyFreedesktopDBus {
     GObject parent;
@@ -44,6 +66,10 @@ struct _PeonyFreedesktopDBus {
     /* Our DBus implementation skeleton */
     PeonyFreedesktopFileManager1 *skeleton;
 
+    /* Registration of the trace interface */
+    GDBusConnection *connection;
+    guint trace_registration_id;
+
     /* Peony application */
     PeonyApplication *application;
 };
@@ -153,6 +179,138 @@ skeleton_handle_show_item_properties_cb (PeonyFreedesktopFileManager1 *object,
     return TRUE;
 }
 
+static gboolean
+path_is_below (const char *path,
+               const char *dir)
+{
+    char *real_dir;
+    gboolean below;
+    size_t length;
+
+    real_dir = realpath (dir, NULL);
+    if (real_dir == NULL) {
+        return FALSE;
+    }
+
+    length = strlen (real_dir);
+    below = strncmp (path, real_dir, length) == 0 &&
+            (path[length] == '\0' || path[length] == '/');
+    free (real_dir);
+
+    return below;
+}
+
+/* Anyone on the session bus may call Dump, so it only writes into the
+ * user's runtime or cache directory rather than wherever it is told.
+ */
+static gboolean
+trace_dump_path_is_allowed (const char *filename)
+{
+    char *dirname, *basename, *real_dir;
+    gboolean allowed;
+
+    if (!g_path_is_absolute (filename)) {
+        return FALSE;
+    }
+
+    basename = g_path_get_basename (filename);
+    allowed = strcmp (basename, ".") != 0 &&
+              strcmp (basename, "..") != 0 &&
+              strcmp (basename, G_DIR_SEPARATOR_S) != 0;
+    g_free (basename);
+    if (!allowed) {
+        return FALSE;
+    }
+
+    dirname = g_path_get_dirname (filename);
+    real_dir = realpath (dirname, NULL);
+    g_free (dirname);
+    if (real_dir == NULL) {
+        return FALSE;
+    }
+
+    allowed = path_is_below (real_dir, g_get_user_runtime_dir ()) ||
+              path_is_below (real_dir, g_get_user_cache_dir ());
+    free (real_dir);
+
+    return allowed;
+}
+
+static void
+trace_method_call_cb (GDBusConnection       *connection,
+                      const gchar           *sender,
+                      const gchar           *object_path,
+                      const gchar           *interface_name,
+                      const gchar           *method_name,
+                      GVariant              *parameters,
+                      GDBusMethodInvocation *invocation,
+                      gpointer               user_data)
+{
+    GVariantBuilder builder;
+    GHashTableIter iter;
+    GHashTable *counters;
+    gpointer name, value;
+    GError *error;
+    gboolean enabled;
+    const gchar *filename;
+
+    if (g_strcmp0 (method_name, "SetEnabled") == 0) {
+        g_variant_get (parameters, "(b)", &enabled);
+        peony_trace_set_enabled (enabled);
+        g_dbus_method_invocation_return_value (invocation, NULL);
+    } else if (g_strcmp0 (method_name, "Dump") == 0) {
+        g_variant_get (parameters, "(&s)", &filename);
+        error = NULL;
+        if (!trace_dump_path_is_allowed (filename)) {
+            g_dbus_method_invocation_return_error (invocation,
+                                                   G_DBUS_ERROR,
+                                                   G_DBUS_ERROR_ACCESS_DENIED,
+                                                   "Traces can only be written below %s or %s",
+                                                   g_get_user_runtime_dir (),
+                                                   g_get_user_cache_dir ());
+        } else if (peony_trace_dump (filename, &error)) {
+            g_dbus_method_invocation_return_value (invocation, NULL);
+        } else {
+            g_dbus_method_invocation_take_error (invocation, error);
+        }
+    } else if (g_strcmp0 (method_name, "GetCounters") == 0) {
+        counters = peony_trace_get_counters ();
+        g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sx}"));
+        g_hash_table_iter_init (&iter, counters);
+        while (g_hash_table_iter_next (&iter, &name, &value)) {
+            g_variant_builder_add (&builder, "{sx}", name, *(gint64 *) value);
+        }
+        g_hash_table_unref (counters);
+        g_dbus_method_invocation_return_value (invocation,
+                                               g_variant_new ("(a{sx})", &builder));
+    }
+}
+
+static const GDBusInterfaceVTable trace_interface_vtable = {
+    trace_method_call_cb,
+    NULL,
+    NULL
+};
+
+static void
+register_trace_interface (PeonyFreedesktopDBus *fdb,
+                          GDBusConnection      *conn)
+{
+    GDBusNodeInfo *node_info;
+
+    node_info = g_dbus_node_info_new_for_xml (trace_introspection_xml, NULL);
+    g_assert (node_info != NULL);
+
+    fdb->connection = g_object_ref (conn);
+    fdb->trace_registration_id =
+        g_dbus_connection_register_object (conn,
+                                           PEONY_TRACE_DBUS_PATH,
+                                           node_info->interfaces[0],
+                                           &trace_interface_vtable,
+                                           fdb, NULL, NULL);
+    g_dbus_node_info_unref (node_info);
+}
+
 static void
 bus_acquired_cb (GDBusConnection *conn,
                  const gchar     *name,
@@ -176,6 +334,8 @@ bus_acquired_cb (GDBusConnection *conn,
     g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (fdb->skeleton), conn, PEONY_FDO_DBUS_PATH, NULL);
 
     g_dbus_object_manager_server_set_connection (fdb->object_manager, conn);
+
+    register_trace_interface (fdb, conn);
 }
 
 static void
@@ -210,6 +370,12 @@ peony_freedesktop_dbus_dispose (GObject *object)
         fdb->skeleton = NULL;
     }
 
+    if (fdb->trace_registration_id != 0) {
+        g_dbus_connection_unregister_object (fdb->connection, fdb->trace_registration_id);
+        fdb->trace_registration_id = 0;
+    }
+    g_clear_object (&fdb->connection);
+
     g_clear_object (&fdb->object_manager);
 
     G_OBJECT_CLASS (peony_freedesktop_dbus_parent_class)->dispose (object);
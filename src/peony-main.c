@@ -28,6 +28,7 @@
 /* peony-main.c: Implementation of the routines that drive program lifecycle and main window creation/destruction. */
 
 #include <config.h>
+#include "peony-startup.h"
 #include "peony-window.h"
 #include <dlfcn.h>
 #include <signal.h>
@@ -40,8 +41,10 @@
 #include <glib/gi18n.h>
 #include <gio/gdesktopappinfo.h>
 #include <libpeony-private/peony-debug-log.h>
+#include <libpeony-private/peony-file.h>
 #include <libpeony-private/peony-global-preferences.h>
 #include <libpeony-private/peony-icon-names.h>
+#include <libpeony-private/peony-trace.h>
 #include <libxml/parser.h>
 #ifdef HAVE_LOCALE_H
 	#include <locale.h>
@@ -67,11 +70,24 @@ static void dump_debug_log (void)
     g_free (filename);
 }
 
+static void dump_trace (void)
+{
+    char *filename;
+
+    if (!peony_trace_is_enabled ())
+        return;
+
+    filename = g_build_filename (g_get_home_dir (), "peony-trace.json", NULL);
+    peony_trace_dump (filename, NULL); /* NULL GError */
+    g_free (filename);
+}
+
 static int debug_log_pipes[2];
 
 static gboolean debug_log_io_cb (GIOChannel *io, GIOCondition condition, gpointer data)
 {
     char a;
+    char *memory_report;
 
     while (read (debug_log_pipes[0], &a, 1) != 1)
         ;
@@ -79,7 +95,13 @@ static gboolean debug_log_io_cb (GIOChannel *io, GIOCondition condition, gpointe
     peony_debug_log (TRUE, PEONY_DEBUG_LOG_DOMAIN_USER,
                     "user requested dump of debug log");
 
+    memory_report = peony_file_get_memory_report ();
+    peony_debug_log (FALSE, PEONY_DEBUG_LOG_DOMAIN_USER,
+                    "file memory usage:\n%s", memory_report);
+    g_free (memory_report);
+
     dump_debug_log ();
+    dump_trace ();
     return FALSE;
 }
 
@@ -214,6 +236,9 @@ setup_debug_log (void)
 
     setup_debug_log_signals ();
     setup_debug_log_glog ();
+
+    if (g_getenv ("PEONY_TRACE") != NULL)
+        peony_trace_set_enabled (TRUE);
 }
 
 static gboolean
@@ -279,6 +304,7 @@ main (int argc, char *argv[])
 	xmp_init();
 #endif
 
+	peony_startup_begin ();
 	setup_debug_log ();
 
 	/* Initialize the services that we use. */
@@ -356,7 +356,6 @@ peony_navigation_window_init (PeonyNavigationWindow *window)
                               window);
 
     //pdf_viewer_init();
-    office_utils_conncet_window_info (PEONY_WINDOW_INFO (window));
     g_signal_connect (PEONY_WINDOW_INFO (window), "image_search", G_CALLBACK (real_image_search_callback), 0);
 }
 
@@ -795,6 +794,12 @@ peony_navigation_window_destroy (GtkWidget *object)
     window->details->pdf_view = NULL;
     window->details->web_swindow = NULL;
     window->details->web_view = NULL;
+    window->details->image_swindow = NULL;
+    window->details->image_view = NULL;
+    if (window->details->preview_cancellable) {
+        g_cancellable_cancel (window->details->preview_cancellable);
+        g_clear_object (&window->details->preview_cancellable);
+    }
     window->details->empty_window = NULL;
     window->details->hint_view = NULL;
     window->details->current_preview_filename = NULL;
@@ -806,7 +811,6 @@ peony_navigation_window_destroy (GtkWidget *object)
     //global_test_widget = NULL;
 
     //pdf_viewer_shutdown();    
-    clean_cache_files_anyway ();
 
     GTK_WIDGET_CLASS (parent_class)->destroy (object);
 }
@@ -1518,14 +1522,42 @@ create_extra_pane (PeonyNavigationWindow *window)
     return slot;
 }
 
+/* Images are decoded to fit the smaller side of the pane, in steps so
+ * resizing the pane a little still finds the cached previews.
+ */
+#define PREVIEW_SIZE_STEP 256
+
+/* Items on each side of the selection whose previews are prefetched */
+#define PREVIEW_PREFETCH_COUNT 2
+
+static void show_preview_widget (PeonyNavigationWindow *window, GtkWidget *widget) {
+    GtkWidget *widgets[5];
+    int i;
+
+    widgets[0] = window->details->empty_window;
+    widgets[1] = window->details->test_widget;
+    widgets[2] = window->details->pdf_swindow;
+    widgets[3] = window->details->web_swindow;
+    widgets[4] = window->details->image_swindow;
+
+    for (i = 0; i < G_N_ELEMENTS (widgets); i++) {
+        if (widgets[i] != widget) {
+            gtk_widget_hide (widgets[i]);
+        }
+    }
+    gtk_widget_show_all (widget);
+}
+
+static void show_preview_hint (PeonyNavigationWindow *window, const char *hint) {
+    gtk_label_set_label (window->details->hint_view, hint);
+    show_preview_widget (window, window->details->empty_window);
+}
+
 static void show_pdf_file_callback (PeonyWindowInfo *window_info, gpointer data) {
     PeonyNavigationWindow *window = PEONY_NAVIGATION_WINDOW (window_info);
     if (is_pdf_file (window->details->current_preview_filename)) {
         set_pdf_preview_widget_file_by_filename(window->details->pdf_view, window->details->current_preview_filename);
-        gtk_widget_hide (window->details->empty_window);
-        gtk_widget_show_all (window->details->pdf_swindow);
-        gtk_widget_hide (window->details->test_widget);
-        gtk_widget_hide (window->details->web_swindow);
+        show_preview_widget (window, window->details->pdf_swindow);
     }
 }
 
@@ -1555,10 +1587,7 @@ static void office_format_trans_ready_callback(PeonyWindowInfo *window_info, gpo
 
     if (filename_has_suffix(pending_preview_filename,".pdf")) {
         set_pdf_preview_widget_file_by_filename (window->details->pdf_view, pending_preview_filename);
-        gtk_widget_hide (window->details->empty_window);
-        gtk_widget_show_all (window->details->pdf_swindow);
-        gtk_widget_hide (window->details->test_widget);
-        gtk_widget_hide (window->details->web_swindow);
+        show_preview_widget (window, window->details->pdf_swindow);
     } else if (filename_has_suffix(pending_preview_filename,".html")) {
         gchar *uri;
         uri = g_strdup_printf("file://%s", pending_preview_filename);
@@ -1566,12 +1595,134 @@ static void office_format_trans_ready_callback(PeonyWindowInfo *window_info, gpo
         webkit_web_view_set_zoom_level (window->details->web_view, 1.50);
         webkit_web_view_load_uri (WEBKIT_WEB_VIEW (window->details->web_view), uri);
         g_free(uri);
-        gtk_widget_hide (window->details->empty_window);
-        gtk_widget_hide (window->details->pdf_swindow);
-        gtk_widget_hide (window->details->test_widget);
-        gtk_widget_show_all (window->details->web_swindow);
+        show_preview_widget (window, window->details->web_swindow);
+    }
+
+}
+
+static void show_preview (PeonyNavigationWindow *window, PreviewData *preview) {
+    char *data = preview->filename;
+
+    switch (preview->kind) {
+    case PREVIEW_KIND_TEXT:
+        if (preview->text) {
+            show_text_cb (window->details->gtk_source_widget, data, preview->text);
+        } else {
+            //not UTF-8, the text view guesses the encoding while loading it
+            open_file_cb (window->details->gtk_source_widget, data);
+        }
+        show_preview_widget (window, window->details->test_widget);
+        break;
+    case PREVIEW_KIND_IMAGE:
+        if (preview->pixbuf) {
+            gtk_image_set_from_pixbuf (GTK_IMAGE (window->details->image_view), preview->pixbuf);
+            show_preview_widget (window, window->details->image_swindow);
+            break;
+        }
+        //let the web view try what couldn't be decoded
+    case PREVIEW_KIND_WEB_IMAGE: {
+        //printf("is image type\n");
+        gchar *uri;
+        uri = g_strdup_printf("file://%s", data);
+        //printf("load uri: %s",uri);
+        webkit_web_view_set_zoom_level (window->details->web_view, 1.00);
+        webkit_web_view_load_uri (WEBKIT_WEB_VIEW (window->details->web_view), uri);
+        g_free(uri);
+        show_preview_widget (window, window->details->web_swindow);
+        break;
+    }
+    case PREVIEW_KIND_PDF:
+        //printf("is pdf type\n");
+        window_delay_set_pdf_preview_widget_file_by_filename (PEONY_WINDOW_INFO (window), data);
+        show_preview_hint (window, _("Loading..."));
+        break;
+    case PREVIEW_KIND_OFFICE: {
+        //window->details->pending_preview_filename = get_pending_preview_filename(window->details->current_preview_filename);
+        char* fakename = get_pending_preview_filename (window->details->current_preview_filename);
+        window->details->current_previewing_office_filename = g_strdup (data);
+        //printf ("current_previewing_office_filename: %s ", peony_navigation_window_get_current_previewing_office_file_by_window_info (PEONY_WINDOW_INFO (window)));
+
+        //we'll sheduel a unoconv child progress to tran office file to pdf/html first, this will be delayed for a few times.
+        //the current preview filename is the file which we selecting now.
+        //the pending preview filename is a tmp pdf/thml file that trans by the child prog.
+        //the current_previewing_office_filename is simillar to current preview filename, but it just recored the newest office file which we select.
+        //when office trans ready, we'll compare the current_previewing_filename and current_previewing_office_filename,
+        //if they are not same, we won't show the office preview widget.
+
+        //printf ("prepare_to_trans_file_by_window\n");
+
+        prepare_to_trans_file_by_window (PEONY_WINDOW_INFO (window), window->details->current_previewing_office_filename);
+
+        if (fakename)
+            show_preview_hint (window, _("Loading..."));
+        else
+            show_preview_hint (window, _("Can't preview this file"));
+
+        g_free (fakename);
+        break;
+    }
+    default:
+        //printf("can't preview this file\n");
+        show_preview_hint (window, _("Can't preview this file"));
+        break;
+    }
+}
+
+static void preview_loaded_callback (GObject *source_object, GAsyncResult *result, gpointer user_data) {
+    PeonyNavigationWindow *window;
+    PreviewData *preview;
+    GError *error = NULL;
+
+    preview = preview_loader_load_finish (result, &error);
+    if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        //the selection moved on or the window went away, don't touch it
+        g_error_free (error);
+        return;
     }
 
+    window = PEONY_NAVIGATION_WINDOW (user_data);
+    g_clear_object (&window->details->preview_cancellable);
+
+    if (preview) {
+        show_preview (window, preview);
+        preview_data_unref (preview);
+    } else {
+        show_preview_hint (window, _("Can't preview this file"));
+        g_error_free (error);
+    }
+}
+
+static int get_preview_size (PeonyNavigationWindow *window) {
+    GtkAllocation allocation;
+    int size;
+
+    gtk_widget_get_allocation (GTK_WIDGET (window->details->preview_hbox), &allocation);
+    size = MIN (allocation.width, allocation.height);
+
+    return MAX (1, (size + PREVIEW_SIZE_STEP - 1) / PREVIEW_SIZE_STEP) * PREVIEW_SIZE_STEP;
+}
+
+static GList *get_adjacent_filenames (PeonyNavigationWindow *window) {
+    PeonyWindowSlot *slot;
+    GList *locations, *filenames, *l;
+    char *path;
+
+    slot = PEONY_WINDOW (window)->details->active_pane->active_slot;
+    if (slot == NULL || slot->content_view == NULL) {
+        return NULL;
+    }
+
+    locations = peony_view_get_adjacent_locations (slot->content_view, PREVIEW_PREFETCH_COUNT);
+    filenames = NULL;
+    for (l = locations; l != NULL; l = l->next) {
+        path = g_file_get_path (l->data);
+        if (path) {
+            filenames = g_list_prepend (filenames, path);
+        }
+    }
+    g_list_free_full (locations, g_object_unref);
+
+    return g_list_reverse (filenames);
 }
 
 static void preview_file_changed_callback(PeonyWindowInfo *window_info){
@@ -1588,6 +1739,11 @@ static void preview_file_changed_callback(PeonyWindowInfo *window_info){
     }
 
     char *data = NULL;
+    GList *neighbours = NULL;
+    GList *adjacent;
+    GList *l;
+    PreviewData *preview;
+    int preview_size;
 
 	printf ("preview file changed callback\n");
 	GList *files = peony_window_info_get_selection (window_info);
@@ -1598,24 +1754,38 @@ static void preview_file_changed_callback(PeonyWindowInfo *window_info){
 			printf ("selection: %s\n", name);
 			data = name;
 		}
+		/* The rest of the selection is likely to be previewed next */
+		for (l = files->next; l != NULL; l = l->next) {
+			name = g_file_get_path (l->data);
+			if (name) {
+				neighbours = g_list_prepend (neighbours, name);
+			}
+		}
+		neighbours = g_list_reverse (neighbours);
         g_list_free_full (files, g_object_unref);
 	}
 
+    /* Whatever the pdf view was still loading was for the old selection */
+    if (window->details->pdf_view) {
+        pdf_preview_widget_cancel_load (window->details->pdf_view);
+    }
+
+    if (window->details->preview_cancellable) {
+        g_cancellable_cancel (window->details->preview_cancellable);
+        g_clear_object (&window->details->preview_cancellable);
+    }
+
     if(data == NULL){
         //printf ("null\n\n\n");
-        gtk_label_set_label(window->details->hint_view, _("Select the file you want to preview"));
-	    gtk_widget_show_all(window->details->empty_window);
-	    gtk_widget_hide(window->details->pdf_swindow);
-	    gtk_widget_hide(window->details->test_widget);
-        gtk_widget_hide(window->details->web_swindow);
+        show_preview_hint (window, _("Select the file you want to preview"));
         window->details->current_preview_filename = NULL;
+        g_list_free_full (neighbours, g_free);
         return;
     } 
 
     if (window->details->pending_preview_filename){
         //printf("has tmp file before: %s\n", window->details->pending_preview_filename);
         //g_remove (window->details->pending_preview_filename);
-        clean_cache_files_anyway();
         free (window->details->pending_preview_filename);
         window->details->pending_preview_filename = NULL;
     }
@@ -1627,79 +1797,29 @@ static void preview_file_changed_callback(PeonyWindowInfo *window_info){
     //printf ("preview start:\n");
     window->details->current_preview_filename = g_strdup (data);
 
-    if(is_text_type((char*)data)){
-	    open_file_cb(window->details->gtk_source_widget,(char*)data);
-        gtk_widget_hide (window->details->empty_window);
-        gtk_widget_hide (window->details->pdf_swindow);
-        gtk_widget_hide (window->details->web_swindow);
-        gtk_widget_show_all (window->details->test_widget);
-    } else if (is_image_type((char*)data)) {
-        //printf("is image type\n");
-        gchar *uri;
-        uri = g_strdup_printf("file://%s", data);
-        //printf("load uri: %s",uri);
-        webkit_web_view_set_zoom_level (window->details->web_view, 1.00);
-        webkit_web_view_load_uri (WEBKIT_WEB_VIEW (window->details->web_view), uri);
-        g_free(uri);
-        gtk_widget_hide (window->details->empty_window);
-        gtk_widget_hide (window->details->pdf_swindow);
-        gtk_widget_hide (window->details->test_widget);
-        gtk_widget_show_all (window->details->web_swindow);
-    }  else if (is_pdf_type((char*)data)) {
-        //printf("is pdf type\n");
-        window_delay_set_pdf_preview_widget_file_by_filename (PEONY_WINDOW_INFO (window), (char*)data);
-        /*
-        set_pdf_preview_widget_file_by_filename(window->details->pdf_view,(char*)data);
-        gtk_widget_hide (window->details->empty_window);
-        gtk_widget_show_all (window->details->pdf_swindow);
-        gtk_widget_hide (window->details->test_widget);
-        gtk_widget_hide (window->details->web_swindow);
-        */
-
-        gtk_label_set_label (window->details->hint_view, _("Loading..."));
-        gtk_widget_show_all (window->details->empty_window);
-	    gtk_widget_hide (window->details->pdf_swindow);
-	    gtk_widget_hide (window->details->test_widget);
-        gtk_widget_hide (window->details->web_swindow);
-    } else if (is_office_file((char*) data)) {
-
-        //window->details->pending_preview_filename = get_pending_preview_filename(window->details->current_preview_filename);
-        //window->details->current_preview_filename = g_strdup (data);
-        char* fakename = get_pending_preview_filename (window->details->current_preview_filename);
-        window->details->current_previewing_office_filename = g_strdup (data);
-        //printf ("current_previewing_office_filename: %s ", peony_navigation_window_get_current_previewing_office_file_by_window_info (PEONY_WINDOW_INFO (window)));
-
-        //we'll sheduel a unoconv child progress to tran office file to pdf/html first, this will be delayed for a few times.
-        //the current preview filename is the file which we selecting now.
-        //the pending preview filename is a tmp pdf/thml file that trans by the child prog.
-        //the current_previewing_office_filename is simillar to current preview filename, but it just recored the newest office file which we select.
-        //when office trans ready, we'll compare the current_previewing_filename and current_previewing_office_filename,
-        //if they are not same, we won't show the office preview widget.
-
-        //printf ("prepare_to_trans_file_by_window\n");
-
-        prepare_to_trans_file_by_window (PEONY_WINDOW_INFO (window), window->details->current_previewing_office_filename);
-
-        if (fakename)
-            gtk_label_set_label (window->details->hint_view, _("Loading..."));
-        else
-            gtk_label_set_label (window->details->hint_view, _("Can't preview this file"));
-
-        g_free (fakename);
-
-	    gtk_widget_show_all (window->details->empty_window);
-	    gtk_widget_hide (window->details->pdf_swindow);
-	    gtk_widget_hide (window->details->test_widget);
-        gtk_widget_hide (window->details->web_swindow);
+    preview_size = get_preview_size (window);
+    preview = preview_loader_lookup (data, preview_size);
+    if (preview) {
+        show_preview (window, preview);
+        preview_data_unref (preview);
     } else {
-        //printf("can't preview this file\n");
-        gtk_label_set_label (window->details->hint_view, _("Can't preview this file"));
-	    gtk_widget_show_all (window->details->empty_window);
-	    gtk_widget_hide (window->details->pdf_swindow);
-	    gtk_widget_hide (window->details->test_widget);
-        gtk_widget_hide (window->details->web_swindow);
+        show_preview_hint (window, _("Loading..."));
+        window->details->preview_cancellable = g_cancellable_new ();
+        preview_loader_load_async (data,
+                                   preview_size,
+                                   window->details->preview_cancellable,
+                                   preview_loaded_callback,
+                                   window);
     }
     g_free (data);
+
+    /* The items next to it in the view are likely to be previewed next */
+    adjacent = get_adjacent_filenames (window);
+    preview_loader_prefetch (adjacent, preview_size);
+    g_list_free_full (adjacent, g_free);
+
+    office_utils_prefetch_files (neighbours);
+    g_list_free_full (neighbours, g_free);
 }
 
 static gboolean do_not_show_right_click_menu_callback (WebKitWebView *web_view) {
@@ -1748,6 +1868,12 @@ peony_navigation_window_split_view_on (PeonyNavigationWindow *window)
         gtk_container_add (GTK_CONTAINER(window->details->web_swindow), GTK_WIDGET(window->details->web_view));
         gtk_box_pack_start (GTK_BOX(window->details->preview_hbox), GTK_WIDGET(window->details->web_swindow), TRUE, TRUE, 0);
 
+        //add image widget to preview_hbox
+        window->details->image_swindow = gtk_scrolled_window_new(NULL,NULL);
+        window->details->image_view = gtk_image_new ();
+        gtk_container_add (GTK_CONTAINER(window->details->image_swindow), window->details->image_view);
+        gtk_box_pack_start (GTK_BOX(window->details->preview_hbox), GTK_WIDGET(window->details->image_swindow), TRUE, TRUE, 0);
+
         //add empty widget to preview_hbox
         window->details->empty_window = gtk_scrolled_window_new(NULL,NULL);
         window->details->hint_view = gtk_label_new (_("Select the file you want to preview"));    
@@ -1766,6 +1892,7 @@ last:
     gtk_widget_hide (window->details->test_widget);
     gtk_widget_hide (window->details->pdf_swindow);
     gtk_widget_hide (window->details->web_swindow);
+    gtk_widget_hide (window->details->image_swindow);
 
     g_signal_connect (PEONY_WINDOW_INFO(window),
                           "selection_changed",
@@ -1791,14 +1918,16 @@ void
 peony_navigation_window_split_view_off (PeonyNavigationWindow *window)
 {
     gtk_widget_hide (window->details->preview_hbox);
+    if (window->details->preview_cancellable) {
+        g_cancellable_cancel (window->details->preview_cancellable);
+        g_clear_object (&window->details->preview_cancellable);
+    }
     g_signal_handlers_disconnect_by_func(PEONY_WINDOW_INFO(window),G_CALLBACK(preview_file_changed_callback), NULL);
     g_signal_handlers_disconnect_by_func(PEONY_WINDOW_INFO(window),G_CALLBACK(office_format_trans_ready_callback),NULL);
     g_signal_handlers_disconnect_by_func(PEONY_WINDOW_INFO(window),G_CALLBACK(show_pdf_file_callback),NULL);
 
     window->details->is_split_view_showing = FALSE;
     peony_navigation_window_update_split_view_actions_sensitivity (window);
-    
-    clean_cache_files_anyway ();
 }
 
 gboolean
@@ -48,6 +48,7 @@
 #include <libpeony-private/peony-window-info.h>
 #include <libpeony-private/peony-window-slot-info.h>
 #include <gio/gio.h>
+#include <glib/gstdio.h>
 #include <libnotify/notify.h>
 
 #include "peony-bookmark-list.h"
@@ -72,10 +73,6 @@ typedef struct
     GtkTreeModel       *filter_model;
     PeonyWindowInfo *window;
     PeonyBookmarkList *bookmarks;
-    GVolumeMonitor *volume_monitor;
-
-    gboolean devices_header_added;
-    gboolean bookmarks_header_added;
 
     /* DnD */
     GList     *drag_list;
@@ -137,6 +134,7 @@ enum
     PLACES_SIDEBAR_COLUMN_EJECT_ICON,
     PLACES_SIDEBAR_COLUMN_SECTION_TYPE,
     PLACES_SIDEBAR_COLUMN_HEADING_TEXT,
+    PLACES_SIDEBAR_COLUMN_GICON, /* what ICON was rendered from */
 
     PLACES_SIDEBAR_COLUMN_COUNT
 };
@@ -158,6 +156,51 @@ typedef enum {
     SECTION_FAVORITE,
 } SectionType;
 
+#define PLACES_MODEL_UPDATE_DELAY 100 /* milliseconds */
+
+/* One row of the places list, as computed by the shared model */
+typedef struct
+{
+    char *key;
+    PlaceType place_type;
+    SectionType section_type;
+    char *name;
+    char *heading_text;
+    char *uri;
+    char *tooltip;
+    int index;
+    GIcon *icon;
+    GdkPixbuf *pixbuf;
+    GDrive *drive;
+    GVolume *volume;
+    GMount *mount;
+    gboolean show_eject_button;
+    GdkPixbuf *eject_pixbuf;
+} PlaceRow;
+
+/* The places are the same in every window, so they are computed once
+ * for all sidebars, which then only apply the differences to their
+ * own stores.
+ */
+typedef struct
+{
+    GVolumeMonitor *volume_monitor;
+    PeonyBookmarkList *bookmarks;
+    GPtrArray *rows;
+    GList *sidebars;
+    guint update_timeout_id;
+
+    /* ~/.config/peony/favorite-files as last read, and the stat
+     * results it was read with.
+     */
+    char **favorite_uris;
+    time_t favorite_files_mtime;
+    goffset favorite_files_size;
+    guint64 favorite_files_inode;
+} PlacesModel;
+
+static PlacesModel *places_model = NULL;
+
 static void  peony_places_sidebar_iface_init        (PeonySidebarIface         *iface);
 static void  sidebar_provider_iface_init               (PeonySidebarProviderIface *iface);
 static GType peony_places_sidebar_provider_get_type (void);
@@ -178,6 +221,7 @@ static void  check_unmount_and_eject                   (GMount *mount,
         gboolean *show_eject);
 
 static void bookmarks_check_popup_sensitivity          (PeonyPlacesSidebar *sidebar);
+static void places_model_queue_update                  (PlacesModel *model);
 
 /* Identifiers for target types */
 enum
@@ -282,64 +326,6 @@ is_built_in_bookmark (PeonyFile *file)
     return built_in;
 }
 
-static GtkTreeIter
-add_heading (PeonyPlacesSidebar *sidebar,
-         SectionType section_type,
-         const gchar *title,
-         const gchar *uri,
-         GIcon *icon)
-{
-    GtkTreeIter iter, child_iter;
-    GdkPixbuf      *pixbuf = NULL;
-    PeonyIconInfo   *icon_info = NULL;
-    int             icon_size;
-
-    
-    // check_heading_for_section (sidebar, section_type);
-    
-     icon_size = peony_get_icon_size_for_stock_size (GTK_ICON_SIZE_MENU);
-     icon_info = peony_icon_info_lookup (icon, icon_size);
-    
-     pixbuf = peony_icon_info_get_pixbuf_at_size (icon_info, icon_size);
-     g_object_unref (icon_info);
-
-    gtk_list_store_append (sidebar->store, &iter);
-	if(NULL == uri || NULL == icon)
-	{
-		gtk_list_store_set (sidebar->store, &iter,
-                PLACES_SIDEBAR_COLUMN_ROW_TYPE, PLACES_HEADING,
-                PLACES_SIDEBAR_COLUMN_SECTION_TYPE, section_type,    
-                PLACES_SIDEBAR_COLUMN_HEADING_TEXT, title,
-                PLACES_SIDEBAR_COLUMN_EJECT, FALSE,
-                PLACES_SIDEBAR_COLUMN_NO_EJECT, TRUE,
-                -1);
-	}
-	else
-	{
-	    gtk_list_store_set (sidebar->store, &iter,
-	                PLACES_SIDEBAR_COLUMN_ROW_TYPE, PLACES_HEADING,
-	                PLACES_SIDEBAR_COLUMN_SECTION_TYPE, section_type,    
-	                PLACES_SIDEBAR_COLUMN_URI,uri,
-	                PLACES_SIDEBAR_COLUMN_ICON,pixbuf,
-	                PLACES_SIDEBAR_COLUMN_HEADING_TEXT, title,
-	                PLACES_SIDEBAR_COLUMN_EJECT, FALSE,
-	                PLACES_SIDEBAR_COLUMN_NO_EJECT, TRUE,
-	                -1);
-	}
-    
-    if (pixbuf != NULL)
-    {
-        g_object_unref (pixbuf);
-    }
-
-    gtk_tree_model_filter_refilter (GTK_TREE_MODEL_FILTER (sidebar->filter_model));
-    gtk_tree_model_filter_convert_child_iter_to_iter (GTK_TREE_MODEL_FILTER (sidebar->filter_model),
-                              &child_iter,
-                              &iter);
-
-    return child_iter;
-}
-
 static void
 check_heading_for_section (PeonyPlacesSidebar *sidebar,
                SectionType section_type)
@@ -367,7 +353,7 @@ check_heading_for_section (PeonyPlacesSidebar *sidebar,
 }
 
 static GtkTreeIter
-insert_place_no_write_file (PeonyPlacesSidebar *sidebar,
+insert_place (PeonyPlacesSidebar *sidebar,
            PlaceType place_type,
            SectionType section_type,
            const char *name,
@@ -422,7 +408,6 @@ insert_place_no_write_file (PeonyPlacesSidebar *sidebar,
 //    gtk_list_store_append (sidebar->store, &iter);
 //    gtk_list_store_insert (sidebar->store, &iter, 5);
 
-
     char            *path1;
     GSettings       *settings1;
     settings1                       = g_settings_new("org.ukui.peony.preferences");
@@ -457,136 +442,198 @@ insert_place_no_write_file (PeonyPlacesSidebar *sidebar,
     position = position +1;
     g_settings_set_int(settings1,"favorite-iter-position",position);
 
+    FILE *fp1;
+    char favorite_files_path[100];
+    sprintf(favorite_files_path,"%s/.config/peony/favorite-files",g_get_home_dir ());
+    fp1= fopen (favorite_files_path, "a");
+    fprintf(fp1,"%s\n", uri);
+    fclose(fp1);
+
+    /* Let the other windows show the new favorite too */
+    places_model_queue_update (places_model);
+
     return child_iter;
 }
-static GtkTreeIter
-insert_place (PeonyPlacesSidebar *sidebar,
-           PlaceType place_type,
-           SectionType section_type,
-           const char *name,
-           GIcon *icon,
-           const char *uri,
-           GDrive *drive,
-           GVolume *volume,
-           GMount *mount,
-           const int index,
-           const char *tooltip)
+static void
+compare_for_selection (PeonyPlacesSidebar *sidebar,
+                       const gchar *location,
+                       const gchar *added_uri,
+                       const gchar *last_uri,
+                       GtkTreeIter *iter,
+                       GtkTreePath **path)
 {
-    GdkPixbuf      *pixbuf;
-    GtkTreeIter     iter, child_iter;
-    GdkPixbuf      *eject;
-    PeonyIconInfo   *icon_info;
-    int             icon_size;
-    gboolean        show_eject;
-    gboolean        show_unmount;
-    gboolean        show_eject_button;
+    int res;
 
-    check_heading_for_section (sidebar, section_type);
+    res = g_strcmp0 (added_uri, last_uri);
 
-    icon_size = peony_get_icon_size_for_stock_size (GTK_ICON_SIZE_MENU);
-    icon_info = peony_icon_info_lookup (icon, icon_size);
+    if (res == 0)
+    {
+        /* last_uri always comes first */
+        if (*path != NULL)
+        {
+            gtk_tree_path_free (*path);
+        }
+        *path = gtk_tree_model_get_path (sidebar->filter_model,
+                                         iter);
+    }
+    else if (g_strcmp0 (location, added_uri) == 0)
+    {
+        if (*path == NULL)
+        {
+            *path = gtk_tree_model_get_path (sidebar->filter_model,
+                                             iter);
+        }
+    }
+}
 
-    pixbuf = peony_icon_info_get_pixbuf_at_size (icon_info, icon_size);
-    g_object_unref (icon_info);
+static void
+place_row_free (PlaceRow *row)
+{
+    g_free (row->key);
+    g_free (row->name);
+    g_free (row->heading_text);
+    g_free (row->uri);
+    g_free (row->tooltip);
+    g_clear_object (&row->icon);
+    g_clear_object (&row->pixbuf);
+    g_clear_object (&row->eject_pixbuf);
+    g_clear_object (&row->drive);
+    g_clear_object (&row->volume);
+    g_clear_object (&row->mount);
+    g_free (row);
+}
 
-    check_unmount_and_eject (mount, volume, drive,
-                             &show_unmount, &show_eject);
+/* Something that stays the same for a device while it is plugged in,
+ * unlike the GDrive, GVolume and GMount objects the volume monitor may
+ * replace.
+ */
+static char *
+place_row_device_id (GDrive *drive,
+                     GVolume *volume,
+                     GMount *mount)
+{
+    char *id;
 
-    if (show_unmount || show_eject)
+    id = NULL;
+    if (volume != NULL)
     {
-        g_assert (place_type != PLACES_BOOKMARK);
+        id = g_volume_get_uuid (volume);
+        if (id == NULL)
+        {
+            id = g_volume_get_identifier (volume, G_VOLUME_IDENTIFIER_KIND_UNIX_DEVICE);
+        }
+        if (id == NULL)
+        {
+            id = g_volume_get_name (volume);
+        }
     }
-
-    if (mount == NULL)
+    else if (mount != NULL)
     {
-        show_eject_button = FALSE;
+        id = g_mount_get_uuid (mount);
+        if (id == NULL)
+        {
+            id = g_mount_get_name (mount);
+        }
     }
-    else
+    else if (drive != NULL)
     {
-        show_eject_button = (show_unmount || show_eject);
-    }
-
-    if (show_eject_button) {
-        eject = get_eject_icon (FALSE);
-    } else {
-        eject = NULL;
+        id = g_drive_get_identifier (drive, G_VOLUME_IDENTIFIER_KIND_UNIX_DEVICE);
+        if (id == NULL)
+        {
+            id = g_drive_get_name (drive);
+        }
     }
 
-//    gtk_list_store_append (sidebar->store, &iter);
-//    gtk_list_store_insert (sidebar->store, &iter, 5);
+    return id;
+}
 
-    char            *path1;
-    GSettings       *settings1;
-    settings1                       = g_settings_new("org.ukui.peony.preferences");
-    int position=g_settings_get_int(settings1,"favorite-iter-position");
-    gtk_list_store_insert (sidebar->store, &iter, position);
+/* Identifies a row across updates. Everything else about it (name,
+ * icon, tooltip, eject button, the device objects) can change in place.
+ */
+static char *
+place_row_make_key (PlaceType place_type,
+                    SectionType section_type,
+                    const char *uri,
+                    const char *heading_text,
+                    GDrive *drive,
+                    GVolume *volume,
+                    GMount *mount)
+{
+    char *device_id, *key;
+
+    device_id = place_row_device_id (drive, volume, mount);
+    key = g_strdup_printf ("%d:%d:%c%c%c:%s:%s:%s",
+                           place_type, section_type,
+                           drive != NULL ? 'd' : '-',
+                           volume != NULL ? 'v' : '-',
+                           mount != NULL ? 'm' : '-',
+                           device_id != NULL ? device_id : "",
+                           uri != NULL ? uri : "",
+                           heading_text != NULL ? heading_text : "");
+    g_free (device_id);
+
+    return key;
+}
 
-    gtk_list_store_set (sidebar->store, &iter,
-                        PLACES_SIDEBAR_COLUMN_ICON, pixbuf,
-                        PLACES_SIDEBAR_COLUMN_NAME, name,
-                        PLACES_SIDEBAR_COLUMN_URI, uri,
-                        PLACES_SIDEBAR_COLUMN_DRIVE, drive,
-                        PLACES_SIDEBAR_COLUMN_VOLUME, volume,
-                        PLACES_SIDEBAR_COLUMN_MOUNT, mount,
-                        PLACES_SIDEBAR_COLUMN_ROW_TYPE, place_type,
-                        PLACES_SIDEBAR_COLUMN_INDEX, index,
-                        PLACES_SIDEBAR_COLUMN_EJECT, show_eject_button,
-                        PLACES_SIDEBAR_COLUMN_NO_EJECT, !show_eject_button,
-                        PLACES_SIDEBAR_COLUMN_BOOKMARK, place_type != PLACES_BOOKMARK,
-                        PLACES_SIDEBAR_COLUMN_TOOLTIP, tooltip,
-                        PLACES_SIDEBAR_COLUMN_EJECT_ICON, eject,
-                        PLACES_SIDEBAR_COLUMN_SECTION_TYPE, section_type,
-                        -1);
+static GdkPixbuf *
+place_icon_get_pixbuf (GIcon *icon)
+{
+    GdkPixbuf *pixbuf;
+    PeonyIconInfo *icon_info;
+    int icon_size;
 
-    if (pixbuf != NULL)
-    {
-        g_object_unref (pixbuf);
-    }
-    gtk_tree_model_filter_refilter (GTK_TREE_MODEL_FILTER (sidebar->filter_model));
-    gtk_tree_model_filter_convert_child_iter_to_iter (GTK_TREE_MODEL_FILTER (sidebar->filter_model),
-            &child_iter,
-            &iter);
-    position = position +1;
-    g_settings_set_int(settings1,"favorite-iter-position",position);
+    icon_size = peony_get_icon_size_for_stock_size (GTK_ICON_SIZE_MENU);
+    icon_info = peony_icon_info_lookup (icon, icon_size);
 
-    FILE *fp1;
-    char favorite_files_path[100];
-    sprintf(favorite_files_path,"%s/.config/peony/favorite-files",g_get_home_dir ());
-    fp1= fopen (favorite_files_path, "a");
-    fprintf(fp1,"%s\n", uri);
-    fclose(fp1);
+    pixbuf = peony_icon_info_get_pixbuf_at_size (icon_info, icon_size);
+    g_object_unref (icon_info);
 
-    return child_iter;
+    return pixbuf;
 }
-static GtkTreeIter
-add_place (PeonyPlacesSidebar *sidebar,
-           PlaceType place_type,
-           SectionType section_type,
-           const char *name,
-           GIcon *icon,
-           const char *uri,
-           GDrive *drive,
-           GVolume *volume,
-           GMount *mount,
-           const int index,
-           const char *tooltip)
+
+static void
+places_rows_add_heading (GPtrArray *rows,
+                         SectionType section_type,
+                         const gchar *title,
+                         const gchar *uri,
+                         GIcon *icon)
 {
-    GdkPixbuf      *pixbuf;
-    GtkTreeIter     iter, child_iter;
-    GdkPixbuf      *eject;
-    PeonyIconInfo   *icon_info;
-    int             icon_size;
-    gboolean        show_eject;
-    gboolean        show_unmount;
-    gboolean        show_eject_button;
+    PlaceRow *row;
 
-    check_heading_for_section (sidebar, section_type);
+    row = g_new0 (PlaceRow, 1);
+    row->place_type = PLACES_HEADING;
+    row->section_type = section_type;
+    row->heading_text = g_strdup (title);
 
-    icon_size = peony_get_icon_size_for_stock_size (GTK_ICON_SIZE_MENU);
-    icon_info = peony_icon_info_lookup (icon, icon_size);
+    if (uri != NULL && icon != NULL)
+    {
+        row->uri = g_strdup (uri);
+        row->icon = g_object_ref (icon);
+        row->pixbuf = place_icon_get_pixbuf (icon);
+    }
 
-    pixbuf = peony_icon_info_get_pixbuf_at_size (icon_info, icon_size);
-    g_object_unref (icon_info);
+    row->key = place_row_make_key (row->place_type, section_type,
+                                   row->uri, title, NULL, NULL, NULL);
+
+    g_ptr_array_add (rows, row);
+}
+
+static void
+places_rows_add_place (GPtrArray *rows,
+                       PlaceType place_type,
+                       SectionType section_type,
+                       const char *name,
+                       GIcon *icon,
+                       const char *uri,
+                       GDrive *drive,
+                       GVolume *volume,
+                       GMount *mount,
+                       const int index,
+                       const char *tooltip)
+{
+    PlaceRow *row;
+    gboolean show_eject;
+    gboolean show_unmount;
 
     check_unmount_and_eject (mount, volume, drive,
                              &show_unmount, &show_eject);
@@ -596,90 +643,87 @@ add_place (PeonyPlacesSidebar *sidebar,
         g_assert (place_type != PLACES_BOOKMARK);
     }
 
-    if (mount == NULL)
+    row = g_new0 (PlaceRow, 1);
+    row->place_type = place_type;
+    row->section_type = section_type;
+    row->name = g_strdup (name);
+    row->uri = g_strdup (uri);
+    row->tooltip = g_strdup (tooltip);
+    row->index = index;
+    row->icon = g_object_ref (icon);
+    row->pixbuf = place_icon_get_pixbuf (icon);
+    row->drive = drive != NULL ? g_object_ref (drive) : NULL;
+    row->volume = volume != NULL ? g_object_ref (volume) : NULL;
+    row->mount = mount != NULL ? g_object_ref (mount) : NULL;
+
+    row->show_eject_button = mount != NULL && (show_unmount || show_eject);
+    if (row->show_eject_button)
     {
-        show_eject_button = FALSE;
-    }
-    else
-    {
-        show_eject_button = (show_unmount || show_eject);
+        row->eject_pixbuf = get_eject_icon (FALSE);
     }
 
-    if (show_eject_button) {
-        eject = get_eject_icon (FALSE);
-    } else {
-        eject = NULL;
-    }
+    row->key = place_row_make_key (place_type, section_type,
+                                   uri, NULL, drive, volume, mount);
 
-    gtk_list_store_append (sidebar->store, &iter);
-    gtk_list_store_set (sidebar->store, &iter,
-                        PLACES_SIDEBAR_COLUMN_ICON, pixbuf,
-                        PLACES_SIDEBAR_COLUMN_NAME, name,
-                        PLACES_SIDEBAR_COLUMN_URI, uri,
-                        PLACES_SIDEBAR_COLUMN_DRIVE, drive,
-                        PLACES_SIDEBAR_COLUMN_VOLUME, volume,
-                        PLACES_SIDEBAR_COLUMN_MOUNT, mount,
-                        PLACES_SIDEBAR_COLUMN_ROW_TYPE, place_type,
-                        PLACES_SIDEBAR_COLUMN_INDEX, index,
-                        PLACES_SIDEBAR_COLUMN_EJECT, show_eject_button,
-                        PLACES_SIDEBAR_COLUMN_NO_EJECT, !show_eject_button,
-                        PLACES_SIDEBAR_COLUMN_BOOKMARK, place_type != PLACES_BOOKMARK,
-                        PLACES_SIDEBAR_COLUMN_TOOLTIP, tooltip,
-                        PLACES_SIDEBAR_COLUMN_EJECT_ICON, eject,
-                        PLACES_SIDEBAR_COLUMN_SECTION_TYPE, section_type,
-                        -1);
-
-    if (pixbuf != NULL)
-    {
-        g_object_unref (pixbuf);
-    }
-    gtk_tree_model_filter_refilter (GTK_TREE_MODEL_FILTER (sidebar->filter_model));
-    gtk_tree_model_filter_convert_child_iter_to_iter (GTK_TREE_MODEL_FILTER (sidebar->filter_model),
-            &child_iter,
-            &iter);
-    return child_iter;
+    g_ptr_array_add (rows, row);
 }
 
+/* The favorites file is only read again once it changed on disk. It
+ * is edited in place by sed, which gives it a new inode.
+ */
 static void
-compare_for_selection (PeonyPlacesSidebar *sidebar,
-                       const gchar *location,
-                       const gchar *added_uri,
-                       const gchar *last_uri,
-                       GtkTreeIter *iter,
-                       GtkTreePath **path)
+places_model_load_favorites (PlacesModel *model)
 {
-    int res;
+    GStatBuf info;
+    char *path, *contents;
 
-    res = g_strcmp0 (added_uri, last_uri);
+    path = g_build_filename (g_get_home_dir (), ".config", "peony", "favorite-files", NULL);
 
-    if (res == 0)
+    if (g_stat (path, &info) != 0)
     {
-        /* last_uri always comes first */
-        if (*path != NULL)
-        {
-            gtk_tree_path_free (*path);
-        }
-        *path = gtk_tree_model_get_path (sidebar->filter_model,
-                                         iter);
+        g_strfreev (model->favorite_uris);
+        model->favorite_uris = g_new0 (char *, 1);
+        model->favorite_files_mtime = 0;
+        model->favorite_files_size = 0;
+        model->favorite_files_inode = 0;
+        g_free (path);
+        return;
     }
-    else if (g_strcmp0 (location, added_uri) == 0)
+
+    if (model->favorite_uris != NULL &&
+        info.st_mtime == model->favorite_files_mtime &&
+        info.st_size == model->favorite_files_size &&
+        info.st_ino == model->favorite_files_inode)
     {
-        if (*path == NULL)
-        {
-            *path = gtk_tree_model_get_path (sidebar->filter_model,
-                                             iter);
-        }
+        g_free (path);
+        return;
+    }
+
+    g_strfreev (model->favorite_uris);
+    if (g_file_get_contents (path, &contents, NULL, NULL))
+    {
+        model->favorite_uris = g_strsplit (contents, "\n", -1);
+        g_free (contents);
+    }
+    else
+    {
+        model->favorite_uris = g_new0 (char *, 1);
     }
+    model->favorite_files_mtime = info.st_mtime;
+    model->favorite_files_size = info.st_size;
+    model->favorite_files_inode = info.st_ino;
+
+    g_free (path);
 }
 
-static void
-update_places (PeonyPlacesSidebar *sidebar)
+/* Computes the rows every sidebar shows, in order. This is the only
+ * place that talks to the volume monitor and the bookmark list.
+ */
+static GPtrArray *
+places_model_build_rows (PlacesModel *model)
 {
+    GPtrArray *rows;
     PeonyBookmark *bookmark;
-    GtkTreeSelection *selection;
-    GtkTreeIter last_iter;
-    GtkTreePath *select_path;
-    GtkTreeModel *model;
     GVolumeMonitor *volume_monitor;
     GList *mounts, *l, *ll;
     GMount *mount;
@@ -688,43 +732,26 @@ update_places (PeonyPlacesSidebar *sidebar)
     GList *volumes;
     GVolume *volume;
     int bookmark_count, index;
-    char *location, *mount_uri, *name, *desktop_path, *last_uri;
+    char *mount_uri, *name, *desktop_path;
     const gchar *path;
     GIcon *icon;
     GFile *root;
-    PeonyWindowSlotInfo *slot;
     char *tooltip;
     GList *network_mounts;
     GList *xdg_dirs;
     PeonyFile *file;
+    int favorite_count;
 
-    model = NULL;
-    last_uri = NULL;
-    select_path = NULL;
+    rows = g_ptr_array_new_with_free_func ((GDestroyNotify) place_row_free);
 
-    selection = gtk_tree_view_get_selection (sidebar->tree_view);
-    if (gtk_tree_selection_get_selected (selection, &model, &last_iter))
-    {
-        gtk_tree_model_get (model,
-                            &last_iter,
-                            PLACES_SIDEBAR_COLUMN_URI, &last_uri, -1);
-    }
-    gtk_list_store_clear (sidebar->store);
-
-    sidebar->devices_header_added = FALSE;
-    sidebar->bookmarks_header_added = FALSE;
+    volume_monitor = model->volume_monitor;
 
-    slot = peony_window_info_get_active_slot (sidebar->window);
-    location = peony_window_slot_info_get_current_location (slot);
-
-    volume_monitor = sidebar->volume_monitor;
-
-    last_iter = add_heading (sidebar, SECTION_FAVORITE,
+    places_rows_add_heading (rows, SECTION_FAVORITE,
                              NULL,NULL,NULL);
 
     /* FAVORITE */
     //icon = g_themed_icon_new (PEONY_ICON_FAVORITE);
-    last_iter = add_heading (sidebar, SECTION_FAVORITE,
+    places_rows_add_heading (rows, SECTION_FAVORITE,
                              _("Favorite"),NULL,NULL);//"favorite:///",icon);
     //g_object_unref (icon);
 
@@ -733,96 +760,76 @@ update_places (PeonyPlacesSidebar *sidebar)
     /* desktop */
     mount_uri = g_filename_to_uri (desktop_path, NULL, NULL);
     icon = g_themed_icon_new (PEONY_ICON_DESKTOP);
-    last_iter = add_place (sidebar, PLACES_BUILT_IN,
+    places_rows_add_place (rows, PLACES_BUILT_IN,
                            SECTION_FAVORITE,
                            _("Desktop"), icon,
                            mount_uri, NULL, NULL, NULL, 0,
                            _("Open the contents of your desktop in a folder"));
     g_object_unref (icon);
-    compare_for_selection (sidebar,
-                           location, mount_uri, last_uri,
-                           &last_iter, &select_path);
     g_free (mount_uri);
     g_free (desktop_path);
 
     /*trash:*/
     mount_uri = "trash:///"; /* No need to strdup */
     icon = peony_trash_monitor_get_icon ();
-    last_iter = add_place (sidebar, PLACES_BUILT_IN,
+    places_rows_add_place (rows, PLACES_BUILT_IN,
                            SECTION_FAVORITE,
                            _("Trash"), icon, mount_uri,
                            NULL, NULL, NULL, 0,
                            _("Open the trash"));
-    compare_for_selection (sidebar,
-                           location, mount_uri, last_uri,
-                           &last_iter, &select_path);
     g_object_unref (icon);
 
     /*recent:*/
     mount_uri = "recent:///";/*No need to strdup*/
     icon = g_themed_icon_new_with_default_fallbacks("folder-recent");
-    last_iter = add_place (sidebar,PLACES_BUILT_IN,
+    places_rows_add_place (rows,PLACES_BUILT_IN,
                            SECTION_FAVORITE,
                            _("Recent"),icon,mount_uri,
                            NULL,NULL,NULL,0,
                            _("Open the recent"));
-    compare_for_selection (sidebar,
-                           location, mount_uri, last_uri,
-                           &last_iter, &select_path);
     g_object_unref (icon);
 
 
-    char            *path1;
-    GSettings       *settings1;
-    settings1                       = g_settings_new("org.ukui.peony.preferences");    
-
-    char line[1000];
-    char favorite_files_path[100];
-    sprintf(favorite_files_path,"%s/.config/peony/favorite-files",g_get_home_dir ());
-    FILE *fp;
-    fp=fopen(favorite_files_path,"r");
-    if(fp==NULL)
+    places_model_load_favorites (model);
+    favorite_count = 0;
+    for (index = 0; model->favorite_uris[index] != NULL; index++)
     {
-	g_settings_set_int(settings1,"favorite-iter-position",5);
-    }else {
-	g_settings_set_int(settings1,"favorite-iter-position",5);
-	char buf[1000];
-        char c;
-        c = fgetc(fp);
-        while(!feof(fp))
+        if (model->favorite_uris[index][0] == '\0')
         {
-            fgets(line,1000,fp);
-	    sprintf(buf,"%c%s",c,line);
-	    buf[strlen(buf)-1]=0;
-    	    mount_uri = buf;
-    	    icon = g_themed_icon_new (PEONY_ICON_FOLDER);
-	    GFile *file1;
-	    char *filename;
-	    file1=g_file_new_for_uri (mount_uri);
-	    filename=g_file_get_basename (file1);
-//	    last_iter = insert_place (sidebar, PLACES_BUILT_IN,
-	    last_iter = insert_place_no_write_file (sidebar, PLACES_BUILT_IN,
-                           			SECTION_FAVORITE,
-                           			filename, icon, buf,
-                           			NULL, NULL, NULL, 0,
-                           			_("Open the folder"));
-    	    compare_for_selection (sidebar,
-                          	   location, mount_uri, last_uri,
-                           	   &last_iter, &select_path);
-    	    g_object_unref (icon);
-            c = fgetc(fp);
+            continue;
         }
-        fclose(fp);
+
+        icon = g_themed_icon_new (PEONY_ICON_FOLDER);
+        root = g_file_new_for_uri (model->favorite_uris[index]);
+        name = g_file_get_basename (root);
+        places_rows_add_place (rows, PLACES_BUILT_IN,
+                               SECTION_FAVORITE,
+                               name, icon, model->favorite_uris[index],
+                               NULL, NULL, NULL, 0,
+                               _("Open the folder"));
+        g_object_unref (icon);
+        g_object_unref (root);
+        g_free (name);
+        favorite_count++;
+    }
+
+    /* insert_place() adds new favorites right after the existing ones.
+     * Writing the setting wakes up everything watching it, so only do
+     * that when it actually moves.
+     */
+    if (g_settings_get_int (peony_preferences, "favorite-iter-position") != 5 + favorite_count)
+    {
+        g_settings_set_int (peony_preferences, "favorite-iter-position", 5 + favorite_count);
     }
 
 
-    last_iter = add_heading (sidebar, SECTION_PERSONAL,
+    places_rows_add_heading (rows, SECTION_PERSONAL,
                              NULL,NULL,NULL);
 
    /*personal*/
     icon = g_themed_icon_new (PEONY_ICON_HOME);
     mount_uri = peony_get_home_directory_uri ();
-    last_iter = add_heading(sidebar,SECTION_PERSONAL,_("Personal"),mount_uri,icon);
+    places_rows_add_heading (rows, SECTION_PERSONAL,_("Personal"),mount_uri,icon);
     g_object_unref(icon);
 	g_free (mount_uri);
 
@@ -833,16 +840,13 @@ update_places (PeonyPlacesSidebar *sidebar)
         mount_uri = peony_get_home_directory_uri ();
         display_name = g_filename_display_basename (g_get_home_dir ());
         icon = g_themed_icon_new (PEONY_ICON_HOME);
-        last_iter = add_place (sidebar, PLACES_BUILT_IN,
+        places_rows_add_place (rows, PLACES_BUILT_IN,
                                SECTION_PERSONAL,
                                display_name, icon,
                                mount_uri, NULL, NULL, NULL, 0,
                                _("Open your personal folder"));
         g_object_unref (icon);
         g_free (display_name);
-        compare_for_selection (sidebar,
-                               location, mount_uri, last_uri,
-                               &last_iter, &select_path);
         g_free (mount_uri);
     }*/
 
@@ -874,14 +878,11 @@ update_places (PeonyPlacesSidebar *sidebar)
         mount_uri = g_file_get_uri (root);
         tooltip = g_file_get_parse_name (root);
 
-        last_iter = add_place (sidebar, PLACES_BUILT_IN,
+        places_rows_add_place (rows, PLACES_BUILT_IN,
                                SECTION_PERSONAL,
                                name, icon, mount_uri,
                                NULL, NULL, NULL, 0,
                                tooltip);
-        compare_for_selection (sidebar,
-                               location, mount_uri, last_uri,
-                               &last_iter, &select_path);
         g_free (name);
         g_object_unref (root);
         g_object_unref (icon);
@@ -892,26 +893,23 @@ update_places (PeonyPlacesSidebar *sidebar)
     }
     g_list_free (xdg_dirs);
 
-    last_iter = add_heading (sidebar, SECTION_FAVORITE,
+    places_rows_add_heading (rows, SECTION_FAVORITE,
                              NULL,NULL,NULL);
 
     /*Computer*/
     icon = g_themed_icon_new ("uk-computer");
-    last_iter = add_heading(sidebar,SECTION_COMPUTER,_("My Computer"),"computer:///",icon);
+    places_rows_add_heading (rows, SECTION_COMPUTER,_("My Computer"),"computer:///",icon);
     g_object_unref (icon);
 
     /* file system root */
     mount_uri = "file:///"; /* No need to strdup */
     icon = g_themed_icon_new (PEONY_ICON_FILESYSTEM);
-    last_iter = add_place (sidebar, PLACES_BUILT_IN,
+    places_rows_add_place (rows, PLACES_BUILT_IN,
                            SECTION_COMPUTER,
                            _("File System"), icon,
                            mount_uri, NULL, NULL, NULL, 0,
                            _("Open the contents of the File System"));
     g_object_unref (icon);
-    compare_for_selection (sidebar,
-                           location, mount_uri, last_uri,
-                           &last_iter, &select_path);
 
     /* first go through all connected drives */
     drives = g_volume_monitor_get_connected_drives (volume_monitor);
@@ -936,13 +934,10 @@ update_places (PeonyPlacesSidebar *sidebar)
                     name = g_mount_get_name (mount);
                     tooltip = g_file_get_parse_name (root);
 
-                    last_iter = add_place (sidebar, PLACES_MOUNTED_VOLUME,
+                    places_rows_add_place (rows, PLACES_MOUNTED_VOLUME,
                                            SECTION_COMPUTER,
                                            name, icon, mount_uri,
                                            drive, volume, mount, 0, tooltip);
-                    compare_for_selection (sidebar,
-                                           location, mount_uri, last_uri,
-                                           &last_iter, &select_path);
                     g_object_unref (root);
                     g_object_unref (mount);
                     g_object_unref (icon);
@@ -964,7 +959,7 @@ update_places (PeonyPlacesSidebar *sidebar)
                     name = g_volume_get_name (volume);
                     tooltip = g_strdup_printf (_("Mount and open %s"), name);
 
-                    last_iter = add_place (sidebar, PLACES_MOUNTED_VOLUME,
+                    places_rows_add_place (rows, PLACES_MOUNTED_VOLUME,
                                            SECTION_COMPUTER,
                                            name, icon, NULL,
                                            drive, volume, NULL, 0, tooltip);
@@ -992,7 +987,7 @@ update_places (PeonyPlacesSidebar *sidebar)
                 name = g_drive_get_name (drive);
                 tooltip = g_strdup_printf (_("Mount and open %s"), name);
 
-                last_iter = add_place (sidebar, PLACES_BUILT_IN,
+                places_rows_add_place (rows, PLACES_BUILT_IN,
                                        SECTION_COMPUTER,
                                        name, icon, NULL,
                                        drive, NULL, NULL, 0, tooltip);
@@ -1026,13 +1021,10 @@ update_places (PeonyPlacesSidebar *sidebar)
             tooltip = g_file_get_parse_name (root);
             g_object_unref (root);
             name = g_mount_get_name (mount);
-            last_iter = add_place (sidebar, PLACES_MOUNTED_VOLUME,
+            places_rows_add_place (rows, PLACES_MOUNTED_VOLUME,
                                    SECTION_COMPUTER,
                                    name, icon, mount_uri,
                                    NULL, volume, mount, 0, tooltip);
-            compare_for_selection (sidebar,
-                                   location, mount_uri, last_uri,
-                                   &last_iter, &select_path);
             g_object_unref (mount);
             g_object_unref (icon);
             g_free (name);
@@ -1044,7 +1036,7 @@ update_places (PeonyPlacesSidebar *sidebar)
             /* see comment above in why we add an icon for an unmounted mountable volume */
             icon = g_volume_get_icon (volume);
             name = g_volume_get_name (volume);
-            last_iter = add_place (sidebar, PLACES_MOUNTED_VOLUME,
+            places_rows_add_place (rows, PLACES_MOUNTED_VOLUME,
                                    SECTION_COMPUTER,
                                    name, icon, NULL,
                                    NULL, volume, NULL, 0, name);
@@ -1085,13 +1077,10 @@ update_places (PeonyPlacesSidebar *sidebar)
         mount_uri = g_file_get_uri (root);
         name = g_mount_get_name (mount);
         tooltip = g_file_get_parse_name (root);
-        last_iter = add_place (sidebar, PLACES_MOUNTED_VOLUME,
+        places_rows_add_place (rows, PLACES_MOUNTED_VOLUME,
                                SECTION_COMPUTER,
                                name, icon, mount_uri,
                                NULL, NULL, mount, 0, tooltip);
-        compare_for_selection (sidebar,
-                               location, mount_uri, last_uri,
-                               &last_iter, &select_path);
         g_object_unref (root);
         g_object_unref (mount);
         g_object_unref (icon);
@@ -1101,7 +1090,7 @@ update_places (PeonyPlacesSidebar *sidebar)
     }
     g_list_free (mounts);
     /* network */
-    //last_iter = add_heading (sidebar, SECTION_NETWORK,
+    //places_rows_add_heading (rows, SECTION_NETWORK,
     //                         _("Network"));
 
     network_mounts = g_list_reverse (network_mounts);
@@ -1112,13 +1101,10 @@ update_places (PeonyPlacesSidebar *sidebar)
         mount_uri = g_file_get_uri (root);
         name = g_mount_get_name (mount);
         tooltip = g_file_get_parse_name (root);
-        last_iter = add_place (sidebar, PLACES_MOUNTED_VOLUME,
+        places_rows_add_place (rows, PLACES_MOUNTED_VOLUME,
                                SECTION_NETWORK,
                                name, icon, mount_uri,
                                NULL, NULL, mount, 0, tooltip);
-        compare_for_selection (sidebar,
-                               location, mount_uri, last_uri,
-                               &last_iter, &select_path);
         g_object_unref (root);
         g_object_unref (mount);
         g_object_unref (icon);
@@ -1133,23 +1119,20 @@ update_places (PeonyPlacesSidebar *sidebar)
 	#if 0
     mount_uri = "network:///"; /* No need to strdup */
     icon = g_themed_icon_new (PEONY_ICON_NETWORK);
-    last_iter = add_place (sidebar, PLACES_BUILT_IN,
+    places_rows_add_place (rows, PLACES_BUILT_IN,
                            SECTION_NETWORK,
                            _("Browse Network"), icon,
                            mount_uri, NULL, NULL, NULL, 0,
                            _("Browse the contents of the network"));
     g_object_unref (icon);
-    compare_for_selection (sidebar,
-                           location, mount_uri, last_uri,
-                           &last_iter, &select_path);
     #endif
     /*/new layout*/
 
     /* add bookmarks */
-    bookmark_count = peony_bookmark_list_length (sidebar->bookmarks);
+    bookmark_count = peony_bookmark_list_length (model->bookmarks);
 
     for (index = 0; index < bookmark_count; ++index) {
-        bookmark = peony_bookmark_list_item_at (sidebar->bookmarks, index);
+        bookmark = peony_bookmark_list_item_at (model->bookmarks, index);
 
         if (peony_bookmark_uri_known_not_to_exist (bookmark)) {
             continue;
@@ -1164,19 +1147,18 @@ update_places (PeonyPlacesSidebar *sidebar)
             continue;
         }
 
+        peony_file_unref (file);
+
         name = peony_bookmark_get_name (bookmark);
         icon = peony_bookmark_get_icon (bookmark);
         mount_uri = peony_bookmark_get_uri (bookmark);
         tooltip = g_file_get_parse_name (root);
 
-        last_iter = add_place (sidebar, PLACES_BOOKMARK,
+        places_rows_add_place (rows, PLACES_BOOKMARK,
                                SECTION_BOOKMARKS,
                                name, icon, mount_uri,
                                NULL, NULL, NULL, index,
                                tooltip);
-        compare_for_selection (sidebar,
-                               location, mount_uri, last_uri,
-                               &last_iter, &select_path);
         g_free (name);
         g_object_unref (root);
         g_object_unref (icon);
@@ -1184,89 +1166,396 @@ update_places (PeonyPlacesSidebar *sidebar)
         g_free (tooltip);
     }
 
-    g_free (location);
+    return rows;
+}
 
-    if (select_path != NULL) {
-        gtk_tree_selection_select_path (selection, select_path);
-    }
+static char *
+place_row_key_from_store (GtkTreeModel *store, GtkTreeIter *iter)
+{
+    PlaceType place_type;
+    SectionType section_type;
+    char *uri, *heading_text, *key;
+    GDrive *drive;
+    GVolume *volume;
+    GMount *mount;
+
+    gtk_tree_model_get (store, iter,
+                        PLACES_SIDEBAR_COLUMN_ROW_TYPE, &place_type,
+                        PLACES_SIDEBAR_COLUMN_SECTION_TYPE, &section_type,
+                        PLACES_SIDEBAR_COLUMN_URI, &uri,
+                        PLACES_SIDEBAR_COLUMN_HEADING_TEXT, &heading_text,
+                        PLACES_SIDEBAR_COLUMN_DRIVE, &drive,
+                        PLACES_SIDEBAR_COLUMN_VOLUME, &volume,
+                        PLACES_SIDEBAR_COLUMN_MOUNT, &mount,
+                        -1);
+
+    key = place_row_make_key (place_type, section_type, uri,
+                              place_type == PLACES_HEADING ? heading_text : NULL,
+                              drive, volume, mount);
 
-    if (select_path != NULL) {
-        gtk_tree_path_free (select_path);
+    g_free (uri);
+    g_free (heading_text);
+    if (drive != NULL)
+    {
+        g_object_unref (drive);
+    }
+    if (volume != NULL)
+    {
+        g_object_unref (volume);
+    }
+    if (mount != NULL)
+    {
+        g_object_unref (mount);
     }
 
-    g_free (last_uri);
+    return key;
 }
 
-static void
-mount_added_callback (GVolumeMonitor *volume_monitor,
-                      GMount *mount,
-                      PeonyPlacesSidebar *sidebar)
+static gboolean
+place_row_differs (GtkTreeModel *store, GtkTreeIter *iter, PlaceRow *row)
 {
-    update_places (sidebar);
-}
+    char *name, *tooltip;
+    GIcon *icon;
+    GDrive *drive;
+    GVolume *volume;
+    GMount *mount;
+    gboolean eject;
+    int index;
+    gboolean differs;
 
-static void
-mount_removed_callback (GVolumeMonitor *volume_monitor,
-                        GMount *mount,
-                        PeonyPlacesSidebar *sidebar)
-{
-    update_places (sidebar);
+    gtk_tree_model_get (store, iter,
+                        PLACES_SIDEBAR_COLUMN_NAME, &name,
+                        PLACES_SIDEBAR_COLUMN_TOOLTIP, &tooltip,
+                        PLACES_SIDEBAR_COLUMN_GICON, &icon,
+                        PLACES_SIDEBAR_COLUMN_DRIVE, &drive,
+                        PLACES_SIDEBAR_COLUMN_VOLUME, &volume,
+                        PLACES_SIDEBAR_COLUMN_MOUNT, &mount,
+                        PLACES_SIDEBAR_COLUMN_EJECT, &eject,
+                        PLACES_SIDEBAR_COLUMN_INDEX, &index,
+                        -1);
+
+    /* The pixbufs are looked up anew for every update, so compare the
+     * icons they come from.
+     */
+    differs = (g_strcmp0 (name, row->name) != 0 ||
+               g_strcmp0 (tooltip, row->tooltip) != 0 ||
+               (icon == NULL) != (row->icon == NULL) ||
+               (icon != NULL && !g_icon_equal (icon, row->icon)) ||
+               drive != row->drive ||
+               volume != row->volume ||
+               mount != row->mount ||
+               eject != row->show_eject_button ||
+               index != row->index);
+
+    g_free (name);
+    g_free (tooltip);
+    if (icon != NULL)
+    {
+        g_object_unref (icon);
+    }
+    if (drive != NULL)
+    {
+        g_object_unref (drive);
+    }
+    if (volume != NULL)
+    {
+        g_object_unref (volume);
+    }
+    if (mount != NULL)
+    {
+        g_object_unref (mount);
+    }
+
+    return differs;
 }
 
 static void
-mount_changed_callback (GVolumeMonitor *volume_monitor,
-                        GMount *mount,
-                        PeonyPlacesSidebar *sidebar)
+place_row_set (GtkListStore *store, GtkTreeIter *iter, PlaceRow *row)
 {
-    update_places (sidebar);
+    if (row->place_type == PLACES_HEADING)
+    {
+        gtk_list_store_set (store, iter,
+                            PLACES_SIDEBAR_COLUMN_ROW_TYPE, PLACES_HEADING,
+                            PLACES_SIDEBAR_COLUMN_SECTION_TYPE, row->section_type,
+                            PLACES_SIDEBAR_COLUMN_URI, row->uri,
+                            PLACES_SIDEBAR_COLUMN_ICON, row->pixbuf,
+                            PLACES_SIDEBAR_COLUMN_GICON, row->icon,
+                            PLACES_SIDEBAR_COLUMN_HEADING_TEXT, row->heading_text,
+                            PLACES_SIDEBAR_COLUMN_EJECT, FALSE,
+                            PLACES_SIDEBAR_COLUMN_NO_EJECT, TRUE,
+                            -1);
+        return;
+    }
+
+    gtk_list_store_set (store, iter,
+                        PLACES_SIDEBAR_COLUMN_ICON, row->pixbuf,
+                        PLACES_SIDEBAR_COLUMN_GICON, row->icon,
+                        PLACES_SIDEBAR_COLUMN_NAME, row->name,
+                        PLACES_SIDEBAR_COLUMN_URI, row->uri,
+                        PLACES_SIDEBAR_COLUMN_DRIVE, row->drive,
+                        PLACES_SIDEBAR_COLUMN_VOLUME, row->volume,
+                        PLACES_SIDEBAR_COLUMN_MOUNT, row->mount,
+                        PLACES_SIDEBAR_COLUMN_ROW_TYPE, row->place_type,
+                        PLACES_SIDEBAR_COLUMN_INDEX, row->index,
+                        PLACES_SIDEBAR_COLUMN_EJECT, row->show_eject_button,
+                        PLACES_SIDEBAR_COLUMN_NO_EJECT, !row->show_eject_button,
+                        PLACES_SIDEBAR_COLUMN_BOOKMARK, row->place_type != PLACES_BOOKMARK,
+                        PLACES_SIDEBAR_COLUMN_TOOLTIP, row->tooltip,
+                        PLACES_SIDEBAR_COLUMN_EJECT_ICON, row->eject_pixbuf,
+                        PLACES_SIDEBAR_COLUMN_SECTION_TYPE, row->section_type,
+                        -1);
 }
 
 static void
-volume_added_callback (GVolumeMonitor *volume_monitor,
-                       GVolume *volume,
-                       PeonyPlacesSidebar *sidebar)
+select_current_location (PeonyPlacesSidebar *sidebar)
 {
-    update_places (sidebar);
+    GtkTreeSelection *selection;
+    GtkTreeIter iter;
+    gboolean valid;
+    char *uri;
+
+    if (sidebar->uri == NULL)
+    {
+        return;
+    }
+
+    selection = gtk_tree_view_get_selection (sidebar->tree_view);
+    valid = gtk_tree_model_get_iter_first (sidebar->filter_model, &iter);
+
+    while (valid)
+    {
+        gtk_tree_model_get (sidebar->filter_model, &iter,
+                            PLACES_SIDEBAR_COLUMN_URI, &uri,
+                            -1);
+        if (g_strcmp0 (uri, sidebar->uri) == 0)
+        {
+            g_free (uri);
+            gtk_tree_selection_select_iter (selection, &iter);
+            break;
+        }
+        g_free (uri);
+        valid = gtk_tree_model_iter_next (sidebar->filter_model, &iter);
+    }
 }
 
+/* Brings the sidebar's store in line with the shared rows, touching
+ * only the rows that were added, removed or changed, so that the
+ * selection, scroll position and a running rename survive.
+ */
 static void
-volume_removed_callback (GVolumeMonitor *volume_monitor,
-                         GVolume *volume,
-                         PeonyPlacesSidebar *sidebar)
+update_places (PeonyPlacesSidebar *sidebar)
 {
-    update_places (sidebar);
+    GtkTreeModel *model;
+    GtkTreeSelection *selection;
+    GtkTreeIter iter, new_iter;
+    GHashTable *pending;
+    GPtrArray *rows;
+    PlaceRow *row;
+    gboolean valid, matched, wanted;
+    char *key;
+    guint i;
+
+    if (places_model == NULL || sidebar->store == NULL)
+    {
+        return;
+    }
+
+    rows = places_model->rows;
+    model = GTK_TREE_MODEL (sidebar->store);
+
+    /* How many of the rows not placed yet have each key */
+    pending = g_hash_table_new (g_str_hash, g_str_equal);
+    for (i = 0; i < rows->len; i++)
+    {
+        row = g_ptr_array_index (rows, i);
+        g_hash_table_insert (pending, row->key,
+                             GINT_TO_POINTER (GPOINTER_TO_INT (g_hash_table_lookup (pending, row->key)) + 1));
+    }
+
+    valid = gtk_tree_model_get_iter_first (model, &iter);
+
+    for (i = 0; i < rows->len; i++)
+    {
+        row = g_ptr_array_index (rows, i);
+        matched = FALSE;
+
+        /* Drop the rows that went away */
+        while (valid)
+        {
+            key = place_row_key_from_store (model, &iter);
+            if (strcmp (key, row->key) == 0)
+            {
+                matched = TRUE;
+                g_free (key);
+                break;
+            }
+
+            wanted = GPOINTER_TO_INT (g_hash_table_lookup (pending, key)) > 0;
+            g_free (key);
+            if (wanted)
+            {
+                break;
+            }
+
+            valid = gtk_list_store_remove (sidebar->store, &iter);
+        }
+
+        g_hash_table_insert (pending, row->key,
+                             GINT_TO_POINTER (GPOINTER_TO_INT (g_hash_table_lookup (pending, row->key)) - 1));
+
+        if (matched)
+        {
+            if (place_row_differs (model, &iter, row))
+            {
+                place_row_set (sidebar->store, &iter, row);
+            }
+            valid = gtk_tree_model_iter_next (model, &iter);
+        }
+        else
+        {
+            if (valid)
+            {
+                gtk_list_store_insert_before (sidebar->store, &new_iter, &iter);
+            }
+            else
+            {
+                gtk_list_store_append (sidebar->store, &new_iter);
+            }
+            place_row_set (sidebar->store, &new_iter, row);
+        }
+    }
+
+    while (valid)
+    {
+        valid = gtk_list_store_remove (sidebar->store, &iter);
+    }
+
+    g_hash_table_destroy (pending);
+
+    selection = gtk_tree_view_get_selection (sidebar->tree_view);
+    if (gtk_tree_selection_count_selected_rows (selection) == 0)
+    {
+        select_current_location (sidebar);
+    }
 }
 
-static void
-volume_changed_callback (GVolumeMonitor *volume_monitor,
-                         GVolume *volume,
-                         PeonyPlacesSidebar *sidebar)
+static gboolean
+places_model_update_timeout (gpointer data)
 {
-    update_places (sidebar);
+    PlacesModel *model;
+    GList *l;
+
+    model = data;
+    model->update_timeout_id = 0;
+
+    g_ptr_array_unref (model->rows);
+    model->rows = places_model_build_rows (model);
+
+    for (l = model->sidebars; l != NULL; l = l->next)
+    {
+        update_places (PEONY_PLACES_SIDEBAR (l->data));
+    }
+
+    return FALSE;
 }
 
+/* Volume monitor events tend to come in bursts (one per drive, volume
+ * and mount, and many at once with automounters), so coalesce them
+ * into one update for all windows.
+ */
 static void
-drive_disconnected_callback (GVolumeMonitor *volume_monitor,
-                             GDrive         *drive,
-                             PeonyPlacesSidebar *sidebar)
+places_model_queue_update (PlacesModel *model)
 {
-    update_places (sidebar);
+    if (model == NULL || model->update_timeout_id != 0)
+    {
+        return;
+    }
+
+    model->update_timeout_id = g_timeout_add (PLACES_MODEL_UPDATE_DELAY,
+                               places_model_update_timeout,
+                               model);
 }
 
 static void
-drive_connected_callback (GVolumeMonitor *volume_monitor,
-                          GDrive         *drive,
-                          PeonyPlacesSidebar *sidebar)
+places_model_free (void)
 {
-    update_places (sidebar);
+    if (places_model->update_timeout_id != 0)
+    {
+        g_source_remove (places_model->update_timeout_id);
+    }
+
+    g_signal_handlers_disconnect_by_func (peony_preferences,
+                                          places_model_queue_update,
+                                          places_model);
+    g_signal_handlers_disconnect_by_func (peony_trash_monitor_get (),
+                                          places_model_queue_update,
+                                          places_model);
+    g_signal_handlers_disconnect_by_func (places_model->volume_monitor,
+                                          places_model_queue_update,
+                                          places_model);
+    g_signal_handlers_disconnect_by_func (places_model->bookmarks,
+                                          places_model_queue_update,
+                                          places_model);
+
+    g_ptr_array_unref (places_model->rows);
+    g_strfreev (places_model->favorite_uris);
+    g_list_free (places_model->sidebars);
+    g_object_unref (places_model->bookmarks);
+    g_object_unref (places_model->volume_monitor);
+    g_free (places_model);
+    places_model = NULL;
 }
 
-static void
-drive_changed_callback (GVolumeMonitor *volume_monitor,
-                        GDrive         *drive,
-                        PeonyPlacesSidebar *sidebar)
+static PlacesModel *
+places_model_get (void)
 {
-    update_places (sidebar);
+    PlacesModel *model;
+
+    if (places_model != NULL)
+    {
+        return places_model;
+    }
+
+    model = g_new0 (PlacesModel, 1);
+    places_model = model;
+
+    model->volume_monitor = g_volume_monitor_get ();
+    model->bookmarks = peony_bookmark_list_new ();
+
+    g_signal_connect_swapped (model->bookmarks, "contents_changed",
+                              G_CALLBACK (places_model_queue_update), model);
+
+    g_signal_connect_swapped (model->volume_monitor, "volume_added",
+                              G_CALLBACK (places_model_queue_update), model);
+    g_signal_connect_swapped (model->volume_monitor, "volume_removed",
+                              G_CALLBACK (places_model_queue_update), model);
+    g_signal_connect_swapped (model->volume_monitor, "volume_changed",
+                              G_CALLBACK (places_model_queue_update), model);
+    g_signal_connect_swapped (model->volume_monitor, "mount_added",
+                              G_CALLBACK (places_model_queue_update), model);
+    g_signal_connect_swapped (model->volume_monitor, "mount_removed",
+                              G_CALLBACK (places_model_queue_update), model);
+    g_signal_connect_swapped (model->volume_monitor, "mount_changed",
+                              G_CALLBACK (places_model_queue_update), model);
+    g_signal_connect_swapped (model->volume_monitor, "drive_disconnected",
+                              G_CALLBACK (places_model_queue_update), model);
+    g_signal_connect_swapped (model->volume_monitor, "drive_connected",
+                              G_CALLBACK (places_model_queue_update), model);
+    g_signal_connect_swapped (model->volume_monitor, "drive_changed",
+                              G_CALLBACK (places_model_queue_update), model);
+
+    /* The trash icon changes with its state */
+    g_signal_connect_swapped (peony_trash_monitor_get (), "trash_state_changed",
+                              G_CALLBACK (places_model_queue_update), model);
+
+    g_signal_connect_swapped (peony_preferences, "changed::" PEONY_PREFERENCES_DESKTOP_IS_HOME_DIR,
+                              G_CALLBACK (places_model_queue_update), model);
+
+    model->rows = places_model_build_rows (model);
+
+    eel_debug_call_at_shutdown (places_model_free);
+
+    return model;
 }
 
 static gboolean
@@ -1366,16 +1655,6 @@ clicked_eject_button (PeonyPlacesSidebar *sidebar,
     return FALSE;
 }
 
-static void
-desktop_location_changed_callback (gpointer user_data)
-{
-    PeonyPlacesSidebar *sidebar;
-
-    sidebar = PEONY_PLACES_SIDEBAR (user_data);
-
-    update_places (sidebar);
-}
-
 static void
 loading_uri_callback (PeonyWindowInfo *window,
                       char *location,
@@ -2810,7 +3089,7 @@ remove_shortcut_cb (GtkMenuItem           *item,
     position = position -1;
     g_settings_set_int(settings1,"favorite-iter-position",position);
 
-    update_places (sidebar);
+    places_model_queue_update (places_model);
 }
 
 static void
@@ -3759,9 +4038,7 @@ trash_state_changed_cb (PeonyTrashMonitor    *trash_monitor,
 
     sidebar = PEONY_PLACES_SIDEBAR (data);
 
-    /* The trash icon changed, update the sidebar */
-    update_places (sidebar);
-
+    /* The shared places model updates the trash icon */
     bookmarks_check_popup_sensitivity (sidebar);
 }
 
@@ -3874,8 +4151,6 @@ peony_places_sidebar_init (PeonyPlacesSidebar *sidebar)
     GtkCellRenderer   *cell;
     GtkTreeSelection  *selection;
 
-    sidebar->volume_monitor = g_volume_monitor_get ();
-
     gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (sidebar),
                                     GTK_POLICY_NEVER,
                                     GTK_POLICY_AUTOMATIC);
@@ -3996,7 +4271,8 @@ peony_places_sidebar_init (PeonyPlacesSidebar *sidebar)
                                          G_TYPE_STRING,
                                          GDK_TYPE_PIXBUF,
                                          G_TYPE_INT,
-                                         G_TYPE_STRING);
+                                         G_TYPE_STRING,
+                                         G_TYPE_ICON);
 
     gtk_tree_view_set_tooltip_column (tree_view, PLACES_SIDEBAR_COLUMN_TOOLTIP);
 
@@ -4056,10 +4332,6 @@ peony_places_sidebar_init (PeonyPlacesSidebar *sidebar)
     eel_gtk_tree_view_set_activate_on_single_click (sidebar->tree_view,
             TRUE);
 
-    g_signal_connect_swapped (peony_preferences, "changed::" PEONY_PREFERENCES_DESKTOP_IS_HOME_DIR,
-                              G_CALLBACK(desktop_location_changed_callback),
-                              sidebar);
-
     g_signal_connect_object (peony_trash_monitor_get (),
                              "trash_state_changed",
                              G_CALLBACK (trash_state_changed_cb),
@@ -4086,17 +4358,17 @@ peony_places_sidebar_dispose (GObject *object)
         sidebar->eject_highlight_path = NULL;
     }
 
+    if (places_model != NULL)
+    {
+        places_model->sidebars = g_list_remove (places_model->sidebars, sidebar);
+    }
+
     g_clear_object (&sidebar->store);
-    g_clear_object (&sidebar->volume_monitor);
     g_clear_object (&sidebar->bookmarks);
     g_clear_object (&sidebar->filter_model);
 
     eel_remove_weak_pointer (&(sidebar->go_to_after_mount_slot));
 
-    g_signal_handlers_disconnect_by_func (peony_preferences,
-                                          desktop_location_changed_callback,
-                                          sidebar);
-
     G_OBJECT_CLASS (peony_places_sidebar_parent_class)->dispose (object);
 }
 
@@ -4154,41 +4426,22 @@ peony_places_sidebar_set_parent_window (PeonyPlacesSidebar *sidebar,
                                        PeonyWindowInfo *window)
 {
     PeonyWindowSlotInfo *slot;
+    PlacesModel *model;
 
     sidebar->window = window;
 
     slot = peony_window_info_get_active_slot (window);
 
-    sidebar->bookmarks = peony_bookmark_list_new ();
-    sidebar->uri = peony_window_slot_info_get_current_location (slot);
+    model = places_model_get ();
+    model->sidebars = g_list_prepend (model->sidebars, sidebar);
 
-    g_signal_connect_object (sidebar->bookmarks, "contents_changed",
-                             G_CALLBACK (update_places),
-                             sidebar, G_CONNECT_SWAPPED);
+    sidebar->bookmarks = g_object_ref (model->bookmarks);
+    sidebar->uri = peony_window_slot_info_get_current_location (slot);
 
     g_signal_connect_object (window, "loading_uri",
                              G_CALLBACK (loading_uri_callback),
                              sidebar, 0);
 
-    g_signal_connect_object (sidebar->volume_monitor, "volume_added",
-                             G_CALLBACK (volume_added_callback), sidebar, 0);
-    g_signal_connect_object (sidebar->volume_monitor, "volume_removed",
-                             G_CALLBACK (volume_removed_callback), sidebar, 0);
-    g_signal_connect_object (sidebar->volume_monitor, "volume_changed",
-                             G_CALLBACK (volume_changed_callback), sidebar, 0);
-    g_signal_connect_object (sidebar->volume_monitor, "mount_added",
-                             G_CALLBACK (mount_added_callback), sidebar, 0);
-    g_signal_connect_object (sidebar->volume_monitor, "mount_removed",
-                             G_CALLBACK (mount_removed_callback), sidebar, 0);
-    g_signal_connect_object (sidebar->volume_monitor, "mount_changed",
-                             G_CALLBACK (mount_changed_callback), sidebar, 0);
-    g_signal_connect_object (sidebar->volume_monitor, "drive_disconnected",
-                             G_CALLBACK (drive_disconnected_callback), sidebar, 0);
-    g_signal_connect_object (sidebar->volume_monitor, "drive_connected",
-                             G_CALLBACK (drive_connected_callback), sidebar, 0);
-    g_signal_connect_object (sidebar->volume_monitor, "drive_changed",
-                             G_CALLBACK (drive_changed_callback), sidebar, 0);
-
     update_places (sidebar);
 }
 
@@ -4199,7 +4452,8 @@ peony_places_sidebar_style_updated (GtkWidget *widget)
 
     sidebar = PEONY_PLACES_SIDEBAR (widget);
 
-    update_places (sidebar);
+    /* Icon sizes may have changed */
+    places_model_queue_update (places_model);
 }
 
 static PeonySidebar *
@@ -0,0 +1,420 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4; tab-width: 8 -*-
+
+   peony-startup.c: Startup tasks, run in dependency order around the
+   first window, and a report of where startup time went.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include <config.h>
+#include "peony-startup.h"
+
+#include <stdarg.h>
+#include <libpeony-private/peony-trace.h>
+
+/* Deferred tasks run anyway if no window gets drawn, as when started
+ * only to manage the desktop or serve D-Bus.
+ */
+#define NO_WINDOW_TIMEOUT_SECONDS 3
+
+typedef enum
+{
+    TASK_WAITING,
+    TASK_RUNNING,
+    TASK_DONE
+} TaskState;
+
+typedef struct
+{
+    const char *name;
+    PeonyStartupStage stage;
+    PeonyStartupFunc func;
+    gpointer data;
+    GList *dependencies; /* of const char *, the names given */
+    TaskState state;
+    gint64 begin;
+    gint64 end;
+} StartupTask;
+
+/* In the order they were added */
+static GList *tasks;
+
+static gint64 startup_begin;
+static gint64 first_window_drawn;
+static gboolean deferred_allowed;
+static guint deferred_idle_id;
+static guint no_window_timeout_id;
+static gboolean report_printed;
+
+static const char *stage_names[] = { "early", "deferred", "thread" };
+
+static void schedule (void);
+
+void
+peony_startup_begin (void)
+{
+    if (startup_begin == 0)
+    {
+        startup_begin = g_get_monotonic_time ();
+    }
+}
+
+void
+peony_startup_add_task (const char *name,
+                        PeonyStartupStage stage,
+                        PeonyStartupFunc func,
+                        gpointer data,
+                        ...)
+{
+    StartupTask *task;
+    const char *dependency;
+    va_list args;
+
+    peony_startup_begin ();
+
+    task = g_new0 (StartupTask, 1);
+    task->name = name;
+    task->stage = stage;
+    task->func = func;
+    task->data = data;
+
+    va_start (args, data);
+    while ((dependency = va_arg (args, const char *)) != NULL)
+    {
+        task->dependencies = g_list_append (task->dependencies, (char *) dependency);
+    }
+    va_end (args);
+
+    tasks = g_list_append (tasks, task);
+}
+
+static StartupTask *
+find_task (const char *name)
+{
+    GList *l;
+    StartupTask *task;
+
+    for (l = tasks; l != NULL; l = l->next)
+    {
+        task = l->data;
+        if (g_strcmp0 (task->name, name) == 0)
+        {
+            return task;
+        }
+    }
+
+    return NULL;
+}
+
+static gboolean
+task_is_ready (StartupTask *task)
+{
+    StartupTask *dependency;
+    GList *l;
+
+    if (task->state != TASK_WAITING)
+    {
+        return FALSE;
+    }
+
+    for (l = task->dependencies; l != NULL; l = l->next)
+    {
+        dependency = find_task (l->data);
+        if (dependency != NULL && dependency->state != TASK_DONE)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static void
+task_done (StartupTask *task)
+{
+    task->state = TASK_DONE;
+
+    if (peony_trace_is_enabled ())
+    {
+        peony_trace_add_duration (PEONY_TRACE_CATEGORY_STARTUP, task->name,
+                                  task->begin, task->end);
+    }
+}
+
+static void
+run_task_here (StartupTask *task)
+{
+    task->state = TASK_RUNNING;
+    task->begin = g_get_monotonic_time ();
+    task->func (task->data);
+    task->end = g_get_monotonic_time ();
+}
+
+static void
+task_thread (GTask *gtask,
+             gpointer source_object,
+             gpointer task_data,
+             GCancellable *cancellable)
+{
+    run_task_here (task_data);
+    g_task_return_boolean (gtask, TRUE);
+}
+
+static void
+task_thread_done (GObject *source_object,
+                  GAsyncResult *result,
+                  gpointer user_data)
+{
+    task_done (user_data);
+    schedule ();
+}
+
+static void
+start_ready_threads (void)
+{
+    GList *l;
+    StartupTask *task;
+    GTask *gtask;
+
+    for (l = tasks; l != NULL; l = l->next)
+    {
+        task = l->data;
+        if (task->stage == PEONY_STARTUP_THREAD && task_is_ready (task))
+        {
+            task->state = TASK_RUNNING;
+            gtask = g_task_new (NULL, NULL, task_thread_done, task);
+            g_task_set_task_data (gtask, task, NULL);
+            g_task_run_in_thread (gtask, task_thread);
+            g_object_unref (gtask);
+        }
+    }
+}
+
+static void
+append_row (GString *report,
+            const char *name,
+            const char *stage,
+            gint64 begin,
+            gint64 end)
+{
+    g_string_append_printf (report, "%9.1f %9.1f %9.1f  %-9s %s\n",
+                            (begin - startup_begin) / 1000.0,
+                            (end - startup_begin) / 1000.0,
+                            (end - begin) / 1000.0,
+                            stage, name);
+}
+
+char *
+peony_startup_get_report (void)
+{
+    GString *report;
+    GList *l;
+    StartupTask *task;
+    gboolean window_row_added;
+
+    report = g_string_new ("Peony startup, in milliseconds:\n"
+                           "    begin       end  duration  stage     task\n");
+
+    window_row_added = first_window_drawn == 0;
+    for (l = tasks; l != NULL; l = l->next)
+    {
+        task = l->data;
+        if (task->state != TASK_DONE)
+        {
+            continue;
+        }
+
+        if (!window_row_added && task->begin >= first_window_drawn)
+        {
+            g_string_append_printf (report, "%9.1f %30s first window drawn\n",
+                                    (first_window_drawn - startup_begin) / 1000.0, "");
+            window_row_added = TRUE;
+        }
+
+        append_row (report, task->name, stage_names[task->stage],
+                    task->begin, task->end);
+    }
+
+    if (!window_row_added)
+    {
+        g_string_append_printf (report, "%9.1f %30s first window drawn\n",
+                                (first_window_drawn - startup_begin) / 1000.0, "");
+    }
+
+    return g_string_free (report, FALSE);
+}
+
+static void
+maybe_print_report (void)
+{
+    GList *l;
+    char *report;
+
+    if (report_printed || g_getenv ("PEONY_STARTUP_REPORT") == NULL)
+    {
+        return;
+    }
+
+    for (l = tasks; l != NULL; l = l->next)
+    {
+        if (((StartupTask *) l->data)->state != TASK_DONE)
+        {
+            return;
+        }
+    }
+
+    report_printed = TRUE;
+    report = peony_startup_get_report ();
+    g_printerr ("%s", report);
+    g_free (report);
+}
+
+/* One task per idle, so input that arrives meanwhile is not kept waiting */
+static gboolean
+run_deferred_idle (gpointer data)
+{
+    GList *l;
+    StartupTask *task;
+
+    for (l = tasks; l != NULL; l = l->next)
+    {
+        task = l->data;
+        if (task->stage == PEONY_STARTUP_DEFERRED && task_is_ready (task))
+        {
+            run_task_here (task);
+            task_done (task);
+            start_ready_threads ();
+            return TRUE;
+        }
+    }
+
+    /* Whatever is left waits for a thread, which schedules again */
+    deferred_idle_id = 0;
+    maybe_print_report ();
+
+    return FALSE;
+}
+
+static void
+schedule (void)
+{
+    start_ready_threads ();
+
+    if (deferred_allowed && deferred_idle_id == 0)
+    {
+        deferred_idle_id = g_idle_add_full (G_PRIORITY_LOW, run_deferred_idle, NULL, NULL);
+    }
+}
+
+static void
+allow_deferred (void)
+{
+    if (deferred_allowed)
+    {
+        return;
+    }
+
+    deferred_allowed = TRUE;
+    if (no_window_timeout_id != 0)
+    {
+        g_source_remove (no_window_timeout_id);
+        no_window_timeout_id = 0;
+    }
+
+    schedule ();
+}
+
+static gboolean
+no_window_timeout (gpointer data)
+{
+    no_window_timeout_id = 0;
+    allow_deferred ();
+
+    return FALSE;
+}
+
+void
+peony_startup_run (void)
+{
+    GList *l;
+    StartupTask *task;
+    gboolean progress;
+
+    start_ready_threads ();
+
+    do
+    {
+        progress = FALSE;
+        for (l = tasks; l != NULL; l = l->next)
+        {
+            task = l->data;
+            if (task->stage == PEONY_STARTUP_EARLY && task_is_ready (task))
+            {
+                run_task_here (task);
+                task_done (task);
+                start_ready_threads ();
+                progress = TRUE;
+            }
+        }
+    }
+    while (progress);
+
+    for (l = tasks; l != NULL; l = l->next)
+    {
+        task = l->data;
+        if (task->stage == PEONY_STARTUP_EARLY && task->state != TASK_DONE)
+        {
+            g_warning ("Startup task %s depends on a task that is not early", task->name);
+        }
+    }
+
+    if (!deferred_allowed)
+    {
+        no_window_timeout_id = g_timeout_add_seconds (NO_WINDOW_TIMEOUT_SECONDS,
+                               no_window_timeout, NULL);
+    }
+}
+
+/* Low priority idles run after the frame that was just drawn is done */
+static gboolean
+window_draw_callback (GtkWidget *widget,
+                      cairo_t *cr,
+                      gpointer data)
+{
+    if (first_window_drawn == 0)
+    {
+        first_window_drawn = g_get_monotonic_time ();
+        allow_deferred ();
+    }
+
+    g_signal_handlers_disconnect_by_func (widget, window_draw_callback, data);
+
+    return FALSE;
+}
+
+void
+peony_startup_watch_window (GtkWidget *window)
+{
+    g_return_if_fail (GTK_IS_WIDGET (window));
+
+    if (first_window_drawn != 0)
+    {
+        return;
+    }
+
+    g_signal_connect_after (window, "draw",
+                            G_CALLBACK (window_draw_callback), NULL);
+}
@@ -0,0 +1,74 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4; tab-width: 8 -*-
+
+   peony-startup.h: Startup tasks, run in dependency order around the
+   first window, and a report of where startup time went.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef PEONY_STARTUP_H
+#define PEONY_STARTUP_H
+
+#include <gtk/gtk.h>
+
+/* Startup is a set of named tasks, each listing the tasks it needs
+ * done first. Only what the first window needs runs before it is
+ * created; the rest waits until that window has been drawn, or runs
+ * in worker threads meanwhile.
+ *
+ * With PEONY_STARTUP_REPORT set in the environment, a table of when
+ * each task ran is printed once all of them are done. The tasks are
+ * also recorded in the trace timeline when tracing is on.
+ */
+
+typedef void (* PeonyStartupFunc) (gpointer data);
+
+typedef enum
+{
+    /* Needed by the first window, runs from peony_startup_run () */
+    PEONY_STARTUP_EARLY,
+    /* Runs from the main loop once the first window has been drawn */
+    PEONY_STARTUP_DEFERRED,
+    /* Runs in a worker thread as soon as its dependencies are done.
+     * Must not use GTK+ or anything else only the main thread may use. */
+    PEONY_STARTUP_THREAD
+} PeonyStartupStage;
+
+/* Marks the beginning of startup, times in the report count from here */
+void     peony_startup_begin      (void);
+
+/* @name must be a static string. The dependencies are the names of
+ * other tasks, followed by NULL. Early tasks may only depend on early
+ * tasks.
+ */
+void     peony_startup_add_task   (const char        *name,
+                                   PeonyStartupStage  stage,
+                                   PeonyStartupFunc   func,
+                                   gpointer           data,
+                                   ...) G_GNUC_NULL_TERMINATED;
+
+/* Runs the early tasks and starts the threads that can start */
+void     peony_startup_run        (void);
+
+/* The first of the watched windows to be drawn lets the deferred
+ * tasks run.
+ */
+void     peony_startup_watch_window (GtkWidget      *window);
+
+/* Returns a table of the tasks run so far */
+char    *peony_startup_get_report (void);
+
+#endif /* PEONY_STARTUP_H */
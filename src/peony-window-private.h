@@ -141,6 +141,13 @@ struct _PeonyNavigationWindowDetails
     GtkWidget *web_swindow;
     GtkWidget *web_view;
 
+    /* image view, for images the preview loader decoded */
+    GtkWidget *image_swindow;
+    GtkWidget *image_view;
+
+    /* the preview being loaded for the current selection */
+    GCancellable *preview_cancellable;
+
     /* empty view */
     GtkWidget *empty_window;
     GtkWidget *hint_view;
@@ -0,0 +1,619 @@
+/* Headless benchmark for directory loading, sorting and view population.
+ *
+ * Generates synthetic trees in a temporary directory, loads them through
+ * PeonyDirectory and prints one JSON object per measurement, so results
+ * can be collected and compared across releases:
+ *
+ *   {"benchmark": "directory", "version": "1.1.6", "scenario": "flat-10k",
+ *    "metric": "time_to_done_loading", "value": 0.412, "unit": "s"}
+ *
+ * The icon container and list model measurements need a display; run
+ * under Xvfb (or GDK_BACKEND=broadway) on build machines. Without one
+ * they are reported as skipped. Peak RSS is process wide, so run one
+ * scenario per invocation when comparing memory use.
+ */
+
+#include "test.h"
+
+#include <libpeony-private/peony-column-utilities.h>
+#include <libpeony-private/peony-directory.h>
+#include <libpeony-private/peony-file.h>
+#include <libpeony-private/peony-file-attributes.h>
+#include <libpeony-private/peony-icon-container.h>
+#include <src/file-manager/fm-list-model.h>
+#include <glib/gstdio.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef enum {
+	TREE_FLAT,
+	TREE_DEEP,
+	TREE_MIXED
+} TreeKind;
+
+typedef struct {
+	const char *name;
+	TreeKind kind;
+	int n_files;
+	int depth;
+	gboolean by_default;
+} Scenario;
+
+static const Scenario scenarios[] = {
+	{ "flat-10k", TREE_FLAT, 10000, 0, TRUE },
+	{ "flat-100k", TREE_FLAT, 100000, 0, TRUE },
+	{ "flat-1m", TREE_FLAT, 1000000, 0, FALSE },
+	{ "deep", TREE_DEEP, 256, 32, TRUE },
+	{ "mixed", TREE_MIXED, 20000, 0, TRUE },
+};
+
+/* Extension and leading bytes, so both name and content sniffing get
+ * some work.
+ */
+static const struct {
+	const char *extension;
+	const char *contents;
+} mixed_types[] = {
+	{ ".txt", "hello world\n" },
+	{ ".png", "\x89PNG\r\n\x1a\n" },
+	{ ".jpg", "\xff\xd8\xff\xe0" },
+	{ ".pdf", "%PDF-1.4\n" },
+	{ ".c", "int main (void) { return 0; }\n" },
+	{ ".html", "<html><body></body></html>\n" },
+	{ ".mp3", "ID3\x03" },
+	{ ".tar.gz", "\x1f\x8b\x08" },
+	{ "", "#!/bin/sh\n" },
+};
+
+static FILE *output;
+static gboolean have_display;
+
+static const char *opt_scenario;
+static const char *opt_output;
+static const char *opt_base_dir;
+static gboolean opt_keep;
+
+static GOptionEntry options[] = {
+	{ "scenario", 's', 0, G_OPTION_ARG_STRING, &opt_scenario,
+	  "Only run SCENARIO (flat-10k, flat-100k, flat-1m, deep, mixed)", "SCENARIO" },
+	{ "output", 'o', 0, G_OPTION_ARG_FILENAME, &opt_output,
+	  "Append results to FILE instead of stdout", "FILE" },
+	{ "base-dir", 'd', 0, G_OPTION_ARG_FILENAME, &opt_base_dir,
+	  "Create the trees below DIR", "DIR" },
+	{ "keep", 'k', 0, G_OPTION_ARG_NONE, &opt_keep,
+	  "Don't delete the generated trees", NULL },
+	{ NULL }
+};
+
+static double
+elapsed (gint64 start)
+{
+	return (g_get_monotonic_time () - start) / (double) G_USEC_PER_SEC;
+}
+
+static void
+report (const Scenario *scenario,
+	const char *metric,
+	double value,
+	const char *unit)
+{
+	fprintf (output,
+		 "{\"benchmark\": \"directory\", \"version\": \"%s\", "
+		 "\"scenario\": \"%s\", \"metric\": \"%s\", "
+		 "\"value\": %.6f, \"unit\": \"%s\"}\n",
+		 VERSION, scenario->name, metric, value, unit);
+	fflush (output);
+}
+
+static void
+report_skipped (const Scenario *scenario,
+		const char *metric,
+		const char *reason)
+{
+	fprintf (output,
+		 "{\"benchmark\": \"directory\", \"version\": \"%s\", "
+		 "\"scenario\": \"%s\", \"metric\": \"%s\", "
+		 "\"skipped\": \"%s\"}\n",
+		 VERSION, scenario->name, metric, reason);
+	fflush (output);
+}
+
+static void
+report_peak_rss (const Scenario *scenario)
+{
+	struct rusage usage;
+
+	if (getrusage (RUSAGE_SELF, &usage) == 0) {
+		/* ru_maxrss is in kilobytes on Linux */
+		report (scenario, "peak_rss", usage.ru_maxrss / 1024.0, "MiB");
+	}
+}
+
+/* Tree generation */
+
+static void
+create_file (const char *path,
+	     const char *contents)
+{
+	int fd;
+
+	fd = open (path, O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		g_error ("Could not create %s", path);
+	}
+	if (contents != NULL && write (fd, contents, strlen (contents)) < 0) {
+		g_error ("Could not write %s", path);
+	}
+	close (fd);
+}
+
+static void
+fill_directory (const char *dir,
+		int n_files,
+		gboolean mixed)
+{
+	char *path;
+	int i, type;
+
+	for (i = 0; i < n_files; i++) {
+		if (mixed) {
+			type = i % G_N_ELEMENTS (mixed_types);
+			path = g_strdup_printf ("%s/file-%07d%s", dir, i,
+						mixed_types[type].extension);
+			create_file (path, mixed_types[type].contents);
+		} else {
+			path = g_strdup_printf ("%s/file-%07d", dir, i);
+			create_file (path, NULL);
+		}
+		g_free (path);
+	}
+}
+
+/* Returns the directories to load, top first. */
+static GList *
+generate_tree (const Scenario *scenario,
+	       const char *root)
+{
+	GList *dirs;
+	char *dir, *child;
+	int level;
+
+	dirs = g_list_prepend (NULL, g_strdup (root));
+
+	switch (scenario->kind) {
+	case TREE_FLAT:
+		fill_directory (root, scenario->n_files, FALSE);
+		break;
+	case TREE_MIXED:
+		fill_directory (root, scenario->n_files, TRUE);
+		break;
+	case TREE_DEEP:
+		dir = g_strdup (root);
+		for (level = 0; level < scenario->depth; level++) {
+			fill_directory (dir, scenario->n_files, TRUE);
+			child = g_strdup_printf ("%s/level-%02d", dir, level + 1);
+			g_mkdir (child, 0755);
+			dirs = g_list_prepend (dirs, g_strdup (child));
+			g_free (dir);
+			dir = child;
+		}
+		g_free (dir);
+		break;
+	}
+
+	return g_list_reverse (dirs);
+}
+
+/* Directory loading */
+
+typedef struct {
+	GMainLoop *loop;
+	gint64 start;
+	double first_file;
+	gboolean done;
+} LoadState;
+
+static void
+files_added (PeonyDirectory *directory,
+	     GList *added_files,
+	     LoadState *state)
+{
+	if (state->first_file < 0 && added_files != NULL) {
+		state->first_file = elapsed (state->start);
+	}
+}
+
+static void
+done_loading (PeonyDirectory *directory,
+	      LoadState *state)
+{
+	state->done = TRUE;
+	g_main_loop_quit (state->loop);
+}
+
+/* Loads the directory the way the views do and returns its files. */
+static GList *
+load_directory (const char *path,
+		gconstpointer client,
+		double *time_to_first_file,
+		double *time_to_done)
+{
+	PeonyDirectory *directory;
+	LoadState state;
+	GList *files;
+	char *uri;
+
+	uri = g_filename_to_uri (path, NULL, NULL);
+	directory = peony_directory_get_by_uri (uri);
+	g_free (uri);
+
+	state.loop = g_main_loop_new (NULL, FALSE);
+	state.first_file = -1;
+	state.done = FALSE;
+
+	g_signal_connect (directory, "files-added", G_CALLBACK (files_added), &state);
+	g_signal_connect (directory, "done-loading", G_CALLBACK (done_loading), &state);
+
+	state.start = g_get_monotonic_time ();
+	peony_directory_file_monitor_add (directory, client, TRUE,
+					  PEONY_FILE_ATTRIBUTE_INFO |
+					  PEONY_FILE_ATTRIBUTE_LINK_INFO |
+					  PEONY_FILE_ATTRIBUTE_MOUNT,
+					  NULL, NULL);
+	if (!peony_directory_are_all_files_seen (directory)) {
+		g_main_loop_run (state.loop);
+	}
+	*time_to_done = elapsed (state.start);
+	*time_to_first_file = state.first_file < 0 ? *time_to_done : state.first_file;
+
+	g_signal_handlers_disconnect_by_data (directory, &state);
+	g_main_loop_unref (state.loop);
+
+	files = peony_directory_get_file_list (directory);
+	peony_directory_file_monitor_remove (directory, client);
+	peony_directory_unref (directory);
+
+	return files;
+}
+
+/* Sorting */
+
+typedef struct {
+	const char *metric;
+	PeonyFileSortType sort_type;
+} SortMetric;
+
+static const SortMetric sort_metrics[] = {
+	{ "sort_by_name", PEONY_FILE_SORT_BY_DISPLAY_NAME },
+	{ "sort_by_size", PEONY_FILE_SORT_BY_SIZE },
+	{ "sort_by_type", PEONY_FILE_SORT_BY_TYPE },
+	{ "sort_by_mtime", PEONY_FILE_SORT_BY_MTIME },
+};
+
+static int
+compare_files (gconstpointer a,
+	       gconstpointer b,
+	       gpointer user_data)
+{
+	return peony_file_compare_for_sort (PEONY_FILE (a), PEONY_FILE (b),
+					    GPOINTER_TO_INT (user_data),
+					    TRUE, FALSE);
+}
+
+static void
+run_sort_benchmarks (const Scenario *scenario,
+		     GList *files)
+{
+	GList *copy;
+	gint64 start;
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (sort_metrics); i++) {
+		/* Reverse first, so every attribute starts from the same
+		 * unsorted order.
+		 */
+		copy = g_list_reverse (g_list_copy (files));
+
+		start = g_get_monotonic_time ();
+		copy = g_list_sort_with_data (copy, compare_files,
+					      GINT_TO_POINTER (sort_metrics[i].sort_type));
+		report (scenario, sort_metrics[i].metric, elapsed (start), "s");
+
+		g_list_free (copy);
+	}
+}
+
+/* Icon container layout.
+ *
+ * A minimal container that answers the class queries from the PeonyFile
+ * itself, the way FMIconContainer does without the view around it.
+ */
+
+typedef PeonyIconContainer BenchIconContainer;
+typedef PeonyIconContainerClass BenchIconContainerClass;
+
+G_DEFINE_TYPE (BenchIconContainer, bench_icon_container, PEONY_TYPE_ICON_CONTAINER)
+
+static PeonyIconInfo *
+bench_get_icon_images (PeonyIconContainer *container,
+		       PeonyIconData *data,
+		       int size,
+		       GList **emblem_pixbufs,
+		       char **embedded_text,
+		       gboolean for_drag_accept,
+		       gboolean need_large_embeddded_text,
+		       gboolean *embedded_text_needs_loading,
+		       gboolean *has_window_open)
+{
+	if (embedded_text != NULL) {
+		*embedded_text = NULL;
+	}
+	if (has_window_open != NULL) {
+		*has_window_open = FALSE;
+	}
+
+	return peony_file_get_icon (PEONY_FILE (data), size, PEONY_FILE_ICON_FLAGS_NONE);
+}
+
+static void
+bench_get_icon_text (PeonyIconContainer *container,
+		     PeonyIconData *data,
+		     char **editable_text,
+		     char **additional_text,
+		     gboolean include_invisible)
+{
+	if (editable_text != NULL) {
+		*editable_text = peony_file_get_display_name (PEONY_FILE (data));
+	}
+	if (additional_text != NULL) {
+		*additional_text = NULL;
+	}
+}
+
+static int
+bench_compare_icons (PeonyIconContainer *container,
+		     PeonyIconData *a,
+		     PeonyIconData *b)
+{
+	return peony_file_compare_for_sort (PEONY_FILE (a), PEONY_FILE (b),
+					    PEONY_FILE_SORT_BY_DISPLAY_NAME,
+					    TRUE, FALSE);
+}
+
+static char *
+bench_get_icon_uri (PeonyIconContainer *container,
+		    PeonyIconData *data)
+{
+	return peony_file_get_uri (PEONY_FILE (data));
+}
+
+static void
+bench_nop (PeonyIconContainer *container)
+{
+}
+
+static void
+bench_nop_monitor_add (PeonyIconContainer *container,
+		       PeonyIconData *data,
+		       gconstpointer client,
+		       gboolean large_text)
+{
+}
+
+static void
+bench_nop_monitor_remove (PeonyIconContainer *container,
+			  PeonyIconData *data,
+			  gconstpointer client)
+{
+}
+
+static void
+bench_nop_prioritize (PeonyIconContainer *container,
+		      PeonyIconData *data)
+{
+}
+
+static void
+bench_icon_container_init (BenchIconContainer *container)
+{
+}
+
+static void
+bench_icon_container_class_init (BenchIconContainerClass *klass)
+{
+	klass->get_icon_images = bench_get_icon_images;
+	klass->get_icon_text = bench_get_icon_text;
+	klass->compare_icons = bench_compare_icons;
+	klass->compare_icons_by_name = bench_compare_icons;
+	klass->get_icon_uri = bench_get_icon_uri;
+	klass->freeze_updates = bench_nop;
+	klass->unfreeze_updates = bench_nop;
+	klass->start_monitor_top_left = bench_nop_monitor_add;
+	klass->stop_monitor_top_left = bench_nop_monitor_remove;
+	klass->prioritize_thumbnailing = bench_nop_prioritize;
+}
+
+static void
+run_icon_layout_benchmark (const Scenario *scenario,
+			   GList *files)
+{
+	GtkWidget *window, *scrolled, *container;
+	gint64 start;
+	GList *l;
+
+	window = gtk_offscreen_window_new ();
+	gtk_window_set_default_size (GTK_WINDOW (window), 1024, 768);
+	scrolled = gtk_scrolled_window_new (NULL, NULL);
+	container = g_object_new (bench_icon_container_get_type (), NULL);
+	gtk_container_add (GTK_CONTAINER (scrolled), container);
+	gtk_container_add (GTK_CONTAINER (window), scrolled);
+	gtk_widget_show_all (window);
+
+	peony_icon_container_set_auto_layout (PEONY_ICON_CONTAINER (container), TRUE);
+
+	start = g_get_monotonic_time ();
+	for (l = files; l != NULL; l = l->next) {
+		peony_icon_container_add (PEONY_ICON_CONTAINER (container), l->data);
+	}
+	peony_icon_container_layout_now (PEONY_ICON_CONTAINER (container));
+	report (scenario, "icon_layout", elapsed (start), "s");
+
+	peony_icon_container_clear (PEONY_ICON_CONTAINER (container));
+	gtk_widget_destroy (window);
+}
+
+/* List model population */
+
+static void
+run_list_model_benchmark (const Scenario *scenario,
+			  const char *path,
+			  GList *files)
+{
+	FMListModel *model;
+	PeonyDirectory *directory;
+	GList *columns, *l;
+	gint64 start;
+	char *uri;
+	int name_column;
+
+	uri = g_filename_to_uri (path, NULL, NULL);
+	directory = peony_directory_get_by_uri (uri);
+	g_free (uri);
+
+	model = g_object_new (FM_TYPE_LIST_MODEL, NULL);
+	columns = peony_get_all_columns ();
+	for (l = columns; l != NULL; l = l->next) {
+		fm_list_model_add_column (model, l->data);
+	}
+	peony_column_list_free (columns);
+
+	name_column = fm_list_model_get_sort_column_id_from_attribute
+		(model, g_quark_from_static_string ("name"));
+	gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (model),
+					      name_column, GTK_SORT_ASCENDING);
+
+	start = g_get_monotonic_time ();
+	for (l = files; l != NULL; l = l->next) {
+		fm_list_model_add_file (model, l->data, directory);
+	}
+	report (scenario, "list_model_population", elapsed (start), "s");
+
+	g_object_unref (model);
+	peony_directory_unref (directory);
+}
+
+static void
+run_scenario (const Scenario *scenario,
+	      const char *base_dir)
+{
+	GList *dirs, *l, *files;
+	double first_file, done, total_first_file, total_done;
+	gint64 start;
+	char *root;
+	int client;
+
+	root = g_build_filename (base_dir, scenario->name, NULL);
+	test_remove_tree (root);
+	g_mkdir_with_parents (root, 0755);
+
+	start = g_get_monotonic_time ();
+	dirs = generate_tree (scenario, root);
+	report (scenario, "generate_tree", elapsed (start), "s");
+
+	/* Deep trees are walked top to bottom, like a user drilling down;
+	 * only the last level is used for the per-view measurements.
+	 */
+	files = NULL;
+	total_first_file = total_done = 0;
+	for (l = dirs; l != NULL; l = l->next) {
+		peony_file_list_free (files);
+		files = load_directory (l->data, &client, &first_file, &done);
+		total_first_file += first_file;
+		total_done += done;
+	}
+	report (scenario, "time_to_first_file", total_first_file, "s");
+	report (scenario, "time_to_done_loading", total_done, "s");
+	report (scenario, "files_loaded", g_list_length (files), "files");
+
+	run_sort_benchmarks (scenario, files);
+
+	if (have_display) {
+		run_icon_layout_benchmark (scenario, files);
+		run_list_model_benchmark (scenario, g_list_last (dirs)->data, files);
+	} else {
+		report_skipped (scenario, "icon_layout", "no display");
+		report_skipped (scenario, "list_model_population", "no display");
+	}
+
+	report_peak_rss (scenario);
+
+	peony_file_list_free (files);
+	g_list_free_full (dirs, g_free);
+
+	if (!opt_keep) {
+		test_remove_tree (root);
+	}
+	g_free (root);
+}
+
+int
+main (int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *error;
+	char *base_dir;
+	gboolean ran;
+	guint i;
+
+	context = g_option_context_new ("- benchmark directory loading and views");
+	g_option_context_add_main_entries (context, options, NULL);
+	error = NULL;
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+	g_option_context_free (context);
+
+	have_display = gtk_init_check (&argc, &argv);
+
+	output = test_open_output (opt_output);
+	if (output == NULL) {
+		return 1;
+	}
+
+	if (opt_base_dir != NULL) {
+		base_dir = g_strdup (opt_base_dir);
+	} else {
+		base_dir = g_dir_make_tmp ("peony-benchmark-XXXXXX", NULL);
+	}
+	if (base_dir == NULL) {
+		g_printerr ("Could not create a directory for the trees\n");
+		return 1;
+	}
+
+	ran = FALSE;
+	for (i = 0; i < G_N_ELEMENTS (scenarios); i++) {
+		if (opt_scenario != NULL ?
+		    strcmp (opt_scenario, scenarios[i].name) == 0 :
+		    scenarios[i].by_default) {
+			run_scenario (&scenarios[i], base_dir);
+			ran = TRUE;
+		}
+	}
+	if (!ran) {
+		g_printerr ("Unknown scenario %s\n", opt_scenario);
+	}
+
+	if (opt_base_dir == NULL && !opt_keep) {
+		g_rmdir (base_dir);
+	}
+	g_free (base_dir);
+
+	test_close_output (output);
+
+	return ran ? 0 : 1;
+}
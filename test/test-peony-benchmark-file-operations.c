@@ -0,0 +1,652 @@
+/* Non-interactive benchmark for the file operations.
+ *
+ * Generates datasets (many small files, a few huge files, a deep tree,
+ * hard links, sparse files) in each target directory and runs them
+ * through copy, link, recursive permission change, move, trash and delete
+ * from the trash, the same entry points the views use. One JSON object per
+ * measurement is printed:
+ *
+ *   {"benchmark": "file-operations", "version": "1.1.6",
+ *    "filesystem": "tmpfs", "dataset": "small-files", "operation": "copy",
+ *    "metric": "wall", "value": 1.25, "unit": "s"}
+ *
+ * Phases are taken from the job's progress info: "scan" lasts until the
+ * job reports its first real progress, "transfer" until it reaches 100%
+ * and "finalize" until it finished. Syscall counts are the syscr/syscw
+ * read and write counters from /proc/self/io.
+ *
+ * The jobs need a display for their progress info; run under Xvfb on
+ * build machines. Only the items the benchmark trashed are deleted from
+ * the trash; the trash is never emptied.
+ */
+
+#include "test.h"
+
+#include <libpeony-private/peony-file-operations.h>
+#include <libpeony-private/peony-global-preferences.h>
+#include <libpeony-private/peony-progress-info.h>
+#include <glib/gstdio.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SMALL_FILE_SIZE (4 * 1024)
+#define MIB (1024 * 1024)
+
+typedef enum {
+	DATASET_SMALL_FILES,
+	DATASET_HUGE_FILES,
+	DATASET_DEEP_TREE,
+	DATASET_HARD_LINKS,
+	DATASET_SPARSE_FILES
+} DatasetKind;
+
+typedef struct {
+	const char *name;
+	DatasetKind kind;
+	int n_files;
+	goffset file_size;
+} Dataset;
+
+static const Dataset datasets[] = {
+	{ "small-files", DATASET_SMALL_FILES, 20000, SMALL_FILE_SIZE },
+	{ "huge-files", DATASET_HUGE_FILES, 3, 128 * (goffset) MIB },
+	{ "deep-tree", DATASET_DEEP_TREE, 20, SMALL_FILE_SIZE },
+	{ "hard-links", DATASET_HARD_LINKS, 2000, SMALL_FILE_SIZE },
+	{ "sparse-files", DATASET_SPARSE_FILES, 4, 1024 * (goffset) MIB },
+};
+
+#define DEEP_TREE_DEPTH 48
+#define HARD_LINKS_PER_FILE 2
+
+typedef struct {
+	const char *filesystem;
+	const Dataset *dataset;
+	const char *operation;
+} Context;
+
+typedef struct {
+	gint64 wall;
+	guint64 syscr;
+	guint64 syscw;
+	long nvcsw;
+	long nivcsw;
+} Sample;
+
+typedef struct {
+	GMainLoop *loop;
+	gint64 transfer_start;
+	gint64 transfer_end;
+} PhaseState;
+
+static FILE *output;
+static char *scratch_buffer;
+
+static char **opt_dirs;
+static char *opt_dataset;
+static char *opt_output;
+
+static GOptionEntry options[] = {
+	{ "dir", 'd', 0, G_OPTION_ARG_FILENAME_ARRAY, &opt_dirs,
+	  "Run in DIR; may be given more than once (default: the cache directory)", "DIR" },
+	{ "dataset", 's', 0, G_OPTION_ARG_STRING, &opt_dataset,
+	  "Only use DATASET (small-files, huge-files, deep-tree, hard-links, sparse-files)", "DATASET" },
+	{ "output", 'o', 0, G_OPTION_ARG_FILENAME, &opt_output,
+	  "Append results to FILE instead of stdout", "FILE" },
+	{ NULL }
+};
+
+static void
+report (Context *context,
+	const char *metric,
+	double value,
+	const char *unit)
+{
+	fprintf (output,
+		 "{\"benchmark\": \"file-operations\", \"version\": \"%s\", "
+		 "\"filesystem\": \"%s\", \"dataset\": \"%s\", \"operation\": \"%s\", "
+		 "\"metric\": \"%s\", \"value\": %.6f, \"unit\": \"%s\"}\n",
+		 VERSION, context->filesystem, context->dataset->name,
+		 context->operation, metric, value, unit);
+	fflush (output);
+}
+
+static void
+report_skipped (Context *context,
+		const char *reason)
+{
+	fprintf (output,
+		 "{\"benchmark\": \"file-operations\", \"version\": \"%s\", "
+		 "\"filesystem\": \"%s\", \"dataset\": \"%s\", \"operation\": \"%s\", "
+		 "\"skipped\": \"%s\"}\n",
+		 VERSION, context->filesystem, context->dataset->name,
+		 context->operation, reason);
+	fflush (output);
+}
+
+static void
+take_sample (Sample *sample)
+{
+	struct rusage usage;
+	char *contents, *line;
+
+	sample->wall = g_get_monotonic_time ();
+	sample->syscr = sample->syscw = 0;
+	if (g_file_get_contents ("/proc/self/io", &contents, NULL, NULL)) {
+		line = strstr (contents, "syscr:");
+		if (line != NULL) {
+			sample->syscr = g_ascii_strtoull (line + strlen ("syscr:"), NULL, 10);
+		}
+		line = strstr (contents, "syscw:");
+		if (line != NULL) {
+			sample->syscw = g_ascii_strtoull (line + strlen ("syscw:"), NULL, 10);
+		}
+		g_free (contents);
+	}
+
+	sample->nvcsw = sample->nivcsw = 0;
+	if (getrusage (RUSAGE_SELF, &usage) == 0) {
+		sample->nvcsw = usage.ru_nvcsw;
+		sample->nivcsw = usage.ru_nivcsw;
+	}
+}
+
+/* Datasets */
+
+static void
+create_file (const char *path,
+	     goffset size,
+	     gboolean sparse)
+{
+	goffset written;
+	gssize chunk;
+	int fd;
+
+	fd = open (path, O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		g_error ("Could not create %s", path);
+	}
+
+	if (sparse) {
+		/* Data at both ends, a hole in between */
+		if (ftruncate (fd, size) != 0 ||
+		    pwrite (fd, scratch_buffer, MIB, 0) != MIB ||
+		    pwrite (fd, scratch_buffer, MIB, size - MIB) != MIB) {
+			g_error ("Could not write %s", path);
+		}
+	} else {
+		for (written = 0; written < size; written += chunk) {
+			chunk = MIN (size - written, MIB);
+			if (write (fd, scratch_buffer, chunk) != chunk) {
+				g_error ("Could not write %s", path);
+			}
+		}
+	}
+
+	close (fd);
+}
+
+static void
+fill_directory (const char *dir,
+		int n_files,
+		goffset size,
+		gboolean sparse)
+{
+	char *path;
+	int i;
+
+	for (i = 0; i < n_files; i++) {
+		path = g_strdup_printf ("%s/file-%06d", dir, i);
+		create_file (path, size, sparse);
+		g_free (path);
+	}
+}
+
+/* Creates the dataset in root and returns the number of bytes in it. */
+static goffset
+generate_dataset (const Dataset *dataset,
+		  const char *root)
+{
+	char *dir, *child, *path, *link_path;
+	int level, i, j;
+
+	g_mkdir_with_parents (root, 0755);
+
+	switch (dataset->kind) {
+	case DATASET_SMALL_FILES:
+	case DATASET_HUGE_FILES:
+		fill_directory (root, dataset->n_files, dataset->file_size, FALSE);
+		return dataset->n_files * dataset->file_size;
+	case DATASET_SPARSE_FILES:
+		fill_directory (root, dataset->n_files, dataset->file_size, TRUE);
+		return dataset->n_files * dataset->file_size;
+	case DATASET_DEEP_TREE:
+		dir = g_strdup (root);
+		for (level = 0; level < DEEP_TREE_DEPTH; level++) {
+			fill_directory (dir, dataset->n_files, dataset->file_size, FALSE);
+			child = g_strdup_printf ("%s/level-%02d", dir, level + 1);
+			g_mkdir (child, 0755);
+			g_free (dir);
+			dir = child;
+		}
+		g_free (dir);
+		return DEEP_TREE_DEPTH * dataset->n_files * dataset->file_size;
+	case DATASET_HARD_LINKS:
+		fill_directory (root, dataset->n_files, dataset->file_size, FALSE);
+		for (i = 0; i < dataset->n_files; i++) {
+			path = g_strdup_printf ("%s/file-%06d", root, i);
+			for (j = 1; j <= HARD_LINKS_PER_FILE; j++) {
+				link_path = g_strdup_printf ("%s.link-%d", path, j);
+				if (link (path, link_path) != 0) {
+					g_error ("Could not link %s", link_path);
+				}
+				g_free (link_path);
+			}
+			g_free (path);
+		}
+		/* Copies don't preserve the links, so they copy every name */
+		return dataset->n_files * (HARD_LINKS_PER_FILE + 1) * dataset->file_size;
+	}
+
+	return 0;
+}
+
+static int
+count_files (const char *path)
+{
+	GDir *dir;
+	const char *name;
+	char *child;
+	int count;
+
+	count = 0;
+	dir = g_dir_open (path, 0, NULL);
+	if (dir != NULL) {
+		while ((name = g_dir_read_name (dir)) != NULL) {
+			child = g_build_filename (path, name, NULL);
+			if (g_file_test (child, G_FILE_TEST_IS_DIR) &&
+			    !g_file_test (child, G_FILE_TEST_IS_SYMLINK)) {
+				count += count_files (child);
+			}
+			count++;
+			g_free (child);
+		}
+		g_dir_close (dir);
+	}
+
+	return count;
+}
+
+static GList *
+list_children (const char *path)
+{
+	GDir *dir;
+	const char *name;
+	GList *children;
+	char *child;
+
+	children = NULL;
+	dir = g_dir_open (path, 0, NULL);
+	if (dir != NULL) {
+		while ((name = g_dir_read_name (dir)) != NULL) {
+			child = g_build_filename (path, name, NULL);
+			children = g_list_prepend (children, g_file_new_for_path (child));
+			g_free (child);
+		}
+		g_dir_close (dir);
+	}
+
+	return children;
+}
+
+/* Running the jobs */
+
+static void
+progress_changed_cb (PeonyProgressInfo *info,
+		     PhaseState *state)
+{
+	double progress;
+	gint64 now;
+
+	progress = peony_progress_info_get_progress (info);
+	if (progress < 0) {
+		return;
+	}
+
+	now = g_get_monotonic_time ();
+	if (state->transfer_start == 0) {
+		state->transfer_start = now;
+	}
+	if (state->transfer_end == 0 && progress >= 1.0) {
+		state->transfer_end = now;
+	}
+}
+
+static void
+finished_cb (PeonyProgressInfo *info,
+	     PhaseState *state)
+{
+	g_main_loop_quit (state->loop);
+}
+
+/* Returns the progress info of the operation started since before was
+ * taken with peony_get_all_progress_info(), and frees before. Other
+ * operations still running are not mistaken for it.
+ */
+static PeonyProgressInfo *
+get_new_progress_info (GList *before)
+{
+	PeonyProgressInfo *info;
+	GList *infos, *l;
+
+	info = NULL;
+	infos = peony_get_all_progress_info ();
+	for (l = infos; l != NULL; l = l->next) {
+		if (g_list_find (before, l->data) == NULL) {
+			info = g_object_ref (l->data);
+			break;
+		}
+	}
+	g_list_free_full (infos, g_object_unref);
+	g_list_free_full (before, g_object_unref);
+
+	return info;
+}
+
+static void
+finish_operation (Context *context,
+		  Sample *before,
+		  PeonyProgressInfo *info,
+		  goffset n_bytes,
+		  int n_files)
+{
+	PhaseState state;
+	Sample after;
+	double wall;
+
+	state.loop = g_main_loop_new (NULL, FALSE);
+	state.transfer_start = 0;
+	state.transfer_end = 0;
+
+	if (info != NULL) {
+		g_signal_connect (info, "progress-changed", G_CALLBACK (progress_changed_cb), &state);
+		g_signal_connect (info, "finished", G_CALLBACK (finished_cb), &state);
+		if (!peony_progress_info_get_is_finished (info)) {
+			g_main_loop_run (state.loop);
+		}
+		g_signal_handlers_disconnect_by_data (info, &state);
+		g_object_unref (info);
+	}
+	g_main_loop_unref (state.loop);
+
+	take_sample (&after);
+
+	if (state.transfer_start == 0) {
+		state.transfer_start = before->wall;
+	}
+	if (state.transfer_end == 0) {
+		state.transfer_end = after.wall;
+	}
+
+	wall = (after.wall - before->wall) / (double) G_USEC_PER_SEC;
+	report (context, "wall", wall, "s");
+	report (context, "scan", (state.transfer_start - before->wall) / (double) G_USEC_PER_SEC, "s");
+	report (context, "transfer", (state.transfer_end - state.transfer_start) / (double) G_USEC_PER_SEC, "s");
+	report (context, "finalize", (after.wall - state.transfer_end) / (double) G_USEC_PER_SEC, "s");
+	if (wall > 0) {
+		if (n_bytes > 0) {
+			report (context, "throughput", n_bytes / wall / MIB, "MiB/s");
+		}
+		report (context, "files_per_second", n_files / wall, "files/s");
+	}
+	report (context, "read_syscalls", after.syscr - before->syscr, "calls");
+	report (context, "write_syscalls", after.syscw - before->syscw, "calls");
+	report (context, "voluntary_context_switches", after.nvcsw - before->nvcsw, "switches");
+	report (context, "involuntary_context_switches", after.nivcsw - before->nivcsw, "switches");
+}
+
+/* The items in the trash that were trashed from orig_path */
+static GList *
+find_trashed (const char *orig_path)
+{
+	GFileEnumerator *enumerator;
+	GFileInfo *info;
+	GFile *trash;
+	GList *found;
+
+	trash = g_file_new_for_uri ("trash:///");
+	enumerator = g_file_enumerate_children (trash,
+						G_FILE_ATTRIBUTE_STANDARD_NAME ","
+						G_FILE_ATTRIBUTE_TRASH_ORIG_PATH,
+						G_FILE_QUERY_INFO_NONE, NULL, NULL);
+	found = NULL;
+	if (enumerator != NULL) {
+		while ((info = g_file_enumerator_next_file (enumerator, NULL, NULL)) != NULL) {
+			if (g_strcmp0 (g_file_info_get_attribute_byte_string (info, G_FILE_ATTRIBUTE_TRASH_ORIG_PATH),
+				       orig_path) == 0) {
+				found = g_list_prepend (found,
+							g_file_get_child (trash, g_file_info_get_name (info)));
+			}
+			g_object_unref (info);
+		}
+		g_object_unref (enumerator);
+	}
+	g_object_unref (trash);
+
+	return found;
+}
+
+static char *
+get_filesystem_type (const char *path)
+{
+	GFileInfo *info;
+	GFile *file;
+	char *type;
+
+	file = g_file_new_for_path (path);
+	info = g_file_query_filesystem_info (file, G_FILE_ATTRIBUTE_FILESYSTEM_TYPE, NULL, NULL);
+	g_object_unref (file);
+
+	type = NULL;
+	if (info != NULL) {
+		type = g_strdup (g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_FILESYSTEM_TYPE));
+		g_object_unref (info);
+	}
+
+	return type != NULL ? type : g_strdup ("unknown");
+}
+
+static void
+run_dataset (const Dataset *dataset,
+	     const char *dir,
+	     GtkWindow *window)
+{
+	Context context;
+	Sample before;
+	GList *sources, *infos;
+	GFile *target;
+	char *base, *src, *copy, *links, *moved, *path, *uri, *filesystem;
+	goffset n_bytes;
+	int n_files;
+
+	filesystem = get_filesystem_type (dir);
+	context.filesystem = filesystem;
+	context.dataset = dataset;
+
+	path = g_build_filename (dir, "peony-benchmark-XXXXXX", NULL);
+	base = g_mkdtemp (path);
+	if (base == NULL) {
+		g_printerr ("Could not create a directory in %s\n", dir);
+		g_free (path);
+		g_free (filesystem);
+		return;
+	}
+
+	src = g_build_filename (base, "src", "data", NULL);
+	copy = g_build_filename (base, "copy", NULL);
+	links = g_build_filename (base, "links", NULL);
+	moved = g_build_filename (base, "moved", NULL);
+	g_mkdir (copy, 0755);
+	g_mkdir (links, 0755);
+	g_mkdir (moved, 0755);
+
+	context.operation = "generate";
+	take_sample (&before);
+	n_bytes = generate_dataset (dataset, src);
+	n_files = count_files (src) + 1;
+	finish_operation (&context, &before, NULL, n_bytes, n_files);
+
+	/* Copy */
+	context.operation = "copy";
+	sources = g_list_prepend (NULL, g_file_new_for_path (src));
+	target = g_file_new_for_path (copy);
+	infos = peony_get_all_progress_info ();
+	take_sample (&before);
+	peony_file_operations_copy (sources, NULL, target, window, NULL, NULL);
+	finish_operation (&context, &before, get_new_progress_info (infos), n_bytes, n_files);
+	g_list_free_full (sources, g_object_unref);
+	g_object_unref (target);
+
+	/* Link every top level item */
+	context.operation = "link";
+	sources = list_children (src);
+	target = g_file_new_for_path (links);
+	infos = peony_get_all_progress_info ();
+	take_sample (&before);
+	peony_file_operations_link (sources, NULL, target, window, FALSE, NULL, NULL);
+	finish_operation (&context, &before, get_new_progress_info (infos), 0, g_list_length (sources));
+	g_list_free_full (sources, g_object_unref);
+	g_object_unref (target);
+
+	/* Recursive permissions on the copy */
+	context.operation = "set-permissions";
+	path = g_build_filename (copy, "data", NULL);
+	infos = peony_get_all_progress_info ();
+	take_sample (&before);
+	uri = g_filename_to_uri (path, NULL, NULL);
+	peony_file_set_permissions_recursive (uri, 0600, 0777, 0700, 0777, NULL, NULL);
+	g_free (uri);
+	finish_operation (&context, &before, get_new_progress_info (infos), 0, n_files);
+	g_free (path);
+
+	/* Move the copy */
+	context.operation = "move";
+	path = g_build_filename (copy, "data", NULL);
+	sources = g_list_prepend (NULL, g_file_new_for_path (path));
+	target = g_file_new_for_path (moved);
+	infos = peony_get_all_progress_info ();
+	take_sample (&before);
+	peony_file_operations_move (sources, NULL, target, window, NULL, NULL);
+	finish_operation (&context, &before, get_new_progress_info (infos), n_bytes, n_files);
+	g_list_free_full (sources, g_object_unref);
+	g_object_unref (target);
+	g_free (path);
+
+	/* Trash what was moved */
+	context.operation = "trash";
+	path = g_build_filename (moved, "data", NULL);
+	sources = g_list_prepend (NULL, g_file_new_for_path (path));
+	infos = peony_get_all_progress_info ();
+	take_sample (&before);
+	peony_file_operations_trash_or_delete (sources, window, NULL, NULL);
+	finish_operation (&context, &before, get_new_progress_info (infos), 0, n_files);
+	g_list_free_full (sources, g_object_unref);
+
+	/* Delete it from the trash again. Emptying the trash would take
+	 * whatever else the user has in there with it.
+	 */
+	context.operation = "delete-from-trash";
+	sources = find_trashed (path);
+	if (sources != NULL) {
+		infos = peony_get_all_progress_info ();
+		take_sample (&before);
+		peony_file_operations_delete (sources, window, NULL, NULL);
+		finish_operation (&context, &before, get_new_progress_info (infos), 0, n_files);
+		g_list_free_full (sources, g_object_unref);
+	} else {
+		report_skipped (&context, "trashed files not found");
+	}
+	g_free (path);
+
+	test_remove_tree (base);
+
+	g_free (src);
+	g_free (copy);
+	g_free (links);
+	g_free (moved);
+	g_free (base);
+	g_free (filesystem);
+}
+
+int
+main (int argc, char **argv)
+{
+	GOptionContext *option_context;
+	GtkWidget *window;
+	GError *error;
+	char **dirs;
+	char *default_dirs[2];
+	gboolean ran;
+	guint i, j;
+
+	/* Never touch the user's settings; just turn off the confirmations */
+	g_setenv ("GSETTINGS_BACKEND", "memory", TRUE);
+
+	option_context = g_option_context_new ("- benchmark file operations");
+	g_option_context_add_main_entries (option_context, options, NULL);
+	error = NULL;
+	if (!g_option_context_parse (option_context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+	g_option_context_free (option_context);
+
+	test_init (&argc, &argv);
+
+	peony_global_preferences_init ();
+	g_settings_set_boolean (peony_preferences, PEONY_PREFERENCES_CONFIRM_TRASH, FALSE);
+
+	output = test_open_output (opt_output);
+	if (output == NULL) {
+		return 1;
+	}
+
+	/* Somewhere on a real disk; tmpfs only when asked for, it hides
+	 * most of what the operations cost.
+	 */
+	if (opt_dirs != NULL) {
+		dirs = opt_dirs;
+	} else {
+		default_dirs[0] = (char *) g_get_user_cache_dir ();
+		default_dirs[1] = NULL;
+		dirs = default_dirs;
+	}
+
+	scratch_buffer = g_malloc (MIB);
+	memset (scratch_buffer, 'x', MIB);
+
+	window = test_window_new ("file operations benchmark", 0);
+
+	ran = FALSE;
+	for (i = 0; dirs[i] != NULL; i++) {
+		for (j = 0; j < G_N_ELEMENTS (datasets); j++) {
+			if (opt_dataset == NULL || strcmp (opt_dataset, datasets[j].name) == 0) {
+				run_dataset (&datasets[j], dirs[i], GTK_WINDOW (window));
+				ran = TRUE;
+			}
+		}
+	}
+	if (!ran) {
+		g_printerr ("Unknown dataset %s\n", opt_dataset);
+	}
+
+	gtk_widget_destroy (window);
+	g_free (scratch_buffer);
+
+	test_close_output (output);
+
+	return ran ? 0 : 1;
+}
@@ -0,0 +1,108 @@
+/* Checks that peony_file_operations_reclaim_trash() deletes what emptying
+ * the trash moved aside, and nothing else.
+ *
+ * The test points XDG_DATA_HOME at a scratch folder, so only a trash
+ * made up for it is touched there. Leftover staging folders in the
+ * trashes of mounted devices are reclaimed too, as at startup.
+ */
+
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+#include <libpeony-private/peony-file-operations.h>
+#include <stdlib.h>
+
+#define TIMEOUT_SECONDS 60
+
+static char *staged_path;
+static gboolean reclaimed;
+
+static void
+make_tree (const char *path, int depth)
+{
+	char *child;
+	int i;
+
+	g_mkdir_with_parents (path, 0700);
+	for (i = 0; i < 10; i++) {
+		child = g_strdup_printf ("%s/file-%d", path, i);
+		g_file_set_contents (child, "trashed", -1, NULL);
+		g_free (child);
+	}
+
+	if (depth > 0) {
+		for (i = 0; i < 3; i++) {
+			child = g_strdup_printf ("%s/folder-%d", path, i);
+			make_tree (child, depth - 1);
+			g_free (child);
+		}
+	}
+}
+
+static gboolean
+check_staged_gone (gpointer data)
+{
+	if (g_file_test (staged_path, G_FILE_TEST_EXISTS)) {
+		return TRUE;
+	}
+
+	reclaimed = TRUE;
+	gtk_main_quit ();
+	return FALSE;
+}
+
+static gboolean
+timeout_cb (gpointer data)
+{
+	gtk_main_quit ();
+	return FALSE;
+}
+
+int
+main (int argc, char **argv)
+{
+	char *data_home, *trash, *info, *kept;
+	int ret;
+
+	data_home = g_dir_make_tmp ("peony-reclaim-trash-XXXXXX", NULL);
+	if (data_home == NULL) {
+		g_printerr ("could not create a scratch folder\n");
+		return 1;
+	}
+	g_setenv ("XDG_DATA_HOME", data_home, TRUE);
+
+	gtk_init (&argc, &argv);
+
+	trash = g_build_filename (data_home, "Trash", NULL);
+	g_mkdir (trash, 0700);
+	g_chmod (trash, 0700);
+
+	kept = g_build_filename (trash, "files", "kept", NULL);
+	g_mkdir_with_parents (kept, 0700);
+	info = g_build_filename (trash, "info", NULL);
+	g_mkdir (info, 0700);
+
+	staged_path = g_build_filename (trash, ".peony-expunge-test", NULL);
+	make_tree (staged_path, 4);
+
+	peony_file_operations_reclaim_trash ();
+
+	g_timeout_add (100, check_staged_gone, NULL);
+	g_timeout_add_seconds (TIMEOUT_SECONDS, timeout_cb, NULL);
+	gtk_main ();
+
+	ret = 0;
+	if (!reclaimed) {
+		g_printerr ("FAIL: %s is still there after %d seconds\n",
+			    staged_path, TIMEOUT_SECONDS);
+		ret = 1;
+	}
+	if (!g_file_test (kept, G_FILE_TEST_IS_DIR)) {
+		g_printerr ("FAIL: the trash itself was deleted\n");
+		ret = 1;
+	}
+	if (ret == 0) {
+		g_print ("PASS: the staged folder was reclaimed\n");
+	}
+
+	return ret;
+}
@@ -1,4 +1,5 @@
 #include "test.h"
+#include <glib/gstdio.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -148,3 +149,56 @@ test_window_set_title_with_pid (GtkWindow *window,
 	g_free (tmp);
 }
 
+
+/* Results go to stdout unless a file to append them to is given.
+ * Returns NULL if that file can't be opened.
+ */
+FILE *
+test_open_output (const char *path)
+{
+	FILE *output;
+
+	if (path == NULL) {
+		return stdout;
+	}
+
+	output = fopen (path, "a");
+	if (output == NULL) {
+		g_printerr ("Could not open %s\n", path);
+	}
+
+	return output;
+}
+
+void
+test_close_output (FILE *output)
+{
+	if (output != stdout) {
+		fclose (output);
+	}
+}
+
+/* Symlinks are removed, never followed */
+void
+test_remove_tree (const char *path)
+{
+	GDir *dir;
+	const char *name;
+	char *child;
+
+	dir = g_dir_open (path, 0, NULL);
+	if (dir != NULL) {
+		while ((name = g_dir_read_name (dir)) != NULL) {
+			child = g_build_filename (path, name, NULL);
+			if (g_file_test (child, G_FILE_TEST_IS_DIR) &&
+			    !g_file_test (child, G_FILE_TEST_IS_SYMLINK)) {
+				test_remove_tree (child);
+			} else {
+				g_unlink (child);
+			}
+			g_free (child);
+		}
+		g_dir_close (dir);
+	}
+	g_rmdir (path);
+}
@@ -3,6 +3,7 @@
 
 #include <config.h>
 #include <gtk/gtk.h>
+#include <stdio.h>
 
 #include <eel/eel-debug.h>
 #include <eel/eel.h>
@@ -35,4 +36,9 @@ void       test_pixbuf_draw_rectangle_tiled     (GdkPixbuf                   *pi
 void       test_window_set_title_with_pid       (GtkWindow                   *window,
 						 const char                  *title);
 
+/* For the benchmarks */
+FILE *     test_open_output                     (const char                  *path);
+void       test_close_output                    (FILE                        *output);
+void       test_remove_tree                     (const char                  *path);
+
 #endif /* TEST_H */